@@ -30,6 +30,7 @@
 #define NVDSCUSTOMMETA_H_
 
 #include "nvdsmeta_schema.h"
+#include "nvmsgconv_event_fields.h"
 #include <glib.h>
 
 #ifdef __cplusplus
@@ -40,43 +41,11 @@ extern "C"
 #define PERSON_LABEL "person"
 #define FACE_LABEL "face"
 #define MAX_TIME_STAMP_LEN 32
-#define MAX_OBJ_NUM 256
 
 #define PET_MODULE_NAME "pet"
 
-
-typedef struct 
-{
-  NvDsObjectType objType;
-  /** Holds the object's bounding box. */
-  NvDsRect bbox;
-
-  /** Holds the confidence level of the inference. */
-  gdouble confidence;
-  /** Holds the object's tracking ID. */
-  gint trackingId;
-
-  gchar label[MAX_LABEL_SIZE];
-
-}NvDsSimpleObjectMetaList;
-
-
-typedef struct
-{
-  gchar* sourceUri;
-  gint sourceId;
-  gint sourceType;
-  guint frameId;
-
-  guint frameWidth;
-  guint frameHeight;
-
-  guint objCounts;
-  NvDsSimpleObjectMetaList objMetaList[MAX_OBJ_NUM];
-
-  gchar* filterCloudModules;
-  gchar* sourceCloudModules;
-}NvDsFrameObjDescEvent;
+/* The event extensions are shared with the converter, see
+ * nvmsgconv_event_fields.h. */
 
 #ifdef __cplusplus
 }
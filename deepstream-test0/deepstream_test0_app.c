@@ -32,6 +32,12 @@
 #include "gstnvdsmeta.h"
 // #include "nvdsmeta_schema.h"
 #include "custom_meta_schema.h"
+#include "event_sampler.h"
+#include "event_worker.h"
+#include "latency_stats.h"
+#define NVDS_TRACE_IMPLEMENTATION
+#include "nvds_trace.h"
+#include "throughput_stats.h"
 //#include "gstnvstreammeta.h"
 #ifndef PLATFORM_TEGRA
 #include "gst-nvmessage.h"
@@ -40,12 +46,11 @@
 #define MAX_DISPLAY_LEN 64
 #define MAX_TIME_STAMP_LEN 32
 
-#define PGIE_CLASS_ID_VEHICLE 0
-#define PGIE_CLASS_ID_PERSON 2
-
 #define PIPELINE_NAME "pipepline_1"
 #define PGIE_CONFIG_FILE  "dstest0_pgie_config.txt"
 #define MSCONV_CONFIG_FILE "dstest0_msgconv_config.txt"
+#define EVENT_CONFIG_FILE "dstest0_event_config.txt"
+#define TRACKER_CONFIG_FILE "dstest0_tracker_config.txt"
 #define PROTOCOL_ADAPTOR_LIB "/opt/nvidia/deepstream/deepstream-5.1/lib/libnvds_kafka_proto.so"
 #define CONNECTION_STRING "10.208.208.167;9092"
 #define CONFIG_FILE_PATH "cfg_kafka.txt"
@@ -74,147 +79,84 @@
 #define TILED_OUTPUT_WIDTH 1280
 #define TILED_OUTPUT_HEIGHT 720
 
+#define CONFIG_GROUP_TRACKER "tracker"
+#define CONFIG_GROUP_TRACKER_WIDTH "tracker-width"
+#define CONFIG_GROUP_TRACKER_HEIGHT "tracker-height"
+#define CONFIG_GROUP_TRACKER_LL_CONFIG_FILE "ll-config-file"
+#define CONFIG_GROUP_TRACKER_LL_LIB_FILE "ll-lib-file"
+#define CONFIG_GROUP_TRACKER_ENABLE_BATCH_PROCESS "enable-batch-process"
+#define CONFIG_GPU_ID "gpu-id"
+
 /* NVIDIA Decoder source pad memory feature. This feature signifies that source
  * pads having this capability will push GstBuffers containing cuda buffers. */
 #define GST_CAPS_FEATURES_NVMM "memory:NVMM"
 
 static gboolean display_off = FALSE;
-gint frame_number = 0;
-gchar pgie_classes_str[4][32] = { "Vehicle", "TwoWheeler", "Person",
-  "RoadSign"
+static gint metrics_port = 0;
+static gchar *metrics_file = NULL;
+static gint metrics_interval = 10;
+static gint stats_interval = 5;
+static gint stats_window = 30;
+static gchar *proto_lib = NULL;
+static gchar *conn_str = NULL;
+static gint payload_type = SCHEMA_TYPE;
+
+static GOptionEntry entries[] = {
+  {"metrics-port", 0, 0, G_OPTION_ARG_INT, &metrics_port,
+      "Serve latency metrics on http://127.0.0.1:PORT/", "PORT"},
+  {"metrics-file", 0, 0, G_OPTION_ARG_FILENAME, &metrics_file,
+      "Periodically write latency metrics to FILE", "FILE"},
+  {"metrics-interval", 0, 0, G_OPTION_ARG_INT, &metrics_interval,
+      "Seconds between metrics file updates (default 10)", "SEC"},
+  {"stats-interval", 0, 0, G_OPTION_ARG_INT, &stats_interval,
+      "Seconds between throughput reports, 0 disables (default 5)", "SEC"},
+  {"stats-window", 0, 0, G_OPTION_ARG_INT, &stats_window,
+      "Seconds of history throughput rates are averaged over (default 30)",
+      "SEC"},
+  {"proto-lib", 0, 0, G_OPTION_ARG_FILENAME, &proto_lib,
+      "Protocol adaptor library (default " PROTOCOL_ADAPTOR_LIB ")", "PATH"},
+  {"conn-str", 0, 0, G_OPTION_ARG_STRING, &conn_str,
+      "Connection string of the protocol adaptor (default " CONNECTION_STRING
+      ")", "STR"},
+  {"payload-type", 0, 0, G_OPTION_ARG_INT, &payload_type,
+      "Converter payload type: 0 DeepStream, 1 minimal, 257 custom (Arrow "
+      "batches when enabled in " MSCONV_CONFIG_FILE ") (default 0)", "TYPE"},
+  {NULL}
+};
+const gchar *pgie_classes_str[THROUGHPUT_NUM_CLASSES] = { "Vehicle",
+  "TwoWheeler", "Person", "RoadSign"
 };
 
-#define FPS_PRINT_INTERVAL 300
-//static struct timeval start_time = { };
-
-//static guint probe_counter = 0;
-
-
-static void generate_ts_rfc3339 (char *buf, int buf_size)
+typedef struct
 {
-  time_t tloc;
-  struct tm tm_log;
-  struct timespec ts;
-  char strmsec[6]; //.nnnZ\0
-
-  clock_gettime(CLOCK_REALTIME,  &ts);
-  memcpy(&tloc, (void *)(&ts.tv_sec), sizeof(time_t));
-  gmtime_r(&tloc, &tm_log);
-  strftime(buf, buf_size,"%Y-%m-%dT%H:%M:%S", &tm_log);
-  int ms = ts.tv_nsec/1000000;
-  g_snprintf(strmsec, sizeof(strmsec),".%.3dZ", ms);
-  strncat(buf, strmsec, buf_size);
-}
-
-static gpointer meta_copy_func (gpointer data, gpointer user_data){
-  NvDsUserMeta *user_meta = (NvDsUserMeta *) data;
-  NvDsEventMsgMeta *srcMeta = (NvDsEventMsgMeta *) user_meta->user_meta_data;
-  NvDsFrameObjDescEvent *srcExt = (NvDsFrameObjDescEvent *) srcMeta->extMsg;
-
-  NvDsEventMsgMeta *dstMeta = NULL;
-  NvDsFrameObjDescEvent *dstExt = NULL;
-
-  dstMeta = (NvDsEventMsgMeta*)g_memdup (srcMeta, sizeof(NvDsEventMsgMeta));
-  dstMeta->sensorStr = g_strdup(srcMeta->sensorStr);
-
-  if(srcMeta->extMsgSize > 0){
-    dstMeta->extMsg = g_memdup(srcExt, sizeof(NvDsFrameObjDescEvent));
-    dstExt = (NvDsFrameObjDescEvent *)dstMeta->extMsg;
-
-    if (srcExt->sourceUri){
-      dstExt->sourceUri = g_strdup (srcExt->sourceUri);
-    }
-    if(srcExt->filterCloudModules){
-      dstExt->filterCloudModules = g_strdup (srcExt->filterCloudModules);
-    }
-    if(srcExt->sourceCloudModules){
-      dstExt->sourceCloudModules = g_strdup(srcExt->sourceCloudModules);
-    }
-  }
-
-  if (srcMeta->ts){
-    dstMeta->ts = g_strdup (srcMeta->ts);
-  }
-  return dstMeta;
-}
-
-static void meta_free_func(gpointer data, gpointer user_data){
-  NvDsUserMeta *user_meta = (NvDsUserMeta *) data;
-  NvDsEventMsgMeta *meta = (NvDsEventMsgMeta *) user_meta->user_meta_data;
-
-  if(meta->ts){
-    g_free (meta->ts);
-  }
-
-  if(meta->sensorStr){
-    g_free(meta->sensorStr);
-  }
-  if(meta->extMsgSize > 0){
-    NvDsFrameObjDescEvent *srcExt = (NvDsFrameObjDescEvent *) meta->extMsg;
-    if(srcExt->sourceUri){
-      g_free (srcExt->sourceUri);
-    }
-    if(srcExt->filterCloudModules){
-      g_free(srcExt->filterCloudModules);
-    }
-    if(srcExt->sourceCloudModules){
-      g_free(srcExt->sourceCloudModules);
-    }
-    g_free(meta->extMsg);
-  }
-  meta->extMsg = NULL;
-
-  g_free(user_meta->user_meta_data);
-  user_meta->user_meta_data = NULL;
-}
-
-void
-generate_object_event_msg_meta( gpointer data, NvDsFrameMeta* frame_meta){
-  NvDsEventMsgMeta *meta = (NvDsEventMsgMeta *) data;
-  NvDsFrameObjDescEvent* frame_obj_desc = (NvDsFrameObjDescEvent*)meta->extMsg;
-  // NvDsSourceConfigExt source_config = appCtx->config.multi_source_config[frame_meta->source_id];
-
-  meta->sensorId = frame_meta->source_id;
-  // meta->sensorStr = g_strdup(source_config.uri);
-  meta->sensorStr = g_strdup ("sensor-0");
-  meta->ts = (gchar *) g_malloc0 (MAX_TIME_STAMP_LEN + 1);
-  // if(source_config.type == NV_DS_SOURCE_URI){
-  //   meta->otherAttrs = (gchar*)"file";
-  // }else if(source_config.type == NV_DS_SOURCE_RTSP || source_config.type == NV_DS_SOURCE_CAMERA_V4L2){
-  //   meta->otherAttrs = (gchar*)"camera";
-  // }
-
-  generate_ts_rfc3339(meta->ts, MAX_TIME_STAMP_LEN);
-
-  // frame_obj_desc->filterCloudModules = 
-  //     g_strjoin(";", FIGHT_MODULE_NAME, WEAPON_MODULE_NAME, DRUNK_MODULE_NAME, NULL);
-  
-  frame_obj_desc->sourceId = frame_meta->source_id;
-  // frame_obj_desc->sourceType = source_config.type;
-  frame_obj_desc->frameHeight = frame_meta->source_frame_height;
-  frame_obj_desc->frameWidth = frame_meta->source_frame_width;
-
-  // frame_obj_desc->sourceUri = g_strdup(source_config.uri);
-  // frame_obj_desc->sourceCloudModules = g_strdup(source_config.cloud_modules);
-}
-
-
-/* tiler_sink_pad_buffer_probe  will extract metadata received on OSD sink pad
- * and update params for drawing rectangle, object information etc. */
+  EventSampler *sampler;
+  EventWorker *event_worker;
+  LatencyStats *latency;
+  ThroughputStats *throughput;
+  /* Queue in front of the message converter. */
+  GstElement *msg_queue;
+} AppCtx;
+
+/* tiler_src_pad_buffer_probe counts the objects of every frame and hands the
+ * frames selected by the sampler to the event worker. It sits behind the
+ * tracker so that object ids are set, and runs on the inference streaming
+ * thread, so it only updates atomic counters; rates are printed from the main
+ * loop. */
 
 static GstPadProbeReturn
 tiler_src_pad_buffer_probe (GstPad * pad, GstPadProbeInfo * info,
     gpointer u_data)
 {
     GstBuffer *buf = (GstBuffer *) info->data;
-    guint num_rects = 0; 
+    AppCtx *app_ctx = (AppCtx *) u_data;
     NvDsObjectMeta *obj_meta = NULL;
-    guint vehicle_count = 0;
-    guint person_count = 0;
-    gboolean is_first_object = TRUE;
+    guint class_counts[THROUGHPUT_NUM_CLASSES];
+    guint frame_obj_count;
+    guint64 max_track_id;
+    gboolean submit;
     NvDsMetaList * l_frame = NULL;
     NvDsMetaList * l_obj = NULL;
-    NvDsFrameObjDescEvent* frame_obj_desc = NULL;
+    gint64 trace_begin = nvds_trace_begin ();
 
     NvDsBatchMeta *batch_meta = gst_buffer_get_nvds_batch_meta (buf);
     if (!batch_meta) {
@@ -226,75 +168,94 @@ tiler_src_pad_buffer_probe (GstPad * pad, GstPadProbeInfo * info,
         continue;
       }
 
-      is_first_object = TRUE;
+      memset (class_counts, 0, sizeof (class_counts));
+      frame_obj_count = 0;
+      max_track_id = 0;
       for (l_obj = frame_meta->obj_meta_list; l_obj != NULL; l_obj = l_obj->next) {
         obj_meta = (NvDsObjectMeta *) (l_obj->data);
         if (obj_meta == NULL) {
           continue;
         }
-        if (obj_meta->class_id == PGIE_CLASS_ID_VEHICLE) {
-            vehicle_count++;
-            num_rects++;
-        }
-        if (obj_meta->class_id == PGIE_CLASS_ID_PERSON) {
-            person_count++;
-            num_rects++;
+        if (obj_meta->class_id >= 0 &&
+            obj_meta->class_id < THROUGHPUT_NUM_CLASSES) {
+          class_counts[obj_meta->class_id]++;
         }
-        
-        if(frame_obj_desc == NULL){
-          frame_obj_desc = (NvDsFrameObjDescEvent*)g_malloc0(sizeof(NvDsFrameObjDescEvent));
-          frame_obj_desc->objCounts = 0;
-        }
-        if (num_rects < MAX_OBJ_NUM) {
-          /* Frequency of messages to be send will be based on use case.
-          * Here message is being sent for first object every 30 frames.
-          */
-          if (obj_meta->class_id == PGIE_CLASS_ID_VEHICLE)
-            frame_obj_desc->objMetaList[frame_obj_desc->objCounts].objType = NVDS_OBJECT_TYPE_VEHICLE;
-          else
-            frame_obj_desc->objMetaList[frame_obj_desc->objCounts].objType = NVDS_OBJECT_TYPE_PERSON;
-          strncpy(frame_obj_desc->objMetaList[frame_obj_desc->objCounts].label, obj_meta->obj_label, MAX_LABEL_SIZE);
-
-          frame_obj_desc->objMetaList[frame_obj_desc->objCounts].bbox.top = obj_meta->rect_params.top;
-          frame_obj_desc->objMetaList[frame_obj_desc->objCounts].bbox.left = obj_meta->rect_params.left;
-          frame_obj_desc->objMetaList[frame_obj_desc->objCounts].bbox.width = obj_meta->rect_params.width;
-          frame_obj_desc->objMetaList[frame_obj_desc->objCounts].bbox.height = obj_meta->rect_params.height;
-          frame_obj_desc->objMetaList[frame_obj_desc->objCounts].trackingId = obj_meta->object_id;
-          frame_obj_desc->objMetaList[frame_obj_desc->objCounts].confidence = obj_meta->confidence;
-          frame_obj_desc->objCounts += 1;
+        frame_obj_count++;
+        if (obj_meta->object_id != UNTRACKED_OBJECT_ID &&
+            obj_meta->object_id > max_track_id) {
+          max_track_id = obj_meta->object_id;
         }
       }
-
-      if (is_first_object && frame_obj_desc != NULL && frame_number %30 == 0) {
-        NvDsEventMsgMeta *msg_meta = (NvDsEventMsgMeta *) g_malloc0 (sizeof (NvDsEventMsgMeta));
-        msg_meta->type = NVDS_EVENT_CUSTOM;
-        frame_obj_desc->frameId = frame_number;
-        msg_meta->frameId = frame_number;
-        msg_meta->extMsg = frame_obj_desc;
-        msg_meta->extMsgSize = sizeof (NvDsFrameObjDescEvent);
-        generate_object_event_msg_meta(msg_meta, frame_meta);
-        
-        NvDsUserMeta *user_event_meta = nvds_acquire_user_meta_from_pool (batch_meta);
-        if (user_event_meta) {
-          user_event_meta->user_meta_data = (void *) msg_meta;
-          user_event_meta->base_meta.meta_type = NVDS_EVENT_MSG_META;
-          user_event_meta->base_meta.copy_func = (NvDsMetaCopyFunc) meta_copy_func;
-          user_event_meta->base_meta.release_func = (NvDsMetaReleaseFunc) meta_free_func;
-          nvds_add_user_meta_to_frame(frame_meta, user_event_meta);
-          is_first_object = FALSE;
-          frame_obj_desc = NULL;
-        } else {
-          g_print ("Error in attaching event meta to buffer\n");
-        }
+      throughput_stats_add_frame (app_ctx->throughput, frame_meta->source_id,
+          class_counts);
+
+      /* Frequency of messages to be sent is decided per source by the
+       * sampler, see event_sampler.h for the available policies. Everything
+       * else, including the scene change check, runs in the event worker.
+       * In trajectory mode the worker needs every frame. Empty frames never
+       * produce an event, so they don't spend a token of the sampler; only
+       * the first one is passed on, for the scene change reference. */
+      if (event_worker_wants_every_frame (app_ctx->event_worker))
+        submit = TRUE;
+      else if (frame_obj_count == 0)
+        submit = event_sampler_skip_empty (app_ctx->sampler,
+            frame_meta->source_id);
+      else
+        submit = event_sampler_should_emit (app_ctx->sampler,
+            frame_meta->source_id, frame_obj_count, max_track_id);
+      if (submit && !event_worker_submit (app_ctx->event_worker, frame_meta)) {
+        throughput_stats_event_dropped (app_ctx->throughput,
+            frame_meta->source_id);
       }
     }
-    g_print ("Frame Number = %d Number of objects = %d "
-          "Vehicle Count = %d Person Count = %d\n",
-          frame_number, num_rects, vehicle_count, person_count);
-    frame_number++;
+    nvds_trace_end ("app", "inference-probe", trace_begin, "frames",
+        batch_meta->num_frames_in_batch);
     return GST_PAD_PROBE_OK;
 }
 
+/* Returns how full @queue is, in percent of whichever of its limits is
+ * closest to being reached. */
+static guint
+queue_fill_percent (GstElement *queue)
+{
+  guint level_buffers, max_buffers, level_bytes, max_bytes;
+  guint64 level_time, max_time;
+  guint fill = 0;
+
+  g_object_get (G_OBJECT (queue),
+      "current-level-buffers", &level_buffers, "max-size-buffers", &max_buffers,
+      "current-level-bytes", &level_bytes, "max-size-bytes", &max_bytes,
+      "current-level-time", &level_time, "max-size-time", &max_time, NULL);
+  if (max_buffers)
+    fill = MAX (fill, (guint) (100ULL * level_buffers / max_buffers));
+  if (max_bytes)
+    fill = MAX (fill, (guint) (100ULL * level_bytes / max_bytes));
+  if (max_time)
+    fill = MAX (fill, (guint) (100 * (level_time / (gdouble) max_time)));
+  return MIN (fill, 100);
+}
+
+/* msg_attach_pad_buffer_probe runs on the message branch thread and attaches
+ * the events built by the event worker to the batch going to msgconv. */
+
+static GstPadProbeReturn
+msg_attach_pad_buffer_probe (GstPad * pad, GstPadProbeInfo * info,
+    gpointer u_data)
+{
+  GstBuffer *buf = (GstBuffer *) info->data;
+  AppCtx *app_ctx = (AppCtx *) u_data;
+  gint64 trace_begin = nvds_trace_begin ();
+
+  NvDsBatchMeta *batch_meta = gst_buffer_get_nvds_batch_meta (buf);
+  if (!batch_meta) {
+    return GST_PAD_PROBE_OK;
+  }
+  event_worker_attach_ready (app_ctx->event_worker, batch_meta,
+      queue_fill_percent (app_ctx->msg_queue));
+  nvds_trace_end ("app", "msg-probe", trace_begin, NULL, 0);
+  return GST_PAD_PROBE_OK;
+}
+
 static gboolean
 bus_call (GstBus * bus, GstMessage * msg, gpointer data)
 {
@@ -436,12 +397,106 @@ create_source_bin (guint index, gchar * uri)
   return bin;
 }
 
+static gboolean
+add_latency_probe (LatencyStats *stats, GstElement *element,
+    const gchar *pad_name, LatencyStage stage)
+{
+  GstPad *pad = gst_element_get_static_pad (element, pad_name);
+
+  if (!pad) {
+    g_printerr ("Unable to get %s pad of %s\n", pad_name,
+        GST_ELEMENT_NAME (element));
+    return FALSE;
+  }
+  latency_stats_add_probe (stats, pad, stage);
+  gst_object_unref (pad);
+  return TRUE;
+}
+
+/* Applies the [tracker] group of TRACKER_CONFIG_FILE to @nvtracker. The
+ * sampler's new-track burst and the trajectory mode of the event worker both
+ * rely on the object ids it assigns. */
+static gboolean
+set_tracker_properties (GstElement *nvtracker)
+{
+  gboolean ret = FALSE;
+  GError *error = NULL;
+  gchar **keys = NULL;
+  gchar **key = NULL;
+  GKeyFile *key_file = g_key_file_new ();
+
+  if (!g_key_file_load_from_file (key_file, TRACKER_CONFIG_FILE,
+          G_KEY_FILE_NONE, &error))
+    goto done;
+
+  keys = g_key_file_get_keys (key_file, CONFIG_GROUP_TRACKER, NULL, &error);
+  if (error)
+    goto done;
+
+  for (key = keys; *key; key++) {
+    if (!g_strcmp0 (*key, CONFIG_GROUP_TRACKER_WIDTH)) {
+      gint width = g_key_file_get_integer (key_file, CONFIG_GROUP_TRACKER,
+          CONFIG_GROUP_TRACKER_WIDTH, &error);
+      if (error)
+        goto done;
+      g_object_set (G_OBJECT (nvtracker), "tracker-width", width, NULL);
+    } else if (!g_strcmp0 (*key, CONFIG_GROUP_TRACKER_HEIGHT)) {
+      gint height = g_key_file_get_integer (key_file, CONFIG_GROUP_TRACKER,
+          CONFIG_GROUP_TRACKER_HEIGHT, &error);
+      if (error)
+        goto done;
+      g_object_set (G_OBJECT (nvtracker), "tracker-height", height, NULL);
+    } else if (!g_strcmp0 (*key, CONFIG_GPU_ID)) {
+      guint gpu_id = g_key_file_get_integer (key_file, CONFIG_GROUP_TRACKER,
+          CONFIG_GPU_ID, &error);
+      if (error)
+        goto done;
+      g_object_set (G_OBJECT (nvtracker), "gpu_id", gpu_id, NULL);
+    } else if (!g_strcmp0 (*key, CONFIG_GROUP_TRACKER_LL_CONFIG_FILE)) {
+      gchar *file = g_key_file_get_string (key_file, CONFIG_GROUP_TRACKER,
+          CONFIG_GROUP_TRACKER_LL_CONFIG_FILE, &error);
+      if (error)
+        goto done;
+      g_object_set (G_OBJECT (nvtracker), "ll-config-file", file, NULL);
+      g_free (file);
+    } else if (!g_strcmp0 (*key, CONFIG_GROUP_TRACKER_LL_LIB_FILE)) {
+      gchar *file = g_key_file_get_string (key_file, CONFIG_GROUP_TRACKER,
+          CONFIG_GROUP_TRACKER_LL_LIB_FILE, &error);
+      if (error)
+        goto done;
+      g_object_set (G_OBJECT (nvtracker), "ll-lib-file", file, NULL);
+      g_free (file);
+    } else if (!g_strcmp0 (*key, CONFIG_GROUP_TRACKER_ENABLE_BATCH_PROCESS)) {
+      gboolean enable = g_key_file_get_integer (key_file, CONFIG_GROUP_TRACKER,
+          CONFIG_GROUP_TRACKER_ENABLE_BATCH_PROCESS, &error);
+      if (error)
+        goto done;
+      g_object_set (G_OBJECT (nvtracker), "enable_batch_process", enable,
+          NULL);
+    } else {
+      g_printerr ("Unknown key '%s' for group [%s]\n", *key,
+          CONFIG_GROUP_TRACKER);
+    }
+  }
+  ret = TRUE;
+
+done:
+  if (error) {
+    g_printerr ("Failed to parse %s: %s\n", TRACKER_CONFIG_FILE,
+        error->message);
+    g_error_free (error);
+  }
+  g_strfreev (keys);
+  g_key_file_free (key_file);
+  return ret;
+}
+
 int
 main (int argc, char *argv[])
 {
   GMainLoop *loop = NULL;
   GstElement *pipeline = NULL, *streammux = NULL, *sink = NULL, *pgie = NULL,
-      *queue1, *queue2, *queue3, *queue4, *queue5, *queue6, *nvvidconv = NULL,
+      *nvtracker = NULL, *queue1, *queue2, *queue3, *queue4, *queue5, *queue6, *nvvidconv = NULL,
       *nvosd = NULL, *tiler = NULL;
   GstElement *msgconv = NULL, *msgbroker = NULL, *tee = NULL;
   GstElement *transform = NULL;
@@ -455,23 +510,49 @@ main (int argc, char *argv[])
   guint i, num_sources;
   guint tiler_rows, tiler_columns;
   guint pgie_batch_size;
+  AppCtx *app_ctx = NULL;
+  EventWorkerStats worker_stats;
+  GOptionContext *ctx = NULL;
+  GError *error = NULL;
 
   int current_device = -1;
   cudaGetDevice(&current_device);
   struct cudaDeviceProp prop;
   cudaGetDeviceProperties(&prop, current_device);
 
+  /* Standard GStreamer initialization, along with our own options */
+  ctx = g_option_context_new ("<uri1> [uri2] ... [uriN]");
+  g_option_context_add_main_entries (ctx, entries, NULL);
+  g_option_context_add_group (ctx, gst_init_get_option_group ());
+  if (!g_option_context_parse (ctx, &argc, &argv, &error)) {
+    g_printerr ("%s\n", error->message);
+    g_error_free (error);
+    g_option_context_free (ctx);
+    return -1;
+  }
+  g_option_context_free (ctx);
+
   /* Check input arguments */
   if (argc < 2) {
-    g_printerr ("Usage: %s <uri1> [uri2] ... [uriN] \n", argv[0]);
+    g_printerr ("Usage: %s [--metrics-port PORT] [--metrics-file FILE] "
+        "<uri1> [uri2] ... [uriN] \n", argv[0]);
     return -1;
   }
   num_sources = argc - 1;
-
-  /* Standard GStreamer initialization */
-  gst_init (&argc, &argv);
   loop = g_main_loop_new (NULL, FALSE);
 
+  app_ctx = g_new0 (AppCtx, 1);
+  app_ctx->sampler = event_sampler_new (EVENT_CONFIG_FILE, num_sources);
+  app_ctx->throughput = throughput_stats_new (num_sources, pgie_classes_str);
+  app_ctx->event_worker = event_worker_new (EVENT_CONFIG_FILE, num_sources,
+      app_ctx->throughput);
+  if (!app_ctx->sampler || !app_ctx->event_worker) {
+    g_printerr ("Failed to create event generation context. Exiting.\n");
+    return -1;
+  }
+  if (metrics_port > 0 || metrics_file)
+    app_ctx->latency = latency_stats_new (num_sources);
+
   /* Create gstreamer elements */
   /* Create Pipeline element that will form a connection of other elements */
   pipeline = gst_pipeline_new (PIPELINE_NAME);
@@ -522,6 +603,10 @@ main (int argc, char *argv[])
   /* Use nvinfer to infer on batched frame. */
   pgie = gst_element_factory_make ("nvinfer", "primary-nvinference-engine");
 
+  /* We need to have a tracker to track the identified objects; the event
+   * sampler and the trajectory mode work on its object ids. */
+  nvtracker = gst_element_factory_make ("nvtracker", "tracker");
+
   /* Add queue elements between every two elements */
   queue1 = gst_element_factory_make ("queue", "queue1");
   queue2 = gst_element_factory_make ("queue", "queue2");
@@ -556,7 +641,7 @@ main (int argc, char *argv[])
   // sink = gst_element_factory_make ("nveglglessink", "nvvideo-renderer");
   sink = gst_element_factory_make ("fakesink", "nvvideo-renderer");
 
-  if (!pgie || !tiler || !nvvidconv || !nvosd || !msgconv || !msgbroker || !tee || !sink) {
+  if (!pgie || !nvtracker || !tiler || !nvvidconv || !nvosd || !msgconv || !msgbroker || !tee || !sink) {
     g_printerr ("One element could not be created. Exiting.\n");
     return -1;
   }
@@ -585,6 +670,12 @@ main (int argc, char *argv[])
     g_object_set (G_OBJECT (pgie), "batch-size", num_sources, NULL);
   }
 
+  /* Set necessary properties of the tracker element. */
+  if (!set_tracker_properties (nvtracker)) {
+    g_printerr ("Failed to set tracker properties. Exiting.\n");
+    return -1;
+  }
+
   tiler_rows = (guint) sqrt (num_sources);
   tiler_columns = (guint) ceil (1.0 * num_sources / tiler_rows);
   /* we set the tiler properties here */
@@ -595,10 +686,15 @@ main (int argc, char *argv[])
       "display-text", OSD_DISPLAY_TEXT, NULL);
 
   g_object_set (G_OBJECT(msgconv), "config", MSCONV_CONFIG_FILE, NULL);
-  g_object_set (G_OBJECT(msgconv), "payload-type", SCHEMA_TYPE, NULL);
+  g_object_set (G_OBJECT(msgconv), "payload-type", payload_type, NULL);
+  /* One payload per event, so that the converter's priority lanes can
+   * reorder them. */
+  g_object_set (G_OBJECT(msgconv), "multiple-payloads", TRUE, NULL);
 
-  g_object_set (G_OBJECT(msgbroker), "proto-lib", PROTOCOL_ADAPTOR_LIB,
-                "conn-str", CONNECTION_STRING, "sync", FALSE, NULL);
+  g_object_set (G_OBJECT(msgbroker),
+                "proto-lib", proto_lib ? proto_lib : PROTOCOL_ADAPTOR_LIB,
+                "conn-str", conn_str ? conn_str : CONNECTION_STRING,
+                "sync", FALSE, NULL);
 
   g_object_set (G_OBJECT(msgbroker), "topic", TOPIC, NULL);
 
@@ -613,8 +709,8 @@ main (int argc, char *argv[])
   g_print ("End initializing pipeline\n");
   
   g_print ("Adding all elements to bin\n");
-  gst_bin_add_many (GST_BIN (pipeline), queue1, pgie, queue2, tiler, queue3,
-      nvvidconv, queue4, nvosd, tee, queue5, msgconv, msgbroker, queue6, sink, NULL);
+  gst_bin_add_many (GST_BIN (pipeline), queue1, pgie, nvtracker, queue2, tiler,
+      queue3, nvvidconv, queue4, nvosd, tee, queue5, msgconv, msgbroker, queue6, sink, NULL);
   g_print ("End bin added\n");
 
   if(prop.integrated) {
@@ -623,8 +719,8 @@ main (int argc, char *argv[])
   }
  
   g_print ("Link 1\n");
-  if (!gst_element_link_many (streammux, queue1, pgie, queue2, tiler, queue3,
-       nvvidconv, queue4, nvosd, tee, NULL)) {
+  if (!gst_element_link_many (streammux, queue1, pgie, nvtracker, queue2,
+       tiler, queue3, nvvidconv, queue4, nvosd, tee, NULL)) {
     g_printerr ("1. Elements could not be linked. Exiting.\n");
     return -1;
   }
@@ -682,17 +778,50 @@ main (int argc, char *argv[])
   gst_object_unref (sink_pad);
 
   /* Lets add probe to get informed of the meta data generated, we add probe to
-   * the sink pad of the osd element, since by that time, the buffer would have
-   * had got all the metadata. */
-  tiler_src_pad = gst_element_get_static_pad (pgie, "src");
+   * the src pad of the tracker element, since by that time the objects carry
+   * their track ids. */
+  tiler_src_pad = gst_element_get_static_pad (nvtracker, "src");
   if (!tiler_src_pad)
     g_print ("Unable to get src pad\n");
   else
     g_print ("Getting src pad\n");
     gst_pad_add_probe (tiler_src_pad, GST_PAD_PROBE_TYPE_BUFFER,
-        tiler_src_pad_buffer_probe, NULL, NULL);
+        tiler_src_pad_buffer_probe, app_ctx, NULL);
   gst_object_unref (tiler_src_pad);
 
+  /* Events built off the inference thread are attached once the batch has
+   * crossed queue5, i.e. on the message branch thread. */
+  app_ctx->msg_queue = queue5;
+  src_pad = gst_element_get_static_pad (queue5, "src");
+  if (!src_pad) {
+    g_printerr ("Unable to get queue5 src pad\n");
+    return -1;
+  }
+  gst_pad_add_probe (src_pad, GST_PAD_PROBE_TYPE_BUFFER,
+      msg_attach_pad_buffer_probe, app_ctx, NULL);
+  gst_object_unref (src_pad);
+
+  if (app_ctx->latency) {
+    LatencyStats *latency = app_ctx->latency;
+
+    if (!add_latency_probe (latency, streammux, "src",
+            LATENCY_STAGE_STREAMMUX) ||
+        !add_latency_probe (latency, pgie, "src", LATENCY_STAGE_PGIE) ||
+        !add_latency_probe (latency, tiler, "src", LATENCY_STAGE_TILER) ||
+        !add_latency_probe (latency, nvosd, "src", LATENCY_STAGE_NVOSD) ||
+        !add_latency_probe (latency, msgconv, "sink", LATENCY_STAGE_MSGCONV) ||
+        !add_latency_probe (latency, msgbroker, "sink",
+            LATENCY_STAGE_MSGBROKER))
+      return -1;
+    latency_stats_add_probe (latency, tee_msg_pad, LATENCY_STAGE_TEE);
+
+    if (metrics_port > 0 && !latency_stats_serve (latency, metrics_port))
+      return -1;
+    if (metrics_file && !latency_stats_dump_to_file (latency, metrics_file,
+            MAX (metrics_interval, 1)))
+      return -1;
+  }
+
   /* Set the pipeline to "playing" state */
   g_print ("Now playing:");
   for (i = 0; i < num_sources; i++) {
@@ -702,6 +831,9 @@ main (int argc, char *argv[])
   gst_element_set_state (pipeline, GST_STATE_PLAYING);
 
   /* Wait till pipeline encounters an error or EOS */
+  if (stats_interval > 0)
+    throughput_stats_start_report (app_ctx->throughput, stats_interval,
+        MAX (stats_window, 0));
   g_print ("Running...\n");
   g_main_loop_run (loop);
 
@@ -715,9 +847,29 @@ main (int argc, char *argv[])
   gst_object_unref (tee_render_pad);
 
   gst_element_set_state (pipeline, GST_STATE_NULL);
+
+  event_worker_get_stats (app_ctx->event_worker, &worker_stats);
+  g_print ("Event worker: snapshots pushed %" G_GUINT64_FORMAT
+      " dropped-oldest %" G_GUINT64_FORMAT " dropped-newest %"
+      G_GUINT64_FORMAT " blocked %" G_GUINT64_FORMAT ", events built %"
+      G_GUINT64_FORMAT " unchanged %" G_GUINT64_FORMAT " dropped %"
+      G_GUINT64_FORMAT "\n", worker_stats.snapshots.pushed,
+      worker_stats.snapshots.dropped_oldest,
+      worker_stats.snapshots.dropped_newest, worker_stats.snapshots.blocked,
+      worker_stats.events_built, worker_stats.events_unchanged,
+      worker_stats.events_dropped);
+
   g_print ("Deleting pipeline\n");
   gst_object_unref (GST_OBJECT (pipeline));
   g_source_remove (bus_watch_id);
   g_main_loop_unref (loop);
+  event_sampler_free (app_ctx->sampler);
+  event_worker_free (app_ctx->event_worker);
+  latency_stats_free (app_ctx->latency);
+  throughput_stats_free (app_ctx->throughput);
+  g_free (app_ctx);
+  g_free (metrics_file);
+  g_free (proto_lib);
+  g_free (conn_str);
   return 0;
 }
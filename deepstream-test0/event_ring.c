@@ -0,0 +1,227 @@
+/*
+ * Copyright (c) 2018-2020, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include <errno.h>
+#include <semaphore.h>
+#include <string.h>
+#include <time.h>
+
+#include "event_ring.h"
+
+#define CACHE_LINE_SIZE 64
+#define BLOCK_RETRY_USEC 100
+
+struct _EventRing
+{
+  guint capacity;
+  guint mask;
+  gsize slot_size;
+  EventRingOverflow overflow;
+  guint8 *slots;
+  sem_t items;
+  gint closed;
+
+  /* Consumer position. Only the consumer advances it, except under the
+   * drop-oldest policy where the producer may skip the oldest slot. */
+  guint64 head __attribute__ ((aligned (CACHE_LINE_SIZE)));
+  /* Producer position, owned by the producer. */
+  guint64 tail __attribute__ ((aligned (CACHE_LINE_SIZE)));
+
+  EventRingStats stats __attribute__ ((aligned (CACHE_LINE_SIZE)));
+};
+
+static inline gpointer
+ring_slot (EventRing *ring, guint64 index)
+{
+  return ring->slots + (index & ring->mask) * ring->slot_size;
+}
+
+static inline void
+stat_inc (guint64 *counter)
+{
+  __atomic_fetch_add (counter, 1, __ATOMIC_RELAXED);
+}
+
+EventRing *
+event_ring_new (guint capacity, gsize slot_size, EventRingOverflow overflow)
+{
+  EventRing *ring = NULL;
+  guint size = 1;
+
+  while (size < capacity)
+    size <<= 1;
+
+  ring = g_new0 (EventRing, 1);
+  ring->capacity = size;
+  ring->mask = size - 1;
+  ring->slot_size = slot_size;
+  ring->overflow = overflow;
+  ring->slots = (guint8 *) g_malloc0 ((gsize) size * slot_size);
+  sem_init (&ring->items, 0, 0);
+  return ring;
+}
+
+void
+event_ring_free (EventRing *ring)
+{
+  if (!ring)
+    return;
+  sem_destroy (&ring->items);
+  g_free (ring->slots);
+  g_free (ring);
+}
+
+gboolean
+event_ring_overflow_from_string (const gchar *str, EventRingOverflow *overflow)
+{
+  if (!g_strcmp0 (str, "drop-oldest"))
+    *overflow = EVENT_RING_DROP_OLDEST;
+  else if (!g_strcmp0 (str, "drop-newest"))
+    *overflow = EVENT_RING_DROP_NEWEST;
+  else if (!g_strcmp0 (str, "block"))
+    *overflow = EVENT_RING_BLOCK;
+  else
+    return FALSE;
+  return TRUE;
+}
+
+gpointer
+event_ring_reserve (EventRing *ring, gboolean *evicted)
+{
+  guint64 tail = __atomic_load_n (&ring->tail, __ATOMIC_RELAXED);
+  guint64 head;
+  gboolean counted_block = FALSE;
+
+  if (evicted)
+    *evicted = FALSE;
+
+  for (;;) {
+    head = __atomic_load_n (&ring->head, __ATOMIC_ACQUIRE);
+    if (tail - head < ring->capacity)
+      return ring_slot (ring, tail);
+
+    switch (ring->overflow) {
+      case EVENT_RING_DROP_NEWEST:
+        stat_inc (&ring->stats.dropped_newest);
+        return NULL;
+      case EVENT_RING_DROP_OLDEST:
+        /* Losing the race means the consumer just freed a slot. Winning it
+         * frees the slot at head, which is the one returned next as tail
+         * is a full ring ahead. */
+        if (__atomic_compare_exchange_n (&ring->head, &head, head + 1, FALSE,
+                __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+          stat_inc (&ring->stats.dropped_oldest);
+          if (evicted)
+            *evicted = TRUE;
+        }
+        break;
+      case EVENT_RING_BLOCK:
+        if (__atomic_load_n (&ring->closed, __ATOMIC_ACQUIRE))
+          return NULL;
+        if (!counted_block) {
+          stat_inc (&ring->stats.blocked);
+          counted_block = TRUE;
+        }
+        g_usleep (BLOCK_RETRY_USEC);
+        break;
+    }
+  }
+}
+
+void
+event_ring_commit (EventRing *ring)
+{
+  guint64 tail = __atomic_load_n (&ring->tail, __ATOMIC_RELAXED);
+
+  __atomic_store_n (&ring->tail, tail + 1, __ATOMIC_RELEASE);
+  stat_inc (&ring->stats.pushed);
+  sem_post (&ring->items);
+}
+
+static void
+deadline_after (struct timespec *deadline, gint64 timeout_us)
+{
+  clock_gettime (CLOCK_REALTIME, deadline);
+  deadline->tv_sec += timeout_us / G_USEC_PER_SEC;
+  deadline->tv_nsec += (timeout_us % G_USEC_PER_SEC) * 1000;
+  if (deadline->tv_nsec >= 1000000000) {
+    deadline->tv_sec++;
+    deadline->tv_nsec -= 1000000000;
+  }
+}
+
+gboolean
+event_ring_pop (EventRing *ring, gpointer out, gint64 timeout_us)
+{
+  struct timespec deadline;
+  gboolean have_deadline = FALSE;
+  guint64 head, tail;
+
+  for (;;) {
+    head = __atomic_load_n (&ring->head, __ATOMIC_ACQUIRE);
+    tail = __atomic_load_n (&ring->tail, __ATOMIC_ACQUIRE);
+
+    if (head == tail) {
+      /* The semaphore counts commits, not queued slots, so it can be ahead
+       * of the ring; keep waiting until the deadline. */
+      if (timeout_us <= 0 || __atomic_load_n (&ring->closed, __ATOMIC_ACQUIRE))
+        return FALSE;
+      if (!have_deadline) {
+        deadline_after (&deadline, timeout_us);
+        have_deadline = TRUE;
+      }
+      if (sem_timedwait (&ring->items, &deadline) != 0 && errno != EINTR)
+        return FALSE;
+      continue;
+    }
+
+    /* Copy first, then release. If the producer reclaimed this slot in the
+     * meantime the copy may be torn, but the release fails and the copy is
+     * discarded. */
+    memcpy (out, ring_slot (ring, head), ring->slot_size);
+    if (__atomic_compare_exchange_n (&ring->head, &head, head + 1, FALSE,
+            __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+      stat_inc (&ring->stats.popped);
+      return TRUE;
+    }
+  }
+}
+
+void
+event_ring_close (EventRing *ring)
+{
+  __atomic_store_n (&ring->closed, TRUE, __ATOMIC_RELEASE);
+  sem_post (&ring->items);
+}
+
+void
+event_ring_get_stats (EventRing *ring, EventRingStats *stats)
+{
+  stats->pushed = __atomic_load_n (&ring->stats.pushed, __ATOMIC_RELAXED);
+  stats->popped = __atomic_load_n (&ring->stats.popped, __ATOMIC_RELAXED);
+  stats->dropped_oldest =
+      __atomic_load_n (&ring->stats.dropped_oldest, __ATOMIC_RELAXED);
+  stats->dropped_newest =
+      __atomic_load_n (&ring->stats.dropped_newest, __ATOMIC_RELAXED);
+  stats->blocked = __atomic_load_n (&ring->stats.blocked, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,112 @@
+/*
+ * Copyright (c) 2018-2020, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+/**
+ * @file
+ * <b>Lock-free single producer / single consumer ring</b>
+ *
+ * @b Description: Fixed-capacity ring of preallocated, fixed-size slots used
+ * to hand data from a streaming thread to a worker thread without locks or
+ * allocation. The producer writes straight into a reserved slot; the consumer
+ * copies the slot out before releasing it, which is what allows the producer
+ * to reclaim the oldest slot under the drop-oldest policy.
+ */
+
+#ifndef EVENT_RING_H_
+#define EVENT_RING_H_
+
+#include <glib.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+typedef enum
+{
+  /** Producer overwrites the oldest queued slot. */
+  EVENT_RING_DROP_OLDEST,
+  /** Producer discards the slot it tried to queue. */
+  EVENT_RING_DROP_NEWEST,
+  /** Producer waits until the consumer frees a slot. */
+  EVENT_RING_BLOCK
+} EventRingOverflow;
+
+typedef struct
+{
+  guint64 pushed;
+  guint64 popped;
+  guint64 dropped_oldest;
+  guint64 dropped_newest;
+  guint64 blocked;
+} EventRingStats;
+
+typedef struct _EventRing EventRing;
+
+/**
+ * Creates a ring of at least @capacity slots of @slot_size bytes. The
+ * capacity is rounded up to a power of two.
+ */
+EventRing *event_ring_new (guint capacity, gsize slot_size,
+    EventRingOverflow overflow);
+
+void event_ring_free (EventRing *ring);
+
+/**
+ * Parses "drop-oldest", "drop-newest" or "block". Returns FALSE for anything
+ * else.
+ */
+gboolean event_ring_overflow_from_string (const gchar *str,
+    EventRingOverflow *overflow);
+
+/**
+ * Producer side. Returns the slot to fill, or NULL if the slot was dropped
+ * (drop-newest) or the ring was closed while blocking. Every non-NULL
+ * reservation must be followed by @event_ring_commit.
+ *
+ * Under drop-oldest, @evicted (may be NULL) is set to TRUE if the oldest
+ * slot was dropped to make room. The returned slot is that slot and still
+ * holds its contents, so the producer can account for what it overwrites.
+ */
+gpointer event_ring_reserve (EventRing *ring, gboolean *evicted);
+
+void event_ring_commit (EventRing *ring);
+
+/**
+ * Consumer side. Copies the oldest slot to @out and releases it. Waits up to
+ * @timeout_us for data when the ring is empty, 0 doesn't wait. Returns FALSE
+ * if nothing was available.
+ */
+gboolean event_ring_pop (EventRing *ring, gpointer out, gint64 timeout_us);
+
+/**
+ * Wakes up a blocked producer and consumer; used on shutdown.
+ */
+void event_ring_close (EventRing *ring);
+
+void event_ring_get_stats (EventRing *ring, EventRingStats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* EVENT_RING_H_ */
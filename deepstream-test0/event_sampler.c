@@ -0,0 +1,246 @@
+/*
+ * Copyright (c) 2018-2020, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "event_sampler.h"
+
+#define CONFIG_GROUP_SENSOR "sensor"
+
+#define CONFIG_KEY_INTERVAL "interval"
+#define CONFIG_KEY_ON_COUNT_CHANGE "on-count-change"
+#define CONFIG_KEY_BURST_MAX_GAP "burst-max-gap"
+#define CONFIG_KEY_MAX_EVENTS_PER_SEC "max-events-per-sec"
+#define CONFIG_KEY_BUCKET_SIZE "bucket-size"
+
+#define DEFAULT_INTERVAL 30
+#define DEFAULT_BUCKET_SIZE 1.0
+
+typedef struct
+{
+  guint interval;
+  gboolean on_count_change;
+  guint burst_max_gap;
+  gdouble max_events_per_sec;
+  gdouble bucket_size;
+} SamplerPolicy;
+
+typedef struct
+{
+  SamplerPolicy policy;
+
+  /** Frames seen from this source. */
+  guint64 frames;
+  guint last_obj_count;
+  guint64 max_track_id;
+
+  /** Current back-off gap of a new-track burst, 0 when no burst is active. */
+  guint burst_gap;
+  guint64 burst_next_frame;
+
+  gdouble tokens;
+  gint64 last_refill_us;
+} SourceState;
+
+struct _EventSampler
+{
+  guint num_sources;
+  SourceState *sources;
+};
+
+static void
+parse_policy (GKeyFile *key_file, const gchar *group, SamplerPolicy *policy)
+{
+  GError *error = NULL;
+  gint ival;
+  gdouble dval;
+
+  if (!g_key_file_has_group (key_file, group))
+    return;
+
+  ival = g_key_file_get_integer (key_file, group, CONFIG_KEY_INTERVAL, &error);
+  if (!error)
+    policy->interval = MAX (ival, 0);
+  g_clear_error (&error);
+
+  ival = g_key_file_get_boolean (key_file, group, CONFIG_KEY_ON_COUNT_CHANGE,
+      &error);
+  if (!error)
+    policy->on_count_change = ival;
+  g_clear_error (&error);
+
+  ival = g_key_file_get_integer (key_file, group, CONFIG_KEY_BURST_MAX_GAP,
+      &error);
+  if (!error)
+    policy->burst_max_gap = MAX (ival, 0);
+  g_clear_error (&error);
+
+  dval = g_key_file_get_double (key_file, group, CONFIG_KEY_MAX_EVENTS_PER_SEC,
+      &error);
+  if (!error)
+    policy->max_events_per_sec = MAX (dval, 0.0);
+  g_clear_error (&error);
+
+  dval = g_key_file_get_double (key_file, group, CONFIG_KEY_BUCKET_SIZE,
+      &error);
+  if (!error)
+    policy->bucket_size = MAX (dval, 1.0);
+  g_clear_error (&error);
+}
+
+EventSampler *
+event_sampler_new (const gchar *config_file, guint num_sources)
+{
+  EventSampler *sampler = NULL;
+  GKeyFile *key_file = NULL;
+  GError *error = NULL;
+  SamplerPolicy defaults = { DEFAULT_INTERVAL, FALSE, 0, 0.0,
+    DEFAULT_BUCKET_SIZE };
+  gchar group[32];
+  guint i;
+
+  key_file = g_key_file_new ();
+  if (config_file && !g_key_file_load_from_file (key_file, config_file,
+          G_KEY_FILE_NONE, &error)) {
+    g_printerr ("Failed to load sampler config %s: %s\n", config_file,
+        error->message);
+    g_error_free (error);
+    g_key_file_free (key_file);
+    return NULL;
+  }
+
+  parse_policy (key_file, SAMPLER_CONFIG_GROUP, &defaults);
+
+  sampler = g_new0 (EventSampler, 1);
+  sampler->num_sources = num_sources;
+  sampler->sources = g_new0 (SourceState, num_sources);
+
+  for (i = 0; i < num_sources; i++) {
+    SourceState *state = &sampler->sources[i];
+
+    state->policy = defaults;
+    g_snprintf (group, sizeof (group), CONFIG_GROUP_SENSOR "%u", i);
+    parse_policy (key_file, group, &state->policy);
+    state->tokens = state->policy.bucket_size;
+  }
+
+  g_key_file_free (key_file);
+  return sampler;
+}
+
+void
+event_sampler_free (EventSampler *sampler)
+{
+  if (!sampler)
+    return;
+  g_free (sampler->sources);
+  g_free (sampler);
+}
+
+static gboolean
+take_token (SourceState *state)
+{
+  const SamplerPolicy *policy = &state->policy;
+  gint64 now;
+
+  if (policy->max_events_per_sec <= 0.0)
+    return TRUE;
+
+  now = g_get_monotonic_time ();
+  if (state->last_refill_us) {
+    state->tokens += policy->max_events_per_sec *
+        (now - state->last_refill_us) / G_USEC_PER_SEC;
+    if (state->tokens > policy->bucket_size)
+      state->tokens = policy->bucket_size;
+  }
+  state->last_refill_us = now;
+
+  if (state->tokens < 1.0)
+    return FALSE;
+  state->tokens -= 1.0;
+  return TRUE;
+}
+
+gboolean
+event_sampler_should_emit (EventSampler *sampler, guint source_id,
+    guint obj_count, guint64 max_track_id)
+{
+  SourceState *state;
+  const SamplerPolicy *policy;
+  guint64 frame;
+  gboolean trigger = FALSE;
+
+  if (!sampler || source_id >= sampler->num_sources)
+    return FALSE;
+
+  state = &sampler->sources[source_id];
+  policy = &state->policy;
+  frame = state->frames++;
+
+  if (policy->interval && frame % policy->interval == 0)
+    trigger = TRUE;
+
+  if (policy->on_count_change && obj_count != state->last_obj_count)
+    trigger = TRUE;
+  state->last_obj_count = obj_count;
+
+  if (policy->burst_max_gap) {
+    if (max_track_id > state->max_track_id) {
+      /* New track: restart the burst from the frame it appears on. */
+      state->burst_gap = 1;
+      state->burst_next_frame = frame;
+    }
+    if (state->burst_gap && frame >= state->burst_next_frame) {
+      trigger = TRUE;
+      state->burst_next_frame = frame + state->burst_gap;
+      state->burst_gap *= 2;
+      if (state->burst_gap > policy->burst_max_gap)
+        state->burst_gap = 0;
+    }
+  }
+  if (max_track_id > state->max_track_id)
+    state->max_track_id = max_track_id;
+
+  if (!trigger)
+    return FALSE;
+
+  return take_token (state);
+}
+
+gboolean
+event_sampler_skip_empty (EventSampler *sampler, guint source_id)
+{
+  SourceState *state;
+  gboolean emptied;
+
+  if (!sampler || source_id >= sampler->num_sources)
+    return FALSE;
+
+  /* A burst step falling on an empty frame moves to the next frame with
+   * objects, burst_next_frame is left behind on purpose. */
+  state = &sampler->sources[source_id];
+  state->frames++;
+  emptied = state->last_obj_count != 0;
+  state->last_obj_count = 0;
+  return emptied;
+}
@@ -0,0 +1,91 @@
+/*
+ * Copyright (c) 2018-2020, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file
+ * <b>Per-source event sampling</b>
+ *
+ * @b Description: Decides, for every frame of every source, whether an
+ * object event should be generated. Each source keeps its own frame counter
+ * and a constant amount of state, so the decision costs the same regardless
+ * of how many objects or sources are in the batch.
+ *
+ * Policies are read from the [sampler] group of the event configuration file
+ * and can be overridden per source in [sensorN] groups:
+ *
+ *   interval=N            emit every N frames of the source (0 disables)
+ *   on-count-change=1     emit when the object count differs from the
+ *                         previous frame of the source
+ *   burst-max-gap=N       when a new track appears emit on that frame and
+ *                         then back off with doubling gaps up to N frames
+ *                         (0 disables); needs the ids of a tracker
+ *   max-events-per-sec=R  token bucket limiting the emitted rate, applied on
+ *                         top of the triggers above (0 disables)
+ *   bucket-size=B         number of events the token bucket can burst
+ */
+
+#ifndef EVENT_SAMPLER_H_
+#define EVENT_SAMPLER_H_
+
+#include <glib.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define SAMPLER_CONFIG_GROUP "sampler"
+
+typedef struct _EventSampler EventSampler;
+
+/**
+ * Creates a sampler for @num_sources sources using the policies in
+ * @config_file. Returns NULL if the file can't be parsed.
+ */
+EventSampler *event_sampler_new (const gchar *config_file, guint num_sources);
+
+void event_sampler_free (EventSampler *sampler);
+
+/**
+ * Advances the frame counter of @source_id and returns TRUE if an event
+ * should be generated for this frame.
+ *
+ * @param[in] obj_count number of objects in the frame.
+ * @param[in] max_track_id highest tracking id in the frame, or 0 if no
+ * object in the frame is tracked. Tracker ids increase monotonically, so a
+ * value above the highest id seen so far means a new track appeared.
+ */
+gboolean event_sampler_should_emit (EventSampler *sampler, guint source_id,
+    guint obj_count, guint64 max_track_id);
+
+/**
+ * Advances the frame counter of @source_id for a frame without objects.
+ * Such a frame never produces an event, so no trigger is evaluated and no
+ * token is spent. Returns TRUE for the first empty frame after frames with
+ * objects, which the scene change detector still needs to see.
+ */
+gboolean event_sampler_skip_empty (EventSampler *sampler, guint source_id);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* EVENT_SAMPLER_H_ */
@@ -0,0 +1,502 @@
+/*
+ * Copyright (c) 2018-2020, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "gstnvdsmeta.h"
+#include "custom_meta_schema.h"
+#include "event_worker.h"
+#include "frame_snapshot.h"
+#include "nvds_trace.h"
+#include "scene_change.h"
+#include "trajectory.h"
+
+#define CONFIG_KEY_QUEUE_SIZE "queue-size"
+#define CONFIG_KEY_OVERFLOW_POLICY "overflow-policy"
+
+#define DEFAULT_QUEUE_SIZE 64
+#define WORKER_POLL_USEC 100000
+
+struct _EventWorker
+{
+  SceneChangeDetector *scene_detector;
+  TrajectoryTracker *trajectories;
+  ClassLabelTable labels;
+  ThroughputStats *throughput;
+
+  /* FrameSnapshot slots, filled by the tracker probe. */
+  EventRing *snapshots;
+  /* NvDsEventMsgMeta pointers, filled by the worker thread. */
+  EventRing *outbox;
+
+  GThread *thread;
+  gint stop;
+
+  /* Only touched by the worker thread. */
+  FrameSnapshot scratch;
+
+  guint64 events_built;
+  guint64 events_unchanged;
+  guint64 events_dropped;
+  guint64 attach_failures;
+};
+
+static void generate_ts_rfc3339 (char *buf, int buf_size)
+{
+  time_t tloc;
+  struct tm tm_log;
+  struct timespec ts;
+  char strmsec[6]; //.nnnZ\0
+
+  clock_gettime(CLOCK_REALTIME,  &ts);
+  memcpy(&tloc, (void *)(&ts.tv_sec), sizeof(time_t));
+  gmtime_r(&tloc, &tm_log);
+  strftime(buf, buf_size,"%Y-%m-%dT%H:%M:%S", &tm_log);
+  int ms = ts.tv_nsec/1000000;
+  g_snprintf(strmsec, sizeof(strmsec),".%.3dZ", ms);
+  strncat(buf, strmsec, buf_size);
+}
+
+static gpointer meta_copy_func (gpointer data, gpointer user_data){
+  NvDsUserMeta *user_meta = (NvDsUserMeta *) data;
+  NvDsEventMsgMeta *srcMeta = (NvDsEventMsgMeta *) user_meta->user_meta_data;
+  NvDsEventMsgMeta *dstMeta = NULL;
+
+  dstMeta = (NvDsEventMsgMeta*)g_memdup (srcMeta, sizeof(NvDsEventMsgMeta));
+  dstMeta->sensorStr = g_strdup(srcMeta->sensorStr);
+  dstMeta->ts = g_strdup (srcMeta->ts);
+
+  if(srcMeta->extMsgSize > 0){
+    dstMeta->extMsg = g_memdup(srcMeta->extMsg, srcMeta->extMsgSize);
+  }
+  switch (nvds_event_ext_kind (srcMeta)) {
+    case NVDS_EVENT_EXT_TRACK:
+      NVDS_EVENT_DEEP_COPY (NVDS_TRACK_EVENT_FIELDS, NvDsTrackEvent,
+          dstMeta->extMsg, srcMeta->extMsg);
+      break;
+    case NVDS_EVENT_EXT_FRAME:
+      NVDS_EVENT_DEEP_COPY (NVDS_FRAME_EVENT_FIELDS, NvDsFrameObjDescEvent,
+          dstMeta->extMsg, srcMeta->extMsg);
+      break;
+    default:
+      break;
+  }
+  return dstMeta;
+}
+
+static void free_event_msg_meta (NvDsEventMsgMeta *meta){
+  g_free (meta->ts);
+  g_free (meta->sensorStr);
+
+  switch (nvds_event_ext_kind (meta)) {
+    case NVDS_EVENT_EXT_TRACK:
+      NVDS_EVENT_FREE_MEMBERS (NVDS_TRACK_EVENT_FIELDS, NvDsTrackEvent,
+          meta->extMsg);
+      break;
+    case NVDS_EVENT_EXT_FRAME:
+      NVDS_EVENT_FREE_MEMBERS (NVDS_FRAME_EVENT_FIELDS,
+          NvDsFrameObjDescEvent, meta->extMsg);
+      break;
+    default:
+      break;
+  }
+  g_free(meta->extMsg);
+  meta->extMsg = NULL;
+
+  g_free(meta);
+}
+
+static void meta_free_func(gpointer data, gpointer user_data){
+  NvDsUserMeta *user_meta = (NvDsUserMeta *) data;
+
+  free_event_msg_meta ((NvDsEventMsgMeta *) user_meta->user_meta_data);
+  user_meta->user_meta_data = NULL;
+}
+
+static void
+generate_object_event_msg_meta( gpointer data, const FrameSnapshot *snapshot){
+  NvDsEventMsgMeta *meta = (NvDsEventMsgMeta *) data;
+  NvDsFrameObjDescEvent* frame_obj_desc = (NvDsFrameObjDescEvent*)meta->extMsg;
+  // NvDsSourceConfigExt source_config = appCtx->config.multi_source_config[frame_meta->source_id];
+
+  meta->sensorId = snapshot->source_id;
+  // meta->sensorStr = g_strdup(source_config.uri);
+  meta->sensorStr = g_strdup ("sensor-0");
+  meta->ts = (gchar *) g_malloc0 (MAX_TIME_STAMP_LEN + 1);
+  // if(source_config.type == NV_DS_SOURCE_URI){
+  //   meta->otherAttrs = (gchar*)"file";
+  // }else if(source_config.type == NV_DS_SOURCE_RTSP || source_config.type == NV_DS_SOURCE_CAMERA_V4L2){
+  //   meta->otherAttrs = (gchar*)"camera";
+  // }
+
+  generate_ts_rfc3339(meta->ts, MAX_TIME_STAMP_LEN);
+
+  // frame_obj_desc->filterCloudModules = 
+  //     g_strjoin(";", FIGHT_MODULE_NAME, WEAPON_MODULE_NAME, DRUNK_MODULE_NAME, NULL);
+  
+  frame_obj_desc->sourceId = snapshot->source_id;
+  // frame_obj_desc->sourceType = source_config.type;
+  frame_obj_desc->frameHeight = snapshot->frame_height;
+  frame_obj_desc->frameWidth = snapshot->frame_width;
+
+  // frame_obj_desc->sourceUri = g_strdup(source_config.uri);
+  // frame_obj_desc->sourceCloudModules = g_strdup(source_config.cloud_modules);
+}
+
+static NvDsEventMsgMeta *
+build_event (EventWorker *worker, const FrameSnapshot *snapshot)
+{
+  NvDsFrameObjDescEvent *frame_obj_desc = NULL;
+  NvDsSimpleObjectMeta *obj = NULL;
+  NvDsEventMsgMeta *msg_meta = NULL;
+  guint i;
+
+  frame_obj_desc = (NvDsFrameObjDescEvent*)g_malloc0(sizeof(NvDsFrameObjDescEvent));
+  frame_obj_desc->kind = NVDS_EVENT_EXT_FRAME;
+  for (i = 0; i < snapshot->count; i++) {
+    obj = &frame_obj_desc->objMetaList[i];
+    if (snapshot->class_id[i] == PGIE_CLASS_ID_VEHICLE)
+      obj->objType = NVDS_OBJECT_TYPE_VEHICLE;
+    else
+      obj->objType = NVDS_OBJECT_TYPE_PERSON;
+    g_strlcpy (obj->label,
+        class_label_table_get (&worker->labels, snapshot->class_id[i]),
+        MAX_LABEL_SIZE);
+
+    obj->bbox.top = snapshot->top[i];
+    obj->bbox.left = snapshot->left[i];
+    obj->bbox.width = snapshot->width[i];
+    obj->bbox.height = snapshot->height[i];
+    obj->trackingId = snapshot->object_id[i];
+    obj->classId = snapshot->class_id[i];
+    obj->confidence = snapshot->confidence[i];
+  }
+  frame_obj_desc->objCounts = snapshot->count;
+  frame_obj_desc->frameId = snapshot->frame_num;
+
+  msg_meta = (NvDsEventMsgMeta *) g_malloc0 (sizeof (NvDsEventMsgMeta));
+  msg_meta->type = NVDS_EVENT_CUSTOM;
+  msg_meta->frameId = snapshot->frame_num;
+  msg_meta->extMsg = frame_obj_desc;
+  msg_meta->extMsgSize = sizeof (NvDsFrameObjDescEvent);
+  generate_object_event_msg_meta(msg_meta, snapshot);
+
+  return msg_meta;
+}
+
+/* Hands @msg_meta over to the message branch, or drops it if the outbox is
+ * full. */
+static void
+queue_event (EventWorker *worker, NvDsEventMsgMeta *msg_meta,
+    guint source_id)
+{
+  gpointer slot;
+
+  __atomic_fetch_add (&worker->events_built, 1, __ATOMIC_RELAXED);
+
+  slot = event_ring_reserve (worker->outbox, NULL);
+  if (!slot) {
+    free_event_msg_meta (msg_meta);
+    __atomic_fetch_add (&worker->events_dropped, 1, __ATOMIC_RELAXED);
+    throughput_stats_event_dropped (worker->throughput, source_id);
+    return;
+  }
+  /* Begun before the commit, the attach may end it right after. */
+  nvds_trace_async_begin ("app", "outbox", GPOINTER_TO_SIZE (msg_meta),
+      "source", source_id);
+  *(NvDsEventMsgMeta **) slot = msg_meta;
+  event_ring_commit (worker->outbox);
+}
+
+static void
+queue_track_event (const TrajectoryEvent *event, gpointer user_data)
+{
+  EventWorker *worker = (EventWorker *) user_data;
+  NvDsTrackEvent *track = NULL;
+  NvDsEventMsgMeta *msg_meta = NULL;
+
+  track = (NvDsTrackEvent *) g_malloc0 (sizeof (NvDsTrackEvent));
+  track->kind = NVDS_EVENT_EXT_TRACK;
+  track->trackingId = event->track_id;
+  track->classId = event->class_id;
+  g_strlcpy (track->label,
+      class_label_table_get (&worker->labels, event->class_id),
+      MAX_LABEL_SIZE);
+  track->firstFrameId = event->first_frame;
+  track->lastFrameId = event->last_frame;
+  track->numPoints = MIN (event->num_points, MAX_TRACK_POINTS);
+  memcpy (track->points, event->points,
+      track->numPoints * sizeof (NvDsTrackPoint));
+
+  msg_meta = (NvDsEventMsgMeta *) g_malloc0 (sizeof (NvDsEventMsgMeta));
+  switch (event->kind) {
+    case TRAJECTORY_TRACK_START:
+      msg_meta->type = NVDS_EVENT_ENTRY;
+      break;
+    case TRAJECTORY_TRACK_UPDATE:
+      msg_meta->type = NVDS_EVENT_MOVING;
+      break;
+    case TRAJECTORY_TRACK_END:
+      msg_meta->type = NVDS_EVENT_EXIT;
+      break;
+  }
+  if (event->class_id == PGIE_CLASS_ID_VEHICLE)
+    msg_meta->objType = NVDS_OBJECT_TYPE_VEHICLE;
+  else
+    msg_meta->objType = NVDS_OBJECT_TYPE_PERSON;
+  msg_meta->objClassId = event->class_id;
+  msg_meta->trackingId = event->track_id;
+  msg_meta->frameId = event->last_frame;
+  msg_meta->sensorId = event->source_id;
+  msg_meta->sensorStr = g_strdup ("sensor-0");
+  msg_meta->ts = (gchar *) g_malloc0 (MAX_TIME_STAMP_LEN + 1);
+  generate_ts_rfc3339 (msg_meta->ts, MAX_TIME_STAMP_LEN);
+  msg_meta->extMsg = track;
+  msg_meta->extMsgSize = sizeof (NvDsTrackEvent);
+
+  queue_event (worker, msg_meta, event->source_id);
+}
+
+static gpointer
+event_worker_thread (gpointer data)
+{
+  EventWorker *worker = (EventWorker *) data;
+  NvDsEventMsgMeta *msg_meta = NULL;
+  gint64 trace_begin;
+
+  for (;;) {
+    if (!event_ring_pop (worker->snapshots, &worker->scratch,
+            WORKER_POLL_USEC)) {
+      if (__atomic_load_n (&worker->stop, __ATOMIC_ACQUIRE))
+        break;
+      continue;
+    }
+
+    trace_begin = nvds_trace_begin ();
+    if (trajectory_tracker_enabled (worker->trajectories)) {
+      trajectory_tracker_update (worker->trajectories, &worker->scratch,
+          queue_track_event, worker);
+      nvds_trace_end ("app", "track", trace_begin, "objects",
+          worker->scratch.count);
+      continue;
+    }
+
+    /* Empty frames still update the scene reference so that objects coming
+     * back count as a change. */
+    if (!scene_change_should_emit (worker->scene_detector, &worker->scratch) ||
+        worker->scratch.count == 0) {
+      __atomic_fetch_add (&worker->events_unchanged, 1, __ATOMIC_RELAXED);
+      nvds_trace_end ("app", "unchanged", trace_begin, NULL, 0);
+      continue;
+    }
+
+    msg_meta = build_event (worker, &worker->scratch);
+    nvds_trace_end ("app", "build", trace_begin, "objects",
+        worker->scratch.count);
+    queue_event (worker, msg_meta, worker->scratch.source_id);
+  }
+  return NULL;
+}
+
+EventWorker *
+event_worker_new (const gchar *config_file, guint num_sources,
+    ThroughputStats *throughput)
+{
+  EventWorker *worker = NULL;
+  GKeyFile *key_file = NULL;
+  GError *error = NULL;
+  EventRingOverflow overflow = EVENT_RING_DROP_OLDEST;
+  gint queue_size = DEFAULT_QUEUE_SIZE;
+  gchar *policy = NULL;
+
+  key_file = g_key_file_new ();
+  if (!g_key_file_load_from_file (key_file, config_file, G_KEY_FILE_NONE,
+          &error)) {
+    g_printerr ("Failed to load event worker config %s: %s\n", config_file,
+        error->message);
+    g_error_free (error);
+    g_key_file_free (key_file);
+    return NULL;
+  }
+
+  if (g_key_file_has_key (key_file, EVENT_WORKER_CONFIG_GROUP,
+          CONFIG_KEY_QUEUE_SIZE, NULL)) {
+    queue_size = g_key_file_get_integer (key_file, EVENT_WORKER_CONFIG_GROUP,
+        CONFIG_KEY_QUEUE_SIZE, NULL);
+  }
+  policy = g_key_file_get_string (key_file, EVENT_WORKER_CONFIG_GROUP,
+      CONFIG_KEY_OVERFLOW_POLICY, NULL);
+  if (policy && !event_ring_overflow_from_string (policy, &overflow)) {
+    g_printerr ("Unknown " CONFIG_KEY_OVERFLOW_POLICY " %s\n", policy);
+    g_free (policy);
+    g_key_file_free (key_file);
+    return NULL;
+  }
+  g_free (policy);
+  g_key_file_free (key_file);
+
+  if (queue_size <= 0) {
+    g_printerr ("Invalid " CONFIG_KEY_QUEUE_SIZE " %d\n", queue_size);
+    return NULL;
+  }
+
+  worker = g_new0 (EventWorker, 1);
+  worker->throughput = throughput;
+  worker->scene_detector = scene_change_detector_new (config_file,
+      num_sources);
+  worker->trajectories = trajectory_tracker_new (config_file, num_sources);
+  if (!worker->scene_detector || !worker->trajectories) {
+    scene_change_detector_free (worker->scene_detector);
+    trajectory_tracker_free (worker->trajectories);
+    g_free (worker);
+    return NULL;
+  }
+  worker->snapshots = event_ring_new (queue_size, sizeof (FrameSnapshot),
+      overflow);
+  /* Built events are only dropped if the message branch stops draining. */
+  worker->outbox = event_ring_new (queue_size, sizeof (NvDsEventMsgMeta *),
+      EVENT_RING_DROP_NEWEST);
+  worker->thread = g_thread_new ("event-worker", event_worker_thread, worker);
+
+  return worker;
+}
+
+void
+event_worker_free (EventWorker *worker)
+{
+  NvDsEventMsgMeta *msg_meta = NULL;
+
+  if (!worker)
+    return;
+
+  __atomic_store_n (&worker->stop, TRUE, __ATOMIC_RELEASE);
+  event_ring_close (worker->snapshots);
+  g_thread_join (worker->thread);
+
+  while (event_ring_pop (worker->outbox, &msg_meta, 0))
+    free_event_msg_meta (msg_meta);
+
+  event_ring_free (worker->snapshots);
+  event_ring_free (worker->outbox);
+  scene_change_detector_free (worker->scene_detector);
+  trajectory_tracker_free (worker->trajectories);
+  g_free (worker);
+}
+
+gboolean
+event_worker_wants_every_frame (EventWorker *worker)
+{
+  return trajectory_tracker_enabled (worker->trajectories);
+}
+
+gboolean
+event_worker_submit (EventWorker *worker, NvDsFrameMeta *frame_meta)
+{
+  gboolean evicted;
+  FrameSnapshot *snapshot =
+      (FrameSnapshot *) event_ring_reserve (worker->snapshots, &evicted);
+
+  if (!snapshot)
+    return FALSE;
+  /* Drop-oldest hands back the evicted snapshot's slot, charge its source
+   * before overwriting it. */
+  if (evicted)
+    throughput_stats_event_dropped (worker->throughput, snapshot->source_id);
+  frame_snapshot_fill (snapshot, frame_meta, &worker->labels);
+  event_ring_commit (worker->snapshots);
+  return TRUE;
+}
+
+void
+event_worker_attach_ready (EventWorker *worker, NvDsBatchMeta *batch_meta,
+    guint queue_fill_percent)
+{
+  NvDsEventMsgMeta *msg_meta = NULL;
+  NvDsFrameMeta *frame_meta = NULL;
+  NvDsMetaList *l_frame = NULL;
+  NvDsUserMeta *user_event_meta = NULL;
+  gint64 trace_begin;
+  guint attached = 0;
+
+  if (!batch_meta->frame_meta_list)
+    return;
+
+  trace_begin = nvds_trace_begin ();
+  while (event_ring_pop (worker->outbox, &msg_meta, 0)) {
+    nvds_trace_async_end ("app", "outbox", GPOINTER_TO_SIZE (msg_meta),
+        NULL, 0);
+    switch (nvds_event_ext_kind (msg_meta)) {
+      case NVDS_EVENT_EXT_TRACK:
+        ((NvDsTrackEvent *) msg_meta->extMsg)->queueFillPercent =
+            queue_fill_percent;
+        break;
+      case NVDS_EVENT_EXT_FRAME:
+        ((NvDsFrameObjDescEvent *) msg_meta->extMsg)->queueFillPercent =
+            queue_fill_percent;
+        break;
+      default:
+        break;
+    }
+    frame_meta = (NvDsFrameMeta *) batch_meta->frame_meta_list->data;
+    for (l_frame = batch_meta->frame_meta_list; l_frame != NULL;
+        l_frame = l_frame->next) {
+      NvDsFrameMeta *candidate = (NvDsFrameMeta *) (l_frame->data);
+      if (candidate && candidate->source_id == (guint) msg_meta->sensorId) {
+        frame_meta = candidate;
+        break;
+      }
+    }
+
+    user_event_meta = nvds_acquire_user_meta_from_pool (batch_meta);
+    if (user_event_meta) {
+      user_event_meta->user_meta_data = (void *) msg_meta;
+      user_event_meta->base_meta.meta_type = NVDS_EVENT_MSG_META;
+      user_event_meta->base_meta.copy_func = (NvDsMetaCopyFunc) meta_copy_func;
+      user_event_meta->base_meta.release_func = (NvDsMetaReleaseFunc) meta_free_func;
+      nvds_add_user_meta_to_frame(frame_meta, user_event_meta);
+      throughput_stats_event_emitted (worker->throughput, msg_meta->sensorId);
+      attached++;
+    } else {
+      throughput_stats_event_dropped (worker->throughput, msg_meta->sensorId);
+      free_event_msg_meta (msg_meta);
+      __atomic_fetch_add (&worker->attach_failures, 1, __ATOMIC_RELAXED);
+    }
+  }
+  nvds_trace_end ("app", "attach", trace_begin, "events", attached);
+}
+
+void
+event_worker_get_stats (EventWorker *worker, EventWorkerStats *stats)
+{
+  event_ring_get_stats (worker->snapshots, &stats->snapshots);
+  stats->events_built =
+      __atomic_load_n (&worker->events_built, __ATOMIC_RELAXED);
+  stats->events_unchanged =
+      __atomic_load_n (&worker->events_unchanged, __ATOMIC_RELAXED);
+  stats->events_dropped =
+      __atomic_load_n (&worker->events_dropped, __ATOMIC_RELAXED);
+  stats->attach_failures =
+      __atomic_load_n (&worker->attach_failures, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,117 @@
+/*
+ * Copyright (c) 2018-2020, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+/**
+ * @file
+ * <b>Event building worker</b>
+ *
+ * @b Description: Moves event construction off the inference streaming
+ * thread. The tracker src probe only snapshots the objects of a sampled frame
+ * into a preallocated slot of a lock-free ring. A dedicated thread runs the
+ * scene change detector on the snapshot, builds the NvDsEventMsgMeta and its
+ * NvDsFrameObjDescEvent, and queues the result. In trajectory mode the
+ * snapshots feed the trajectory tracker instead, see trajectory.h, and the
+ * track lifecycle events it produces are queued as NvDsTrackEvent. The probe on the message
+ * branch then attaches ready events to the batch passing through it.
+ *
+ * Settings are read from the [event-worker] group of the event configuration
+ * file:
+ *
+ *   queue-size=N          number of snapshot slots
+ *   overflow-policy=P     drop-oldest, drop-newest or block when the worker
+ *                         falls behind
+ */
+
+#ifndef EVENT_WORKER_H_
+#define EVENT_WORKER_H_
+
+#include "gstnvdsmeta.h"
+#include "event_ring.h"
+#include "throughput_stats.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define EVENT_WORKER_CONFIG_GROUP "event-worker"
+
+#define PGIE_CLASS_ID_VEHICLE 0
+#define PGIE_CLASS_ID_PERSON 2
+
+typedef struct
+{
+  /** Snapshot ring between the tracker probe and the worker. */
+  EventRingStats snapshots;
+  guint64 events_built;
+  /** Snapshots dropped by the scene change detector. */
+  guint64 events_unchanged;
+  /** Built events dropped because the message branch fell behind. */
+  guint64 events_dropped;
+  guint64 attach_failures;
+} EventWorkerStats;
+
+typedef struct _EventWorker EventWorker;
+
+/**
+ * Creates the worker and starts its thread. Returns NULL if the
+ * configuration can't be parsed. Events attached or lost are counted per
+ * source in @throughput, which may be NULL.
+ */
+EventWorker *event_worker_new (const gchar *config_file, guint num_sources,
+    ThroughputStats *throughput);
+
+/**
+ * Stops the thread and releases events that were never attached.
+ */
+void event_worker_free (EventWorker *worker);
+
+/**
+ * Returns TRUE if the worker needs to see every frame, which is the case in
+ * trajectory mode. The sampler is then bypassed.
+ */
+gboolean event_worker_wants_every_frame (EventWorker *worker);
+
+/**
+ * Streaming thread side. Snapshots the objects of @frame_meta for the
+ * worker. Returns FALSE if the snapshot was dropped. Under drop-oldest a
+ * full queue evicts its oldest snapshot instead, counted as a dropped event
+ * of that snapshot's source.
+ */
+gboolean event_worker_submit (EventWorker *worker, NvDsFrameMeta *frame_meta);
+
+/**
+ * Attaches all events built so far to the frames of @batch_meta, to the
+ * frame of the event's source when the batch carries one. Each event
+ * carries @queue_fill_percent, the fill level of the queue in front of the
+ * message converter, which the converter uses to shed load.
+ */
+void event_worker_attach_ready (EventWorker *worker, NvDsBatchMeta *batch_meta,
+    guint queue_fill_percent);
+
+void event_worker_get_stats (EventWorker *worker, EventWorkerStats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* EVENT_WORKER_H_ */
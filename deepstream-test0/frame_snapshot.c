@@ -0,0 +1,81 @@
+/*
+ * Copyright (c) 2018-2020, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include <string.h>
+
+#include "frame_snapshot.h"
+
+static void
+class_label_table_record (ClassLabelTable *labels, NvDsObjectMeta *obj_meta)
+{
+  gint class_id = obj_meta->class_id;
+
+  if (class_id < 0 || class_id >= MAX_CLASS_LABELS ||
+      __atomic_load_n (&labels->known[class_id], __ATOMIC_ACQUIRE))
+    return;
+
+  g_strlcpy (labels->label[class_id], obj_meta->obj_label, MAX_LABEL_SIZE);
+  __atomic_store_n (&labels->known[class_id], TRUE, __ATOMIC_RELEASE);
+}
+
+const gchar *
+class_label_table_get (ClassLabelTable *labels, gint class_id)
+{
+  if (class_id < 0 || class_id >= MAX_CLASS_LABELS ||
+      !__atomic_load_n (&labels->known[class_id], __ATOMIC_ACQUIRE))
+    return "";
+  return labels->label[class_id];
+}
+
+void
+frame_snapshot_fill (FrameSnapshot *snapshot, NvDsFrameMeta *frame_meta,
+    ClassLabelTable *labels)
+{
+  NvDsMetaList *l_obj = NULL;
+  NvDsObjectMeta *obj_meta = NULL;
+  guint n = 0;
+
+  snapshot->source_id = frame_meta->source_id;
+  snapshot->frame_num = frame_meta->frame_num;
+  snapshot->frame_width = frame_meta->source_frame_width;
+  snapshot->frame_height = frame_meta->source_frame_height;
+
+  for (l_obj = frame_meta->obj_meta_list; l_obj != NULL && n < MAX_OBJ_NUM;
+      l_obj = l_obj->next) {
+    obj_meta = (NvDsObjectMeta *) (l_obj->data);
+    if (obj_meta == NULL) {
+      continue;
+    }
+    snapshot->object_id[n] = obj_meta->object_id;
+    snapshot->left[n] = obj_meta->rect_params.left;
+    snapshot->top[n] = obj_meta->rect_params.top;
+    snapshot->width[n] = obj_meta->rect_params.width;
+    snapshot->height[n] = obj_meta->rect_params.height;
+    snapshot->class_id[n] = obj_meta->class_id;
+    snapshot->confidence[n] = obj_meta->confidence;
+    if (labels)
+      class_label_table_record (labels, obj_meta);
+    n++;
+  }
+  snapshot->count = n;
+}
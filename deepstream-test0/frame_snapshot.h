@@ -0,0 +1,91 @@
+/*
+ * Copyright (c) 2018-2020, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+/**
+ * @file
+ * <b>Frame object snapshot</b>
+ *
+ * @b Description: Compact structure-of-arrays copy of the objects of one
+ * frame. It is filled from NvDsFrameMeta in the streaming thread and holds
+ * everything later stages need to decide on and build an event, so they
+ * never have to walk the metadata lists again.
+ */
+
+#ifndef FRAME_SNAPSHOT_H_
+#define FRAME_SNAPSHOT_H_
+
+#include "gstnvdsmeta.h"
+#include "custom_meta_schema.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define MAX_CLASS_LABELS 64
+
+/**
+ * Labels of the detector classes. Labels are the same for every object of a
+ * class, so they are copied once the first time a class is seen instead of
+ * with every object.
+ */
+typedef struct
+{
+  gint known[MAX_CLASS_LABELS];
+  gchar label[MAX_CLASS_LABELS][MAX_LABEL_SIZE];
+} ClassLabelTable;
+
+typedef struct
+{
+  guint source_id;
+  gint frame_num;
+  guint frame_width;
+  guint frame_height;
+
+  guint count;
+  /** Object ids, UNTRACKED_OBJECT_ID for objects without a track. */
+  guint64 object_id[MAX_OBJ_NUM];
+  gfloat left[MAX_OBJ_NUM];
+  gfloat top[MAX_OBJ_NUM];
+  gfloat width[MAX_OBJ_NUM];
+  gfloat height[MAX_OBJ_NUM];
+  gint class_id[MAX_OBJ_NUM];
+  gfloat confidence[MAX_OBJ_NUM];
+} FrameSnapshot;
+
+/**
+ * Copies up to MAX_OBJ_NUM objects of @frame_meta into @snapshot, and the
+ * labels of classes not seen before into @labels if it is not NULL.
+ */
+void frame_snapshot_fill (FrameSnapshot *snapshot, NvDsFrameMeta *frame_meta,
+    ClassLabelTable *labels);
+
+/**
+ * Returns the label recorded for @class_id, or an empty string.
+ */
+const gchar *class_label_table_get (ClassLabelTable *labels, gint class_id);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* FRAME_SNAPSHOT_H_ */
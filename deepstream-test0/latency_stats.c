@@ -0,0 +1,502 @@
+/*
+ * Copyright (c) 2018-2020, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include <gio/gio.h>
+#include <string.h>
+
+#include "gstnvdsmeta.h"
+#include "latency_stats.h"
+
+#define LATENCY_STAMP_META_TYPE "NVIDIA.DSTEST0.LATENCY_STAMP"
+
+/* Log-linear buckets: values below 2^SUB_BUCKET_BITS+1 get their own bucket,
+ * every power of two above is split into 2^SUB_BUCKET_BITS buckets, which
+ * bounds the relative error to about 6%. Values are in microseconds. */
+#define SUB_BUCKET_BITS 4
+#define SUB_BUCKETS (1 << SUB_BUCKET_BITS)
+#define LINEAR_LIMIT (2 * SUB_BUCKETS)
+#define MAX_MAGNITUDE 40
+#define NUM_BUCKETS (LINEAR_LIMIT + (MAX_MAGNITUDE - SUB_BUCKET_BITS) * SUB_BUCKETS)
+
+#define LATENCY_METRIC_E2E LATENCY_STAGE_COUNT
+#define LATENCY_METRIC_COUNT (LATENCY_STAGE_COUNT + 1)
+
+#define HTTP_READ_TIMEOUT_SEC 1
+
+static const gchar *metric_names[LATENCY_METRIC_COUNT] = {
+  "streammux", "pgie", "tiler", "nvosd", "tee", "msgconv", "msgbroker", "e2e"
+};
+
+static const gdouble quantiles[] = { 0.5, 0.9, 0.99, 0.999 };
+
+typedef struct
+{
+  guint64 count;
+  guint64 sum_us;
+  guint64 max_us;
+  guint64 buckets[NUM_BUCKETS];
+} LatencyHistogram;
+
+typedef struct
+{
+  LatencyHistogram metrics[LATENCY_METRIC_COUNT];
+} LatencyGroup;
+
+/* Monotonic time at which the batch passed each stage point, 0 if it
+ * didn't. */
+typedef struct
+{
+  gint64 stamp_us[LATENCY_STAGE_COUNT];
+} LatencyStamp;
+
+typedef struct
+{
+  LatencyStats *stats;
+  LatencyStage stage;
+} StageProbe;
+
+/* One metrics request, read and answered without blocking the main loop. */
+typedef struct
+{
+  LatencyStats *stats;
+  GCancellable *cancellable;
+  GSocketConnection *connection;
+  gchar request[1024];
+  gchar *response;
+} MetricsRequest;
+
+struct _LatencyStats
+{
+  guint num_sources;
+  NvDsMetaType stamp_meta_type;
+  StageProbe probes[LATENCY_STAGE_COUNT];
+  /* Aggregate first, then one group per source. */
+  LatencyGroup *groups;
+
+  GSocketService *service;
+  /* Cancels the requests in flight when the statistics are freed. */
+  GCancellable *cancellable;
+  gchar *dump_path;
+  guint dump_source_id;
+};
+
+static guint
+bucket_index (guint64 value)
+{
+  guint magnitude;
+
+  if (value < LINEAR_LIMIT)
+    return (guint) value;
+
+  magnitude = 63 - __builtin_clzll (value);
+  if (magnitude > MAX_MAGNITUDE)
+    return NUM_BUCKETS - 1;
+  return LINEAR_LIMIT + (magnitude - SUB_BUCKET_BITS - 1) * SUB_BUCKETS +
+      (guint) ((value >> (magnitude - SUB_BUCKET_BITS)) - SUB_BUCKETS);
+}
+
+/* Midpoint of the range covered by bucket @index. */
+static guint64
+bucket_value (guint index)
+{
+  guint magnitude, sub;
+  guint64 width;
+
+  if (index < LINEAR_LIMIT)
+    return index;
+
+  magnitude = (index - LINEAR_LIMIT) / SUB_BUCKETS + SUB_BUCKET_BITS + 1;
+  sub = (index - LINEAR_LIMIT) % SUB_BUCKETS + SUB_BUCKETS;
+  width = (guint64) 1 << (magnitude - SUB_BUCKET_BITS);
+  return sub * width + width / 2;
+}
+
+static void
+histogram_record (LatencyHistogram *hist, gint64 value_us)
+{
+  guint64 value = value_us > 0 ? (guint64) value_us : 0;
+  guint64 max = __atomic_load_n (&hist->max_us, __ATOMIC_RELAXED);
+
+  __atomic_fetch_add (&hist->buckets[bucket_index (value)], 1,
+      __ATOMIC_RELAXED);
+  __atomic_fetch_add (&hist->count, 1, __ATOMIC_RELAXED);
+  __atomic_fetch_add (&hist->sum_us, value, __ATOMIC_RELAXED);
+  while (value > max && !__atomic_compare_exchange_n (&hist->max_us, &max,
+          value, TRUE, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+static void
+record (LatencyStats *stats, guint source_id, guint metric, gint64 value_us)
+{
+  if (source_id < stats->num_sources)
+    histogram_record (&stats->groups[1 + source_id].metrics[metric], value_us);
+}
+
+static gpointer
+stamp_copy_func (gpointer data, gpointer user_data)
+{
+  NvDsUserMeta *user_meta = (NvDsUserMeta *) data;
+
+  return g_memdup (user_meta->user_meta_data, sizeof (LatencyStamp));
+}
+
+static void
+stamp_free_func (gpointer data, gpointer user_data)
+{
+  NvDsUserMeta *user_meta = (NvDsUserMeta *) data;
+
+  g_free (user_meta->user_meta_data);
+  user_meta->user_meta_data = NULL;
+}
+
+static LatencyStamp *
+attach_stamp (LatencyStats *stats, NvDsBatchMeta *batch_meta)
+{
+  NvDsUserMeta *user_meta = nvds_acquire_user_meta_from_pool (batch_meta);
+
+  if (!user_meta)
+    return NULL;
+  user_meta->user_meta_data = g_malloc0 (sizeof (LatencyStamp));
+  user_meta->base_meta.meta_type = stats->stamp_meta_type;
+  user_meta->base_meta.copy_func = (NvDsMetaCopyFunc) stamp_copy_func;
+  user_meta->base_meta.release_func = (NvDsMetaReleaseFunc) stamp_free_func;
+  nvds_add_user_meta_to_batch (batch_meta, user_meta);
+  return (LatencyStamp *) user_meta->user_meta_data;
+}
+
+static LatencyStamp *
+find_stamp (LatencyStats *stats, NvDsBatchMeta *batch_meta)
+{
+  NvDsMetaList *l_user = NULL;
+
+  for (l_user = batch_meta->batch_user_meta_list; l_user != NULL;
+      l_user = l_user->next) {
+    NvDsUserMeta *user_meta = (NvDsUserMeta *) (l_user->data);
+    if (user_meta && user_meta->base_meta.meta_type == stats->stamp_meta_type)
+      return (LatencyStamp *) user_meta->user_meta_data;
+  }
+  return NULL;
+}
+
+static GstPadProbeReturn
+latency_probe (GstPad * pad, GstPadProbeInfo * info, gpointer u_data)
+{
+  StageProbe *probe = (StageProbe *) u_data;
+  LatencyStats *stats = probe->stats;
+  LatencyStage stage = probe->stage;
+  LatencyGroup *all = &stats->groups[0];
+  NvDsMetaList *l_frame = NULL;
+  LatencyStamp *stamp = NULL;
+  gint64 now = g_get_monotonic_time ();
+  gint64 now_real_ns = g_get_real_time () * 1000;
+  gint64 delta = 0;
+
+  NvDsBatchMeta *batch_meta =
+      gst_buffer_get_nvds_batch_meta ((GstBuffer *) info->data);
+  if (!batch_meta)
+    return GST_PAD_PROBE_OK;
+
+  if (stage == LATENCY_STAGE_STREAMMUX) {
+    stamp = attach_stamp (stats, batch_meta);
+  } else {
+    stamp = find_stamp (stats, batch_meta);
+    if (stamp && stamp->stamp_us[stage - 1]) {
+      delta = now - stamp->stamp_us[stage - 1];
+      histogram_record (&all->metrics[stage], delta);
+    }
+  }
+  if (!stamp)
+    return GST_PAD_PROBE_OK;
+  stamp->stamp_us[stage] = now;
+
+  for (l_frame = batch_meta->frame_meta_list; l_frame != NULL;
+      l_frame = l_frame->next) {
+    NvDsFrameMeta *frame_meta = (NvDsFrameMeta *) (l_frame->data);
+    gint64 arrival_wait;
+
+    if (frame_meta == NULL)
+      continue;
+
+    /* The muxer stamps the system time at which it received each frame
+     * into ntp_timestamp, which gives per-source wait and end to end
+     * times. */
+    arrival_wait = frame_meta->ntp_timestamp ?
+        (now_real_ns - (gint64) frame_meta->ntp_timestamp) / 1000 : 0;
+
+    if (stage == LATENCY_STAGE_STREAMMUX) {
+      histogram_record (&all->metrics[stage], arrival_wait);
+      record (stats, frame_meta->source_id, stage, arrival_wait);
+      continue;
+    }
+
+    if (delta)
+      record (stats, frame_meta->source_id, stage, delta);
+
+    if (stage == LATENCY_STAGE_MSGBROKER) {
+      gint64 e2e = frame_meta->ntp_timestamp ? arrival_wait :
+          now - stamp->stamp_us[LATENCY_STAGE_STREAMMUX];
+      histogram_record (&all->metrics[LATENCY_METRIC_E2E], e2e);
+      record (stats, frame_meta->source_id, LATENCY_METRIC_E2E, e2e);
+    }
+  }
+  return GST_PAD_PROBE_OK;
+}
+
+LatencyStats *
+latency_stats_new (guint num_sources)
+{
+  LatencyStats *stats = g_new0 (LatencyStats, 1);
+  guint i;
+
+  stats->num_sources = num_sources;
+  stats->stamp_meta_type =
+      nvds_get_user_meta_type ((gchar *) LATENCY_STAMP_META_TYPE);
+  stats->groups = g_new0 (LatencyGroup, num_sources + 1);
+  for (i = 0; i < LATENCY_STAGE_COUNT; i++) {
+    stats->probes[i].stats = stats;
+    stats->probes[i].stage = (LatencyStage) i;
+  }
+  return stats;
+}
+
+void
+latency_stats_free (LatencyStats *stats)
+{
+  if (!stats)
+    return;
+  if (stats->service) {
+    g_cancellable_cancel (stats->cancellable);
+    g_socket_service_stop (stats->service);
+    g_socket_listener_close (G_SOCKET_LISTENER (stats->service));
+    g_object_unref (stats->service);
+    g_object_unref (stats->cancellable);
+  }
+  if (stats->dump_source_id)
+    g_source_remove (stats->dump_source_id);
+  g_free (stats->dump_path);
+  g_free (stats->groups);
+  g_free (stats);
+}
+
+void
+latency_stats_add_probe (LatencyStats *stats, GstPad *pad, LatencyStage stage)
+{
+  gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_BUFFER, latency_probe,
+      &stats->probes[stage], NULL);
+}
+
+static void
+append_histogram (GString *out, LatencyHistogram *hist, const gchar *labels)
+{
+  guint64 buckets[NUM_BUCKETS];
+  guint64 count = 0, seen = 0;
+  guint i, q = 0;
+
+  for (i = 0; i < NUM_BUCKETS; i++) {
+    buckets[i] = __atomic_load_n (&hist->buckets[i], __ATOMIC_RELAXED);
+    count += buckets[i];
+  }
+  if (count == 0)
+    return;
+
+  for (i = 0; i < NUM_BUCKETS && q < G_N_ELEMENTS (quantiles); i++) {
+    seen += buckets[i];
+    while (q < G_N_ELEMENTS (quantiles) && seen >= quantiles[q] * count) {
+      g_string_append_printf (out,
+          "dstest0_latency_seconds{%s,quantile=\"%g\"} %.6f\n", labels,
+          quantiles[q], bucket_value (i) / 1e6);
+      q++;
+    }
+  }
+  g_string_append_printf (out, "dstest0_latency_seconds_sum{%s} %.6f\n",
+      labels, __atomic_load_n (&hist->sum_us, __ATOMIC_RELAXED) / 1e6);
+  g_string_append_printf (out, "dstest0_latency_seconds_count{%s} %"
+      G_GUINT64_FORMAT "\n", labels, count);
+  g_string_append_printf (out, "dstest0_latency_max_seconds{%s} %.6f\n",
+      labels, __atomic_load_n (&hist->max_us, __ATOMIC_RELAXED) / 1e6);
+}
+
+gchar *
+latency_stats_to_prometheus (LatencyStats *stats)
+{
+  GString *out = g_string_new (NULL);
+  gchar labels[64];
+  guint g, m;
+
+  g_string_append (out,
+      "# HELP dstest0_latency_seconds Time spent since the previous stage "
+      "point.\n"
+      "# TYPE dstest0_latency_seconds summary\n"
+      "# HELP dstest0_latency_max_seconds Largest latency seen.\n"
+      "# TYPE dstest0_latency_max_seconds gauge\n");
+
+  for (g = 0; g <= stats->num_sources; g++) {
+    for (m = 0; m < LATENCY_METRIC_COUNT; m++) {
+      if (g == 0)
+        g_snprintf (labels, sizeof (labels), "stage=\"%s\",source=\"all\"",
+            metric_names[m]);
+      else
+        g_snprintf (labels, sizeof (labels), "stage=\"%s\",source=\"%u\"",
+            metric_names[m], g - 1);
+      append_histogram (out, &stats->groups[g].metrics[m], labels);
+    }
+  }
+  return g_string_free (out, FALSE);
+}
+
+static void
+metrics_request_free (MetricsRequest *req)
+{
+  g_io_stream_close (G_IO_STREAM (req->connection), NULL, NULL);
+  g_object_unref (req->connection);
+  g_object_unref (req->cancellable);
+  g_free (req->response);
+  g_free (req);
+}
+
+static void
+on_metrics_written (GObject *source_object, GAsyncResult *res,
+    gpointer user_data)
+{
+  MetricsRequest *req = (MetricsRequest *) user_data;
+
+  g_output_stream_write_all_finish (G_OUTPUT_STREAM (source_object), res,
+      NULL, NULL);
+  metrics_request_free (req);
+}
+
+static void
+on_metrics_request_read (GObject *source_object, GAsyncResult *res,
+    gpointer user_data)
+{
+  MetricsRequest *req = (MetricsRequest *) user_data;
+  GOutputStream *out;
+  gchar *body;
+
+  /* A failed or timed out read still gets the metrics, only a cancelled
+   * one means the statistics are gone. */
+  g_input_stream_read_finish (G_INPUT_STREAM (source_object), res, NULL);
+  if (g_cancellable_is_cancelled (req->cancellable)) {
+    metrics_request_free (req);
+    return;
+  }
+
+  body = latency_stats_to_prometheus (req->stats);
+  req->response = g_strdup_printf ("HTTP/1.0 200 OK\r\n"
+      "Content-Type: text/plain; version=0.0.4\r\n"
+      "Content-Length: %u\r\n"
+      "Connection: close\r\n\r\n%s", (guint) strlen (body), body);
+  g_free (body);
+
+  out = g_io_stream_get_output_stream (G_IO_STREAM (req->connection));
+  g_output_stream_write_all_async (out, req->response,
+      strlen (req->response), G_PRIORITY_DEFAULT, req->cancellable,
+      on_metrics_written, req);
+}
+
+static gboolean
+on_metrics_request (GSocketService *service, GSocketConnection *connection,
+    GObject *source_object, gpointer user_data)
+{
+  LatencyStats *stats = (LatencyStats *) user_data;
+  MetricsRequest *req = g_new0 (MetricsRequest, 1);
+
+  req->stats = stats;
+  req->cancellable = (GCancellable *) g_object_ref (stats->cancellable);
+  req->connection = (GSocketConnection *) g_object_ref (connection);
+
+  /* Any request gets the metrics; read it so the client sees a clean
+   * close. The read and the answer run from the main loop without
+   * blocking it, and a silent client is given up on after the timeout. */
+  g_socket_set_timeout (g_socket_connection_get_socket (connection),
+      HTTP_READ_TIMEOUT_SEC);
+  g_input_stream_read_async (
+      g_io_stream_get_input_stream (G_IO_STREAM (connection)), req->request,
+      sizeof (req->request), G_PRIORITY_DEFAULT, req->cancellable,
+      on_metrics_request_read, req);
+  return TRUE;
+}
+
+gboolean
+latency_stats_serve (LatencyStats *stats, guint port)
+{
+  GInetAddress *address = NULL;
+  GSocketAddress *socket_address = NULL;
+  GError *error = NULL;
+  gboolean ret;
+
+  stats->service = g_socket_service_new ();
+  address = g_inet_address_new_loopback (G_SOCKET_FAMILY_IPV4);
+  socket_address = g_inet_socket_address_new (address, port);
+  ret = g_socket_listener_add_address (G_SOCKET_LISTENER (stats->service),
+      socket_address, G_SOCKET_TYPE_STREAM, G_SOCKET_PROTOCOL_TCP, NULL, NULL,
+      &error);
+  g_object_unref (socket_address);
+  g_object_unref (address);
+
+  if (!ret) {
+    g_printerr ("Failed to serve metrics on port %u: %s\n", port,
+        error->message);
+    g_error_free (error);
+    g_object_unref (stats->service);
+    stats->service = NULL;
+    return FALSE;
+  }
+
+  stats->cancellable = g_cancellable_new ();
+  g_signal_connect (stats->service, "incoming",
+      G_CALLBACK (on_metrics_request), stats);
+  g_socket_service_start (stats->service);
+  return TRUE;
+}
+
+static gboolean
+dump_metrics (gpointer user_data)
+{
+  LatencyStats *stats = (LatencyStats *) user_data;
+  GError *error = NULL;
+  gchar *text = latency_stats_to_prometheus (stats);
+
+  if (!g_file_set_contents (stats->dump_path, text, -1, &error)) {
+    g_printerr ("Failed to write metrics to %s: %s\n", stats->dump_path,
+        error->message);
+    g_error_free (error);
+  }
+  g_free (text);
+  return G_SOURCE_CONTINUE;
+}
+
+gboolean
+latency_stats_dump_to_file (LatencyStats *stats, const gchar *path,
+    guint interval_sec)
+{
+  if (!path || interval_sec == 0)
+    return FALSE;
+  g_free (stats->dump_path);
+  stats->dump_path = g_strdup (path);
+  if (stats->dump_source_id)
+    g_source_remove (stats->dump_source_id);
+  stats->dump_source_id = g_timeout_add_seconds (interval_sec, dump_metrics,
+      stats);
+  return TRUE;
+}
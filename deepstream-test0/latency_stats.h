@@ -0,0 +1,110 @@
+/*
+ * Copyright (c) 2018-2020, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+/**
+ * @file
+ * <b>Pipeline latency statistics</b>
+ *
+ * @b Description: Pad probes stamp each batch as it passes the stage points
+ * of the pipeline and record the time spent since the previous point into
+ * lock-free log-linear (HDR style) histograms, per source and aggregated.
+ * The first stamp travels with the batch as batch user meta, so no lookup
+ * table is needed to correlate the probes.
+ *
+ * Stage latencies:
+ *   streammux  time a frame waited in the muxer (from its arrival timestamp)
+ *   pgie       streammux src to pgie src, i.e. inference
+ *   tiler      pgie src to tiler src, including the tracker
+ *   nvosd      tiler src to nvosd src, including the video converter
+ *   tee        nvosd src to the tee pad feeding the message branch
+ *   msgconv    tee to msgconv sink, i.e. time queued in queue5
+ *   msgbroker  msgconv sink to msgbroker sink, i.e. payload generation
+ *   e2e        frame arrival at the muxer to msgbroker sink
+ *
+ * Statistics are exposed in the Prometheus text format, either served over
+ * HTTP on the loopback interface or dumped periodically to a file.
+ */
+
+#ifndef LATENCY_STATS_H_
+#define LATENCY_STATS_H_
+
+#include <gst/gst.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+typedef enum
+{
+  LATENCY_STAGE_STREAMMUX,
+  LATENCY_STAGE_PGIE,
+  LATENCY_STAGE_TILER,
+  LATENCY_STAGE_NVOSD,
+  LATENCY_STAGE_TEE,
+  LATENCY_STAGE_MSGCONV,
+  LATENCY_STAGE_MSGBROKER,
+  LATENCY_STAGE_COUNT
+} LatencyStage;
+
+typedef struct _LatencyStats LatencyStats;
+
+LatencyStats *latency_stats_new (guint num_sources);
+
+/**
+ * Stops serving and dumping. Probes must have been removed, e.g. by setting
+ * the pipeline to NULL, before this is called.
+ */
+void latency_stats_free (LatencyStats *stats);
+
+/**
+ * Adds the probe stamping @stage to @pad. Stages must be added on pads that
+ * batches traverse in the order of the LatencyStage enum.
+ */
+void latency_stats_add_probe (LatencyStats *stats, GstPad *pad,
+    LatencyStage stage);
+
+/**
+ * Returns the current statistics in the Prometheus text exposition format.
+ * Free with g_free().
+ */
+gchar *latency_stats_to_prometheus (LatencyStats *stats);
+
+/**
+ * Serves the statistics on http://127.0.0.1:@port/ from the default main
+ * context. Requests are read and answered asynchronously, so a slow client
+ * never holds the main loop.
+ */
+gboolean latency_stats_serve (LatencyStats *stats, guint port);
+
+/**
+ * Rewrites @path with the statistics every @interval_sec seconds from the
+ * default main context.
+ */
+gboolean latency_stats_dump_to_file (LatencyStats *stats, const gchar *path,
+    guint interval_sec);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* LATENCY_STATS_H_ */
@@ -0,0 +1,312 @@
+/*
+ * Copyright (c) 2018-2020, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "scene_change.h"
+
+#define CONFIG_GROUP_SENSOR "sensor"
+
+#define CONFIG_KEY_ENABLE "enable"
+#define CONFIG_KEY_IOU_THRESHOLD "iou-threshold"
+#define CONFIG_KEY_MIN_INTERVAL_MS "min-interval-ms"
+#define CONFIG_KEY_HEARTBEAT_INTERVAL_MS "heartbeat-interval-ms"
+
+#define DEFAULT_IOU_THRESHOLD 0.7
+#define DEFAULT_MIN_INTERVAL_MS 0
+#define DEFAULT_HEARTBEAT_INTERVAL_MS 10000
+
+typedef struct
+{
+  gdouble iou_threshold;
+  gint64 min_interval_us;
+  gint64 heartbeat_interval_us;
+} ScenePolicy;
+
+/* Boxes are kept as left/top/right/bottom in separate arrays, sorted by
+ * object id, so that matching tracks line up index by index and the IoU
+ * loops run over contiguous floats. */
+typedef struct
+{
+  guint count;
+  guint tracked;
+  guint64 id[MAX_OBJ_NUM];
+  gfloat l[MAX_OBJ_NUM];
+  gfloat t[MAX_OBJ_NUM];
+  gfloat r[MAX_OBJ_NUM];
+  gfloat b[MAX_OBJ_NUM];
+} SceneBoxes;
+
+typedef struct
+{
+  ScenePolicy policy;
+  gboolean has_reference;
+  gint64 last_emit_us;
+  SceneBoxes reference;
+} SourceScene;
+
+typedef struct
+{
+  guint64 id;
+  guint index;
+} IdIndex;
+
+struct _SceneChangeDetector
+{
+  gboolean enabled;
+  guint num_sources;
+  SourceScene *sources;
+
+  /* Scratch space for the frame being compared. */
+  SceneBoxes current;
+  IdIndex order[MAX_OBJ_NUM];
+  gfloat iou[MAX_OBJ_NUM];
+};
+
+static void
+parse_policy (GKeyFile *key_file, const gchar *group, ScenePolicy *policy)
+{
+  GError *error = NULL;
+  gdouble dval;
+  gint ival;
+
+  if (!g_key_file_has_group (key_file, group))
+    return;
+
+  dval = g_key_file_get_double (key_file, group, CONFIG_KEY_IOU_THRESHOLD,
+      &error);
+  if (!error)
+    policy->iou_threshold = CLAMP (dval, 0.0, 1.0);
+  g_clear_error (&error);
+
+  ival = g_key_file_get_integer (key_file, group, CONFIG_KEY_MIN_INTERVAL_MS,
+      &error);
+  if (!error)
+    policy->min_interval_us = (gint64) MAX (ival, 0) * 1000;
+  g_clear_error (&error);
+
+  ival = g_key_file_get_integer (key_file, group,
+      CONFIG_KEY_HEARTBEAT_INTERVAL_MS, &error);
+  if (!error)
+    policy->heartbeat_interval_us = (gint64) MAX (ival, 0) * 1000;
+  g_clear_error (&error);
+}
+
+SceneChangeDetector *
+scene_change_detector_new (const gchar *config_file, guint num_sources)
+{
+  SceneChangeDetector *detector = NULL;
+  GKeyFile *key_file = NULL;
+  GError *error = NULL;
+  ScenePolicy defaults = { DEFAULT_IOU_THRESHOLD,
+    (gint64) DEFAULT_MIN_INTERVAL_MS * 1000,
+    (gint64) DEFAULT_HEARTBEAT_INTERVAL_MS * 1000 };
+  gchar group[32];
+  guint i;
+
+  key_file = g_key_file_new ();
+  if (config_file && !g_key_file_load_from_file (key_file, config_file,
+          G_KEY_FILE_NONE, &error)) {
+    g_printerr ("Failed to load scene change config %s: %s\n", config_file,
+        error->message);
+    g_error_free (error);
+    g_key_file_free (key_file);
+    return NULL;
+  }
+
+  detector = g_new0 (SceneChangeDetector, 1);
+  detector->num_sources = num_sources;
+
+  if (g_key_file_has_group (key_file, SCENE_CHANGE_CONFIG_GROUP)) {
+    detector->enabled = g_key_file_get_boolean (key_file,
+        SCENE_CHANGE_CONFIG_GROUP, CONFIG_KEY_ENABLE, NULL);
+  }
+
+  if (detector->enabled) {
+    parse_policy (key_file, SCENE_CHANGE_CONFIG_GROUP, &defaults);
+    detector->sources = g_new0 (SourceScene, num_sources);
+    for (i = 0; i < num_sources; i++) {
+      detector->sources[i].policy = defaults;
+      g_snprintf (group, sizeof (group), CONFIG_GROUP_SENSOR "%u", i);
+      parse_policy (key_file, group, &detector->sources[i].policy);
+    }
+  }
+
+  g_key_file_free (key_file);
+  return detector;
+}
+
+void
+scene_change_detector_free (SceneChangeDetector *detector)
+{
+  if (!detector)
+    return;
+  g_free (detector->sources);
+  g_free (detector);
+}
+
+static int
+compare_id_index (const void *a, const void *b)
+{
+  guint64 ia = ((const IdIndex *) a)->id;
+  guint64 ib = ((const IdIndex *) b)->id;
+
+  return ia < ib ? -1 : (ia > ib ? 1 : 0);
+}
+
+/* Gathers the snapshot into id-sorted box arrays. Untracked objects carry
+ * the largest possible id and therefore end up after all tracked ones. */
+static void
+gather_sorted (SceneChangeDetector *detector, const FrameSnapshot *snapshot)
+{
+  SceneBoxes *cur = &detector->current;
+  guint i, k;
+
+  for (i = 0; i < snapshot->count; i++) {
+    detector->order[i].id = snapshot->object_id[i];
+    detector->order[i].index = i;
+  }
+  qsort (detector->order, snapshot->count, sizeof (IdIndex), compare_id_index);
+
+  cur->count = snapshot->count;
+  cur->tracked = 0;
+  for (i = 0; i < snapshot->count; i++) {
+    k = detector->order[i].index;
+    cur->id[i] = detector->order[i].id;
+    cur->l[i] = snapshot->left[k];
+    cur->t[i] = snapshot->top[k];
+    cur->r[i] = snapshot->left[k] + snapshot->width[k];
+    cur->b[i] = snapshot->top[k] + snapshot->height[k];
+    if (cur->id[i] != UNTRACKED_OBJECT_ID)
+      cur->tracked = i + 1;
+  }
+}
+
+/* Element-wise IoU of box i of a with box i of b. Written branch-free over
+ * separate coordinate arrays so the compiler can vectorize it. */
+static void
+batched_iou (const gfloat * restrict al, const gfloat * restrict at,
+    const gfloat * restrict ar, const gfloat * restrict ab,
+    const gfloat * restrict bl, const gfloat * restrict bt,
+    const gfloat * restrict br, const gfloat * restrict bb,
+    gfloat * restrict out, guint n)
+{
+  guint i;
+
+  for (i = 0; i < n; i++) {
+    gfloat iw = MIN (ar[i], br[i]) - MAX (al[i], bl[i]);
+    gfloat ih = MIN (ab[i], bb[i]) - MAX (at[i], bt[i]);
+    gfloat inter = MAX (iw, 0.0f) * MAX (ih, 0.0f);
+    gfloat uni = (ar[i] - al[i]) * (ab[i] - at[i]) +
+        (br[i] - bl[i]) * (bb[i] - bt[i]) - inter;
+    out[i] = uni > 0.0f ? inter / uni : 1.0f;
+  }
+}
+
+/* Best IoU of box (l, t, r, b) against n boxes starting at index first. */
+static gfloat
+best_iou (const SceneBoxes *ref, guint first, guint n, gfloat l, gfloat t,
+    gfloat r, gfloat b)
+{
+  gfloat best = 0.0f;
+  guint i;
+
+  for (i = first; i < first + n; i++) {
+    gfloat iw = MIN (r, ref->r[i]) - MAX (l, ref->l[i]);
+    gfloat ih = MIN (b, ref->b[i]) - MAX (t, ref->t[i]);
+    gfloat inter = MAX (iw, 0.0f) * MAX (ih, 0.0f);
+    gfloat uni = (r - l) * (b - t) +
+        (ref->r[i] - ref->l[i]) * (ref->b[i] - ref->t[i]) - inter;
+    gfloat iou = uni > 0.0f ? inter / uni : 1.0f;
+    best = MAX (best, iou);
+  }
+  return best;
+}
+
+static gboolean
+scene_changed (SceneChangeDetector *detector, const SceneBoxes *ref,
+    gfloat threshold)
+{
+  const SceneBoxes *cur = &detector->current;
+  guint i, n;
+
+  /* Tracking id join: both sides are sorted, so equal track sets means
+   * equal id arrays and matching tracks share the same index. */
+  if (cur->count != ref->count || cur->tracked != ref->tracked)
+    return TRUE;
+  n = cur->tracked;
+  if (memcmp (cur->id, ref->id, n * sizeof (guint64)) != 0)
+    return TRUE;
+
+  batched_iou (cur->l, cur->t, cur->r, cur->b, ref->l, ref->t, ref->r, ref->b,
+      detector->iou, n);
+  for (i = 0; i < n; i++) {
+    if (detector->iou[i] < threshold)
+      return TRUE;
+  }
+
+  /* Untracked objects have no identity, match each by its best IoU. */
+  for (i = n; i < cur->count; i++) {
+    if (best_iou (ref, n, ref->count - n, cur->l[i], cur->t[i], cur->r[i],
+            cur->b[i]) < threshold)
+      return TRUE;
+  }
+  return FALSE;
+}
+
+gboolean
+scene_change_should_emit (SceneChangeDetector *detector,
+    const FrameSnapshot *snapshot)
+{
+  SourceScene *scene;
+  gint64 now, elapsed;
+  gboolean emit;
+
+  if (!detector || !detector->enabled)
+    return TRUE;
+  if (snapshot->source_id >= detector->num_sources)
+    return FALSE;
+
+  scene = &detector->sources[snapshot->source_id];
+  now = g_get_monotonic_time ();
+  elapsed = now - scene->last_emit_us;
+
+  if (scene->has_reference && elapsed < scene->policy.min_interval_us)
+    return FALSE;
+
+  gather_sorted (detector, snapshot);
+
+  emit = !scene->has_reference ||
+      (scene->policy.heartbeat_interval_us &&
+      elapsed >= scene->policy.heartbeat_interval_us) ||
+      scene_changed (detector, &scene->reference,
+      (gfloat) scene->policy.iou_threshold);
+  if (!emit)
+    return FALSE;
+
+  memcpy (&scene->reference, &detector->current, sizeof (SceneBoxes));
+  scene->has_reference = TRUE;
+  scene->last_emit_us = now;
+  return TRUE;
+}
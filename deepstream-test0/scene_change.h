@@ -0,0 +1,81 @@
+/*
+ * Copyright (c) 2018-2020, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file
+ * <b>Scene change detection</b>
+ *
+ * @b Description: Keeps the object set of the last event emitted for each
+ * source and only lets a new event through when the scene changed: a track
+ * appeared or disappeared, or a track moved so that the IoU with its previous
+ * box fell below the threshold. Objects without a tracking id are matched to
+ * the previous boxes by best IoU.
+ *
+ * Settings are read from the [scene-change] group of the event configuration
+ * file and can be overridden per source in [sensorN] groups:
+ *
+ *   enable=1                 turn the detector on
+ *   iou-threshold=F          a matched box with IoU below F is a change
+ *   min-interval-ms=N        never emit more often than every N ms
+ *   heartbeat-interval-ms=N  emit after N ms even if nothing changed
+ *                            (0 disables)
+ *
+ * The detector is only consulted for frames the sampler selected, so the
+ * heartbeat is bounded below by the sampling interval.
+ */
+
+#ifndef SCENE_CHANGE_H_
+#define SCENE_CHANGE_H_
+
+#include "frame_snapshot.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define SCENE_CHANGE_CONFIG_GROUP "scene-change"
+
+typedef struct _SceneChangeDetector SceneChangeDetector;
+
+/**
+ * Creates a detector for @num_sources sources. Returns NULL if the
+ * configuration can't be parsed. A detector whose [scene-change] group is
+ * missing or disabled lets every frame through.
+ */
+SceneChangeDetector *scene_change_detector_new (const gchar *config_file,
+    guint num_sources);
+
+void scene_change_detector_free (SceneChangeDetector *detector);
+
+/**
+ * Compares the objects of @snapshot with the last emitted set of its
+ * source. Returns TRUE, and remembers the snapshot's objects as the new
+ * reference, if an event should be emitted.
+ */
+gboolean scene_change_should_emit (SceneChangeDetector *detector,
+    const FrameSnapshot *snapshot);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* SCENE_CHANGE_H_ */
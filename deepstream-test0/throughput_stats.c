@@ -0,0 +1,258 @@
+/*
+ * Copyright (c) 2018-2020, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include <string.h>
+
+#include "throughput_stats.h"
+
+#define CACHE_LINE_SIZE 64
+
+typedef struct
+{
+  guint64 frames;
+  guint64 objects[THROUGHPUT_NUM_CLASSES];
+  guint64 events_emitted;
+  guint64 events_dropped;
+} ThroughputCounters;
+
+/* Sources are updated from different threads, keep them on separate
+ * cache lines. */
+typedef struct
+{
+  ThroughputCounters counters;
+} __attribute__ ((aligned (CACHE_LINE_SIZE))) SourceCounters;
+
+/* Counters of all sources at one report. */
+typedef struct
+{
+  gint64 time_us;
+  ThroughputCounters *sources;
+} ThroughputSample;
+
+struct _ThroughputStats
+{
+  guint num_sources;
+  gchar *class_names[THROUGHPUT_NUM_CLASSES];
+  SourceCounters *sources;
+
+  /* Sliding window, only touched from the main context. */
+  ThroughputSample *samples;
+  guint num_samples;
+  guint next_sample;
+  guint samples_taken;
+  guint report_source_id;
+};
+
+static inline void
+counter_add (guint64 *counter, guint64 value)
+{
+  __atomic_fetch_add (counter, value, __ATOMIC_RELAXED);
+}
+
+ThroughputStats *
+throughput_stats_new (guint num_sources, const gchar *const *class_names)
+{
+  ThroughputStats *stats = g_new0 (ThroughputStats, 1);
+  guint i;
+
+  stats->num_sources = num_sources;
+  for (i = 0; i < THROUGHPUT_NUM_CLASSES; i++)
+    stats->class_names[i] = g_strdup (class_names[i]);
+  stats->sources = g_new0 (SourceCounters, num_sources);
+  return stats;
+}
+
+static void
+free_samples (ThroughputStats *stats)
+{
+  guint i;
+
+  for (i = 0; i < stats->num_samples; i++)
+    g_free (stats->samples[i].sources);
+  g_free (stats->samples);
+  stats->samples = NULL;
+  stats->num_samples = 0;
+}
+
+void
+throughput_stats_free (ThroughputStats *stats)
+{
+  guint i;
+
+  if (!stats)
+    return;
+  if (stats->report_source_id)
+    g_source_remove (stats->report_source_id);
+  free_samples (stats);
+  for (i = 0; i < THROUGHPUT_NUM_CLASSES; i++)
+    g_free (stats->class_names[i]);
+  g_free (stats->sources);
+  g_free (stats);
+}
+
+void
+throughput_stats_add_frame (ThroughputStats *stats, guint source_id,
+    const guint *class_counts)
+{
+  ThroughputCounters *counters;
+  guint i;
+
+  if (source_id >= stats->num_sources)
+    return;
+  counters = &stats->sources[source_id].counters;
+  counter_add (&counters->frames, 1);
+  for (i = 0; i < THROUGHPUT_NUM_CLASSES; i++) {
+    if (class_counts[i])
+      counter_add (&counters->objects[i], class_counts[i]);
+  }
+}
+
+void
+throughput_stats_event_emitted (ThroughputStats *stats, guint source_id)
+{
+  if (stats && source_id < stats->num_sources)
+    counter_add (&stats->sources[source_id].counters.events_emitted, 1);
+}
+
+void
+throughput_stats_event_dropped (ThroughputStats *stats, guint source_id)
+{
+  if (stats && source_id < stats->num_sources)
+    counter_add (&stats->sources[source_id].counters.events_dropped, 1);
+}
+
+static void
+take_sample (ThroughputStats *stats, ThroughputSample *sample)
+{
+  guint s, i;
+
+  sample->time_us = g_get_monotonic_time ();
+  for (s = 0; s < stats->num_sources; s++) {
+    ThroughputCounters *from = &stats->sources[s].counters;
+    ThroughputCounters *to = &sample->sources[s];
+
+    to->frames = __atomic_load_n (&from->frames, __ATOMIC_RELAXED);
+    for (i = 0; i < THROUGHPUT_NUM_CLASSES; i++)
+      to->objects[i] = __atomic_load_n (&from->objects[i], __ATOMIC_RELAXED);
+    to->events_emitted =
+        __atomic_load_n (&from->events_emitted, __ATOMIC_RELAXED);
+    to->events_dropped =
+        __atomic_load_n (&from->events_dropped, __ATOMIC_RELAXED);
+  }
+}
+
+static void
+append_rates (GString *line, ThroughputStats *stats,
+    const ThroughputCounters *now, const ThroughputCounters *then,
+    gdouble seconds)
+{
+  guint64 frames = now->frames - then->frames;
+  guint i;
+
+  g_string_append_printf (line, "%.1f fps", frames / seconds);
+  for (i = 0; i < THROUGHPUT_NUM_CLASSES; i++) {
+    g_string_append_printf (line, ", %s %.2f/frame", stats->class_names[i],
+        frames ? (gdouble) (now->objects[i] - then->objects[i]) / frames : 0.0);
+  }
+  g_string_append_printf (line, ", events %.2f/s, dropped %.2f/s",
+      (now->events_emitted - then->events_emitted) / seconds,
+      (now->events_dropped - then->events_dropped) / seconds);
+}
+
+static gboolean
+report (gpointer user_data)
+{
+  ThroughputStats *stats = (ThroughputStats *) user_data;
+  ThroughputSample *now = &stats->samples[stats->next_sample];
+  ThroughputSample *oldest;
+  ThroughputCounters total_now, total_then;
+  GString *out = NULL;
+  gdouble seconds;
+  guint s, i;
+
+  take_sample (stats, now);
+  stats->samples_taken++;
+  /* The oldest sample still in the window is the next one to be
+   * overwritten, or the first one until the window has filled up. */
+  stats->next_sample = (stats->next_sample + 1) % stats->num_samples;
+  oldest = stats->samples_taken < stats->num_samples ? &stats->samples[0] :
+      &stats->samples[stats->next_sample];
+  if (oldest == now)
+    return G_SOURCE_CONTINUE;
+
+  seconds = (now->time_us - oldest->time_us) / (gdouble) G_USEC_PER_SEC;
+  memset (&total_now, 0, sizeof (total_now));
+  memset (&total_then, 0, sizeof (total_then));
+
+  out = g_string_new (NULL);
+  for (s = 0; s < stats->num_sources; s++) {
+    ThroughputCounters *a = &now->sources[s];
+    ThroughputCounters *b = &oldest->sources[s];
+
+    g_string_append_printf (out, "Source %u: ", s);
+    append_rates (out, stats, a, b, seconds);
+    g_string_append_c (out, '\n');
+
+    total_now.frames += a->frames;
+    total_then.frames += b->frames;
+    for (i = 0; i < THROUGHPUT_NUM_CLASSES; i++) {
+      total_now.objects[i] += a->objects[i];
+      total_then.objects[i] += b->objects[i];
+    }
+    total_now.events_emitted += a->events_emitted;
+    total_then.events_emitted += b->events_emitted;
+    total_now.events_dropped += a->events_dropped;
+    total_then.events_dropped += b->events_dropped;
+  }
+  g_string_append_printf (out, "All sources (last %.0fs): ", seconds);
+  append_rates (out, stats, &total_now, &total_then, seconds);
+  g_string_append_c (out, '\n');
+
+  g_print ("%s", out->str);
+  g_string_free (out, TRUE);
+  return G_SOURCE_CONTINUE;
+}
+
+void
+throughput_stats_start_report (ThroughputStats *stats, guint interval_sec,
+    guint window_sec)
+{
+  guint i;
+
+  if (stats->report_source_id)
+    g_source_remove (stats->report_source_id);
+  free_samples (stats);
+
+  interval_sec = MAX (interval_sec, 1);
+  /* One sample per report plus the one at the start of the window. */
+  stats->num_samples = MAX (window_sec / interval_sec, 1) + 1;
+  stats->samples = g_new0 (ThroughputSample, stats->num_samples);
+  for (i = 0; i < stats->num_samples; i++)
+    stats->samples[i].sources = g_new0 (ThroughputCounters, stats->num_sources);
+
+  take_sample (stats, &stats->samples[0]);
+  stats->next_sample = 1;
+  stats->samples_taken = 1;
+  stats->report_source_id = g_timeout_add_seconds (interval_sec, report,
+      stats);
+}
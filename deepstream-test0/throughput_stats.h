@@ -0,0 +1,85 @@
+/*
+ * Copyright (c) 2018-2020, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+/**
+ * @file
+ * <b>Per-source throughput statistics</b>
+ *
+ * @b Description: Counts frames, objects per class and events per source
+ * with relaxed atomic increments, so the streaming threads never format or
+ * write output. A timer on the default main context snapshots the counters
+ * and prints rates over a sliding window of recent reports.
+ */
+
+#ifndef THROUGHPUT_STATS_H_
+#define THROUGHPUT_STATS_H_
+
+#include <glib.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/** Number of classes counted, matching the classes of the primary model. */
+#define THROUGHPUT_NUM_CLASSES 4
+
+typedef struct _ThroughputStats ThroughputStats;
+
+/**
+ * Creates counters for @num_sources sources. @class_names holds
+ * THROUGHPUT_NUM_CLASSES names used in the report.
+ */
+ThroughputStats *throughput_stats_new (guint num_sources,
+    const gchar *const *class_names);
+
+/**
+ * Stops reporting. The counters must no longer be updated when this is
+ * called.
+ */
+void throughput_stats_free (ThroughputStats *stats);
+
+/**
+ * Counts one frame of @source_id holding @class_counts objects of each
+ * class. Objects of other classes are not counted.
+ */
+void throughput_stats_add_frame (ThroughputStats *stats, guint source_id,
+    const guint *class_counts);
+
+/** Counts an event of @source_id handed to the message converter. */
+void throughput_stats_event_emitted (ThroughputStats *stats, guint source_id);
+
+/** Counts an event of @source_id lost before reaching the converter. */
+void throughput_stats_event_dropped (ThroughputStats *stats, guint source_id);
+
+/**
+ * Prints rates every @interval_sec seconds, averaged over the last
+ * @window_sec seconds, from the default main context.
+ */
+void throughput_stats_start_report (ThroughputStats *stats,
+    guint interval_sec, guint window_sec);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* THROUGHPUT_STATS_H_ */
@@ -0,0 +1,453 @@
+/*
+ * Copyright (c) 2018-2020, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <math.h>
+#include <string.h>
+
+#include "trajectory.h"
+
+#define CONFIG_GROUP_SENSOR "sensor"
+
+#define CONFIG_KEY_ENABLE "enable"
+#define CONFIG_KEY_WINDOW_SIZE "window-size"
+#define CONFIG_KEY_MAX_TRACKS "max-tracks"
+#define CONFIG_KEY_EPSILON "epsilon"
+#define CONFIG_KEY_UPDATE_INTERVAL "update-interval"
+#define CONFIG_KEY_END_AFTER "end-after"
+
+#define DEFAULT_WINDOW_SIZE 64
+#define DEFAULT_MAX_TRACKS 128
+#define DEFAULT_EPSILON 4.0
+#define DEFAULT_UPDATE_INTERVAL 150
+#define DEFAULT_END_AFTER 30
+
+/* The last reported point and room for new ones. */
+#define MIN_WINDOW_SIZE 3
+
+typedef struct
+{
+  gdouble epsilon;
+  guint update_interval;
+  guint end_after;
+} TrajectoryPolicy;
+
+typedef struct
+{
+  guint64 id;
+  gboolean active;
+  gint class_id;
+  gint first_frame;
+  gint last_seen;
+  gint last_event;
+
+  /* Points not reported yet, after window[0], the last point reported. */
+  guint count;
+  NvDsTrackPoint *window;
+} Track;
+
+typedef struct
+{
+  TrajectoryPolicy policy;
+  Track *tracks;
+  /* Active tracks by id, keys point to Track.id. */
+  GHashTable *by_id;
+} SourceTracks;
+
+struct _TrajectoryTracker
+{
+  gboolean enabled;
+  guint window_size;
+  guint max_tracks;
+  guint num_sources;
+  SourceTracks *sources;
+  /* Windows of all tracks of all sources. */
+  NvDsTrackPoint *points;
+
+  /* Scratch space for the simplification. */
+  gboolean *keep;
+  guint *stack;
+};
+
+static void
+parse_policy (GKeyFile *key_file, const gchar *group,
+    TrajectoryPolicy *policy)
+{
+  GError *error = NULL;
+  gdouble dval;
+  gint ival;
+
+  if (!g_key_file_has_group (key_file, group))
+    return;
+
+  dval = g_key_file_get_double (key_file, group, CONFIG_KEY_EPSILON, &error);
+  if (!error)
+    policy->epsilon = MAX (dval, 0.0);
+  g_clear_error (&error);
+
+  ival = g_key_file_get_integer (key_file, group, CONFIG_KEY_UPDATE_INTERVAL,
+      &error);
+  if (!error)
+    policy->update_interval = MAX (ival, 0);
+  g_clear_error (&error);
+
+  ival = g_key_file_get_integer (key_file, group, CONFIG_KEY_END_AFTER,
+      &error);
+  if (!error)
+    policy->end_after = MAX (ival, 1);
+  g_clear_error (&error);
+}
+
+TrajectoryTracker *
+trajectory_tracker_new (const gchar *config_file, guint num_sources)
+{
+  TrajectoryTracker *tracker = NULL;
+  GKeyFile *key_file = NULL;
+  GError *error = NULL;
+  TrajectoryPolicy defaults = { DEFAULT_EPSILON, DEFAULT_UPDATE_INTERVAL,
+    DEFAULT_END_AFTER };
+  gint window_size = DEFAULT_WINDOW_SIZE;
+  gint max_tracks = DEFAULT_MAX_TRACKS;
+  gchar group[32];
+  guint i, t;
+
+  key_file = g_key_file_new ();
+  if (config_file && !g_key_file_load_from_file (key_file, config_file,
+          G_KEY_FILE_NONE, &error)) {
+    g_printerr ("Failed to load trajectory config %s: %s\n", config_file,
+        error->message);
+    g_error_free (error);
+    g_key_file_free (key_file);
+    return NULL;
+  }
+
+  tracker = g_new0 (TrajectoryTracker, 1);
+  tracker->enabled = g_key_file_get_boolean (key_file,
+      TRAJECTORY_CONFIG_GROUP, CONFIG_KEY_ENABLE, NULL);
+  if (!tracker->enabled) {
+    g_key_file_free (key_file);
+    return tracker;
+  }
+
+  if (g_key_file_has_key (key_file, TRAJECTORY_CONFIG_GROUP,
+          CONFIG_KEY_WINDOW_SIZE, NULL)) {
+    window_size = g_key_file_get_integer (key_file, TRAJECTORY_CONFIG_GROUP,
+        CONFIG_KEY_WINDOW_SIZE, NULL);
+  }
+  if (g_key_file_has_key (key_file, TRAJECTORY_CONFIG_GROUP,
+          CONFIG_KEY_MAX_TRACKS, NULL)) {
+    max_tracks = g_key_file_get_integer (key_file, TRAJECTORY_CONFIG_GROUP,
+        CONFIG_KEY_MAX_TRACKS, NULL);
+  }
+  if (window_size < MIN_WINDOW_SIZE || window_size > MAX_TRACK_POINTS) {
+    g_printerr ("Invalid " CONFIG_KEY_WINDOW_SIZE " %d, must be %d to %d\n",
+        window_size, MIN_WINDOW_SIZE, MAX_TRACK_POINTS);
+    g_key_file_free (key_file);
+    g_free (tracker);
+    return NULL;
+  }
+  if (max_tracks <= 0) {
+    g_printerr ("Invalid " CONFIG_KEY_MAX_TRACKS " %d\n", max_tracks);
+    g_key_file_free (key_file);
+    g_free (tracker);
+    return NULL;
+  }
+
+  parse_policy (key_file, TRAJECTORY_CONFIG_GROUP, &defaults);
+
+  tracker->window_size = window_size;
+  tracker->max_tracks = max_tracks;
+  tracker->num_sources = num_sources;
+  tracker->sources = g_new0 (SourceTracks, num_sources);
+  tracker->points = g_new (NvDsTrackPoint,
+      (gsize) num_sources * max_tracks * window_size);
+  tracker->keep = g_new (gboolean, window_size);
+  tracker->stack = g_new (guint, 2 * window_size);
+
+  for (i = 0; i < num_sources; i++) {
+    SourceTracks *source = &tracker->sources[i];
+
+    source->policy = defaults;
+    g_snprintf (group, sizeof (group), CONFIG_GROUP_SENSOR "%u", i);
+    parse_policy (key_file, group, &source->policy);
+
+    source->tracks = g_new0 (Track, max_tracks);
+    for (t = 0; t < (guint) max_tracks; t++) {
+      source->tracks[t].window = tracker->points +
+          ((gsize) i * max_tracks + t) * window_size;
+    }
+    source->by_id = g_hash_table_new (g_int64_hash, g_int64_equal);
+  }
+
+  g_key_file_free (key_file);
+  return tracker;
+}
+
+void
+trajectory_tracker_free (TrajectoryTracker *tracker)
+{
+  guint i;
+
+  if (!tracker)
+    return;
+  for (i = 0; i < tracker->num_sources; i++) {
+    g_hash_table_destroy (tracker->sources[i].by_id);
+    g_free (tracker->sources[i].tracks);
+  }
+  g_free (tracker->sources);
+  g_free (tracker->points);
+  g_free (tracker->keep);
+  g_free (tracker->stack);
+  g_free (tracker);
+}
+
+gboolean
+trajectory_tracker_enabled (const TrajectoryTracker *tracker)
+{
+  return tracker && tracker->enabled;
+}
+
+/* Distance of @p from the segment @a - @b. */
+static gdouble
+segment_distance (const NvDsTrackPoint *p, const NvDsTrackPoint *a,
+    const NvDsTrackPoint *b)
+{
+  gdouble dx = b->x - a->x;
+  gdouble dy = b->y - a->y;
+  gdouble len2 = dx * dx + dy * dy;
+  gdouble t = 0.0;
+  gdouble ex, ey;
+
+  if (len2 > 0.0) {
+    t = ((p->x - a->x) * dx + (p->y - a->y) * dy) / len2;
+    t = CLAMP (t, 0.0, 1.0);
+  }
+  ex = a->x + t * dx - p->x;
+  ey = a->y + t * dy - p->y;
+  return sqrt (ex * ex + ey * ey);
+}
+
+/* Drops the points of @track's window that Douglas-Peucker finds within
+ * @epsilon of the simplified line. The first and last points stay. */
+static void
+simplify (TrajectoryTracker *tracker, Track *track, gdouble epsilon)
+{
+  NvDsTrackPoint *window = track->window;
+  gboolean *keep = tracker->keep;
+  guint *stack = tracker->stack;
+  guint n = track->count;
+  guint top = 0, kept = 0;
+  guint first, last, index, i;
+  gdouble max, d;
+
+  if (n < 3)
+    return;
+
+  memset (keep, 0, n * sizeof (gboolean));
+  keep[0] = keep[n - 1] = TRUE;
+  stack[top++] = 0;
+  stack[top++] = n - 1;
+
+  while (top) {
+    last = stack[--top];
+    first = stack[--top];
+    max = epsilon;
+    index = 0;
+    for (i = first + 1; i < last; i++) {
+      d = segment_distance (&window[i], &window[first], &window[last]);
+      if (d > max) {
+        max = d;
+        index = i;
+      }
+    }
+    if (!index)
+      continue;
+    keep[index] = TRUE;
+    stack[top++] = first;
+    stack[top++] = index;
+    stack[top++] = index;
+    stack[top++] = last;
+  }
+
+  for (i = 0; i < n; i++) {
+    if (keep[i])
+      window[kept++] = window[i];
+  }
+  track->count = kept;
+}
+
+static void
+emit_event (guint source_id, Track *track, TrajectoryEventKind kind,
+    const NvDsTrackPoint *points, guint num_points, TrajectoryEmitFunc emit,
+    gpointer user_data)
+{
+  TrajectoryEvent event;
+
+  event.kind = kind;
+  event.source_id = source_id;
+  event.track_id = track->id;
+  event.class_id = track->class_id;
+  event.first_frame = track->first_frame;
+  event.last_frame = track->last_seen;
+  event.num_points = num_points;
+  event.points = points;
+  emit (&event, user_data);
+}
+
+/* Reports the simplified points of @track since its last event, which then
+ * become the start of the next window. */
+static void
+report_track (TrajectoryTracker *tracker, guint source_id, Track *track,
+    TrajectoryEventKind kind, gint frame, TrajectoryEmitFunc emit,
+    gpointer user_data)
+{
+  const TrajectoryPolicy *policy = &tracker->sources[source_id].policy;
+  NvDsTrackPoint *window = track->window;
+
+  simplify (tracker, track, policy->epsilon);
+  track->last_event = frame;
+
+  /* An update of an object that didn't go anywhere isn't worth sending,
+   * keep measuring from the point last reported. */
+  if (kind == TRAJECTORY_TRACK_UPDATE && (track->count == 1 ||
+          (track->count == 2 && segment_distance (&window[1], &window[0],
+                  &window[0]) <= policy->epsilon))) {
+    track->count = 1;
+    return;
+  }
+
+  emit_event (source_id, track, kind, window + 1, track->count - 1, emit,
+      user_data);
+  window[0] = window[track->count - 1];
+  track->count = 1;
+}
+
+static void
+end_track (TrajectoryTracker *tracker, guint source_id, Track *track,
+    gint frame, TrajectoryEmitFunc emit, gpointer user_data)
+{
+  report_track (tracker, source_id, track, TRAJECTORY_TRACK_END, frame, emit,
+      user_data);
+  g_hash_table_remove (tracker->sources[source_id].by_id, &track->id);
+  track->active = FALSE;
+}
+
+/* Returns a free track of @source_id, ending the least recently seen one
+ * if there is none. */
+static Track *
+allocate_track (TrajectoryTracker *tracker, guint source_id, gint frame,
+    TrajectoryEmitFunc emit, gpointer user_data)
+{
+  SourceTracks *source = &tracker->sources[source_id];
+  Track *oldest = NULL;
+  guint t;
+
+  for (t = 0; t < tracker->max_tracks; t++) {
+    Track *track = &source->tracks[t];
+
+    if (!track->active)
+      return track;
+    if (!oldest || track->last_seen < oldest->last_seen)
+      oldest = track;
+  }
+  end_track (tracker, source_id, oldest, frame, emit, user_data);
+  return oldest;
+}
+
+void
+trajectory_tracker_update (TrajectoryTracker *tracker,
+    const FrameSnapshot *snapshot, TrajectoryEmitFunc emit,
+    gpointer user_data)
+{
+  SourceTracks *source;
+  const TrajectoryPolicy *policy;
+  guint source_id = snapshot->source_id;
+  gint frame = snapshot->frame_num;
+  NvDsTrackPoint point;
+  Track *track;
+  guint i;
+
+  if (!trajectory_tracker_enabled (tracker) ||
+      source_id >= tracker->num_sources)
+    return;
+
+  source = &tracker->sources[source_id];
+  policy = &source->policy;
+
+  for (i = 0; i < snapshot->count; i++) {
+    if (snapshot->object_id[i] == UNTRACKED_OBJECT_ID)
+      continue;
+
+    point.frameId = frame;
+    point.x = snapshot->left[i] + snapshot->width[i] / 2;
+    point.y = snapshot->top[i] + snapshot->height[i] / 2;
+
+    track = (Track *) g_hash_table_lookup (source->by_id,
+        &snapshot->object_id[i]);
+    /* Frame numbers going back mean the stream restarted. */
+    if (track && frame < track->last_seen) {
+      end_track (tracker, source_id, track, frame, emit, user_data);
+      track = NULL;
+    }
+    if (track && frame == track->last_seen)
+      continue;
+
+    if (!track) {
+      track = allocate_track (tracker, source_id, frame, emit, user_data);
+      track->id = snapshot->object_id[i];
+      track->active = TRUE;
+      track->class_id = snapshot->class_id[i];
+      track->first_frame = frame;
+      track->last_seen = frame;
+      track->last_event = frame;
+      track->window[0] = point;
+      track->count = 1;
+      g_hash_table_insert (source->by_id, &track->id, track);
+      emit_event (source_id, track, TRAJECTORY_TRACK_START, track->window, 1,
+          emit, user_data);
+      continue;
+    }
+
+    track->window[track->count++] = point;
+    track->last_seen = frame;
+
+    if (track->count == tracker->window_size) {
+      simplify (tracker, track, policy->epsilon);
+      if (track->count == tracker->window_size) {
+        report_track (tracker, source_id, track, TRAJECTORY_TRACK_UPDATE,
+            frame, emit, user_data);
+        continue;
+      }
+    }
+    if (policy->update_interval &&
+        (gint64) frame - track->last_event >= policy->update_interval) {
+      report_track (tracker, source_id, track, TRAJECTORY_TRACK_UPDATE,
+          frame, emit, user_data);
+    }
+  }
+
+  for (i = 0; i < tracker->max_tracks; i++) {
+    track = &source->tracks[i];
+    if (track->active && (frame < track->last_seen ||
+            (gint64) frame - track->last_seen >= policy->end_after))
+      end_track (tracker, source_id, track, frame, emit, user_data);
+  }
+}
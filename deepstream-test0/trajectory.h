@@ -0,0 +1,118 @@
+/*
+ * Copyright (c) 2018-2020, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file
+ * <b>Track trajectory summarization</b>
+ *
+ * @b Description: Replaces per-frame object dumps with one short story per
+ * track. The box centers of each tracked object are buffered per source in
+ * a window of fixed capacity and simplified with Douglas-Peucker, so only
+ * points where the object turned or changed speed are kept. A track
+ * produces a start event when it first appears, an update event with the
+ * points simplified since the previous event every update-interval frames
+ * (or earlier if its window fills up with significant points), and an end
+ * event once it has been missing for end-after frames. Updates of an
+ * object that stayed within epsilon of its last reported point are skipped.
+ *
+ * Each source keeps at most max-tracks tracks; when a new track finds no
+ * room the least recently seen one is ended early. Memory is allocated once
+ * per source at creation. Objects without a tracking id are ignored.
+ *
+ * The tracker must see every frame of a source, so when it is enabled the
+ * sampler and the scene change detector are bypassed.
+ *
+ * Settings are read from the [trajectory] group of the event configuration
+ * file; epsilon, update-interval and end-after can be overridden per
+ * source in [sensorN] groups:
+ *
+ *   enable=1             turn trajectory mode on
+ *   window-size=N        points buffered per track, at most MAX_TRACK_POINTS
+ *   max-tracks=N         tracks kept per source
+ *   epsilon=F            simplification tolerance in pixels
+ *   update-interval=N    frames between two updates of a track, 0 only
+ *                        updates when the window fills up
+ *   end-after=N          frames a track may be missing before it ends
+ */
+
+#ifndef TRAJECTORY_H_
+#define TRAJECTORY_H_
+
+#include "frame_snapshot.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define TRAJECTORY_CONFIG_GROUP "trajectory"
+
+typedef enum
+{
+  TRAJECTORY_TRACK_START,
+  TRAJECTORY_TRACK_UPDATE,
+  TRAJECTORY_TRACK_END,
+} TrajectoryEventKind;
+
+typedef struct
+{
+  TrajectoryEventKind kind;
+  guint source_id;
+  guint64 track_id;
+  gint class_id;
+  gint first_frame;
+  gint last_frame;
+  /** Points since the previous event of the track, valid during the call. */
+  guint num_points;
+  const NvDsTrackPoint *points;
+} TrajectoryEvent;
+
+typedef void (*TrajectoryEmitFunc) (const TrajectoryEvent *event,
+    gpointer user_data);
+
+typedef struct _TrajectoryTracker TrajectoryTracker;
+
+/**
+ * Creates a tracker for @num_sources sources. Returns NULL if the
+ * configuration can't be parsed. A tracker whose [trajectory] group is
+ * missing or disabled does nothing.
+ */
+TrajectoryTracker *trajectory_tracker_new (const gchar *config_file,
+    guint num_sources);
+
+void trajectory_tracker_free (TrajectoryTracker *tracker);
+
+gboolean trajectory_tracker_enabled (const TrajectoryTracker *tracker);
+
+/**
+ * Adds the tracked objects of @snapshot to the trajectories of its source
+ * and calls @emit for every track that started, is due for an update or
+ * ended.
+ */
+void trajectory_tracker_update (TrajectoryTracker *tracker,
+    const FrameSnapshot *snapshot, TrajectoryEmitFunc emit,
+    gpointer user_data);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* TRAJECTORY_H_ */
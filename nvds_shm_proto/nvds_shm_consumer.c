@@ -0,0 +1,287 @@
+/*
+ * Copyright (c) 2018-2020, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+/*
+ * Consumer side of the shared-memory ring, see nvds_shm_consumer.h.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <linux/futex.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "nvds_shm_consumer.h"
+#include "nvds_shm_ring.h"
+
+struct _NvDsShmConsumer
+{
+  void *map;
+  size_t map_size;
+  NvDsShmRingHeader *header;
+  uint8_t *data;
+
+  /* Position of the next record to read. */
+  uint64_t pos;
+  uint64_t next_seq;
+  uint64_t lost;
+};
+
+/* Receives the ring's memfd and the start position from the adaptor
+ * listening at @path. */
+static int
+receive_ring_fd (const char *path, NvDsShmHandoff *handoff)
+{
+  union
+  {
+    struct cmsghdr align;
+    char buf[CMSG_SPACE (sizeof (int))];
+  } control;
+  struct sockaddr_un addr;
+  struct msghdr msg;
+  struct cmsghdr *cmsg;
+  struct iovec iov;
+  int sock, fd = -1;
+
+  if (strlen (path) >= sizeof (addr.sun_path)) {
+    errno = ENAMETOOLONG;
+    return -1;
+  }
+  memset (&addr, 0, sizeof (addr));
+  addr.sun_family = AF_UNIX;
+  strcpy (addr.sun_path, path);
+
+  sock = socket (AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (sock < 0)
+    return -1;
+  if (connect (sock, (struct sockaddr *) &addr, sizeof (addr)) < 0)
+    goto done;
+
+  memset (&msg, 0, sizeof (msg));
+  iov.iov_base = handoff;
+  iov.iov_len = sizeof (*handoff);
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.buf;
+  msg.msg_controllen = sizeof (control.buf);
+  if (recvmsg (sock, &msg, MSG_CMSG_CLOEXEC | MSG_WAITALL) !=
+      sizeof (*handoff)) {
+    errno = EPROTO;
+    goto done;
+  }
+
+  cmsg = CMSG_FIRSTHDR (&msg);
+  if (cmsg && cmsg->cmsg_level == SOL_SOCKET &&
+      cmsg->cmsg_type == SCM_RIGHTS &&
+      cmsg->cmsg_len == CMSG_LEN (sizeof (int)))
+    memcpy (&fd, CMSG_DATA (cmsg), sizeof (int));
+  else
+    errno = EPROTO;
+
+done:
+  close (sock);
+  return fd;
+}
+
+NvDsShmConsumer *
+nvds_shm_consumer_open (const char *address)
+{
+  NvDsShmConsumer *consumer = NULL;
+  NvDsShmRingHeader *header;
+  NvDsShmHandoff handoff;
+  struct stat st;
+  const char *path = address;
+  int fd;
+
+  if (strncmp (address, NVDS_SHM_PREFIX, strlen (NVDS_SHM_PREFIX)) == 0)
+    path = address + strlen (NVDS_SHM_PREFIX);
+
+  fd = receive_ring_fd (path, &handoff);
+  if (fd < 0)
+    return NULL;
+
+  consumer = calloc (1, sizeof (*consumer));
+  if (!consumer || fstat (fd, &st) < 0 ||
+      (size_t) st.st_size < sizeof (NvDsShmRingHeader))
+    goto error;
+
+  consumer->map_size = st.st_size;
+  consumer->map = mmap (NULL, consumer->map_size, PROT_READ | PROT_WRITE,
+      MAP_SHARED, fd, 0);
+  if (consumer->map == MAP_FAILED) {
+    consumer->map = NULL;
+    goto error;
+  }
+  close (fd);
+  fd = -1;
+
+  header = consumer->header = (NvDsShmRingHeader *) consumer->map;
+  if (__atomic_load_n (&header->magic, __ATOMIC_ACQUIRE) !=
+      NVDS_SHM_RING_MAGIC || header->version != NVDS_SHM_RING_VERSION ||
+      !header->capacity || (header->capacity & (header->capacity - 1)) ||
+      header->data_offset < sizeof (NvDsShmRingHeader) ||
+      header->data_offset + header->capacity > consumer->map_size) {
+    errno = EPROTO;
+    goto error;
+  }
+  consumer->data = (uint8_t *) consumer->map + header->data_offset;
+
+  consumer->pos = handoff.head;
+  consumer->next_seq = handoff.next_seq;
+  return consumer;
+
+error:
+  if (fd >= 0)
+    close (fd);
+  nvds_shm_consumer_close (consumer);
+  return NULL;
+}
+
+void
+nvds_shm_consumer_close (NvDsShmConsumer *consumer)
+{
+  if (!consumer)
+    return;
+  if (consumer->map)
+    munmap (consumer->map, consumer->map_size);
+  free (consumer);
+}
+
+static int64_t
+now_ms (void)
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
+
+/* Sleeps until the producer publishes past @pos or @deadline_ms passes. */
+static void
+wait_for_data (NvDsShmConsumer *consumer, int64_t deadline_ms)
+{
+  NvDsShmRingHeader *header = consumer->header;
+  uint32_t wake = __atomic_load_n (&header->wake, __ATOMIC_ACQUIRE);
+  struct timespec timeout, *ptimeout = NULL;
+
+  if (deadline_ms >= 0) {
+    int64_t left = deadline_ms - now_ms ();
+
+    if (left <= 0)
+      return;
+    timeout.tv_sec = left / 1000;
+    timeout.tv_nsec = (left % 1000) * 1000000;
+    ptimeout = &timeout;
+  }
+
+  /* Pairs with the producer storing head then checking waiters. */
+  __atomic_fetch_add (&header->waiters, 1, __ATOMIC_SEQ_CST);
+  if (__atomic_load_n (&header->head, __ATOMIC_SEQ_CST) == consumer->pos) {
+    /* The ring is shared between processes, so no FUTEX_PRIVATE_FLAG. */
+    syscall (SYS_futex, &header->wake, FUTEX_WAIT, wake, ptimeout, NULL, 0);
+  }
+  __atomic_fetch_sub (&header->waiters, 1, __ATOMIC_SEQ_CST);
+}
+
+int
+nvds_shm_consumer_next (NvDsShmConsumer *consumer, NvDsShmMessage *msg,
+    int timeout_ms)
+{
+  NvDsShmRingHeader *header = consumer->header;
+  int64_t deadline_ms = timeout_ms < 0 ? -1 : now_ms () + timeout_ms;
+
+  for (;;) {
+    uint64_t head = __atomic_load_n (&header->head, __ATOMIC_ACQUIRE);
+    uint64_t tail, span, seq;
+    NvDsShmRecord *record;
+    uint32_t size;
+    uint16_t topic_len, flags;
+
+    if (consumer->pos == head) {
+      if (deadline_ms >= 0 && now_ms () >= deadline_ms)
+        return 0;
+      wait_for_data (consumer, deadline_ms);
+      continue;
+    }
+
+    tail = __atomic_load_n (&header->tail, __ATOMIC_ACQUIRE);
+    if (tail > consumer->pos)
+      consumer->pos = tail;
+
+    record = nvds_shm_record_at (header, consumer->data, consumer->pos);
+    seq = record->seq;
+    size = record->size;
+    topic_len = record->topic_len;
+    flags = record->flags;
+
+    /* Only trust the record header if it wasn't being overwritten. */
+    __atomic_thread_fence (__ATOMIC_ACQUIRE);
+    if (__atomic_load_n (&header->tail, __ATOMIC_RELAXED) > consumer->pos)
+      continue;
+
+    span = nvds_shm_record_span (size);
+    if (span > header->capacity - (consumer->pos & (header->capacity - 1)) ||
+        topic_len > size)
+      return -1;
+    if (flags & NVDS_SHM_RECORD_PADDING) {
+      consumer->pos += span;
+      continue;
+    }
+
+    if (seq > consumer->next_seq)
+      consumer->lost += seq - consumer->next_seq;
+    consumer->next_seq = seq + 1;
+
+    msg->seq = seq;
+    msg->topic = (const char *) (record + 1);
+    msg->topic_len = topic_len;
+    msg->payload = (const uint8_t *) (record + 1) + topic_len;
+    msg->size = size - topic_len;
+    msg->pos = consumer->pos;
+    consumer->pos += span;
+    return 1;
+  }
+}
+
+int
+nvds_shm_consumer_done (NvDsShmConsumer *consumer, const NvDsShmMessage *msg)
+{
+  __atomic_thread_fence (__ATOMIC_ACQUIRE);
+  if (__atomic_load_n (&consumer->header->tail, __ATOMIC_RELAXED) <= msg->pos)
+    return 1;
+  consumer->lost++;
+  return 0;
+}
+
+uint64_t
+nvds_shm_consumer_lost (const NvDsShmConsumer *consumer)
+{
+  return consumer->lost;
+}
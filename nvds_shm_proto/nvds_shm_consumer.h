@@ -0,0 +1,104 @@
+/*
+ * Copyright (c) 2018-2020, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+/**
+ * @file
+ * <b>Shared-memory ring consumer</b>
+ *
+ * @b Description: Reads the messages libnvds_shm_proto.so publishes, in
+ * place, from any process on the same host. A consumer sees the messages
+ * published after it opened the ring. It never slows the producer down: if
+ * it falls behind, the messages overwritten before it got to them are
+ * counted as lost and it continues with the oldest message still there.
+ *
+ *   NvDsShmConsumer *consumer = nvds_shm_consumer_open ("shm:/tmp/sock");
+ *   NvDsShmMessage msg;
+ *
+ *   while (nvds_shm_consumer_next (consumer, &msg, 1000) >= 0) {
+ *     ...use msg.topic and msg.payload...
+ *     if (!nvds_shm_consumer_done (consumer, &msg))
+ *       ...msg was overwritten while in use, discard what was derived...
+ *   }
+ *
+ * Message contents point into the ring and are only valid until the
+ * producer overwrites them; nvds_shm_consumer_done() tells whether that
+ * happened. Copy what has to outlive the check. A consumer must only be
+ * used by one thread at a time.
+ */
+
+#ifndef NVDS_SHM_CONSUMER_H_
+#define NVDS_SHM_CONSUMER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+typedef struct _NvDsShmConsumer NvDsShmConsumer;
+
+typedef struct
+{
+  uint64_t seq;
+  const char *topic;
+  size_t topic_len;
+  const uint8_t *payload;
+  size_t size;
+
+  /* Position of the record in the ring. */
+  uint64_t pos;
+} NvDsShmMessage;
+
+/**
+ * Connects to the adaptor's socket at @address, "shm:<path>" or an absolute
+ * path, and maps the ring it hands out. Returns NULL on failure, with errno
+ * set.
+ */
+NvDsShmConsumer *nvds_shm_consumer_open (const char *address);
+
+void nvds_shm_consumer_close (NvDsShmConsumer *consumer);
+
+/**
+ * Waits up to @timeout_ms, or forever if negative, for the next message.
+ * Returns 1 and fills @msg if there is one, 0 on timeout and -1 if the ring
+ * is corrupt.
+ */
+int nvds_shm_consumer_next (NvDsShmConsumer *consumer, NvDsShmMessage *msg,
+    int timeout_ms);
+
+/**
+ * Returns 1 if @msg was intact until now, 0 if the producer overwrote it
+ * while it was in use, which is then counted as lost.
+ */
+int nvds_shm_consumer_done (NvDsShmConsumer *consumer,
+    const NvDsShmMessage *msg);
+
+/** Returns the number of messages the consumer missed. */
+uint64_t nvds_shm_consumer_lost (const NvDsShmConsumer *consumer);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* NVDS_SHM_CONSUMER_H_ */
@@ -0,0 +1,489 @@
+/*
+ * Copyright (c) 2018-2020, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+/*
+ * Protocol adaptor publishing messages into a shared-memory ring for
+ * consumers on the same host, see nvds_shm_ring.h for the layout and
+ * nvds_shm_consumer.h for the consumer side.
+ *
+ * Connection string: "shm:/path/to/socket" (or just an absolute path). The
+ * adaptor creates the ring in a sealed memfd and listens on the Unix domain
+ * socket at that path; every consumer that connects is sent the memfd and
+ * disconnected.
+ *
+ * Sending copies the message into the ring and never blocks: records of
+ * consumers that fall behind are overwritten. Completion callbacks of
+ * nvds_msgapi_send_async() run from the next nvds_msgapi_do_work(), which
+ * also hands the ring to new consumers.
+ *
+ * Optional settings in the [message-broker] group of the config file:
+ *   ring-size=N   bytes of record data, rounded up to a power of two
+ *                 (16 MiB); a message may take at most half of it
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <linux/futex.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <glib.h>
+
+#include "nvds_msgapi.h"
+#include "nvds_shm_ring.h"
+#define NVDS_TRACE_IMPLEMENTATION
+#include "nvds_trace.h"
+
+#define CONFIG_GROUP_BROKER "message-broker"
+#define CONFIG_KEY_RING_SIZE "ring-size"
+
+#define DEFAULT_RING_SIZE (16 * 1024 * 1024)
+#define MIN_RING_SIZE (64 * 1024)
+#define MAX_RING_SIZE (1024 * 1024 * 1024)
+
+typedef struct
+{
+  nvds_msgapi_send_cb_t send_cb;
+  void *user_ptr;
+} ShmCompletion;
+
+typedef struct
+{
+  gchar *conn_str;
+  gchar *socket_path;
+  nvds_msgapi_connect_cb_t connect_cb;
+  gsize ring_size;
+
+  gint memfd;
+  gint listen_fd;
+  guint8 *map;
+  gsize map_size;
+  NvDsShmRingHeader *header;
+  guint8 *data;
+
+  /* Serializes publishers. */
+  GMutex lock;
+
+  /* Completions of send_async, run by do_work. */
+  GMutex done_lock;
+  GArray *done;
+  GArray *running;
+} ShmConn;
+
+static gboolean
+parse_connection_string (ShmConn *conn, const char *connection_str)
+{
+  if (g_str_has_prefix (connection_str, NVDS_SHM_PREFIX)) {
+    conn->socket_path =
+        g_strdup (connection_str + strlen (NVDS_SHM_PREFIX));
+  } else if (connection_str[0] == '/') {
+    conn->socket_path = g_strdup (connection_str);
+  }
+  return conn->socket_path && conn->socket_path[0] != '\0' &&
+      strlen (conn->socket_path) <
+      sizeof (((struct sockaddr_un *) 0)->sun_path);
+}
+
+static void
+parse_config (ShmConn *conn, const char *config_path)
+{
+  GKeyFile *key_file = NULL;
+  GError *error = NULL;
+  gint64 value;
+
+  if (!config_path)
+    return;
+
+  key_file = g_key_file_new ();
+  if (!g_key_file_load_from_file (key_file, config_path, G_KEY_FILE_NONE,
+          &error)) {
+    g_printerr ("Failed to load config %s: %s\n", config_path,
+        error->message);
+    g_error_free (error);
+    g_key_file_free (key_file);
+    return;
+  }
+
+  value = g_key_file_get_int64 (key_file, CONFIG_GROUP_BROKER,
+      CONFIG_KEY_RING_SIZE, &error);
+  if (!error && value > 0) {
+    conn->ring_size = MIN_RING_SIZE;
+    while (conn->ring_size < (guint64) value &&
+        conn->ring_size < MAX_RING_SIZE)
+      conn->ring_size *= 2;
+  }
+  g_clear_error (&error);
+
+  g_key_file_free (key_file);
+}
+
+/* Creates the sealed memfd holding the ring and maps it. */
+static gboolean
+create_ring (ShmConn *conn)
+{
+  gsize data_offset = sizeof (NvDsShmRingHeader);
+
+  conn->map_size = data_offset + conn->ring_size;
+  conn->memfd = memfd_create ("nvds-shm-ring",
+      MFD_CLOEXEC | MFD_ALLOW_SEALING);
+  if (conn->memfd < 0)
+    return FALSE;
+  /* Consumers map it too, they must not be able to resize it under us. */
+  if (ftruncate (conn->memfd, conn->map_size) < 0 ||
+      fcntl (conn->memfd, F_ADD_SEALS,
+          F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) < 0)
+    return FALSE;
+
+  conn->map = (guint8 *) mmap (NULL, conn->map_size, PROT_READ | PROT_WRITE,
+      MAP_SHARED | MAP_POPULATE, conn->memfd, 0);
+  if (conn->map == MAP_FAILED) {
+    conn->map = NULL;
+    return FALSE;
+  }
+
+  conn->header = (NvDsShmRingHeader *) conn->map;
+  conn->data = conn->map + data_offset;
+  conn->header->version = NVDS_SHM_RING_VERSION;
+  conn->header->capacity = conn->ring_size;
+  conn->header->data_offset = data_offset;
+  conn->header->next_seq = 1;
+  /* Consumers check the magic last. */
+  __atomic_store_n (&conn->header->magic, NVDS_SHM_RING_MAGIC,
+      __ATOMIC_RELEASE);
+  return TRUE;
+}
+
+static gboolean
+listen_socket (ShmConn *conn)
+{
+  struct sockaddr_un addr;
+
+  memset (&addr, 0, sizeof (addr));
+  addr.sun_family = AF_UNIX;
+  g_strlcpy (addr.sun_path, conn->socket_path, sizeof (addr.sun_path));
+  unlink (conn->socket_path);
+
+  conn->listen_fd = socket (AF_UNIX,
+      SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+  return conn->listen_fd >= 0 &&
+      bind (conn->listen_fd, (struct sockaddr *) &addr, sizeof (addr)) == 0 &&
+      listen (conn->listen_fd, 16) == 0;
+}
+
+/* Sends the memfd to every consumer waiting on the socket. */
+static void
+accept_consumers (ShmConn *conn)
+{
+  union
+  {
+    struct cmsghdr align;
+    gchar buf[CMSG_SPACE (sizeof (gint))];
+  } control;
+  struct msghdr msg;
+  struct cmsghdr *cmsg;
+  struct iovec iov;
+  NvDsShmHandoff handoff;
+  gint fd;
+
+  while ((fd = accept4 (conn->listen_fd, NULL, NULL, SOCK_CLOEXEC)) >= 0) {
+    memset (&msg, 0, sizeof (msg));
+    memset (&control, 0, sizeof (control));
+    iov.iov_base = &handoff;
+    iov.iov_len = sizeof (handoff);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof (control.buf);
+    cmsg = CMSG_FIRSTHDR (&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN (sizeof (gint));
+    memcpy (CMSG_DATA (cmsg), &conn->memfd, sizeof (gint));
+
+    /* Hold off publishing so the consumer starts exactly at the next
+     * message. */
+    g_mutex_lock (&conn->lock);
+    handoff.head = conn->header->head;
+    handoff.next_seq = conn->header->next_seq;
+    if (sendmsg (fd, &msg, MSG_NOSIGNAL | MSG_DONTWAIT) < 0)
+      g_printerr ("Failed to hand the ring to a consumer: %s\n",
+          g_strerror (errno));
+    g_mutex_unlock (&conn->lock);
+    close (fd);
+  }
+}
+
+/* Advances the tail past the records that writing up to @end overwrites. */
+static void
+make_room (ShmConn *conn, guint64 end)
+{
+  NvDsShmRingHeader *header = conn->header;
+  guint64 tail = header->tail;
+
+  if (end - tail <= header->capacity)
+    return;
+  while (end - tail > header->capacity) {
+    NvDsShmRecord *record = nvds_shm_record_at (header, conn->data, tail);
+    tail += nvds_shm_record_span (record->size);
+  }
+  /* The new tail must be visible before any of the records it passed is
+   * overwritten, so consumers still reading them notice. */
+  __atomic_store_n (&header->tail, tail, __ATOMIC_RELAXED);
+  __atomic_thread_fence (__ATOMIC_RELEASE);
+}
+
+static gboolean
+publish (ShmConn *conn, const char *topic, const uint8_t *payload,
+    size_t nbuf)
+{
+  NvDsShmRingHeader *header = conn->header;
+  size_t topic_len = topic ? strlen (topic) : 0;
+  guint64 span = nvds_shm_record_span ((guint64) topic_len + nbuf);
+  NvDsShmRecord *record;
+  guint64 pos, room;
+
+  if (topic_len > G_MAXUINT16 || span > header->capacity / 2)
+    return FALSE;
+
+  g_mutex_lock (&conn->lock);
+  pos = header->head;
+
+  room = header->capacity - (pos & (header->capacity - 1));
+  if (room < span) {
+    make_room (conn, pos + room);
+    record = nvds_shm_record_at (header, conn->data, pos);
+    record->seq = 0;
+    record->size = room - sizeof (NvDsShmRecord);
+    record->topic_len = 0;
+    record->flags = NVDS_SHM_RECORD_PADDING;
+    pos += room;
+  }
+
+  make_room (conn, pos + span);
+  record = nvds_shm_record_at (header, conn->data, pos);
+  record->seq = header->next_seq++;
+  record->size = topic_len + nbuf;
+  record->topic_len = topic_len;
+  record->flags = 0;
+  memcpy (record + 1, topic, topic_len);
+  memcpy ((guint8 *) (record + 1) + topic_len, payload, nbuf);
+
+  /* Pairs with the waiters increment of consumers going to sleep: either
+   * they see the new head or we see them waiting. */
+  __atomic_store_n (&header->head, pos + span, __ATOMIC_SEQ_CST);
+  if (__atomic_load_n (&header->waiters, __ATOMIC_SEQ_CST)) {
+    __atomic_fetch_add (&header->wake, 1, __ATOMIC_RELEASE);
+    syscall (SYS_futex, &header->wake, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+  }
+  g_mutex_unlock (&conn->lock);
+  return TRUE;
+}
+
+static void
+run_completions (ShmConn *conn)
+{
+  GArray *running;
+  gint64 trace_begin = nvds_trace_begin ();
+
+  g_mutex_lock (&conn->done_lock);
+  running = conn->done;
+  conn->done = conn->running;
+  conn->running = running;
+  g_mutex_unlock (&conn->done_lock);
+
+  for (guint i = 0; i < running->len; i++) {
+    ShmCompletion *completion = &g_array_index (running, ShmCompletion, i);
+    completion->send_cb (completion->user_ptr, NVDS_MSGAPI_OK);
+  }
+  /* Only calls that had callbacks to run, do_work() is called in a loop. */
+  if (running->len)
+    nvds_trace_end ("broker", "complete", trace_begin, "messages",
+        running->len);
+  g_array_set_size (running, 0);
+}
+
+static void
+conn_free (ShmConn *conn)
+{
+  if (conn->listen_fd >= 0) {
+    close (conn->listen_fd);
+    unlink (conn->socket_path);
+  }
+  if (conn->map)
+    munmap (conn->map, conn->map_size);
+  if (conn->memfd >= 0)
+    close (conn->memfd);
+  g_array_free (conn->done, TRUE);
+  g_array_free (conn->running, TRUE);
+  g_mutex_clear (&conn->lock);
+  g_mutex_clear (&conn->done_lock);
+  g_free (conn->conn_str);
+  g_free (conn->socket_path);
+  g_free (conn);
+}
+
+NvDsMsgApiHandle
+nvds_msgapi_connect (char *connection_str,
+    nvds_msgapi_connect_cb_t connect_cb, char *config_path)
+{
+  ShmConn *conn = NULL;
+
+  if (!connection_str) {
+    g_printerr ("No connection string\n");
+    return NULL;
+  }
+
+  conn = g_new0 (ShmConn, 1);
+  g_mutex_init (&conn->lock);
+  g_mutex_init (&conn->done_lock);
+  conn->done = g_array_new (FALSE, FALSE, sizeof (ShmCompletion));
+  conn->running = g_array_new (FALSE, FALSE, sizeof (ShmCompletion));
+  conn->conn_str = g_strdup (connection_str);
+  conn->connect_cb = connect_cb;
+  conn->ring_size = DEFAULT_RING_SIZE;
+  conn->memfd = -1;
+  conn->listen_fd = -1;
+
+  if (!parse_connection_string (conn, connection_str)) {
+    g_printerr ("Invalid connection string %s, expected "
+        NVDS_SHM_PREFIX "<path>\n", connection_str);
+    conn_free (conn);
+    return NULL;
+  }
+  parse_config (conn, config_path);
+
+  if (!create_ring (conn)) {
+    g_printerr ("Failed to create a %" G_GSIZE_FORMAT " byte ring: %s\n",
+        conn->ring_size, g_strerror (errno));
+    conn_free (conn);
+    return NULL;
+  }
+  if (!listen_socket (conn)) {
+    g_printerr ("Failed to listen on %s: %s\n", conn->socket_path,
+        g_strerror (errno));
+    conn_free (conn);
+    return NULL;
+  }
+  return (NvDsMsgApiHandle) conn;
+}
+
+NvDsMsgApiErrorType
+nvds_msgapi_send (NvDsMsgApiHandle h_ptr, char *topic, const uint8_t *payload,
+    size_t nbuf)
+{
+  ShmConn *conn = (ShmConn *) h_ptr;
+  gint64 trace_begin = nvds_trace_begin ();
+
+  if (!conn || !payload || !publish (conn, topic, payload, nbuf))
+    return NVDS_MSGAPI_ERR;
+  nvds_trace_end ("broker", "send", trace_begin, "bytes", nbuf);
+  return NVDS_MSGAPI_OK;
+}
+
+NvDsMsgApiErrorType
+nvds_msgapi_send_async (NvDsMsgApiHandle h_ptr, char *topic,
+    const uint8_t *payload, size_t nbuf, nvds_msgapi_send_cb_t send_callback,
+    void *user_ptr)
+{
+  ShmConn *conn = (ShmConn *) h_ptr;
+  ShmCompletion completion = { send_callback, user_ptr };
+  gint64 trace_begin = nvds_trace_begin ();
+
+  if (!conn || !payload || !publish (conn, topic, payload, nbuf))
+    return NVDS_MSGAPI_ERR;
+  nvds_trace_end ("broker", "send", trace_begin, "bytes", nbuf);
+
+  /* The caller may hold the lock its callback takes, so the callback
+   * can't run from here. */
+  if (send_callback) {
+    g_mutex_lock (&conn->done_lock);
+    g_array_append_val (conn->done, completion);
+    g_mutex_unlock (&conn->done_lock);
+  }
+  return NVDS_MSGAPI_OK;
+}
+
+void
+nvds_msgapi_do_work (NvDsMsgApiHandle h_ptr)
+{
+  ShmConn *conn = (ShmConn *) h_ptr;
+
+  if (!conn)
+    return;
+
+  accept_consumers (conn);
+  run_completions (conn);
+}
+
+NvDsMsgApiErrorType
+nvds_msgapi_subscribe (NvDsMsgApiHandle h_ptr, char **topics, int num_topics,
+    nvds_msgapi_subscribe_request_cb_t cb, void *user_ctx)
+{
+  g_printerr ("Subscribe is not supported by the " NVDS_SHM_PROTOCOL_NAME
+      " adaptor\n");
+  return NVDS_MSGAPI_ERR;
+}
+
+NvDsMsgApiErrorType
+nvds_msgapi_disconnect (NvDsMsgApiHandle h_ptr)
+{
+  ShmConn *conn = (ShmConn *) h_ptr;
+
+  if (!conn)
+    return NVDS_MSGAPI_ERR;
+
+  run_completions (conn);
+  conn_free (conn);
+  return NVDS_MSGAPI_OK;
+}
+
+char *
+nvds_msgapi_getversion (void)
+{
+  return (char *) NVDS_MSGAPI_VERSION;
+}
+
+char *
+nvds_msgapi_get_protocol_name (void)
+{
+  return (char *) NVDS_SHM_PROTOCOL_NAME;
+}
+
+NvDsMsgApiErrorType
+nvds_msgapi_connection_signature (char *broker_str, char *cfg,
+    char *output_str, int max_len)
+{
+  if (!broker_str || !output_str || max_len <= 0)
+    return NVDS_MSGAPI_ERR;
+  /* Connections are only shared between identical connection strings. */
+  if (g_strlcpy (output_str, broker_str, max_len) >= (gsize) max_len) {
+    output_str[0] = '\0';
+    return NVDS_MSGAPI_ERR;
+  }
+  return NVDS_MSGAPI_OK;
+}
@@ -0,0 +1,138 @@
+/*
+ * Copyright (c) 2018-2020, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+/**
+ * @file
+ * <b>Shared-memory ring layout</b>
+ *
+ * @b Description: Layout shared by libnvds_shm_proto.so and the consumer
+ * library. The adaptor publishes every message as a record of a ring in a
+ * sealed memfd and hands the memfd to consumers that connect to its Unix
+ * domain socket. Consumers map the ring and read records in place.
+ *
+ * The ring is a header followed by @capacity bytes of records. Positions
+ * grow without wrapping, a position's offset in the data is position &
+ * (capacity - 1). Each record is
+ *
+ *   NvDsShmRecord   sequence number, size, topic length, flags
+ *   topic           not NUL terminated
+ *   payload
+ *
+ * padded to NVDS_SHM_RECORD_ALIGN. Records never straddle the end of the
+ * data, the rest of it is filled with a padding record instead.
+ *
+ * The producer never waits for consumers. Before it overwrites records it
+ * advances @tail past them, so a consumer knows a record it read was still
+ * intact if @tail hadn't passed it afterwards, seqlock style. Consumers that
+ * fall behind see gaps in the sequence numbers.
+ *
+ * Consumers waiting for data increment @waiters and sleep on the futex word
+ * @wake, which the producer bumps and wakes after publishing when there are
+ * waiters. They write nothing else in the ring.
+ */
+
+#ifndef NVDS_SHM_RING_H_
+#define NVDS_SHM_RING_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define NVDS_SHM_PROTOCOL_NAME "SHM"
+/** Prefix of the socket path in the connection string. */
+#define NVDS_SHM_PREFIX "shm:"
+
+#define NVDS_SHM_RING_MAGIC 0x4e445352u
+#define NVDS_SHM_RING_VERSION 1
+#define NVDS_SHM_RECORD_ALIGN 16
+
+/** Flag of records that only fill the data up to its end. */
+#define NVDS_SHM_RECORD_PADDING 0x1
+
+typedef struct
+{
+  uint32_t magic;
+  uint32_t version;
+  /** Bytes of record data, a power of two. */
+  uint64_t capacity;
+  /** Offset of the record data from the start of the ring. */
+  uint64_t data_offset;
+  uint8_t reserved0[40];
+
+  /* Written by the producer only, on their own cache line. */
+  /** Position after the last published record. */
+  uint64_t head;
+  /** Position of the oldest record not being overwritten. */
+  uint64_t tail;
+  /** Sequence number of the next record. */
+  uint64_t next_seq;
+  uint8_t reserved1[40];
+
+  /* Shared with the consumers. */
+  uint32_t wake;
+  uint32_t waiters;
+  uint8_t reserved2[56];
+} NvDsShmRingHeader;
+
+typedef struct
+{
+  uint64_t seq;
+  /** Bytes of topic and payload following the record header. */
+  uint32_t size;
+  uint16_t topic_len;
+  uint16_t flags;
+} NvDsShmRecord;
+
+/**
+ * Sent along with the memfd: where the consumer starts reading, taken while
+ * no message was being published.
+ */
+typedef struct
+{
+  uint64_t head;
+  uint64_t next_seq;
+} NvDsShmHandoff;
+
+/** Bytes a record with @size bytes of topic and payload takes in the ring. */
+static inline uint64_t
+nvds_shm_record_span (uint64_t size)
+{
+  return (sizeof (NvDsShmRecord) + size + NVDS_SHM_RECORD_ALIGN - 1) &
+      ~(uint64_t) (NVDS_SHM_RECORD_ALIGN - 1);
+}
+
+static inline NvDsShmRecord *
+nvds_shm_record_at (const NvDsShmRingHeader *header, uint8_t *data,
+    uint64_t pos)
+{
+  return (NvDsShmRecord *) (data + (pos & (header->capacity - 1)));
+}
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* NVDS_SHM_RING_H_ */
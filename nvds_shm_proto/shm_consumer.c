@@ -0,0 +1,122 @@
+/*
+ * Copyright (c) 2018-2020, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+/*
+ * Minimal consumer for the shared-memory protocol adaptor. Maps the ring
+ * handed out by the adaptor and prints the message rate and the number of
+ * messages it missed once a second, or every message with -v.
+ *
+ *   shm_consumer [-v] shm:/path/to/socket
+ */
+
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "nvds_shm_consumer.h"
+
+static volatile sig_atomic_t quit = 0;
+
+static void
+on_signal (int sig)
+{
+  quit = 1;
+}
+
+static double
+now_sec (void)
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int
+main (int argc, char *argv[])
+{
+  NvDsShmConsumer *consumer;
+  NvDsShmMessage msg;
+  unsigned long messages = 0, bytes = 0, last_messages = 0;
+  double last_report;
+  int verbose = 0;
+
+  if (argc > 1 && strcmp (argv[1], "-v") == 0) {
+    verbose = 1;
+    argc--;
+    argv++;
+  }
+  if (argc != 2) {
+    fprintf (stderr, "Usage: shm_consumer [-v] shm:/path\n");
+    return -1;
+  }
+
+  consumer = nvds_shm_consumer_open (argv[1]);
+  if (!consumer) {
+    fprintf (stderr, "Failed to open ring at %s: %s\n", argv[1],
+        strerror (errno));
+    return -1;
+  }
+
+  signal (SIGINT, on_signal);
+  signal (SIGTERM, on_signal);
+  last_report = now_sec ();
+
+  while (!quit) {
+    int ret = nvds_shm_consumer_next (consumer, &msg, 200);
+    double now;
+
+    if (ret < 0) {
+      fprintf (stderr, "Corrupt ring, exiting\n");
+      break;
+    }
+    if (ret > 0) {
+      if (verbose) {
+        printf ("%.*s: %.*s\n", (int) msg.topic_len, msg.topic,
+            (int) msg.size, (const char *) msg.payload);
+      }
+      /* Only count what survived being printed. */
+      if (nvds_shm_consumer_done (consumer, &msg)) {
+        messages++;
+        bytes += msg.size;
+      }
+    }
+
+    now = now_sec ();
+    if (!verbose && now - last_report >= 1.0) {
+      printf ("%.0f msg/s, %lu messages, %lu bytes total, %lu lost\n",
+          (messages - last_messages) / (now - last_report), messages, bytes,
+          (unsigned long) nvds_shm_consumer_lost (consumer));
+      fflush (stdout);
+      last_messages = messages;
+      last_report = now;
+    }
+  }
+
+  printf ("Received %lu messages, %lu payload bytes, %lu lost\n", messages,
+      bytes, (unsigned long) nvds_shm_consumer_lost (consumer));
+  nvds_shm_consumer_close (consumer);
+  return 0;
+}
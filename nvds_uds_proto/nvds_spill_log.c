@@ -0,0 +1,572 @@
+/*
+ * Copyright (c) 2018-2020, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+/*
+ * Segmented spill log, see nvds_spill_log.h. Segment files are named after
+ * their index, in hex, so that the order survives a restart. Only the
+ * segment being written to is open for writing; a reopened log always
+ * starts a new segment, so a record torn by a crash is never appended to.
+ */
+
+#define _GNU_SOURCE
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <glib.h>
+
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#elif defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#endif
+
+#include "nvds_spill_log.h"
+
+#define SEGMENT_SUFFIX ".spill"
+#define SEGMENT_NAME_FORMAT "%016" G_GINT64_MODIFIER "x" SEGMENT_SUFFIX
+#define RECORD_ALIGN 8
+/* Records per pwritev(), three iovecs each. */
+#define WRITE_BATCH 256
+
+#define POS(segment, offset) (((guint64) (segment) << 32) | (offset))
+#define POS_SEGMENT(pos) ((pos) >> 32)
+#define POS_OFFSET(pos) ((gsize) ((pos) & G_MAXUINT32))
+
+struct _NvDsSpillLog
+{
+  gchar *dir;
+  gint dir_fd;
+  gsize segment_size;
+  guint64 max_segments;
+
+  /* Segments first_segment..write_segment may exist on disk. */
+  guint64 first_segment;
+  guint64 write_segment;
+  gint write_fd;
+  gsize write_offset;
+  gboolean dirty;
+  gboolean dir_dirty;
+
+  guint64 read_segment;
+  gsize read_offset;
+  gint read_fd;
+  guint64 read_fd_segment;
+  /* Header of the record at the read offset once peeked. */
+  guint32 peek_size;
+  guint32 peek_crc;
+
+  guint64 ack_pos;
+  guint64 last_read_pos;
+};
+
+static const guint8 zeros[RECORD_ALIGN];
+static guint32 crc_table[256];
+
+static void
+init_crc_table (void)
+{
+  guint32 i, j;
+
+  for (i = 0; i < 256; i++) {
+    guint32 crc = i;
+
+    for (j = 0; j < 8; j++)
+      crc = (crc >> 1) ^ (0x82F63B78 & (0u - (crc & 1)));
+    crc_table[i] = crc;
+  }
+}
+
+static guint32
+crc32c_table (guint32 crc, const guint8 *data, gsize len)
+{
+  while (len--)
+    crc = crc_table[(crc ^ *data++) & 0xff] ^ (crc >> 8);
+  return crc;
+}
+
+#if defined(__x86_64__)
+__attribute__ ((target ("sse4.2")))
+static guint32
+crc32c_hw (guint32 crc, const guint8 *data, gsize len)
+{
+  guint64 crc64 = crc;
+
+  for (; len >= 8; data += 8, len -= 8) {
+    guint64 word;
+
+    memcpy (&word, data, 8);
+    crc64 = _mm_crc32_u64 (crc64, word);
+  }
+  crc = (guint32) crc64;
+  for (; len; data++, len--)
+    crc = _mm_crc32_u8 (crc, *data);
+  return crc;
+}
+#elif defined(__ARM_FEATURE_CRC32)
+static guint32
+crc32c_hw (guint32 crc, const guint8 *data, gsize len)
+{
+  for (; len >= 8; data += 8, len -= 8) {
+    guint64 word;
+
+    memcpy (&word, data, 8);
+    crc = __crc32cd (crc, word);
+  }
+  for (; len; data++, len--)
+    crc = __crc32cb (crc, *data);
+  return crc;
+}
+#endif
+
+static guint32 (*crc32c_update) (guint32, const guint8 *, gsize) =
+    crc32c_table;
+
+static void
+init_crc32c (void)
+{
+  static gsize initialized = 0;
+
+  if (g_once_init_enter (&initialized)) {
+    init_crc_table ();
+#if defined(__x86_64__)
+    if (__builtin_cpu_supports ("sse4.2"))
+      crc32c_update = crc32c_hw;
+#elif defined(__ARM_FEATURE_CRC32)
+    crc32c_update = crc32c_hw;
+#endif
+    g_once_init_leave (&initialized, 1);
+  }
+}
+
+static guint32
+crc32c (const guint8 *data, gsize len)
+{
+  return ~crc32c_update (~0u, data, len);
+}
+
+static gsize
+record_span (gsize size)
+{
+  return NVDS_SPILL_RECORD_HEADER_SIZE +
+      ((size + RECORD_ALIGN - 1) & ~(gsize) (RECORD_ALIGN - 1));
+}
+
+static gint
+open_segment (NvDsSpillLog *log, guint64 index, gint flags)
+{
+  gchar name[32];
+
+  g_snprintf (name, sizeof (name), SEGMENT_NAME_FORMAT, index);
+  return openat (log->dir_fd, name, flags | O_CLOEXEC, 0644);
+}
+
+static void
+remove_segment (NvDsSpillLog *log, guint64 index)
+{
+  gchar name[32];
+
+  g_snprintf (name, sizeof (name), SEGMENT_NAME_FORMAT, index);
+  if (unlinkat (log->dir_fd, name, 0) < 0 && errno != ENOENT)
+    g_printerr ("Failed to remove spill segment %s/%s: %s\n", log->dir, name,
+        g_strerror (errno));
+}
+
+/* Starts segment write_segment + 1, preallocated so that appending never
+ * has to extend the file and unwritten space reads as the end marker. */
+static gboolean
+start_segment (NvDsSpillLog *log)
+{
+  guint64 index = log->write_fd >= 0 ? log->write_segment + 1 :
+      log->write_segment;
+  gint fd, err;
+
+  if (index - log->first_segment >= log->max_segments)
+    return FALSE;
+
+  fd = open_segment (log, index, O_RDWR | O_CREAT | O_TRUNC);
+  if (fd < 0) {
+    g_printerr ("Failed to create spill segment in %s: %s\n", log->dir,
+        g_strerror (errno));
+    return FALSE;
+  }
+  err = posix_fallocate (fd, 0, log->segment_size);
+  if (err == EOPNOTSUPP || err == EINVAL)
+    err = ftruncate (fd, log->segment_size) < 0 ? errno : 0;
+  if (err) {
+    g_printerr ("Failed to allocate spill segment in %s: %s\n", log->dir,
+        g_strerror (err));
+    close (fd);
+    remove_segment (log, index);
+    return FALSE;
+  }
+
+  if (log->write_fd >= 0) {
+    /* The records of the old segment must not depend on a later sync. */
+    if (log->dirty)
+      fdatasync (log->write_fd);
+    close (log->write_fd);
+  }
+  log->write_fd = fd;
+  log->write_segment = index;
+  log->write_offset = 0;
+  log->dirty = FALSE;
+  log->dir_dirty = TRUE;
+  return TRUE;
+}
+
+/* Writes @iov completely at @offset, resuming after short writes. */
+static gboolean
+write_all (gint fd, struct iovec *iov, gint count, off_t offset)
+{
+  while (count > 0) {
+    gssize written = pwritev (fd, iov, MIN (count, IOV_MAX), offset);
+
+    if (written < 0) {
+      if (errno == EINTR)
+        continue;
+      return FALSE;
+    }
+    offset += written;
+    while (count > 0 && (gsize) written >= iov->iov_len) {
+      written -= iov->iov_len;
+      iov++;
+      count--;
+    }
+    if (count > 0) {
+      iov->iov_base = (guint8 *) iov->iov_base + written;
+      iov->iov_len -= written;
+    }
+  }
+  return TRUE;
+}
+
+/* Finds the segments a previous process left in the directory. */
+static void
+recover_segments (NvDsSpillLog *log)
+{
+  DIR *dir = fdopendir (dup (log->dir_fd));
+  struct dirent *entry;
+  guint64 first = G_MAXUINT64, last = 0;
+
+  if (!dir)
+    return;
+  while ((entry = readdir (dir))) {
+    gchar *end = NULL;
+    guint64 index;
+
+    if (!g_str_has_suffix (entry->d_name, SEGMENT_SUFFIX))
+      continue;
+    index = g_ascii_strtoull (entry->d_name, &end, 16);
+    if (end != entry->d_name + strlen (entry->d_name) - strlen (SEGMENT_SUFFIX))
+      continue;
+    first = MIN (first, index);
+    last = MAX (last, index);
+  }
+  closedir (dir);
+
+  if (first == G_MAXUINT64)
+    return;
+  log->first_segment = log->read_segment = first;
+  log->ack_pos = log->last_read_pos = POS (first, 0);
+  /* The old segments stay readable; appending continues in a new one. */
+  log->write_segment = last + 1;
+  g_print ("Replaying %" G_GUINT64_FORMAT " spill segments from %s\n",
+      last - first + 1, log->dir);
+}
+
+NvDsSpillLog *
+nvds_spill_log_open (const gchar *dir, gsize segment_size, guint64 max_size)
+{
+  NvDsSpillLog *log = NULL;
+
+  init_crc32c ();
+
+  if (g_mkdir_with_parents (dir, 0755) < 0) {
+    g_printerr ("Failed to create spill directory %s: %s\n", dir,
+        g_strerror (errno));
+    return NULL;
+  }
+
+  log = g_new0 (NvDsSpillLog, 1);
+  log->dir = g_strdup (dir);
+  log->segment_size = segment_size;
+  log->max_segments = MAX (max_size / segment_size, 2);
+  log->write_fd = -1;
+  log->read_fd = -1;
+  log->dir_fd = open (dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (log->dir_fd < 0) {
+    g_printerr ("Failed to open spill directory %s: %s\n", dir,
+        g_strerror (errno));
+    nvds_spill_log_close (log);
+    return NULL;
+  }
+
+  recover_segments (log);
+  /* Leftover segments count against max_size, but appending gets at least
+   * one segment. */
+  if (log->write_segment - log->first_segment >= log->max_segments)
+    log->max_segments = log->write_segment - log->first_segment + 1;
+  if (!start_segment (log)) {
+    nvds_spill_log_close (log);
+    return NULL;
+  }
+  return log;
+}
+
+void
+nvds_spill_log_close (NvDsSpillLog *log)
+{
+  if (!log)
+    return;
+  if (log->write_fd >= 0) {
+    nvds_spill_log_sync (log);
+    close (log->write_fd);
+    /* Don't leave an empty segment behind for the next process to read. */
+    if (nvds_spill_log_is_empty (log)) {
+      guint64 index;
+
+      for (index = log->first_segment; index <= log->write_segment; index++)
+        remove_segment (log, index);
+    }
+  }
+  if (log->read_fd >= 0)
+    close (log->read_fd);
+  if (log->dir_fd >= 0)
+    close (log->dir_fd);
+  g_free (log->dir);
+  g_free (log);
+}
+
+gsize
+nvds_spill_log_max_record (const NvDsSpillLog *log)
+{
+  return log->segment_size - NVDS_SPILL_RECORD_HEADER_SIZE;
+}
+
+guint
+nvds_spill_log_append (NvDsSpillLog *log, const struct iovec *records,
+    guint n)
+{
+  struct iovec iov[WRITE_BATCH * 3];
+  guint8 headers[WRITE_BATCH][NVDS_SPILL_RECORD_HEADER_SIZE];
+  guint done = 0;
+
+  /* A zero length would read back as the end of the segment. */
+  for (; done < n; done++) {
+    if (!records[done].iov_len ||
+        records[done].iov_len > nvds_spill_log_max_record (log))
+      break;
+  }
+  n = done;
+  done = 0;
+
+  while (done < n) {
+    gsize offset = log->write_offset;
+    guint count = 0;
+    gint niov = 0;
+
+    /* Gather the records that fit in the current segment. */
+    while (done + count < n && count < WRITE_BATCH) {
+      const struct iovec *record = &records[done + count];
+      gsize span = record_span (record->iov_len);
+      guint32 value;
+
+      if (offset + span > log->segment_size)
+        break;
+
+      value = GUINT32_TO_LE ((guint32) record->iov_len);
+      memcpy (headers[count], &value, 4);
+      value = GUINT32_TO_LE (crc32c (record->iov_base, record->iov_len));
+      memcpy (headers[count] + 4, &value, 4);
+
+      iov[niov].iov_base = headers[count];
+      iov[niov++].iov_len = NVDS_SPILL_RECORD_HEADER_SIZE;
+      iov[niov].iov_base = record->iov_base;
+      iov[niov++].iov_len = record->iov_len;
+      if (span - NVDS_SPILL_RECORD_HEADER_SIZE > record->iov_len) {
+        iov[niov].iov_base = (void *) zeros;
+        iov[niov++].iov_len =
+            span - NVDS_SPILL_RECORD_HEADER_SIZE - record->iov_len;
+      }
+      offset += span;
+      count++;
+    }
+
+    if (!count) {
+      if (!start_segment (log))
+        break;
+      continue;
+    }
+    if (!write_all (log->write_fd, iov, niov, log->write_offset)) {
+      g_printerr ("Failed to write to spill segment in %s: %s\n", log->dir,
+          g_strerror (errno));
+      break;
+    }
+    log->write_offset = offset;
+    log->dirty = TRUE;
+    done += count;
+  }
+  return done;
+}
+
+gboolean
+nvds_spill_log_sync (NvDsSpillLog *log)
+{
+  gboolean ok = TRUE;
+
+  if (log->dirty && fdatasync (log->write_fd) < 0) {
+    g_printerr ("Failed to sync spill segment in %s: %s\n", log->dir,
+        g_strerror (errno));
+    ok = FALSE;
+  }
+  log->dirty = FALSE;
+  /* New segment files must survive a crash too. */
+  if (log->dir_dirty)
+    fsync (log->dir_fd);
+  log->dir_dirty = FALSE;
+  return ok;
+}
+
+static void
+next_segment (NvDsSpillLog *log)
+{
+  if (log->read_segment < log->write_segment) {
+    log->read_segment++;
+    log->read_offset = 0;
+  } else {
+    log->read_offset = log->write_offset;
+  }
+  log->peek_size = 0;
+}
+
+gboolean
+nvds_spill_log_peek (NvDsSpillLog *log, gsize *size)
+{
+  while (!log->peek_size) {
+    guint8 header[NVDS_SPILL_RECORD_HEADER_SIZE];
+    guint32 value;
+    gssize n;
+
+    if (log->read_segment == log->write_segment &&
+        log->read_offset >= log->write_offset)
+      return FALSE;
+    if (log->read_offset + NVDS_SPILL_RECORD_HEADER_SIZE > log->segment_size) {
+      next_segment (log);
+      continue;
+    }
+
+    if (log->read_fd < 0 || log->read_fd_segment != log->read_segment) {
+      if (log->read_fd >= 0)
+        close (log->read_fd);
+      log->read_fd = open_segment (log, log->read_segment, O_RDONLY);
+      log->read_fd_segment = log->read_segment;
+      if (log->read_fd < 0) {
+        /* Removed behind our back, go on with the next one. */
+        next_segment (log);
+        continue;
+      }
+    }
+
+    do {
+      n = pread (log->read_fd, header, sizeof (header), log->read_offset);
+    } while (n < 0 && errno == EINTR);
+    if (n != sizeof (header)) {
+      next_segment (log);
+      continue;
+    }
+    memcpy (&value, header, 4);
+    log->peek_size = GUINT32_FROM_LE (value);
+    memcpy (&value, header + 4, 4);
+    log->peek_crc = GUINT32_FROM_LE (value);
+
+    /* A zero length marks the end of the segment's data. */
+    if (!log->peek_size || log->read_offset + record_span (log->peek_size) >
+        log->segment_size)
+      next_segment (log);
+  }
+  *size = log->peek_size;
+  return TRUE;
+}
+
+gboolean
+nvds_spill_log_read (NvDsSpillLog *log, guint8 *buf, guint64 *pos)
+{
+  gsize size = log->peek_size, got = 0;
+
+  while (got < size) {
+    gssize n = pread (log->read_fd, buf + got, size - got,
+        log->read_offset + NVDS_SPILL_RECORD_HEADER_SIZE + got);
+
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      break;
+    got += n;
+  }
+
+  if (got < size || crc32c (buf, size) != log->peek_crc) {
+    g_printerr ("Corrupt record in spill segment " SEGMENT_NAME_FORMAT
+        " at %" G_GSIZE_FORMAT ", skipping the rest of it\n",
+        log->read_segment, log->read_offset);
+    next_segment (log);
+    return FALSE;
+  }
+
+  log->read_offset += record_span (size);
+  log->peek_size = 0;
+  *pos = log->last_read_pos = POS (log->read_segment, log->read_offset);
+  return TRUE;
+}
+
+void
+nvds_spill_log_ack (NvDsSpillLog *log, guint64 pos)
+{
+  guint64 segment = POS_SEGMENT (pos);
+
+  log->ack_pos = pos;
+  /* Whole segments before the acknowledged record are no longer needed. */
+  for (; log->first_segment < segment; log->first_segment++)
+    remove_segment (log, log->first_segment);
+}
+
+void
+nvds_spill_log_rewind (NvDsSpillLog *log)
+{
+  log->read_segment = POS_SEGMENT (log->ack_pos);
+  log->read_offset = POS_OFFSET (log->ack_pos);
+  log->peek_size = 0;
+  log->last_read_pos = log->ack_pos;
+}
+
+gboolean
+nvds_spill_log_is_empty (const NvDsSpillLog *log)
+{
+  return log->read_segment == log->write_segment &&
+      log->read_offset >= log->write_offset &&
+      log->ack_pos == log->last_read_pos;
+}
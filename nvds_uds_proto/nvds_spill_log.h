@@ -0,0 +1,112 @@
+/*
+ * Copyright (c) 2018-2020, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+/**
+ * @file
+ * <b>Disk spill log</b>
+ *
+ * @b Description: Append-only log of opaque records in a directory of
+ * preallocated segment files, used by the local protocol adaptor to keep
+ * messages across broker outages. Each record is
+ *
+ *   uint32  length of the data, little endian
+ *   uint32  CRC32C of the data, little endian
+ *   data    padded with zeros to 8 bytes
+ *
+ * and a zero length ends the data of a segment. Records are appended in
+ * batches with one pwritev() per batch and made durable with
+ * nvds_spill_log_sync(), so one fdatasync() covers any number of records.
+ * The reader returns records in order and only forgets them once they are
+ * acknowledged; a segment file is deleted when all of its records are.
+ *
+ * Segments left over by an earlier process are replayed: a log reopened on
+ * the same directory continues after the last record whose CRC matches.
+ * Records read but not acknowledged before a restart are read again.
+ *
+ * Appending and reading must not run concurrently.
+ */
+
+#ifndef NVDS_SPILL_LOG_H_
+#define NVDS_SPILL_LOG_H_
+
+#include <sys/uio.h>
+#include <glib.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define NVDS_SPILL_RECORD_HEADER_SIZE 8
+
+typedef struct _NvDsSpillLog NvDsSpillLog;
+
+/**
+ * Opens or creates the log in @dir. Segments are @segment_size bytes and
+ * the log takes at most @max_size bytes of disk. Returns NULL on failure.
+ */
+NvDsSpillLog *nvds_spill_log_open (const gchar *dir, gsize segment_size,
+    guint64 max_size);
+
+void nvds_spill_log_close (NvDsSpillLog *log);
+
+/** Largest record that fits in a segment. */
+gsize nvds_spill_log_max_record (const NvDsSpillLog *log);
+
+/**
+ * Appends @n records. Returns the number appended, fewer than @n if the log
+ * is full or writing failed. Appended records are readable at once but only
+ * durable after nvds_spill_log_sync().
+ */
+guint nvds_spill_log_append (NvDsSpillLog *log, const struct iovec *records,
+    guint n);
+
+/** Makes everything appended so far durable. Returns FALSE on failure. */
+gboolean nvds_spill_log_sync (NvDsSpillLog *log);
+
+/**
+ * Returns the size of the next unread record in @size, or FALSE if all
+ * records have been read.
+ */
+gboolean nvds_spill_log_peek (NvDsSpillLog *log, gsize *size);
+
+/**
+ * Reads the record nvds_spill_log_peek() returned into @buf and returns
+ * the position to acknowledge it with in @pos. Returns FALSE if the record
+ * is corrupt; the rest of its segment is then skipped.
+ */
+gboolean nvds_spill_log_read (NvDsSpillLog *log, guint8 *buf, guint64 *pos);
+
+/** Forgets the records up to and including the one read at @pos. */
+void nvds_spill_log_ack (NvDsSpillLog *log, guint64 pos);
+
+/** Makes the records read but not acknowledged readable again. */
+void nvds_spill_log_rewind (NvDsSpillLog *log);
+
+/** Returns TRUE if every record appended has been read and acknowledged. */
+gboolean nvds_spill_log_is_empty (const NvDsSpillLog *log);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* NVDS_SPILL_LOG_H_ */
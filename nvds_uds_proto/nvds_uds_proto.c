@@ -0,0 +1,928 @@
+/*
+ * Copyright (c) 2018-2020, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+/*
+ * Protocol adaptor writing messages to a local aggregator over a Unix
+ * domain socket or TCP, see nvds_uds_proto.h for the framing.
+ *
+ * Connection string: "unix:/path/to/socket" (or just an absolute path) for
+ * a Unix domain socket, "host;port" for TCP.
+ *
+ * nvds_msgapi_send_async() only queues the framed message. Every call to
+ * nvds_msgapi_do_work() writes whatever is queued with one sendmsg() per
+ * batch of up to max-batch frames, without blocking, and then runs the
+ * completion callbacks of the messages fully written. On a write error the
+ * connection is closed, all pending messages complete with an error and
+ * do_work() reconnects with exponential back-off.
+ *
+ * With spill-dir set, messages go to a spill log on disk instead (see
+ * nvds_spill_log.h) while the connection is down or more than
+ * spill-threshold messages are pending, and so do the messages a dropped
+ * connection leaves unsent. Their callbacks run once they are durable.
+ * Once the connection is back, do_work() replays the log in order at
+ * spill-replay-rate, and new messages keep going to the log until it is
+ * drained so they stay behind the replayed ones. A replayed message is
+ * only removed from the log after it was written to the socket, so
+ * delivery across outages and restarts is at least once.
+ *
+ * Optional settings in the [message-broker] group of the config file:
+ *   queue-size=N          messages queued before send_async() fails (4096)
+ *   max-batch=N           frames per sendmsg() call (256, at most 1024)
+ *   spill-dir=PATH        directory of the spill log, unset disables it
+ *   spill-threshold=N     pending messages before spilling (queue-size / 2)
+ *   spill-segment-size=N  bytes per segment file (64 MiB, 1 MiB to 1 GiB)
+ *   spill-max-size=N      bytes of disk the log may take (4 GiB); further
+ *                         messages fail
+ *   spill-commit-ms=N     longest a message waits for the group commit,
+ *                         which also happens every max-batch messages (50)
+ *   spill-replay-rate=N   messages replayed per second, 0 for unlimited
+ *                         (1000)
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <glib.h>
+
+#include "nvds_msgapi.h"
+#include "nvds_spill_log.h"
+#define NVDS_TRACE_IMPLEMENTATION
+#include "nvds_trace.h"
+#include "nvds_uds_proto.h"
+
+#define CONFIG_GROUP_BROKER "message-broker"
+#define CONFIG_KEY_QUEUE_SIZE "queue-size"
+#define CONFIG_KEY_MAX_BATCH "max-batch"
+#define CONFIG_KEY_SPILL_DIR "spill-dir"
+#define CONFIG_KEY_SPILL_THRESHOLD "spill-threshold"
+#define CONFIG_KEY_SPILL_SEGMENT_SIZE "spill-segment-size"
+#define CONFIG_KEY_SPILL_MAX_SIZE "spill-max-size"
+#define CONFIG_KEY_SPILL_COMMIT_MS "spill-commit-ms"
+#define CONFIG_KEY_SPILL_REPLAY_RATE "spill-replay-rate"
+
+#define DEFAULT_QUEUE_SIZE 4096
+#define DEFAULT_MAX_BATCH 256
+#define MAX_BATCH_LIMIT 1024
+
+#define DEFAULT_SPILL_SEGMENT_SIZE (64 * 1024 * 1024)
+#define MIN_SPILL_SEGMENT_SIZE (1024 * 1024)
+#define MAX_SPILL_SEGMENT_SIZE (1024 * 1024 * 1024)
+#define DEFAULT_SPILL_MAX_SIZE (G_GUINT64_CONSTANT (4) << 30)
+#define DEFAULT_SPILL_COMMIT_MS 50
+#define DEFAULT_SPILL_REPLAY_RATE 1000
+
+#define RECONNECT_MIN_MS 100
+#define RECONNECT_MAX_MS 5000
+/* How long a blocking send waits for the peer to accept more data. */
+#define SEND_TIMEOUT_MS 5000
+
+typedef struct _UdsMessage
+{
+  struct _UdsMessage *next;
+  nvds_msgapi_send_cb_t send_cb;
+  void *user_ptr;
+  /* Counted against queue-size, i.e. sent with send_async. */
+  gboolean queued;
+  /* Sent with send_async, traced until its completion. */
+  gboolean async;
+  /* Position in the spill log of a replayed message, 0 otherwise. */
+  guint64 spill_pos;
+  gsize size;
+  guint8 frame[];
+} UdsMessage;
+
+typedef struct
+{
+  UdsMessage *head;
+  UdsMessage *tail;
+} UdsQueue;
+
+typedef struct
+{
+  gchar *conn_str;
+  gchar *unix_path;
+  gchar *host;
+  gchar *port;
+  nvds_msgapi_connect_cb_t connect_cb;
+  guint max_queue;
+  guint max_batch;
+  gchar *spill_dir;
+  guint spill_threshold;
+  gsize spill_segment_size;
+  guint64 spill_max_size;
+  gint64 spill_commit_us;
+  guint replay_rate;
+
+  /* Protects the queue of messages not yet picked up by a writer. */
+  GMutex lock;
+  UdsQueue queue;
+  guint pending;
+  gboolean connected;
+  /* Messages waiting for the next group commit to the spill log, and
+   * whether new messages have to be spilled to stay behind spilled ones. */
+  UdsQueue spill_queue;
+  guint spill_pending;
+  gint64 spill_since_us;
+  gboolean spilling;
+
+  /* Serializes writers. Protects everything below. */
+  GMutex io_lock;
+  gint fd;
+  UdsQueue inflight;
+  /* Bytes of inflight.head already written. */
+  gsize offset;
+  gint64 next_reconnect_us;
+  guint backoff_ms;
+  NvDsSpillLog *spill;
+  /* Replayed messages not yet written. */
+  guint replaying;
+  gdouble replay_budget;
+  gint64 replay_last_us;
+  guint64 spilled;
+  guint64 replayed;
+} UdsConn;
+
+static void
+queue_push (UdsQueue *queue, UdsMessage *msg)
+{
+  msg->next = NULL;
+  if (queue->tail)
+    queue->tail->next = msg;
+  else
+    queue->head = msg;
+  queue->tail = msg;
+}
+
+static void
+queue_append (UdsQueue *queue, UdsQueue *other)
+{
+  if (!other->head)
+    return;
+  if (queue->tail)
+    queue->tail->next = other->head;
+  else
+    queue->head = other->head;
+  queue->tail = other->tail;
+  other->head = other->tail = NULL;
+}
+
+static UdsMessage *
+message_new (const char *topic, const uint8_t *payload, size_t nbuf,
+    nvds_msgapi_send_cb_t send_cb, void *user_ptr)
+{
+  size_t topic_len = topic ? strlen (topic) : 0;
+  gsize size = NVDS_UDS_FRAME_HEADER_SIZE + topic_len + nbuf;
+  UdsMessage *msg = NULL;
+
+  if (topic_len > G_MAXUINT16 || size - 4 > NVDS_UDS_MAX_FRAME_SIZE)
+    return NULL;
+
+  msg = (UdsMessage *) g_malloc (sizeof (UdsMessage) + size);
+  msg->next = NULL;
+  msg->send_cb = send_cb;
+  msg->user_ptr = user_ptr;
+  msg->queued = FALSE;
+  msg->async = FALSE;
+  msg->spill_pos = 0;
+  msg->size = size;
+  nvds_uds_write_header (msg->frame, topic_len, nbuf);
+  memcpy (msg->frame + NVDS_UDS_FRAME_HEADER_SIZE, topic, topic_len);
+  memcpy (msg->frame + NVDS_UDS_FRAME_HEADER_SIZE + topic_len, payload, nbuf);
+  return msg;
+}
+
+/* Runs the callbacks of @done, frees the messages and returns how many
+ * there were. */
+static guint
+complete (UdsConn *conn, UdsQueue *done, NvDsMsgApiErrorType status)
+{
+  UdsMessage *msg = done->head;
+  guint queued = 0;
+  guint count = 0;
+
+  while (msg) {
+    UdsMessage *next = msg->next;
+
+    if (msg->async) {
+      nvds_trace_async_end ("broker", "send", GPOINTER_TO_SIZE (msg),
+          "status", status);
+    }
+    if (msg->send_cb)
+      msg->send_cb (msg->user_ptr, status);
+    queued += msg->queued;
+    count++;
+    g_free (msg);
+    msg = next;
+  }
+  done->head = done->tail = NULL;
+
+  if (queued) {
+    g_mutex_lock (&conn->lock);
+    conn->pending -= queued;
+    g_mutex_unlock (&conn->lock);
+  }
+  return count;
+}
+
+static gint
+open_socket (UdsConn *conn)
+{
+  gint fd = -1;
+
+  if (conn->unix_path) {
+    struct sockaddr_un addr;
+
+    memset (&addr, 0, sizeof (addr));
+    addr.sun_family = AF_UNIX;
+    g_strlcpy (addr.sun_path, conn->unix_path, sizeof (addr.sun_path));
+    fd = socket (AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd >= 0 && connect (fd, (struct sockaddr *) &addr, sizeof (addr)) < 0) {
+      close (fd);
+      fd = -1;
+    }
+  } else {
+    struct addrinfo hints, *res = NULL, *ai;
+    gint one = 1;
+
+    memset (&hints, 0, sizeof (hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo (conn->host, conn->port, &hints, &res) != 0)
+      return -1;
+    for (ai = res; ai && fd < 0; ai = ai->ai_next) {
+      fd = socket (ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC,
+          ai->ai_protocol);
+      if (fd >= 0 && connect (fd, ai->ai_addr, ai->ai_addrlen) < 0) {
+        close (fd);
+        fd = -1;
+      }
+    }
+    freeaddrinfo (res);
+    /* Frames are already batched, don't let Nagle hold back the tail. */
+    if (fd >= 0)
+      setsockopt (fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof (one));
+  }
+
+  if (fd >= 0)
+    fcntl (fd, F_SETFL, fcntl (fd, F_GETFL) | O_NONBLOCK);
+  return fd;
+}
+
+static gboolean
+wait_writable (gint fd)
+{
+  struct pollfd pfd = { fd, POLLOUT, 0 };
+  gint ret;
+
+  do {
+    ret = poll (&pfd, 1, SEND_TIMEOUT_MS);
+  } while (ret < 0 && errno == EINTR);
+  return ret > 0 && !(pfd.revents & (POLLERR | POLLHUP | POLLNVAL));
+}
+
+/*
+ * Writes the queued messages, followed by @extra if set, moving fully
+ * written messages to @done. Without @block, stops when the socket is
+ * full. Returns FALSE on a write error. Called with io_lock held.
+ */
+static gboolean
+write_pending (UdsConn *conn, UdsMessage *extra, gboolean block,
+    UdsQueue *done)
+{
+  struct iovec iov[MAX_BATCH_LIMIT];
+  struct msghdr hdr;
+
+  g_mutex_lock (&conn->lock);
+  queue_append (&conn->inflight, &conn->queue);
+  g_mutex_unlock (&conn->lock);
+  if (extra)
+    queue_push (&conn->inflight, extra);
+
+  while (conn->inflight.head) {
+    UdsMessage *msg = conn->inflight.head;
+    gsize offset = conn->offset;
+    guint n = 0;
+    gssize written;
+
+    for (; msg && n < conn->max_batch; msg = msg->next, n++) {
+      iov[n].iov_base = msg->frame + offset;
+      iov[n].iov_len = msg->size - offset;
+      offset = 0;
+    }
+
+    memset (&hdr, 0, sizeof (hdr));
+    hdr.msg_iov = iov;
+    hdr.msg_iovlen = n;
+    written = sendmsg (conn->fd, &hdr, MSG_NOSIGNAL | MSG_DONTWAIT);
+    if (written < 0) {
+      if (errno == EINTR)
+        continue;
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        if (block && wait_writable (conn->fd))
+          continue;
+        return !block;
+      }
+      return FALSE;
+    }
+
+    /* Retire the frames covered by @written. */
+    while (written > 0) {
+      msg = conn->inflight.head;
+      if ((gsize) written < msg->size - conn->offset) {
+        conn->offset += written;
+        break;
+      }
+      written -= msg->size - conn->offset;
+      conn->offset = 0;
+      conn->inflight.head = msg->next;
+      if (!conn->inflight.head)
+        conn->inflight.tail = NULL;
+      if (msg->spill_pos) {
+        nvds_spill_log_ack (conn->spill, msg->spill_pos);
+        conn->replaying--;
+        conn->replayed++;
+      }
+      queue_push (done, msg);
+    }
+  }
+  return TRUE;
+}
+
+/*
+ * Closes the connection after a write error and moves every pending
+ * message to @failed. With a spill log, messages sent with send_async go
+ * to the spill queue instead and replayed messages are left to be read
+ * again. Called with io_lock held.
+ */
+static void
+drop_connection (UdsConn *conn, UdsQueue *failed)
+{
+  UdsQueue dropped = { NULL, NULL };
+  UdsQueue rescued = { NULL, NULL };
+  UdsMessage *msg;
+  guint n = 0;
+
+  if (conn->fd >= 0)
+    close (conn->fd);
+  conn->fd = -1;
+  conn->offset = 0;
+  queue_append (&dropped, &conn->inflight);
+
+  g_mutex_lock (&conn->lock);
+  queue_append (&dropped, &conn->queue);
+  conn->connected = FALSE;
+  g_mutex_unlock (&conn->lock);
+
+  while (conn->spill && (msg = dropped.head)) {
+    dropped.head = msg->next;
+    if (msg->spill_pos) {
+      conn->replaying--;
+      g_free (msg);
+    } else if (msg->queued) {
+      msg->queued = FALSE;
+      queue_push (&rescued, msg);
+      n++;
+    } else {
+      queue_push (failed, msg);
+    }
+  }
+  if (conn->spill) {
+    dropped.tail = NULL;
+    nvds_spill_log_rewind (conn->spill);
+    /* They are older than anything waiting for the commit. */
+    g_mutex_lock (&conn->lock);
+    conn->pending -= n;
+    queue_append (&rescued, &conn->spill_queue);
+    conn->spill_queue = rescued;
+    conn->spill_pending += n;
+    if (n && !conn->spill_since_us)
+      conn->spill_since_us = g_get_monotonic_time ();
+    conn->spilling = conn->spilling || n;
+    g_mutex_unlock (&conn->lock);
+  }
+  queue_append (failed, &dropped);
+
+  conn->backoff_ms = RECONNECT_MIN_MS;
+  conn->next_reconnect_us = g_get_monotonic_time () +
+      conn->backoff_ms * G_TIME_SPAN_MILLISECOND;
+}
+
+static void
+try_reconnect (UdsConn *conn)
+{
+  gint64 now = g_get_monotonic_time ();
+
+  if (now < conn->next_reconnect_us)
+    return;
+
+  conn->fd = open_socket (conn);
+  if (conn->fd < 0) {
+    conn->backoff_ms = MIN (conn->backoff_ms * 2, RECONNECT_MAX_MS);
+    conn->next_reconnect_us = now + conn->backoff_ms * G_TIME_SPAN_MILLISECOND;
+    return;
+  }
+  g_mutex_lock (&conn->lock);
+  conn->connected = TRUE;
+  g_mutex_unlock (&conn->lock);
+  g_print ("Reconnected to %s\n", conn->conn_str);
+}
+
+/*
+ * Appends the spill queue to the spill log once its oldest message waited
+ * spill-commit-ms or max-batch messages are waiting, or right away with
+ * @force, and syncs the log. Messages
+ * made durable go to @done, those the log had no room for to @failed.
+ * Called with io_lock held.
+ */
+static void
+spill_messages (UdsConn *conn, gboolean force, UdsQueue *done,
+    UdsQueue *failed)
+{
+  UdsQueue batch = { NULL, NULL };
+  struct iovec *records;
+  UdsMessage *msg;
+  guint n = 0, appended, i;
+  gboolean synced;
+
+  g_mutex_lock (&conn->lock);
+  if (conn->spill_queue.head && (force ||
+          conn->spill_pending >= conn->max_batch ||
+          g_get_monotonic_time () - conn->spill_since_us >=
+          conn->spill_commit_us)) {
+    batch = conn->spill_queue;
+    n = conn->spill_pending;
+    conn->spill_queue.head = conn->spill_queue.tail = NULL;
+    conn->spill_pending = 0;
+    conn->spill_since_us = 0;
+  }
+  g_mutex_unlock (&conn->lock);
+  if (!n)
+    return;
+
+  records = g_new (struct iovec, n);
+  for (msg = batch.head, i = 0; msg; msg = msg->next, i++) {
+    records[i].iov_base = msg->frame;
+    records[i].iov_len = msg->size;
+  }
+  /* One sync for the whole batch is the group commit. */
+  appended = nvds_spill_log_append (conn->spill, records, n);
+  synced = nvds_spill_log_sync (conn->spill);
+  g_free (records);
+
+  if (appended < n) {
+    g_printerr ("Spill log %s is full, dropping %u messages\n",
+        conn->spill_dir, n - appended);
+  }
+  for (i = 0; (msg = batch.head); i++) {
+    batch.head = msg->next;
+    queue_push (i < appended && synced ? done : failed, msg);
+  }
+  conn->spilled += appended;
+}
+
+/*
+ * Moves spilled messages back into the send queue, after what is already
+ * queued, as fast as spill-replay-rate allows. Called with io_lock held.
+ */
+static void
+replay_messages (UdsConn *conn)
+{
+  gint64 now = g_get_monotonic_time ();
+  gsize size;
+
+  if (conn->replay_rate) {
+    conn->replay_budget = MIN (conn->replay_budget +
+        (now - conn->replay_last_us) * conn->replay_rate / 1e6,
+        conn->max_batch);
+  } else {
+    conn->replay_budget = conn->max_batch;
+  }
+  conn->replay_last_us = now;
+
+  g_mutex_lock (&conn->lock);
+  queue_append (&conn->inflight, &conn->queue);
+  g_mutex_unlock (&conn->lock);
+
+  while (conn->replay_budget >= 1 && conn->replaying < conn->spill_threshold &&
+      nvds_spill_log_peek (conn->spill, &size)) {
+    UdsMessage *msg = (UdsMessage *) g_malloc (sizeof (UdsMessage) + size);
+
+    /* The CRC vouches for the frame, it was built by message_new(). */
+    memset (msg, 0, sizeof (UdsMessage));
+    msg->size = size;
+    if (!nvds_spill_log_read (conn->spill, msg->frame, &msg->spill_pos)) {
+      g_free (msg);
+      continue;
+    }
+    queue_push (&conn->inflight, msg);
+    conn->replaying++;
+    conn->replay_budget -= 1;
+  }
+
+  if (!conn->replaying && nvds_spill_log_is_empty (conn->spill)) {
+    g_mutex_lock (&conn->lock);
+    if (conn->spilling && !conn->spill_queue.head) {
+      conn->spilling = FALSE;
+      g_print ("Spilled %" G_GUINT64_FORMAT " messages, replayed %"
+          G_GUINT64_FORMAT " to %s\n", conn->spilled, conn->replayed,
+          conn->conn_str);
+      conn->spilled = conn->replayed = 0;
+    }
+    g_mutex_unlock (&conn->lock);
+  }
+}
+
+static gboolean
+parse_connection_string (UdsConn *conn, const char *connection_str)
+{
+  gchar **tokens = NULL;
+  gboolean ret = FALSE;
+
+  if (g_str_has_prefix (connection_str, NVDS_UDS_UNIX_PREFIX)) {
+    conn->unix_path =
+        g_strdup (connection_str + strlen (NVDS_UDS_UNIX_PREFIX));
+  } else if (connection_str[0] == '/') {
+    conn->unix_path = g_strdup (connection_str);
+  }
+  if (conn->unix_path) {
+    return conn->unix_path[0] != '\0' &&
+        strlen (conn->unix_path) < sizeof (((struct sockaddr_un *) 0)->sun_path);
+  }
+
+  tokens = g_strsplit (connection_str, ";", 2);
+  if (tokens[0] && tokens[1] && tokens[0][0] && tokens[1][0]) {
+    conn->host = g_strdup (g_strstrip (tokens[0]));
+    conn->port = g_strdup (g_strstrip (tokens[1]));
+    ret = TRUE;
+  }
+  g_strfreev (tokens);
+  return ret;
+}
+
+static void
+parse_config (UdsConn *conn, const char *config_path)
+{
+  GKeyFile *key_file = NULL;
+  GError *error = NULL;
+  gint64 size;
+  gint value;
+
+  if (!config_path)
+    return;
+
+  key_file = g_key_file_new ();
+  if (!g_key_file_load_from_file (key_file, config_path, G_KEY_FILE_NONE,
+          &error)) {
+    g_printerr ("Failed to load config %s: %s\n", config_path,
+        error->message);
+    g_error_free (error);
+    g_key_file_free (key_file);
+    return;
+  }
+
+  value = g_key_file_get_integer (key_file, CONFIG_GROUP_BROKER,
+      CONFIG_KEY_QUEUE_SIZE, &error);
+  if (!error && value > 0)
+    conn->max_queue = value;
+  g_clear_error (&error);
+
+  value = g_key_file_get_integer (key_file, CONFIG_GROUP_BROKER,
+      CONFIG_KEY_MAX_BATCH, &error);
+  if (!error && value > 0)
+    conn->max_batch = MIN (value, MAX_BATCH_LIMIT);
+  g_clear_error (&error);
+
+  conn->spill_dir = g_key_file_get_string (key_file, CONFIG_GROUP_BROKER,
+      CONFIG_KEY_SPILL_DIR, NULL);
+  if (conn->spill_dir && !conn->spill_dir[0]) {
+    g_free (conn->spill_dir);
+    conn->spill_dir = NULL;
+  }
+
+  value = g_key_file_get_integer (key_file, CONFIG_GROUP_BROKER,
+      CONFIG_KEY_SPILL_THRESHOLD, &error);
+  if (!error && value > 0)
+    conn->spill_threshold = value;
+  g_clear_error (&error);
+
+  size = g_key_file_get_int64 (key_file, CONFIG_GROUP_BROKER,
+      CONFIG_KEY_SPILL_SEGMENT_SIZE, &error);
+  if (!error && size > 0)
+    conn->spill_segment_size = CLAMP (size, MIN_SPILL_SEGMENT_SIZE,
+        MAX_SPILL_SEGMENT_SIZE);
+  g_clear_error (&error);
+
+  size = g_key_file_get_int64 (key_file, CONFIG_GROUP_BROKER,
+      CONFIG_KEY_SPILL_MAX_SIZE, &error);
+  if (!error && size > 0)
+    conn->spill_max_size = size;
+  g_clear_error (&error);
+
+  value = g_key_file_get_integer (key_file, CONFIG_GROUP_BROKER,
+      CONFIG_KEY_SPILL_COMMIT_MS, &error);
+  if (!error && value >= 0)
+    conn->spill_commit_us = value * G_TIME_SPAN_MILLISECOND;
+  g_clear_error (&error);
+
+  value = g_key_file_get_integer (key_file, CONFIG_GROUP_BROKER,
+      CONFIG_KEY_SPILL_REPLAY_RATE, &error);
+  if (!error && value >= 0)
+    conn->replay_rate = value;
+  g_clear_error (&error);
+
+  g_key_file_free (key_file);
+}
+
+static void
+conn_free (UdsConn *conn)
+{
+  g_mutex_clear (&conn->lock);
+  g_mutex_clear (&conn->io_lock);
+  nvds_spill_log_close (conn->spill);
+  g_free (conn->spill_dir);
+  g_free (conn->conn_str);
+  g_free (conn->unix_path);
+  g_free (conn->host);
+  g_free (conn->port);
+  g_free (conn);
+}
+
+NvDsMsgApiHandle
+nvds_msgapi_connect (char *connection_str,
+    nvds_msgapi_connect_cb_t connect_cb, char *config_path)
+{
+  UdsConn *conn = NULL;
+
+  if (!connection_str) {
+    g_printerr ("No connection string\n");
+    return NULL;
+  }
+
+  conn = g_new0 (UdsConn, 1);
+  g_mutex_init (&conn->lock);
+  g_mutex_init (&conn->io_lock);
+  conn->conn_str = g_strdup (connection_str);
+  conn->connect_cb = connect_cb;
+  conn->max_queue = DEFAULT_QUEUE_SIZE;
+  conn->max_batch = DEFAULT_MAX_BATCH;
+  conn->spill_segment_size = DEFAULT_SPILL_SEGMENT_SIZE;
+  conn->spill_max_size = DEFAULT_SPILL_MAX_SIZE;
+  conn->spill_commit_us = DEFAULT_SPILL_COMMIT_MS * G_TIME_SPAN_MILLISECOND;
+  conn->replay_rate = DEFAULT_SPILL_REPLAY_RATE;
+  conn->backoff_ms = RECONNECT_MIN_MS;
+
+  if (!parse_connection_string (conn, connection_str)) {
+    g_printerr ("Invalid connection string %s, expected "
+        NVDS_UDS_UNIX_PREFIX "<path> or <host>;<port>\n", connection_str);
+    conn_free (conn);
+    return NULL;
+  }
+  parse_config (conn, config_path);
+  if (!conn->spill_threshold)
+    conn->spill_threshold = MAX (conn->max_queue / 2, 1);
+
+  if (conn->spill_dir) {
+    conn->spill = nvds_spill_log_open (conn->spill_dir,
+        conn->spill_segment_size, conn->spill_max_size);
+    if (!conn->spill) {
+      conn_free (conn);
+      return NULL;
+    }
+    /* Leftovers of an earlier run go out before anything new. */
+    conn->spilling = !nvds_spill_log_is_empty (conn->spill);
+    conn->replay_last_us = g_get_monotonic_time ();
+  }
+
+  conn->fd = open_socket (conn);
+  if (conn->fd < 0 && !conn->spill) {
+    g_printerr ("Failed to connect to %s: %s\n", connection_str,
+        g_strerror (errno));
+    conn_free (conn);
+    return NULL;
+  }
+  if (conn->fd < 0) {
+    /* Messages can be spilled until the peer shows up. */
+    g_printerr ("Failed to connect to %s: %s, spilling to %s\n",
+        connection_str, g_strerror (errno), conn->spill_dir);
+    conn->next_reconnect_us = g_get_monotonic_time () +
+        conn->backoff_ms * G_TIME_SPAN_MILLISECOND;
+  }
+  conn->connected = conn->fd >= 0;
+  return (NvDsMsgApiHandle) conn;
+}
+
+NvDsMsgApiErrorType
+nvds_msgapi_send (NvDsMsgApiHandle h_ptr, char *topic, const uint8_t *payload,
+    size_t nbuf)
+{
+  UdsConn *conn = (UdsConn *) h_ptr;
+  UdsQueue done = { NULL, NULL };
+  UdsQueue failed = { NULL, NULL };
+  UdsMessage *msg = NULL;
+  gboolean ok = FALSE;
+  gint64 trace_begin;
+
+  if (!conn || !payload)
+    return NVDS_MSGAPI_ERR;
+  msg = message_new (topic, payload, nbuf, NULL, NULL);
+  if (!msg)
+    return NVDS_MSGAPI_ERR;
+  trace_begin = nvds_trace_begin ();
+
+  /* Holding io_lock keeps the message out of reach of do_work(), so it is
+   * known to be written, after everything queued before it, once
+   * write_pending() returns. */
+  g_mutex_lock (&conn->io_lock);
+  if (conn->fd >= 0) {
+    ok = write_pending (conn, msg, TRUE, &done);
+    if (!ok)
+      drop_connection (conn, &failed);
+  } else {
+    queue_push (&failed, msg);
+  }
+  g_mutex_unlock (&conn->io_lock);
+
+  complete (conn, &done, NVDS_MSGAPI_OK);
+  complete (conn, &failed, NVDS_MSGAPI_ERR);
+  nvds_trace_end ("broker", "send", trace_begin, "bytes", nbuf);
+  if (!ok && conn->connect_cb)
+    conn->connect_cb (h_ptr, NVDS_MSGAPI_EVT_DISCONNECT);
+  return ok ? NVDS_MSGAPI_OK : NVDS_MSGAPI_ERR;
+}
+
+NvDsMsgApiErrorType
+nvds_msgapi_send_async (NvDsMsgApiHandle h_ptr, char *topic,
+    const uint8_t *payload, size_t nbuf, nvds_msgapi_send_cb_t send_callback,
+    void *user_ptr)
+{
+  UdsConn *conn = (UdsConn *) h_ptr;
+  UdsMessage *msg = NULL;
+  gboolean queued = FALSE;
+
+  if (!conn || !payload)
+    return NVDS_MSGAPI_ERR;
+  msg = message_new (topic, payload, nbuf, send_callback, user_ptr);
+  if (!msg)
+    return NVDS_MSGAPI_ERR;
+  /* Begun before the message is queued, a writer may complete it at
+   * once. */
+  msg->async = TRUE;
+  nvds_trace_async_begin ("broker", "send", GPOINTER_TO_SIZE (msg), "bytes",
+      nbuf);
+
+  g_mutex_lock (&conn->lock);
+  if (conn->spill && (conn->spilling || !conn->connected ||
+          conn->pending >= conn->spill_threshold)) {
+    if (conn->spill_pending < conn->max_queue) {
+      if (!conn->spill_queue.head)
+        conn->spill_since_us = g_get_monotonic_time ();
+      queue_push (&conn->spill_queue, msg);
+      conn->spill_pending++;
+      conn->spilling = TRUE;
+      queued = TRUE;
+    }
+  } else if (conn->connected && conn->pending < conn->max_queue) {
+    msg->queued = TRUE;
+    queue_push (&conn->queue, msg);
+    conn->pending++;
+    queued = TRUE;
+  }
+  g_mutex_unlock (&conn->lock);
+
+  if (!queued) {
+    nvds_trace_async_end ("broker", "send", GPOINTER_TO_SIZE (msg), "status",
+        NVDS_MSGAPI_ERR);
+    g_free (msg);
+    return NVDS_MSGAPI_ERR;
+  }
+  return NVDS_MSGAPI_OK;
+}
+
+void
+nvds_msgapi_do_work (NvDsMsgApiHandle h_ptr)
+{
+  UdsConn *conn = (UdsConn *) h_ptr;
+  UdsQueue done = { NULL, NULL };
+  UdsQueue failed = { NULL, NULL };
+  gboolean ok = TRUE;
+  gint64 trace_begin;
+  guint written;
+
+  if (!conn)
+    return;
+
+  trace_begin = nvds_trace_begin ();
+  g_mutex_lock (&conn->io_lock);
+  if (conn->spill)
+    spill_messages (conn, FALSE, &done, &failed);
+  if (conn->fd < 0)
+    try_reconnect (conn);
+  if (conn->fd >= 0) {
+    if (conn->spill)
+      replay_messages (conn);
+    ok = write_pending (conn, NULL, FALSE, &done);
+    if (!ok)
+      drop_connection (conn, &failed);
+  }
+  g_mutex_unlock (&conn->io_lock);
+
+  /* Only calls that got something done, do_work() is called in a loop. */
+  written = complete (conn, &done, NVDS_MSGAPI_OK);
+  if (written)
+    nvds_trace_end ("broker", "write", trace_begin, "messages", written);
+  complete (conn, &failed, NVDS_MSGAPI_ERR);
+  if (!ok) {
+    g_printerr ("Lost connection to %s\n", conn->conn_str);
+    if (conn->connect_cb)
+      conn->connect_cb (h_ptr, NVDS_MSGAPI_EVT_DISCONNECT);
+  }
+}
+
+NvDsMsgApiErrorType
+nvds_msgapi_subscribe (NvDsMsgApiHandle h_ptr, char **topics, int num_topics,
+    nvds_msgapi_subscribe_request_cb_t cb, void *user_ctx)
+{
+  g_printerr ("Subscribe is not supported by the " NVDS_UDS_PROTOCOL_NAME
+      " adaptor\n");
+  return NVDS_MSGAPI_ERR;
+}
+
+NvDsMsgApiErrorType
+nvds_msgapi_disconnect (NvDsMsgApiHandle h_ptr)
+{
+  UdsConn *conn = (UdsConn *) h_ptr;
+  UdsQueue done = { NULL, NULL };
+  UdsQueue failed = { NULL, NULL };
+
+  if (!conn)
+    return NVDS_MSGAPI_ERR;
+
+  /* Give the peer a chance to take what is still queued. */
+  g_mutex_lock (&conn->io_lock);
+  if (conn->fd >= 0)
+    write_pending (conn, NULL, TRUE, &done);
+  drop_connection (conn, &failed);
+  /* Whatever is left is kept for the next run. */
+  if (conn->spill)
+    spill_messages (conn, TRUE, &done, &failed);
+  g_mutex_unlock (&conn->io_lock);
+
+  complete (conn, &done, NVDS_MSGAPI_OK);
+  complete (conn, &failed, NVDS_MSGAPI_ERR);
+  conn_free (conn);
+  return NVDS_MSGAPI_OK;
+}
+
+char *
+nvds_msgapi_getversion (void)
+{
+  return (char *) NVDS_MSGAPI_VERSION;
+}
+
+char *
+nvds_msgapi_get_protocol_name (void)
+{
+  return (char *) NVDS_UDS_PROTOCOL_NAME;
+}
+
+NvDsMsgApiErrorType
+nvds_msgapi_connection_signature (char *broker_str, char *cfg,
+    char *output_str, int max_len)
+{
+  if (!broker_str || !output_str || max_len <= 0)
+    return NVDS_MSGAPI_ERR;
+  /* Connections are only shared between identical connection strings. */
+  if (g_strlcpy (output_str, broker_str, max_len) >= (gsize) max_len) {
+    output_str[0] = '\0';
+    return NVDS_MSGAPI_ERR;
+  }
+  return NVDS_MSGAPI_OK;
+}
@@ -0,0 +1,90 @@
+/*
+ * Copyright (c) 2018-2020, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+/**
+ * @file
+ * <b>Local protocol adaptor framing</b>
+ *
+ * @b Description: Wire format shared by libnvds_uds_proto.so and
+ * uds_receiver. The adaptor writes a stream of frames to a Unix domain
+ * socket or a TCP connection:
+ *
+ *   uint32  length of the rest of the frame, big endian
+ *   uint16  length of the topic, big endian
+ *   topic   not NUL terminated
+ *   payload the remaining bytes
+ */
+
+#ifndef NVDS_UDS_PROTO_H_
+#define NVDS_UDS_PROTO_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define NVDS_UDS_PROTOCOL_NAME "UDS"
+#define NVDS_UDS_FRAME_HEADER_SIZE 6
+/** Frames larger than this are rejected by both sides. */
+#define NVDS_UDS_MAX_FRAME_SIZE (64 * 1024 * 1024)
+
+/** Prefix selecting a Unix domain socket in the connection string. */
+#define NVDS_UDS_UNIX_PREFIX "unix:"
+
+static inline void
+nvds_uds_write_header (uint8_t *header, size_t topic_len, size_t payload_len)
+{
+  uint32_t length = (uint32_t) (2 + topic_len + payload_len);
+
+  header[0] = length >> 24;
+  header[1] = length >> 16;
+  header[2] = length >> 8;
+  header[3] = length;
+  header[4] = topic_len >> 8;
+  header[5] = topic_len;
+}
+
+/**
+ * Parses the header at @header. Returns the number of bytes following the
+ * length field, or 0 if the header is malformed.
+ */
+static inline uint32_t
+nvds_uds_read_header (const uint8_t *header, uint16_t *topic_len)
+{
+  uint32_t length = ((uint32_t) header[0] << 24) |
+      ((uint32_t) header[1] << 16) | ((uint32_t) header[2] << 8) | header[3];
+
+  *topic_len = (uint16_t) ((header[4] << 8) | header[5]);
+  if (length < 2 || length > NVDS_UDS_MAX_FRAME_SIZE ||
+      *topic_len > length - 2)
+    return 0;
+  return length;
+}
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* NVDS_UDS_PROTO_H_ */
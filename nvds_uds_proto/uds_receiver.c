@@ -0,0 +1,275 @@
+/*
+ * Copyright (c) 2018-2020, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+/*
+ * Minimal receiver for the local protocol adaptor. Accepts any number of
+ * connections on a Unix domain socket or a TCP port, reassembles the
+ * frames and prints the message rate once a second, or every message
+ * with -v. SIGUSR1 pauses and resumes reading, so that the sender backs
+ * up as it would behind a stalled broker.
+ *
+ *   uds_receiver [-v] unix:/path/to/socket
+ *   uds_receiver [-v] port
+ */
+
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "nvds_uds_proto.h"
+
+#define MAX_CLIENTS 64
+#define READ_SIZE (256 * 1024)
+
+typedef struct
+{
+  int fd;
+  uint8_t *buf;
+  size_t len;
+  size_t cap;
+} Client;
+
+static volatile sig_atomic_t quit = 0;
+static volatile sig_atomic_t paused = 0;
+
+static void
+on_signal (int sig)
+{
+  quit = 1;
+}
+
+static void
+on_pause (int sig)
+{
+  paused = !paused;
+}
+
+static double
+now_sec (void)
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int
+listen_on (const char *address)
+{
+  int fd;
+
+  if (strncmp (address, NVDS_UDS_UNIX_PREFIX,
+          strlen (NVDS_UDS_UNIX_PREFIX)) == 0 || address[0] == '/') {
+    const char *path = address[0] == '/' ? address :
+        address + strlen (NVDS_UDS_UNIX_PREFIX);
+    struct sockaddr_un addr;
+
+    memset (&addr, 0, sizeof (addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen (path) >= sizeof (addr.sun_path)) {
+      fprintf (stderr, "Socket path too long: %s\n", path);
+      return -1;
+    }
+    strcpy (addr.sun_path, path);
+    unlink (path);
+    fd = socket (AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || bind (fd, (struct sockaddr *) &addr, sizeof (addr)) < 0)
+      goto error;
+  } else {
+    struct sockaddr_in addr;
+    int one = 1;
+
+    memset (&addr, 0, sizeof (addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+    addr.sin_port = htons (atoi (address));
+    fd = socket (AF_INET, SOCK_STREAM, 0);
+    if (fd < 0)
+      goto error;
+    setsockopt (fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof (one));
+    if (bind (fd, (struct sockaddr *) &addr, sizeof (addr)) < 0)
+      goto error;
+  }
+  if (listen (fd, MAX_CLIENTS) < 0)
+    goto error;
+  return fd;
+
+error:
+  fprintf (stderr, "Failed to listen on %s: %s\n", address, strerror (errno));
+  if (fd >= 0)
+    close (fd);
+  return -1;
+}
+
+/* Consumes the complete frames in @client's buffer. Returns -1 on a
+ * malformed frame. */
+static int
+parse_frames (Client *client, int verbose, unsigned long *messages,
+    unsigned long *bytes)
+{
+  size_t pos = 0;
+
+  while (client->len - pos >= NVDS_UDS_FRAME_HEADER_SIZE) {
+    const uint8_t *frame = client->buf + pos;
+    uint16_t topic_len;
+    uint32_t length = nvds_uds_read_header (frame, &topic_len);
+
+    if (!length)
+      return -1;
+    if (client->len - pos < 4 + (size_t) length)
+      break;
+    if (verbose) {
+      printf ("%.*s: %.*s\n", topic_len,
+          (const char *) frame + NVDS_UDS_FRAME_HEADER_SIZE,
+          (int) (length - 2 - topic_len),
+          (const char *) frame + NVDS_UDS_FRAME_HEADER_SIZE + topic_len);
+    }
+    (*messages)++;
+    *bytes += length - 2 - topic_len;
+    pos += 4 + length;
+  }
+  memmove (client->buf, client->buf + pos, client->len - pos);
+  client->len -= pos;
+  return 0;
+}
+
+static void
+drop_client (Client *client)
+{
+  close (client->fd);
+  free (client->buf);
+  memset (client, 0, sizeof (*client));
+  client->fd = -1;
+}
+
+int
+main (int argc, char *argv[])
+{
+  Client clients[MAX_CLIENTS];
+  struct pollfd pfds[MAX_CLIENTS + 1];
+  unsigned long messages = 0, bytes = 0, last_messages = 0;
+  double last_report;
+  int verbose = 0;
+  int listen_fd, i;
+
+  if (argc > 1 && strcmp (argv[1], "-v") == 0) {
+    verbose = 1;
+    argc--;
+    argv++;
+  }
+  if (argc != 2) {
+    fprintf (stderr, "Usage: uds_receiver [-v] <unix:/path | port>\n");
+    return -1;
+  }
+
+  listen_fd = listen_on (argv[1]);
+  if (listen_fd < 0)
+    return -1;
+
+  signal (SIGINT, on_signal);
+  signal (SIGTERM, on_signal);
+  signal (SIGUSR1, on_pause);
+  for (i = 0; i < MAX_CLIENTS; i++)
+    clients[i].fd = -1;
+  last_report = now_sec ();
+
+  while (!quit) {
+    int nfds = 1;
+    double now;
+
+    pfds[0].fd = listen_fd;
+    pfds[0].events = POLLIN;
+    for (i = 0; i < MAX_CLIENTS; i++) {
+      pfds[i + 1].fd = paused ? -1 : clients[i].fd;
+      pfds[i + 1].events = POLLIN;
+      pfds[i + 1].revents = 0;
+      nfds++;
+    }
+
+    if (poll (pfds, nfds, 1000) < 0 && errno != EINTR)
+      break;
+
+    if (pfds[0].revents & POLLIN) {
+      int fd = accept (listen_fd, NULL, NULL);
+      for (i = 0; fd >= 0 && i < MAX_CLIENTS && clients[i].fd >= 0; i++);
+      if (fd >= 0 && i == MAX_CLIENTS) {
+        close (fd);
+      } else if (fd >= 0) {
+        clients[i].fd = fd;
+        clients[i].cap = READ_SIZE;
+        clients[i].buf = malloc (clients[i].cap);
+        clients[i].len = 0;
+      }
+    }
+
+    for (i = 0; i < MAX_CLIENTS; i++) {
+      Client *client = &clients[i];
+      ssize_t n;
+
+      if (client->fd < 0 || !(pfds[i + 1].revents & (POLLIN | POLLHUP)))
+        continue;
+      if (client->cap - client->len < READ_SIZE) {
+        client->cap = client->len + READ_SIZE;
+        client->buf = realloc (client->buf, client->cap);
+      }
+      n = read (client->fd, client->buf + client->len, READ_SIZE);
+      if (n <= 0) {
+        if (n < 0 && errno == EINTR)
+          continue;
+        drop_client (client);
+        continue;
+      }
+      client->len += n;
+      if (parse_frames (client, verbose, &messages, &bytes) < 0) {
+        fprintf (stderr, "Malformed frame, dropping connection\n");
+        drop_client (client);
+      }
+    }
+
+    now = now_sec ();
+    if (!verbose && now - last_report >= 1.0) {
+      printf ("%.0f msg/s, %lu messages, %lu bytes total%s\n",
+          (messages - last_messages) / (now - last_report), messages, bytes,
+          paused ? " (paused)" : "");
+      fflush (stdout);
+      last_messages = messages;
+      last_report = now;
+    }
+  }
+
+  printf ("Received %lu messages, %lu payload bytes\n", messages, bytes);
+  for (i = 0; i < MAX_CLIENTS; i++) {
+    if (clients[i].fd >= 0)
+      drop_client (&clients[i]);
+  }
+  close (listen_fd);
+  return 0;
+}
@@ -0,0 +1,1209 @@
+/*
+ * Copyright (c) 2018-2020, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA Corporation and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA Corporation is strictly prohibited.
+ *
+ */
+
+/*
+ * Differential harness for the converter's encoders.
+ *
+ * Generates seeded random frames with the inputs our consumers have tripped
+ * over: labels with quotes, control characters and UTF-8, NaN, infinite and
+ * huge boxes, empty and full (MAX_OBJ_NUM) frames, unknown sensors, NULL
+ * strings and every object extension. Each frame is encoded by a reference
+ * and by the candidate of every payload path, and the outputs are parsed and
+ * compared as JSON values, so whitespace and member order don't matter but
+ * every string and number does.
+ *
+ *   minimal  reference: the json-glib encoder the minimal schema was defined
+ *            by, kept here verbatim apart from the documented additions
+ *            (face attributes, bag / bicycle / road sign confidence,
+ *            undersized extensions skipped).
+ *            candidate: nvds_msg2p_generate with the minimal payload type.
+ *   schema   reference: a json-glib tree built from the frame following the
+ *            DeepStream schema as consumers read it.
+ *            candidate: nvds_msg2p_generate with the DeepStream payload type.
+ *
+ * The messageid member is random and only checked for presence. Every
+ * encoder is timed per case, and results go to a CSV file. A run fails on
+ * any mismatch, on a candidate emitting invalid JSON, or if a candidate got
+ * slower than in the baseline results by more than the allowed regression.
+ */
+
+#include "nvmsgconv.h"
+#include "nvmsgconv_event.h"
+#include <json-glib/json-glib.h>
+#include <unistd.h>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+#define DEFAULT_SEED 1
+#define DEFAULT_CASES 1000
+#define DEFAULT_ITERATIONS 50
+#define DEFAULT_MAX_REGRESSION 10.0
+#define DEFAULT_TOLERANCE 1e-6
+
+/* Timed batches per case and encoder; the fastest one is recorded. */
+#define TIMING_REPEATS 3
+
+#define RESULTS_HEADER "case,path,encoder,status,bytes,ns_per_op,inputs"
+
+static gint64 seed = DEFAULT_SEED;
+static gint num_cases = DEFAULT_CASES;
+static gint iterations = DEFAULT_ITERATIONS;
+static gchar *results_file = NULL;
+static gchar *baseline_file = NULL;
+static gdouble max_regression = DEFAULT_MAX_REGRESSION;
+static gdouble tolerance = DEFAULT_TOLERANCE;
+static gboolean verbose = FALSE;
+
+static GOptionEntry entries[] = {
+  {"seed", 0, 0, G_OPTION_ARG_INT64, &seed,
+      "Seed of the input generator (default 1)", "N"},
+  {"cases", 0, 0, G_OPTION_ARG_INT, &num_cases,
+      "Number of generated frames (default 1000)", "N"},
+  {"iterations", 0, 0, G_OPTION_ARG_INT, &iterations,
+      "Encodings per timed batch, 0 disables timing (default 50)", "N"},
+  {"results", 0, 0, G_OPTION_ARG_FILENAME, &results_file,
+      "Write per-case results to FILE", "FILE"},
+  {"baseline", 0, 0, G_OPTION_ARG_FILENAME, &baseline_file,
+      "Compare candidate throughput with the results in FILE", "FILE"},
+  {"max-regression", 0, 0, G_OPTION_ARG_DOUBLE, &max_regression,
+      "Allowed slowdown against the baseline in percent (default 10)", "PCT"},
+  {"tolerance", 0, 0, G_OPTION_ARG_DOUBLE, &tolerance,
+      "Relative tolerance of JSON numbers (default 1e-6)", "F"},
+  {"verbose", 'v', 0, G_OPTION_ARG_NONE, &verbose,
+      "Print the outputs of mismatching cases", NULL},
+  {NULL}
+};
+
+/* xorshift64*, so inputs only depend on the seed. */
+struct Rng {
+  guint64 state;
+
+  explicit Rng (guint64 s) : state (s ? s : 0x9e3779b97f4a7c15ULL) {}
+
+  guint64 next ()
+  {
+    state ^= state >> 12;
+    state ^= state << 25;
+    state ^= state >> 27;
+    return state * 2685821657736338717ULL;
+  }
+
+  guint below (guint n) { return n ? next () % n : 0; }
+  bool chance (guint percent) { return below (100) < percent; }
+  gdouble uniform () { return (next () >> 11) * (1.0 / 9007199254740992.0); }
+};
+
+/*
+ * Sensors of the generated configuration. Their strings need escaping too.
+ * Frames also reference MISSING_SENSOR_ID, which has no entry.
+ */
+struct HarnessSensor {
+  gint id;
+  const gchar *sensorId;
+  const gchar *type;
+  const gchar *description;
+};
+
+static const HarnessSensor sensors[] = {
+  { 0, "cam-0", "Camera", "Entrance \"A\" of the Z\xc3\xbcrich garage\t(left)" },
+  { 1, "\xe4\xb8\x9c\xe9\x97\xa8-1", "Puck", "" },
+  { 5, "back\\slash/5", "Camera", "line 1\nline 2" },
+};
+
+#define MISSING_SENSOR_ID 7
+
+static const HarnessSensor *
+find_sensor (gint id)
+{
+  for (guint i = 0; i < G_N_ELEMENTS (sensors); i++) {
+    if (sensors[i].id == id)
+      return &sensors[i];
+  }
+  return NULL;
+}
+
+/* Owns everything a case's events point to. */
+struct HarnessCase {
+  guint id;
+  string inputs;
+
+  NvDsFrameObjDescEvent *frame;
+  gint sensorId;
+  gchar *sensorStr;
+  gchar *ts;
+
+  vector<NvDsEventMsgMeta> metas;
+  vector<NvDsEvent> events;
+  vector<gpointer> allocations;
+
+  NvDsEventMsgMeta schemaMeta;
+  NvDsEvent schemaEvent;
+
+  HarnessCase () : id (0), frame (NULL), sensorId (0), sensorStr (NULL),
+      ts (NULL) {}
+  ~HarnessCase ()
+  {
+    for (gpointer p : allocations)
+      g_free (p);
+    g_free (frame);
+  }
+
+  gchar *keep (gchar *str)
+  {
+    if (str)
+      allocations.push_back (str);
+    return str;
+  }
+
+  void tag (const gchar *name)
+  {
+    if (inputs.find (name) != string::npos)
+      return;
+    if (!inputs.empty ())
+      inputs += ' ';
+    inputs += name;
+  }
+};
+
+static const gchar *label_pieces[][2] = {
+  { "plain", "car" },
+  { "plain", "person" },
+  { "quote", "say \"hi\"" },
+  { "backslash", "C:\\path\\" },
+  { "slash", "</script>" },
+  { "control", "\x01\x1f" },
+  { "control", "tab\there\nnewline\r" },
+  { "control", "\b\f\x7f" },
+  { "utf8", "Z\xc3\xbcrich" },
+  { "utf8", "\xe6\x9d\xb1\xe4\xba\xac\xe9\xa7\x85" },
+  { "utf8", "\xf0\x9f\x9a\x97" },
+  { "utf8", "\xe2\x80\xa8sep" },
+};
+
+/* A label of up to three pieces, or an empty or maximum length one. */
+static gchar *
+generate_label (Rng &rng, HarnessCase &c)
+{
+  string label;
+  guint pieces;
+
+  switch (rng.below (10)) {
+    case 0:
+      c.tag ("label:empty");
+      return g_strdup ("");
+    case 1:
+      c.tag ("label:long");
+      return g_strnfill (MAX_LABEL_SIZE - 1, 'x');
+    default:
+      break;
+  }
+
+  pieces = 1 + rng.below (3);
+  for (guint i = 0; i < pieces; i++) {
+    guint piece = rng.below (G_N_ELEMENTS (label_pieces));
+    string name = string ("label:") + label_pieces[piece][0];
+
+    c.tag (name.c_str ());
+    label += label_pieces[piece][1];
+  }
+  return g_strdup (label.c_str ());
+}
+
+/* An optional string attribute: usually a label, sometimes NULL. */
+static gchar *
+generate_attr (Rng &rng, HarnessCase &c)
+{
+  if (rng.chance (10)) {
+    c.tag ("attr:null");
+    return NULL;
+  }
+  return c.keep (generate_label (rng, c));
+}
+
+static gfloat
+generate_coord (Rng &rng, HarnessCase &c)
+{
+  switch (rng.below (40)) {
+    case 0:
+      c.tag ("bbox:nan");
+      return NAN;
+    case 1:
+      c.tag ("bbox:nan");
+      return -NAN;
+    case 2:
+      c.tag ("bbox:inf");
+      return INFINITY;
+    case 3:
+      c.tag ("bbox:inf");
+      return -INFINITY;
+    case 4:
+      c.tag ("bbox:huge");
+      return 3.4e38f;
+    case 5:
+      c.tag ("bbox:huge");
+      return 1e30f * (gfloat) rng.uniform ();
+    case 6:
+      c.tag ("bbox:tiny");
+      return 1e-40f;
+    case 7:
+      c.tag ("bbox:negative");
+      return -1920.0f * (gfloat) rng.uniform ();
+    case 8:
+      return 0.0f;
+    case 9:
+      return (gfloat) rng.below (1921);
+    default:
+      return 1920.0f * (gfloat) rng.uniform ();
+  }
+}
+
+static gdouble
+generate_confidence (Rng &rng, HarnessCase &c)
+{
+  switch (rng.below (20)) {
+    case 0:
+      c.tag ("confidence:nan");
+      return NAN;
+    case 1:
+      return -0.1;
+    case 2:
+      return 1.0;
+    default:
+      return rng.uniform ();
+  }
+}
+
+static const NvDsObjectType object_types[] = {
+  NVDS_OBJECT_TYPE_VEHICLE,
+  NVDS_OBJECT_TYPE_PERSON,
+  NVDS_OBJECT_TYPE_FACE,
+  NVDS_OBJECT_TYPE_BAG,
+  NVDS_OBJECT_TYPE_BICYCLE,
+  NVDS_OBJECT_TYPE_ROADSIGN,
+  NVDS_OBJECT_TYPE_CUSTOM,
+  NVDS_OBJECT_TYPE_UNKNOWN,
+};
+
+/* Attaches an extension matching, or deliberately not matching, the type. */
+static void
+generate_extension (Rng &rng, HarnessCase &c, NvDsEventMsgMeta &meta)
+{
+  gpointer ext = NULL;
+  guint size = 0;
+
+  if (rng.chance (20))
+    return;
+
+  switch (meta.objType) {
+    case NVDS_OBJECT_TYPE_VEHICLE: {
+      NvDsVehicleObject *obj = g_new0 (NvDsVehicleObject, 1);
+      obj->type = generate_attr (rng, c);
+      obj->make = generate_attr (rng, c);
+      obj->model = generate_attr (rng, c);
+      obj->color = generate_attr (rng, c);
+      obj->license = generate_attr (rng, c);
+      obj->region = generate_attr (rng, c);
+      ext = obj;
+      size = sizeof (*obj);
+      break;
+    }
+    case NVDS_OBJECT_TYPE_PERSON: {
+      NvDsPersonObject *obj = g_new0 (NvDsPersonObject, 1);
+      obj->gender = generate_attr (rng, c);
+      obj->hair = generate_attr (rng, c);
+      obj->cap = generate_attr (rng, c);
+      obj->apparel = generate_attr (rng, c);
+      obj->age = rng.chance (5) ? G_MAXUINT : rng.below (100);
+      ext = obj;
+      size = sizeof (*obj);
+      break;
+    }
+    case NVDS_OBJECT_TYPE_FACE: {
+      NvDsFaceObject *obj = g_new0 (NvDsFaceObject, 1);
+      obj->gender = generate_attr (rng, c);
+      obj->hair = generate_attr (rng, c);
+      obj->cap = generate_attr (rng, c);
+      obj->glasses = generate_attr (rng, c);
+      obj->facialhair = generate_attr (rng, c);
+      obj->name = generate_attr (rng, c);
+      obj->eyecolor = generate_attr (rng, c);
+      obj->age = rng.below (100);
+      ext = obj;
+      size = sizeof (*obj);
+      break;
+    }
+    default:
+      /* Types without an extension struct still may carry a buffer. */
+      ext = g_malloc0 (16);
+      size = 16;
+      break;
+  }
+  c.allocations.push_back (ext);
+
+  if (rng.chance (5)) {
+    c.tag ("ext:undersized");
+    size = 8;
+  }
+  meta.extMsg = ext;
+  meta.extMsgSize = size;
+}
+
+static guint
+generate_object_count (Rng &rng, HarnessCase &c)
+{
+  switch (rng.below (20)) {
+    case 0:
+      c.tag ("objects:0");
+      return 0;
+    case 1:
+      c.tag ("objects:max");
+      return MAX_OBJ_NUM;
+    case 2:
+      c.tag ("objects:overflow");
+      return MAX_OBJ_NUM + 1 + rng.below (100);
+    case 3:
+      return 1;
+    default:
+      return 2 + rng.below (31);
+  }
+}
+
+static void
+generate_case (Rng &rng, guint id, HarnessCase &c)
+{
+  guint objCounts;
+  guint count;
+
+  c.id = id;
+
+  switch (rng.below (10)) {
+    case 0:
+      c.tag ("sensor:missing");
+      c.sensorId = MISSING_SENSOR_ID;
+      break;
+    case 1:
+      c.tag ("sensor:string");
+      c.sensorId = sensors[0].id;
+      c.sensorStr = c.keep (generate_label (rng, c));
+      break;
+    default:
+      c.sensorId = sensors[rng.below (G_N_ELEMENTS (sensors))].id;
+      break;
+  }
+
+  if (rng.chance (5)) {
+    c.tag ("ts:null");
+  } else {
+    c.ts = c.keep (g_strdup_printf ("2021-%02u-%02uT%02u:%02u:%02u.%03uZ",
+        1 + rng.below (12), 1 + rng.below (28), rng.below (24),
+        rng.below (60), rng.below (60), rng.below (1000)));
+  }
+
+  objCounts = generate_object_count (rng, c);
+  count = MIN (objCounts, MAX_OBJ_NUM);
+
+  c.frame = g_new0 (NvDsFrameObjDescEvent, 1);
+  c.frame->kind = NVDS_EVENT_EXT_FRAME;
+  c.frame->frameId = rng.chance (5) ? G_MAXINT : rng.below (100000);
+  c.frame->frameWidth = 1920;
+  c.frame->frameHeight = 1080;
+  c.frame->sourceId = c.sensorId;
+  c.frame->objCounts = objCounts;
+
+  c.metas.resize (count);
+  for (guint i = 0; i < count; i++) {
+    NvDsEventMsgMeta &meta = c.metas[i];
+    NvDsSimpleObjectMeta &obj = c.frame->objMetaList[i];
+    gchar *label;
+
+    memset (&meta, 0, sizeof (meta));
+    meta.objType = object_types[rng.below (G_N_ELEMENTS (object_types))];
+    meta.bbox.left = generate_coord (rng, c);
+    meta.bbox.top = generate_coord (rng, c);
+    meta.bbox.width = generate_coord (rng, c);
+    meta.bbox.height = generate_coord (rng, c);
+    meta.confidence = generate_confidence (rng, c);
+    meta.trackingId = rng.chance (10) ? -1 : (gint) rng.below (1 << 20);
+    meta.frameId = c.frame->frameId;
+    meta.sensorId = c.sensorId;
+    meta.sensorStr = c.sensorStr;
+    meta.ts = c.ts;
+    if (meta.objType == NVDS_OBJECT_TYPE_UNKNOWN)
+      meta.objectId = generate_attr (rng, c);
+    generate_extension (rng, c, meta);
+
+    obj.objType = meta.objType;
+    obj.bbox = meta.bbox;
+    obj.confidence = meta.confidence;
+    obj.trackingId = meta.trackingId;
+    obj.classId = rng.below (4);
+    label = generate_label (rng, c);
+    g_strlcpy (obj.label, label, MAX_LABEL_SIZE);
+    g_free (label);
+  }
+
+  c.events.resize (count);
+  for (guint i = 0; i < count; i++) {
+    c.events[i].eventType = NVDS_EVENT_ENTRY;
+    c.events[i].metadata = &c.metas[i];
+  }
+
+  memset (&c.schemaMeta, 0, sizeof (c.schemaMeta));
+  c.schemaMeta.sensorId = c.sensorId;
+  c.schemaMeta.frameId = c.frame->frameId;
+  c.schemaMeta.ts = c.ts;
+  c.schemaMeta.extMsg = c.frame;
+  c.schemaMeta.extMsgSize = sizeof (NvDsFrameObjDescEvent);
+  c.schemaEvent.eventType = NVDS_EVENT_ENTRY;
+  c.schemaEvent.metadata = &c.schemaMeta;
+
+  if (c.inputs.empty ())
+    c.inputs = "plain";
+}
+
+/*
+ * Encoders. Each returns the message or NULL if the frame yields no
+ * payload, and the caller frees it with g_free.
+ */
+struct HarnessEncoder {
+  const gchar *path;
+  const gchar *name;
+  bool reference;
+  gchar *(*encode) (NvDsMsg2pCtx *ctx, HarnessCase &c);
+  /* Whether the path is defined for the case at all. */
+  bool (*applies) (HarnessCase &c);
+};
+
+static const gchar *
+object_enum_to_str (NvDsObjectType type, gchar *objectId)
+{
+  switch (type) {
+    case NVDS_OBJECT_TYPE_VEHICLE:
+      return "Vehicle";
+    case NVDS_OBJECT_TYPE_FACE:
+      return "Face";
+    case NVDS_OBJECT_TYPE_PERSON:
+      return "Person";
+    case NVDS_OBJECT_TYPE_BAG:
+      return "Bag";
+    case NVDS_OBJECT_TYPE_BICYCLE:
+      return "Bicycle";
+    case NVDS_OBJECT_TYPE_ROADSIGN:
+      return "RoadSign";
+    case NVDS_OBJECT_TYPE_CUSTOM:
+      return "Custom";
+    case NVDS_OBJECT_TYPE_UNKNOWN:
+      return objectId ? objectId : "Unknown";
+    default:
+      return "Unknown";
+  }
+}
+
+static const gchar *
+to_str (const gchar *cstr)
+{
+  return cstr ? cstr : "";
+}
+
+static bool
+minimal_applies (HarnessCase &c)
+{
+  /* Frames without objects never reach the converter. */
+  return !c.events.empty ();
+}
+
+static gchar *
+minimal_reference (NvDsMsg2pCtx *ctx, HarnessCase &c)
+{
+  JsonNode *rootNode;
+  JsonObject *jobject;
+  JsonArray *jArray;
+  NvDsEventMsgMeta *first = c.events[0].metadata;
+  const HarnessSensor *sensor;
+  stringstream ss;
+  gchar *message;
+
+  jArray = json_array_new ();
+
+  for (guint i = 0; i < c.events.size (); i++) {
+    NvDsEventMsgMeta *meta = c.events[i].metadata;
+
+    ss.str ("");
+    ss.clear ();
+
+    ss << meta->trackingId << "|" << meta->bbox.left << "|" << meta->bbox.top
+        << "|" << meta->bbox.left + meta->bbox.width << "|"
+        << meta->bbox.top + meta->bbox.height
+        << "|" << object_enum_to_str (meta->objType, meta->objectId);
+
+    if (meta->extMsg && meta->extMsgSize) {
+      switch (meta->objType) {
+        case NVDS_OBJECT_TYPE_VEHICLE: {
+          NvDsVehicleObject *dsObj = (NvDsVehicleObject *) meta->extMsg;
+          if (meta->extMsgSize >= sizeof (*dsObj)) {
+            ss << "|#|" << to_str (dsObj->type) << "|" << to_str (dsObj->make)
+                << "|" << to_str (dsObj->model) << "|" << to_str (dsObj->color)
+                << "|" << to_str (dsObj->license) << "|"
+                << to_str (dsObj->region) << "|" << meta->confidence;
+          }
+          break;
+        }
+        case NVDS_OBJECT_TYPE_PERSON: {
+          NvDsPersonObject *dsObj = (NvDsPersonObject *) meta->extMsg;
+          if (meta->extMsgSize >= sizeof (*dsObj)) {
+            ss << "|#|" << to_str (dsObj->gender) << "|" << dsObj->age << "|"
+                << to_str (dsObj->hair) << "|" << to_str (dsObj->cap) << "|"
+                << to_str (dsObj->apparel) << "|" << meta->confidence;
+          }
+          break;
+        }
+        case NVDS_OBJECT_TYPE_FACE: {
+          NvDsFaceObject *dsObj = (NvDsFaceObject *) meta->extMsg;
+          if (meta->extMsgSize >= sizeof (*dsObj)) {
+            ss << "|#|" << to_str (dsObj->gender) << "|" << dsObj->age << "|"
+                << to_str (dsObj->hair) << "|" << to_str (dsObj->cap) << "|"
+                << to_str (dsObj->glasses) << "|"
+                << to_str (dsObj->facialhair) << "|" << to_str (dsObj->name)
+                << "|" << to_str (dsObj->eyecolor) << "|" << meta->confidence;
+          }
+          break;
+        }
+        case NVDS_OBJECT_TYPE_BAG:
+        case NVDS_OBJECT_TYPE_BICYCLE:
+        case NVDS_OBJECT_TYPE_ROADSIGN:
+          ss << "|#|" << meta->confidence;
+          break;
+        default:
+          break;
+      }
+    }
+
+    json_array_add_string_element (jArray, ss.str ().c_str ());
+  }
+
+  jobject = json_object_new ();
+  json_object_set_string_member (jobject, "version", "4.0");
+  json_object_set_int_member (jobject, "id", first->frameId);
+  json_object_set_string_member (jobject, "@timestamp", first->ts);
+  if (first->sensorStr) {
+    json_object_set_string_member (jobject, "sensorId", first->sensorStr);
+  } else {
+    sensor = find_sensor (first->sensorId);
+    json_object_set_string_member (jobject, "sensorId",
+        sensor ? sensor->sensorId : "");
+  }
+
+  json_object_set_array_member (jobject, "objects", jArray);
+  rootNode = json_node_new (JSON_NODE_OBJECT);
+  json_node_set_object (rootNode, jobject);
+  message = json_to_string (rootNode, TRUE);
+  json_node_free (rootNode);
+  json_object_unref (jobject);
+
+  return message;
+}
+
+/* Returns the payload of @ctx for @events as a NUL terminated string. */
+static gchar *
+library_encode (NvDsMsg2pCtx *ctx, NvDsEvent *events, guint size)
+{
+  NvDsPayload *payload;
+  gchar *message = NULL;
+
+  payload = nvds_msg2p_generate (ctx, events, size);
+  if (!payload)
+    return NULL;
+  if (payload->payload)
+    message = g_strndup ((const gchar *) payload->payload,
+        payload->payloadSize);
+  nvds_msg2p_release (ctx, payload);
+  return message;
+}
+
+static gchar *
+minimal_candidate (NvDsMsg2pCtx *ctx, HarnessCase &c)
+{
+  return library_encode (ctx, c.events.data (), c.events.size ());
+}
+
+static bool
+schema_applies (HarnessCase &c)
+{
+  return true;
+}
+
+/* Consumers read a box coordinate without a JSON number as null. */
+static void
+add_number (JsonArray *array, gdouble value)
+{
+  if (std::isfinite (value))
+    json_array_add_double_element (array, value);
+  else
+    json_array_add_null_element (array);
+}
+
+static gchar *
+schema_reference (NvDsMsg2pCtx *ctx, HarnessCase &c)
+{
+  NvDsFrameObjDescEvent *frame = c.frame;
+  const HarnessSensor *sensor = find_sensor (c.sensorId);
+  guint count = MIN (frame->objCounts, MAX_OBJ_NUM);
+  JsonObject *rootObj, *sensorObj, *frameObj;
+  JsonArray *objectArray;
+  JsonNode *rootNode;
+  gchar *message;
+
+  if (!frame->objCounts || !sensor)
+    return NULL;
+
+  sensorObj = json_object_new ();
+  json_object_set_string_member (sensorObj, "id", sensor->sensorId);
+  json_object_set_string_member (sensorObj, "type", sensor->type);
+  json_object_set_string_member (sensorObj, "description",
+      sensor->description);
+
+  objectArray = json_array_new ();
+  for (guint i = 0; i < count; i++) {
+    NvDsSimpleObjectMeta *meta = &frame->objMetaList[i];
+    JsonObject *obj = json_object_new ();
+    JsonArray *bbox = json_array_new ();
+
+    add_number (bbox, meta->bbox.top);
+    add_number (bbox, meta->bbox.left);
+    add_number (bbox, meta->bbox.width);
+    add_number (bbox, meta->bbox.height);
+    json_object_set_int_member (obj, "trackingId", meta->trackingId);
+    json_object_set_array_member (obj, "bbox", bbox);
+    json_object_set_string_member (obj, "type", meta->label);
+    json_array_add_object_element (objectArray, obj);
+  }
+
+  frameObj = json_object_new ();
+  json_object_set_int_member (frameObj, "width", frame->frameWidth);
+  json_object_set_int_member (frameObj, "height", frame->frameHeight);
+  json_object_set_int_member (frameObj, "frameId", frame->frameId);
+
+  rootObj = json_object_new ();
+  json_object_set_string_member (rootObj, "messageid",
+      "00000000-0000-0000-0000-000000000000");
+  json_object_set_string_member (rootObj, "mdsversion", "1.0");
+  json_object_set_string_member (rootObj, "@timestamp", c.ts);
+  json_object_set_object_member (rootObj, "sensor", sensorObj);
+  json_object_set_array_member (rootObj, "objects", objectArray);
+  json_object_set_object_member (rootObj, "frame", frameObj);
+  if (count < frame->objCounts)
+    json_object_set_int_member (rootObj, "objectCount", frame->objCounts);
+
+  rootNode = json_node_new (JSON_NODE_OBJECT);
+  json_node_set_object (rootNode, rootObj);
+  message = json_to_string (rootNode, TRUE);
+  json_node_free (rootNode);
+  json_object_unref (rootObj);
+
+  return message;
+}
+
+static gchar *
+schema_candidate (NvDsMsg2pCtx *ctx, HarnessCase &c)
+{
+  return library_encode (ctx, &c.schemaEvent, 1);
+}
+
+/* The reference of each path comes first. */
+static const HarnessEncoder encoders[] = {
+  { "minimal", "json-glib", true, minimal_reference, minimal_applies },
+  { "minimal", "library", false, minimal_candidate, minimal_applies },
+  { "schema", "json-glib", true, schema_reference, schema_applies },
+  { "schema", "library", false, schema_candidate, schema_applies },
+};
+
+static NvDsPayloadType
+path_payload_type (const gchar *path)
+{
+  return g_strcmp0 (path, "minimal") ? NVDS_PAYLOAD_DEEPSTREAM :
+      NVDS_PAYLOAD_DEEPSTREAM_MINIMAL;
+}
+
+/* Members only checked for presence. */
+static bool
+volatile_member (const string &path)
+{
+  return path == "$.messageid";
+}
+
+static bool
+numbers_equal (gdouble a, gdouble b)
+{
+  if (std::isnan (a) || std::isnan (b))
+    return std::isnan (a) && std::isnan (b);
+  if (a == b)
+    return true;
+  return fabs (a - b) <= tolerance * MAX (fabs (a), fabs (b));
+}
+
+/*
+ * Compares two parsed values. Returns false and sets @where to the path of
+ * the first difference.
+ */
+static bool
+nodes_equal (JsonNode *a, JsonNode *b, const string &path, string &where)
+{
+  JsonNodeType type = json_node_get_node_type (a);
+
+  if (type != json_node_get_node_type (b)) {
+    where = path + " (type)";
+    return false;
+  }
+
+  switch (type) {
+    case JSON_NODE_OBJECT: {
+      JsonObject *objA = json_node_get_object (a);
+      JsonObject *objB = json_node_get_object (b);
+      GList *members = json_object_get_members (objA);
+      bool equal = true;
+
+      if (json_object_get_size (objA) != json_object_get_size (objB)) {
+        where = path + " (member count)";
+        g_list_free (members);
+        return false;
+      }
+      for (GList *l = members; l && equal; l = l->next) {
+        const gchar *name = (const gchar *) l->data;
+        string memberPath = path + "." + name;
+
+        if (!json_object_has_member (objB, name)) {
+          where = memberPath + " (missing)";
+          equal = false;
+        } else if (!volatile_member (memberPath)) {
+          equal = nodes_equal (json_object_get_member (objA, name),
+              json_object_get_member (objB, name), memberPath, where);
+        }
+      }
+      g_list_free (members);
+      return equal;
+    }
+    case JSON_NODE_ARRAY: {
+      JsonArray *arrA = json_node_get_array (a);
+      JsonArray *arrB = json_node_get_array (b);
+      guint len = json_array_get_length (arrA);
+
+      if (len != json_array_get_length (arrB)) {
+        where = path + " (length)";
+        return false;
+      }
+      for (guint i = 0; i < len; i++) {
+        string elemPath = path + "[" + to_string (i) + "]";
+
+        if (!nodes_equal (json_array_get_element (arrA, i),
+                json_array_get_element (arrB, i), elemPath, where))
+          return false;
+      }
+      return true;
+    }
+    case JSON_NODE_VALUE: {
+      GType typeA = json_node_get_value_type (a);
+      GType typeB = json_node_get_value_type (b);
+      bool numA = typeA == G_TYPE_INT64 || typeA == G_TYPE_DOUBLE;
+      bool numB = typeB == G_TYPE_INT64 || typeB == G_TYPE_DOUBLE;
+      bool equal;
+
+      if (numA && numB) {
+        if (typeA == G_TYPE_INT64 && typeB == G_TYPE_INT64)
+          equal = json_node_get_int (a) == json_node_get_int (b);
+        else
+          equal = numbers_equal (json_node_get_double (a),
+              json_node_get_double (b));
+      } else if (typeA != typeB) {
+        equal = false;
+      } else if (typeA == G_TYPE_STRING) {
+        equal = !g_strcmp0 (json_node_get_string (a), json_node_get_string (b));
+      } else if (typeA == G_TYPE_BOOLEAN) {
+        equal = json_node_get_boolean (a) == json_node_get_boolean (b);
+      } else {
+        equal = true;
+      }
+      if (!equal)
+        where = path;
+      return equal;
+    }
+    default:
+      /* Both null. */
+      return true;
+  }
+}
+
+enum CaseStatus {
+  STATUS_MATCH,
+  /* Neither encoder produced a payload. */
+  STATUS_NO_PAYLOAD,
+  /* The path doesn't apply to the frame. */
+  STATUS_SKIPPED,
+  /* Both outputs are invalid JSON, a known defect of the reference. */
+  STATUS_BOTH_INVALID,
+  STATUS_REFERENCE_INVALID,
+  STATUS_CANDIDATE_INVALID,
+  STATUS_MISMATCH,
+};
+
+static const gchar *status_names[] = {
+  "match", "no-payload", "skipped", "both-invalid", "reference-invalid",
+  "candidate-invalid", "mismatch",
+};
+
+static bool
+status_fails (CaseStatus status)
+{
+  return status == STATUS_CANDIDATE_INVALID || status == STATUS_MISMATCH;
+}
+
+static JsonParser *
+parse_message (const gchar *message)
+{
+  JsonParser *parser = json_parser_new ();
+  GError *error = NULL;
+
+  if (!json_parser_load_from_data (parser, message, -1, &error)) {
+    g_error_free (error);
+    g_object_unref (parser);
+    return NULL;
+  }
+  return parser;
+}
+
+static bool
+valid_json (const gchar *message)
+{
+  JsonParser *parser = parse_message (message);
+
+  if (parser)
+    g_object_unref (parser);
+  return parser != NULL;
+}
+
+static CaseStatus
+compare_messages (const gchar *reference, const gchar *candidate,
+    string &where)
+{
+  JsonParser *refParser, *candParser;
+  CaseStatus status;
+
+  if (!reference || !candidate) {
+    where = reference ? "no candidate payload" : "unexpected payload";
+    return reference || candidate ? STATUS_MISMATCH : STATUS_NO_PAYLOAD;
+  }
+
+  refParser = parse_message (reference);
+  candParser = parse_message (candidate);
+
+  if (!refParser && !candParser) {
+    status = STATUS_BOTH_INVALID;
+  } else if (!refParser) {
+    status = STATUS_REFERENCE_INVALID;
+  } else if (!candParser) {
+    status = STATUS_CANDIDATE_INVALID;
+  } else {
+    status = nodes_equal (json_parser_get_root (refParser),
+        json_parser_get_root (candParser), "$", where) ?
+        STATUS_MATCH : STATUS_MISMATCH;
+  }
+
+  if (refParser)
+    g_object_unref (refParser);
+  if (candParser)
+    g_object_unref (candParser);
+  return status;
+}
+
+/* Nanoseconds per encoding, the best of TIMING_REPEATS batches. */
+static gdouble
+time_encoder (const HarnessEncoder &encoder, NvDsMsg2pCtx *ctx,
+    HarnessCase &c)
+{
+  gdouble best = 0.0;
+
+  for (guint r = 0; r < TIMING_REPEATS; r++) {
+    auto start = chrono::steady_clock::now ();
+    for (gint i = 0; i < iterations; i++)
+      g_free (encoder.encode (ctx, c));
+    auto end = chrono::steady_clock::now ();
+    gdouble ns = chrono::duration<gdouble, nano> (end - start).count () /
+        iterations;
+
+    if (r == 0 || ns < best)
+      best = ns;
+  }
+  return best;
+}
+
+struct EncoderTotals {
+  guint cases;
+  guint counts[G_N_ELEMENTS (status_names)];
+  guint64 bytes;
+  gdouble ns;
+
+  EncoderTotals () : cases (0), bytes (0), ns (0.0)
+  {
+    memset (counts, 0, sizeof (counts));
+  }
+};
+
+static string
+encoder_key (const gchar *path, const gchar *name)
+{
+  return string (path) + "/" + name;
+}
+
+static string
+results_comment ()
+{
+  return "# seed=" + to_string (seed) + " cases=" + to_string (num_cases);
+}
+
+/*
+ * Sums the per-case timings of @file by encoder. The baseline must have
+ * been recorded from the same inputs.
+ */
+static bool
+load_baseline (const gchar *file, map<string, gdouble> &totals)
+{
+  ifstream in (file);
+  string line;
+
+  if (!in.is_open ()) {
+    cout << "Failed to open baseline " << file << endl;
+    return false;
+  }
+  if (!getline (in, line) || line != results_comment ()) {
+    cout << "Baseline " << file << " was not recorded with " <<
+        results_comment ().substr (2) << endl;
+    return false;
+  }
+  getline (in, line);
+
+  while (getline (in, line)) {
+    gchar **fields = g_strsplit (line.c_str (), ",", 7);
+
+    if (g_strv_length (fields) == 7)
+      totals[encoder_key (fields[1], fields[2])] +=
+          g_ascii_strtod (fields[5], NULL);
+    g_strfreev (fields);
+  }
+  return true;
+}
+
+static gchar *
+write_config ()
+{
+  GKeyFile *keyFile = g_key_file_new ();
+  GError *error = NULL;
+  gchar *path = NULL;
+  gint fd;
+
+  for (guint i = 0; i < G_N_ELEMENTS (sensors); i++) {
+    gchar *group = g_strdup_printf ("sensor%d", sensors[i].id);
+
+    g_key_file_set_boolean (keyFile, group, "enable", TRUE);
+    g_key_file_set_string (keyFile, group, "type", sensors[i].type);
+    g_key_file_set_string (keyFile, group, "id", sensors[i].sensorId);
+    g_key_file_set_string (keyFile, group, "description",
+        sensors[i].description);
+    g_free (group);
+  }
+
+  fd = g_file_open_tmp ("nvds_msgconv_harness_XXXXXX.txt", &path, &error);
+  if (fd >= 0)
+    close (fd);
+  if (fd < 0 || !g_key_file_save_to_file (keyFile, path, &error)) {
+    cout << "Failed to write configuration: " << error->message << endl;
+    g_error_free (error);
+    if (path)
+      unlink (path);
+    g_free (path);
+    path = NULL;
+  }
+  g_key_file_free (keyFile);
+  return path;
+}
+
+static void
+print_mismatch (HarnessCase &c, const HarnessEncoder &encoder,
+    CaseStatus status, const string &where, const gchar *reference,
+    const gchar *candidate)
+{
+  cout << "case " << c.id << " " << encoder.path << "/" << encoder.name <<
+      ": " << status_names[status];
+  if (!where.empty ())
+    cout << " at " << where;
+  cout << " [" << c.inputs << "]" << endl;
+  if (verbose) {
+    cout << "  reference: " << (reference ? reference : "(none)") << endl;
+    cout << "  candidate: " << (candidate ? candidate : "(none)") << endl;
+  }
+}
+
+int
+main (int argc, char *argv[])
+{
+  GOptionContext *optCtx;
+  GError *error = NULL;
+  NvDsMsg2pCtx *ctxs[G_N_ELEMENTS (encoders)];
+  map<string, EncoderTotals> totals;
+  map<string, gdouble> baseline;
+  ofstream results;
+  gchar *config;
+  bool failed = false;
+
+  optCtx = g_option_context_new ("- compare the converter's encoders");
+  g_option_context_add_main_entries (optCtx, entries, NULL);
+  if (!g_option_context_parse (optCtx, &argc, &argv, &error)) {
+    cout << error->message << endl;
+    g_error_free (error);
+    g_option_context_free (optCtx);
+    return 1;
+  }
+  g_option_context_free (optCtx);
+
+  if (num_cases <= 0 || iterations < 0) {
+    cout << "--cases must be positive and --iterations not negative" << endl;
+    return 1;
+  }
+  if (baseline_file && !iterations) {
+    cout << "--baseline needs timing, --iterations must not be 0" << endl;
+    return 1;
+  }
+  if (baseline_file && !load_baseline (baseline_file, baseline))
+    return 1;
+
+  if (results_file) {
+    results.open (results_file);
+    if (!results.is_open ()) {
+      cout << "Failed to open " << results_file << endl;
+      return 1;
+    }
+    results << results_comment () << "\n" RESULTS_HEADER "\n";
+  }
+
+  config = write_config ();
+  if (!config)
+    return 1;
+
+  for (guint e = 0; e < G_N_ELEMENTS (encoders); e++) {
+    ctxs[e] = nvds_msg2p_ctx_create (config,
+        path_payload_type (encoders[e].path));
+    if (!ctxs[e]) {
+      cout << "Failed to create the " << encoders[e].path << " context" <<
+          endl;
+      unlink (config);
+      return 1;
+    }
+  }
+  unlink (config);
+  g_free (config);
+
+  Rng rng ((guint64) seed);
+  for (gint id = 0; id < num_cases; id++) {
+    HarnessCase c;
+    gchar *reference = NULL;
+
+    generate_case (rng, id, c);
+
+    for (guint e = 0; e < G_N_ELEMENTS (encoders); e++) {
+      const HarnessEncoder &encoder = encoders[e];
+      EncoderTotals &total = totals[encoder_key (encoder.path, encoder.name)];
+      CaseStatus status = STATUS_MATCH;
+      gchar *message = NULL;
+      gdouble ns = 0.0;
+      string where;
+
+      if (encoder.reference) {
+        g_free (reference);
+        reference = NULL;
+      }
+
+      if (!encoder.applies (c)) {
+        status = STATUS_SKIPPED;
+      } else {
+        message = encoder.encode (ctxs[e], c);
+        if (encoder.reference) {
+          if (!message)
+            status = STATUS_NO_PAYLOAD;
+          else if (!valid_json (message))
+            status = STATUS_REFERENCE_INVALID;
+        } else {
+          status = compare_messages (reference, message, where);
+        }
+        if (iterations)
+          ns = time_encoder (encoder, ctxs[e], c);
+      }
+
+      total.cases++;
+      total.counts[status]++;
+      total.bytes += message ? strlen (message) : 0;
+      total.ns += ns;
+
+      if (status_fails (status)) {
+        failed = true;
+        print_mismatch (c, encoder, status, where, reference, message);
+      }
+      if (results.is_open ()) {
+        results << c.id << "," << encoder.path << "," << encoder.name << "," <<
+            status_names[status] << "," << (message ? strlen (message) : 0) <<
+            "," << ns << "," << c.inputs << "\n";
+      }
+
+      if (encoder.reference)
+        reference = message;
+      else
+        g_free (message);
+    }
+    g_free (reference);
+  }
+
+  cout << "Seed " << seed << ", " << num_cases << " cases" << endl;
+  for (guint e = 0; e < G_N_ELEMENTS (encoders); e++) {
+    const HarnessEncoder &encoder = encoders[e];
+    string key = encoder_key (encoder.path, encoder.name);
+    EncoderTotals &total = totals[key];
+
+    cout << "  " << key << (encoder.reference ? " (reference)" : "") << ":";
+    for (guint s = 0; s < G_N_ELEMENTS (status_names); s++) {
+      if (total.counts[s])
+        cout << " " << status_names[s] << "=" << total.counts[s];
+    }
+    if (iterations && total.ns > 0.0) {
+      cout << ", " << total.ns / total.cases << " ns/case, " <<
+          total.bytes * 1e3 / total.ns << " MB/s";
+    }
+    cout << endl;
+
+    if (encoder.reference || baseline.find (key) == baseline.end ())
+      continue;
+    if (total.ns > baseline[key] * (1.0 + max_regression / 100.0)) {
+      cout << "  " << key << " regressed: " << total.ns << " ns against " <<
+          baseline[key] << " ns in the baseline" << endl;
+      failed = true;
+    }
+  }
+
+  for (guint e = 0; e < G_N_ELEMENTS (encoders); e++)
+    nvds_msg2p_ctx_destroy (ctxs[e]);
+
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,49 @@
+/*
+ * Copyright (c) 2018-2020, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA Corporation and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA Corporation is strictly prohibited.
+ *
+ */
+
+/*
+ * Compiles a converter configuration (key-value or CSV) into a binary
+ * sensor catalog snapshot, see nvmsgconv_snapshot.h.
+ *
+ * Usage: nvds_msgconv_snapshot <config> <snapshot.snap>
+ */
+
+#include "nvmsgconv_snapshot.h"
+#include <iostream>
+
+using namespace std;
+
+int
+main (int argc, char *argv[])
+{
+  NvDsMsg2pCtx *ctx;
+  NvDsSensorCatalog check;
+  bool ret;
+
+  if (argc != 3 || !g_str_has_suffix (argv[2], NVDS_SNAPSHOT_SUFFIX)) {
+    cout << "Usage: " << argv[0] << " <config> <snapshot" NVDS_SNAPSHOT_SUFFIX
+        ">" << endl;
+    return 1;
+  }
+
+  ctx = nvds_msg2p_ctx_create (argv[1], NVDS_PAYLOAD_DEEPSTREAM);
+  if (!ctx)
+    return 1;
+
+  ret = nvds_msg2p_write_snapshot (ctx, argv[2]);
+  nvds_msg2p_ctx_destroy (ctx);
+
+  /* Read it back the way the converter will. */
+  if (ret)
+    ret = nvds_sensor_snapshot_map (argv[2], check);
+
+  return ret ? 0 : 1;
+}
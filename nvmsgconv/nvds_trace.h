@@ -0,0 +1,443 @@
+/*
+ * Copyright (c) 2018-2020, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA Corporation and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA Corporation is strictly prohibited.
+ *
+ */
+
+/**
+ * @file
+ * <b>Timeline tracing</b>
+ *
+ * @b Description: Opt-in recording of spans (probes, event building,
+ * encoding, broker sends) into a Chrome trace-event file, which
+ * chrome://tracing and ui.perfetto.dev open as a per-thread timeline.
+ *
+ * Tracing is off unless the environment names a file:
+ *
+ *   NVDS_TRACE_FILE=/tmp/trace-%p.json   %p is replaced by the process id
+ *   NVDS_TRACE_DURATION_MS=N             stop recording N ms after the
+ *                                        first span (0, the default, never)
+ *
+ * When it is off, nvds_trace_begin() is one atomic load and returns 0, and
+ * the other calls return at once for a 0 begin.
+ *
+ * Every thread records into its own ring, which only it writes and a
+ * background thread drains every 100 ms, so recording takes no locks;
+ * spans that find their ring full are dropped and shown as a "dropped"
+ * counter. The file is in the JSON array format without the closing
+ * bracket, which the viewers accept, so that the application, the
+ * converter and the protocol adaptors, each with its own copy of the
+ * tracer, can all append whole lines to the same file.
+ *
+ * Single header: exactly one source file of each library or program
+ * defines NVDS_TRACE_IMPLEMENTATION before including it. The functions
+ * have hidden visibility, so copies in different libraries don't collide.
+ * Category, name and argument strings must be literals, they are kept by
+ * pointer until written.
+ */
+
+#ifndef NVDS_TRACE_H_
+#define NVDS_TRACE_H_
+
+#include <glib.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define NVDS_TRACE_ENV_FILE "NVDS_TRACE_FILE"
+#define NVDS_TRACE_ENV_DURATION "NVDS_TRACE_DURATION_MS"
+
+#define NVDS_TRACE_API __attribute__ ((visibility ("hidden")))
+
+/** Returns the start time of a span, or 0 if nothing is being recorded. */
+NVDS_TRACE_API gint64 nvds_trace_begin (void);
+
+/**
+ * Records a span from @begin to now on the calling thread, with @arg set
+ * to @value unless @arg is NULL. Does nothing if @begin is 0.
+ */
+NVDS_TRACE_API void nvds_trace_end (const gchar *cat, const gchar *name,
+    gint64 begin, const gchar *arg, gint64 value);
+
+/**
+ * Starts and ends a span that may end on another thread, e.g. a message
+ * queued for sending and its completion. Spans of the same @cat and @name
+ * are told apart by @id.
+ */
+NVDS_TRACE_API void nvds_trace_async_begin (const gchar *cat,
+    const gchar *name, guint64 id, const gchar *arg, gint64 value);
+NVDS_TRACE_API void nvds_trace_async_end (const gchar *cat,
+    const gchar *name, guint64 id, const gchar *arg, gint64 value);
+
+/** Writes everything recorded so far. */
+NVDS_TRACE_API void nvds_trace_flush (void);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* NVDS_TRACE_H_ */
+
+#if defined(NVDS_TRACE_IMPLEMENTATION) && !defined(NVDS_TRACE_IMPLEMENTED)
+#define NVDS_TRACE_IMPLEMENTED
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/prctl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+/* Spans per thread between two drains, a power of two. */
+#define NVDS_TRACE_RING_SIZE 8192
+#define NVDS_TRACE_DRAIN_US (100 * G_TIME_SPAN_MILLISECOND)
+
+typedef struct
+{
+  const gchar *cat;
+  const gchar *name;
+  const gchar *arg;
+  gint64 ts;
+  gint64 dur;
+  guint64 id;
+  gint64 value;
+  gchar ph;
+} NvDsTraceRecord;
+
+typedef struct _NvDsTraceRing
+{
+  struct _NvDsTraceRing *next;
+  gint tid;
+  gchar thread_name[17];
+  gboolean named;
+  /* Written by the owning thread only. */
+  guint head;
+  guint dropped;
+  /* Written by the drain only, under the tracer's lock. */
+  guint tail;
+  guint reported_dropped;
+  NvDsTraceRecord records[NVDS_TRACE_RING_SIZE];
+} NvDsTraceRing;
+
+static struct
+{
+  gsize initialized;
+  gint recording;
+  gint64 duration_us;
+  gint64 deadline_us;
+  gint pid;
+  gint fd;
+  /* Protects the rings list, their tails and the drain thread. */
+  GMutex lock;
+  GCond cond;
+  gboolean stopping;
+  GThread *thread;
+  NvDsTraceRing *rings;
+} nvds_trace;
+
+static __thread NvDsTraceRing *nvds_trace_local;
+
+static void
+nvds_trace_sanitize (gchar *str)
+{
+  for (; *str; str++) {
+    if (*str == '"' || *str == '\\' || (guchar) *str < 0x20)
+      *str = '_';
+  }
+}
+
+static void
+nvds_trace_write (const gchar *data, gsize len)
+{
+  while (len > 0) {
+    gssize written = write (nvds_trace.fd, data, len);
+
+    if (written < 0) {
+      if (errno == EINTR)
+        continue;
+      return;
+    }
+    data += written;
+    len -= written;
+  }
+}
+
+static void
+nvds_trace_format (GString *out, NvDsTraceRing *ring,
+    const NvDsTraceRecord *record)
+{
+  g_string_append_printf (out,
+      "{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"%c\",\"ts\":%"
+      G_GINT64_FORMAT ",\"pid\":%d,\"tid\":%d", record->name, record->cat,
+      record->ph, record->ts, nvds_trace.pid, ring->tid);
+  if (record->ph == 'X')
+    g_string_append_printf (out, ",\"dur\":%" G_GINT64_FORMAT, record->dur);
+  else
+    g_string_append_printf (out, ",\"id\":\"0x%" G_GINT64_MODIFIER "x\"",
+        record->id);
+  if (record->arg)
+    g_string_append_printf (out, ",\"args\":{\"%s\":%" G_GINT64_FORMAT "}",
+        record->arg, record->value);
+  g_string_append (out, "},\n");
+}
+
+/* Whether the thread that owned @ring is gone, so nothing writes it any
+ * more. A reused thread id only keeps the ring a little longer. */
+static gboolean
+nvds_trace_thread_exited (NvDsTraceRing *ring)
+{
+  gchar path[64];
+  struct stat st;
+
+  g_snprintf (path, sizeof (path), "/proc/self/task/%d", ring->tid);
+  return stat (path, &st) < 0 && errno == ENOENT;
+}
+
+/* Writes the spans recorded since the last drain. Called with the lock. */
+static void
+nvds_trace_drain (void)
+{
+  GString *out = g_string_sized_new (64 * 1024);
+  NvDsTraceRing **link = &nvds_trace.rings;
+
+  while (*link) {
+    NvDsTraceRing *ring = *link;
+    guint head = g_atomic_int_get (&ring->head);
+    guint dropped = g_atomic_int_get (&ring->dropped);
+    gboolean exited = head == ring->tail && nvds_trace_thread_exited (ring);
+
+    if (!ring->named) {
+      g_string_append_printf (out, "{\"name\":\"thread_name\",\"ph\":\"M\","
+          "\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"%s\"}},\n",
+          nvds_trace.pid, ring->tid, ring->thread_name);
+      ring->named = TRUE;
+    }
+    for (guint tail = ring->tail; tail != head; tail++) {
+      nvds_trace_format (out, ring,
+          &ring->records[tail & (NVDS_TRACE_RING_SIZE - 1)]);
+    }
+    g_atomic_int_set (&ring->tail, head);
+    if (dropped != ring->reported_dropped) {
+      g_string_append_printf (out, "{\"name\":\"dropped\",\"ph\":\"C\","
+          "\"ts\":%" G_GINT64_FORMAT ",\"pid\":%d,\"tid\":%d,\"id\":%d,"
+          "\"args\":{\"spans\":%u}},\n", g_get_monotonic_time (),
+          nvds_trace.pid, ring->tid, ring->tid, dropped);
+      ring->reported_dropped = dropped;
+    }
+
+    if (exited) {
+      *link = ring->next;
+      g_free (ring);
+    } else {
+      link = &ring->next;
+    }
+  }
+
+  nvds_trace_write (out->str, out->len);
+  g_string_free (out, TRUE);
+}
+
+static gpointer
+nvds_trace_thread (gpointer data)
+{
+  g_mutex_lock (&nvds_trace.lock);
+  while (!nvds_trace.stopping) {
+    g_cond_wait_until (&nvds_trace.cond, &nvds_trace.lock,
+        g_get_monotonic_time () + NVDS_TRACE_DRAIN_US);
+    nvds_trace_drain ();
+  }
+  g_mutex_unlock (&nvds_trace.lock);
+  return NULL;
+}
+
+/* Also runs when a library holding a copy of the tracer is unloaded. The
+ * rings are left allocated, threads may still be writing them. */
+static void
+nvds_trace_stop (void)
+{
+  g_atomic_int_set (&nvds_trace.recording, FALSE);
+  g_mutex_lock (&nvds_trace.lock);
+  nvds_trace.stopping = TRUE;
+  g_cond_signal (&nvds_trace.cond);
+  g_mutex_unlock (&nvds_trace.lock);
+  g_thread_join (nvds_trace.thread);
+
+  g_mutex_lock (&nvds_trace.lock);
+  nvds_trace_drain ();
+  close (nvds_trace.fd);
+  nvds_trace.fd = -1;
+  g_mutex_unlock (&nvds_trace.lock);
+}
+
+/* Opens the trace file; whoever creates it starts the array. */
+static gboolean
+nvds_trace_open (const gchar *file)
+{
+  gchar pid[16];
+  gchar **parts;
+  gchar *path;
+
+  g_snprintf (pid, sizeof (pid), "%d", nvds_trace.pid);
+  parts = g_strsplit (file, "%p", -1);
+  path = g_strjoinv (pid, parts);
+  g_strfreev (parts);
+
+  nvds_trace.fd = open (path, O_WRONLY | O_APPEND | O_CREAT | O_EXCL |
+      O_CLOEXEC, 0644);
+  if (nvds_trace.fd >= 0) {
+    nvds_trace_write ("[\n", 2);
+  } else if (errno == EEXIST) {
+    nvds_trace.fd = open (path, O_WRONLY | O_APPEND | O_CLOEXEC);
+  }
+  if (nvds_trace.fd < 0)
+    g_printerr ("Failed to open trace file %s: %s\n", path,
+        g_strerror (errno));
+  g_free (path);
+  return nvds_trace.fd >= 0;
+}
+
+static void
+nvds_trace_init (void)
+{
+  const gchar *file = g_getenv (NVDS_TRACE_ENV_FILE);
+  const gchar *duration = g_getenv (NVDS_TRACE_ENV_DURATION);
+
+  nvds_trace.pid = getpid ();
+  nvds_trace.fd = -1;
+  if (!file || !*file || !nvds_trace_open (file))
+    return;
+
+  nvds_trace.duration_us = duration ?
+      g_ascii_strtoll (duration, NULL, 10) * G_TIME_SPAN_MILLISECOND : 0;
+  nvds_trace.deadline_us = G_MAXINT64;
+  g_mutex_init (&nvds_trace.lock);
+  g_cond_init (&nvds_trace.cond);
+  nvds_trace.thread = g_thread_new ("nvds-trace", nvds_trace_thread, NULL);
+  atexit (nvds_trace_stop);
+  g_atomic_int_set (&nvds_trace.recording, TRUE);
+}
+
+static NvDsTraceRing *
+nvds_trace_ring (void)
+{
+  NvDsTraceRing *ring = nvds_trace_local;
+
+  if (G_LIKELY (ring))
+    return ring;
+
+  ring = (NvDsTraceRing *) g_malloc0 (sizeof (NvDsTraceRing));
+  ring->tid = (gint) syscall (SYS_gettid);
+  prctl (PR_GET_NAME, ring->thread_name, 0, 0, 0);
+  nvds_trace_sanitize (ring->thread_name);
+
+  g_mutex_lock (&nvds_trace.lock);
+  ring->next = nvds_trace.rings;
+  nvds_trace.rings = ring;
+  g_mutex_unlock (&nvds_trace.lock);
+  nvds_trace_local = ring;
+  return ring;
+}
+
+static void
+nvds_trace_record (gchar ph, const gchar *cat, const gchar *name, gint64 ts,
+    gint64 dur, guint64 id, const gchar *arg, gint64 value)
+{
+  NvDsTraceRing *ring = nvds_trace_ring ();
+  guint head = ring->head;
+  NvDsTraceRecord *record;
+
+  if (head - g_atomic_int_get (&ring->tail) >= NVDS_TRACE_RING_SIZE) {
+    g_atomic_int_set (&ring->dropped, ring->dropped + 1);
+    return;
+  }
+  record = &ring->records[head & (NVDS_TRACE_RING_SIZE - 1)];
+  record->cat = cat;
+  record->name = name;
+  record->arg = arg;
+  record->ts = ts;
+  record->dur = dur;
+  record->id = id;
+  record->value = value;
+  record->ph = ph;
+  g_atomic_int_set (&ring->head, head + 1);
+}
+
+gint64
+nvds_trace_begin (void)
+{
+  gint64 now;
+
+  if (g_once_init_enter (&nvds_trace.initialized)) {
+    nvds_trace_init ();
+    g_once_init_leave (&nvds_trace.initialized, 1);
+  }
+  if (G_LIKELY (!g_atomic_int_get (&nvds_trace.recording)))
+    return 0;
+
+  now = g_get_monotonic_time ();
+  if (nvds_trace.duration_us) {
+    /* The first span starts the clock. */
+    gint64 deadline = G_MAXINT64;
+
+    __atomic_compare_exchange_n (&nvds_trace.deadline_us, &deadline,
+        now + nvds_trace.duration_us, FALSE, __ATOMIC_SEQ_CST,
+        __ATOMIC_SEQ_CST);
+    if (now >= __atomic_load_n (&nvds_trace.deadline_us, __ATOMIC_SEQ_CST)) {
+      g_atomic_int_set (&nvds_trace.recording, FALSE);
+      return 0;
+    }
+  }
+  return now;
+}
+
+void
+nvds_trace_end (const gchar *cat, const gchar *name, gint64 begin,
+    const gchar *arg, gint64 value)
+{
+  if (!begin)
+    return;
+  nvds_trace_record ('X', cat, name, begin, g_get_monotonic_time () - begin,
+      0, arg, value);
+}
+
+void
+nvds_trace_async_begin (const gchar *cat, const gchar *name, guint64 id,
+    const gchar *arg, gint64 value)
+{
+  gint64 now = nvds_trace_begin ();
+
+  if (now)
+    nvds_trace_record ('b', cat, name, now, 0, id, arg, value);
+}
+
+void
+nvds_trace_async_end (const gchar *cat, const gchar *name, guint64 id,
+    const gchar *arg, gint64 value)
+{
+  gint64 now = nvds_trace_begin ();
+
+  if (now)
+    nvds_trace_record ('e', cat, name, now, 0, id, arg, value);
+}
+
+void
+nvds_trace_flush (void)
+{
+  if (!__atomic_load_n (&nvds_trace.initialized, __ATOMIC_ACQUIRE) ||
+      !nvds_trace.thread)
+    return;
+  g_mutex_lock (&nvds_trace.lock);
+  if (!nvds_trace.stopping)
+    nvds_trace_drain ();
+  g_mutex_unlock (&nvds_trace.lock);
+}
+
+#endif /* NVDS_TRACE_IMPLEMENTATION */
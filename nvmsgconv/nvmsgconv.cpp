@@ -10,15 +10,29 @@
  */
 
 #include "nvmsgconv.h"
-#include <json-glib/json-glib.h>
+#include "nvmsgconv_arrow.h"
+#include "nvmsgconv_context.h"
+#include "nvmsgconv_event.h"
+#include "nvmsgconv_heatmap.h"
+#include "nvmsgconv_log.h"
+#include "nvmsgconv_modules.h"
+#include "nvmsgconv_shed.h"
+#include "nvmsgconv_lanes.h"
+#include "nvmsgconv_linger.h"
+#include "nvmsgconv_results.h"
+#include "nvmsgconv_json.h"
+#include "nvmsgconv_schema.h"
+#include "nvmsgconv_sensor.h"
+#include "nvmsgconv_snapshot.h"
+#define NVDS_TRACE_IMPLEMENTATION
+#include "nvds_trace.h"
 #include <uuid.h>
 #include <stdlib.h>
 #include <iostream>
-#include <fstream>
-#include <sstream>
 #include <cstring>
 #include <vector>
 #include <unordered_map>
+#include <algorithm>
 
 using namespace std;
 
@@ -44,8 +58,6 @@ using namespace std;
 #define CONFIG_KEY_PLACE_SUB_FIELD2 "place-sub-field2"
 #define CONFIG_KEY_PLACE_SUB_FIELD3 "place-sub-field3"
 
-#define DEFAULT_CSV_FIELDS 10
-
 
 #define CHECK_ERROR(error) \
     if (error) { \
@@ -53,219 +65,379 @@ using namespace std;
       goto done; \
     }
 
-#define MAX_OBJ_NUM 256
-#define MAX_LABEL_SIZE 128
+struct NvDsPayloadPriv {
+  NvDsSharedCatalog catalog;
+  NvDsContextConfig context;
+  NvDsShedBacklog backlog;
+  NvDsModuleTable modules;
+  NvDsResultPool results;
+  /* Holds the configuration, and the state unless the context is
+   * concurrent. */
+  NvDsMsg2pScratch scratch;
+  NvDsScratchSet threads;
+};
 
-typedef struct 
+/* Returns the state the calling thread may change. */
+static NvDsMsg2pScratch *
+get_scratch (NvDsMsg2pCtx *ctx)
 {
-  NvDsObjectType objType;
-  /** Holds the object's bounding box. */
-  NvDsRect bbox;
+  NvDsPayloadPriv *privObj = (NvDsPayloadPriv *) ctx->privData;
 
-  /** Holds the confidence level of the inference. */
-  gdouble confidence;
-  /** Holds the object's tracking ID. */
-  gint trackingId;
+  if (!privObj->context.concurrent)
+    return &privObj->scratch;
+  return nvds_scratch_get (&privObj->threads, &privObj->scratch);
+}
 
-  gchar label[MAX_LABEL_SIZE];
+/*
+ * Fills @indices with the @maxObjects most confident objects of
+ * @frame_obj_desc, in their original order, and returns their number.
+ */
+static guint
+select_objects (NvDsMsg2pScratch *scratch,
+    NvDsFrameObjDescEvent *frame_obj_desc, guint maxObjects, guint *indices)
+{
+  guint count = MIN (frame_obj_desc->objCounts, MAX_OBJ_NUM);
+  vector<guint> &order = scratch->objOrder;
+
+  for (guint idx = 0; idx < count; idx++)
+    indices[idx] = idx;
+  if (count <= maxObjects)
+    return count;
+
+  order.assign (indices, indices + count);
+  nth_element (order.begin (), order.begin () + maxObjects, order.end (),
+      [frame_obj_desc] (guint a, guint b) {
+        return frame_obj_desc->objMetaList[a].confidence >
+            frame_obj_desc->objMetaList[b].confidence;
+      });
+  sort (order.begin (), order.begin () + maxObjects);
+  copy (order.begin (), order.begin () + maxObjects, indices);
+  return maxObjects;
+}
 
-}NvDsSimpleObjectMeta;
+static const gchar *
+track_event_to_str (NvDsEventType type)
+{
+  switch (type) {
+    case NVDS_EVENT_ENTRY:
+      return "start";
+    case NVDS_EVENT_EXIT:
+      return "end";
+    default:
+      return "update";
+  }
+}
 
+/*
+ * Opens a message written without json-glib with the members every
+ * message of the schema starts with, up to the sensor object.
+ */
+static void
+append_message_header (GString *message, NvDsEventMsgMeta *meta,
+    const NvDsSensorView &sensor)
+{
+  uuid_t msgId;
+  gchar msgIdStr[37];
 
-typedef struct
+  uuid_generate_random (msgId);
+  uuid_unparse_lower (msgId, msgIdStr);
+
+  g_string_append (message, "{\"messageid\":");
+  nvds_json_append_string (message, msgIdStr);
+  g_string_append (message, ",\"mdsversion\":\"1.0\",\"@timestamp\":");
+  nvds_json_append_string (message, meta->ts);
+  g_string_append (message, ",\"sensor\":{\"id\":");
+  nvds_json_append_string (message, sensor.id);
+  g_string_append (message, ",\"type\":");
+  nvds_json_append_string (message, sensor.type);
+  g_string_append (message, ",\"description\":");
+  nvds_json_append_string (message, sensor.desc);
+  g_string_append_c (message, '}');
+}
+
+/*
+ * Writes a track lifecycle event:
+ * {
+ *   "messageid": "...", "mdsversion": "1.0", "@timestamp": "...",
+ *   "sensor": { "id": "...", "type": "...", "description": "..." },
+ *   "track": {
+ *     "event": "start|update|end", "trackingId": 12, "classId": 0,
+ *     "type": "car", "firstFrame": 100, "lastFrame": 160,
+ *     "points": [[frame, x, y], ...]
+ *   }
+ * }
+ * Tracks are never shed, a lost end event would leave the track open.
+ */
+static bool
+generate_track_message (NvDsMsg2pCtx *ctx, NvDsEventMsgMeta *meta,
+    GString *message)
 {
-  gchar* sourceUri;
-  gint sourceId;
-  gint sourceType;
-  guint frameId;
+  NvDsPayloadPriv *privObj = (NvDsPayloadPriv *) ctx->privData;
+  NvDsTrackEvent *track = (NvDsTrackEvent *) meta->extMsg;
+  NvDsSensorView sensor;
+  guint numPoints = MIN (track->numPoints, MAX_TRACK_POINTS);
+
+  if (!nvds_sensor_catalog_find (*privObj->catalog, meta->sensorId, sensor)) {
+    NVDS_MSG2P_LOG (meta->sensorId,
+        "No entry for " CONFIG_GROUP_SENSOR "%d in configuration file",
+        meta->sensorId);
+    return false;
+  }
 
-  guint frameWidth;
-  guint frameHeight;
+  nvds_json_reserve (message, 256 + nvds_schema_estimate (*track) +
+      numPoints * 32);
+  append_message_header (message, meta, sensor);
+  g_string_append (message, ",\"track\":{\"event\":\"");
+  g_string_append (message, track_event_to_str (meta->type));
+  g_string_append_c (message, '"');
+  nvds_schema_append_members (message, *track, false);
+  g_string_append (message, ",\"points\":[");
+  for (guint i = 0; i < numPoints; i++) {
+    if (i)
+      g_string_append_c (message, ',');
+    nvds_schema_append_tuple (message, track->points[i]);
+  }
+  g_string_append (message, "]}}");
 
-  guint objCounts;
-  NvDsSimpleObjectMeta objMetaList[MAX_OBJ_NUM];
+  return true;
+}
 
-  gchar* filterCloudModules;
-  gchar* sourceCloudModules;
-}NvDsFrameObjDescEvent;
+/*
+ * Appends the message of the heatmap of @meta's sensor to @message and
+ * starts a new period.
+ */
+static void
+write_heatmap_message (NvDsHeatmap *heatmap, NvDsEventMsgMeta *meta,
+    const NvDsSensorView &sensor, GString *message)
+{
+  nvds_json_reserve (message, 1024);
+  append_message_header (message, meta, sensor);
+  g_string_append_c (message, ',');
+  nvds_heatmap_write (heatmap, meta->sensorId, message);
+  g_string_append_c (message, '}');
+}
 
-struct NvDsSensorObject {
-  string id;
-  string type;
-  string desc;
-};
+/*
+ * Bins the objects of a frame event into the heatmap of its sensor, and
+ * writes the heatmap once its period is over, see nvmsgconv_heatmap.h.
+ * Heatmaps are not shed, they are already a fraction of the objects.
+ */
+static bool
+generate_heatmap_message (NvDsMsg2pCtx *ctx, NvDsMsg2pScratch *scratch,
+    NvDsEventMsgMeta *meta, GString *message)
+{
+  NvDsPayloadPriv *privObj = (NvDsPayloadPriv *) ctx->privData;
+  NvDsHeatmap *heatmap = &scratch->heatmap;
+  NvDsSensorView sensor;
+
+  if (!nvds_sensor_catalog_find (*privObj->catalog, meta->sensorId, sensor)) {
+    NVDS_MSG2P_LOG (meta->sensorId,
+        "No entry for " CONFIG_GROUP_SENSOR "%d in configuration file",
+        meta->sensorId);
+    return false;
+  }
 
-struct NvDsPayloadPriv {
-  unordered_map<int, NvDsSensorObject> sensorObj;
-};
+  nvds_heatmap_add (heatmap, meta->sensorId,
+      (NvDsFrameObjDescEvent *) meta->extMsg, meta->ts);
+  if (!nvds_heatmap_ready (heatmap, meta->sensorId))
+    return false;
 
+  write_heatmap_message (heatmap, meta, sensor, message);
+  return true;
+}
+
+/* Opens a message of the minimal schema, up to its objects array. */
 static void
-get_csv_tokens (const string &text, vector<string> &tokens)
+append_minimal_header (GString *message, gint64 frameId, const gchar *ts,
+    const gchar *sensorStr)
 {
-  /* This is based on assumption that fields and their locations
-   * are fixed in CSV file. This should be updated accordingly if
-   * that is not the case.
-   */
-  gint count = 0;
-
-  gchar **csv_tokens = g_strsplit (text.c_str(), ",", -1);
-  gchar **temp = csv_tokens;
-  gchar *token;
+  g_string_append (message, "{\"version\":\"4.0\",\"id\":");
+  nvds_json_append_int (message, frameId);
+  g_string_append (message, ",\"@timestamp\":");
+  nvds_json_append_string (message, ts);
+  g_string_append (message, ",\"sensorId\":");
+  nvds_json_append_string (message, sensorStr);
+  g_string_append (message, ",\"objects\":[");
+}
 
-  while (*temp && count < DEFAULT_CSV_FIELDS) {
-    token = *temp++;
-    tokens.push_back (string(g_strstrip(token)));
-    count++;
+/*
+ * Writes the selected objects of a frame event in the minimal schema, the
+ * first load shedding stage: one "trackingId|left|top|right|bottom|type"
+ * record per object, and the sensor id only.
+ */
+static void
+generate_minimal_frame_message (NvDsEventMsgMeta *meta,
+    const NvDsSensorView &sensor, const NvDsFrameObjDescEvent *frame,
+    const guint *objIndices, guint objCount, GString *message)
+{
+  nvds_json_reserve (message, 256 + objCount * 128);
+  append_minimal_header (message, meta->frameId, meta->ts, sensor.id);
+  for (guint i = 0; i < objCount; i++) {
+    const NvDsSimpleObjectMeta *obj = &frame->objMetaList[objIndices[i]];
+
+    if (i)
+      g_string_append_c (message, ',');
+    g_string_append_c (message, '"');
+    nvds_json_append_int (message, obj->trackingId);
+    g_string_append_c (message, '|');
+    nvds_json_append_double (message, obj->bbox.left);
+    g_string_append_c (message, '|');
+    nvds_json_append_double (message, obj->bbox.top);
+    g_string_append_c (message, '|');
+    nvds_json_append_double (message, obj->bbox.left + obj->bbox.width);
+    g_string_append_c (message, '|');
+    nvds_json_append_double (message, obj->bbox.top + obj->bbox.height);
+    g_string_append_c (message, '|');
+    nvds_json_append_escaped (message, obj->label,
+        strnlen (obj->label, MAX_LABEL_SIZE));
+    g_string_append_c (message, '"');
+  }
+  g_string_append_c (message, ']');
+  if (objCount < frame->objCounts) {
+    g_string_append (message, ",\"objectCount\":");
+    nvds_json_append_int (message, frame->objCounts);
   }
-  g_strfreev (csv_tokens);
+  g_string_append_c (message, '}');
 }
 
-static JsonObject*
-generate_sensor_object (NvDsMsg2pCtx *ctx, NvDsEventMsgMeta *meta)
-{
-  NvDsPayloadPriv *privObj = NULL;
-  NvDsSensorObject *dsSensorObj = NULL;
-  JsonObject *sensorObj;
+/* @shed is false for events that must not be degraded by load shedding. */
+static bool
+encode_schema_message (NvDsMsg2pCtx *ctx, NvDsMsg2pScratch *scratch,
+    NvDsEventMsgMeta *meta, bool shed, GString *message){
+  NvDsPayloadPriv *privObj = (NvDsPayloadPriv *) ctx->privData;
+  NvDsLoadShedder *shedder = &scratch->shedder;
+  NvDsShedStage stage;
+  guint objIndices[MAX_OBJ_NUM];
+  guint objCount;
+  NvDsSensorView sensor;
+  gsize size;
 
-  privObj = (NvDsPayloadPriv *) ctx->privData;
-  auto idMap = privObj->sensorObj.find (meta->sensorId);
+  // TODO: hash sensorObj.id
+  // json_object_set_string_member(rootObj, "id", sensorObj.id.c_str());
+  // partition-key, follow this guide https://docs.nvidia.com/metropolis/deepstream/dev-guide/text/DS_plugin_gst-nvmsgbroker.html
 
-  if (idMap != privObj->sensorObj.end()) {
-    dsSensorObj = &idMap->second;
-  } else {
-    cout << "No entry for " CONFIG_GROUP_SENSOR << meta->sensorId
-         << " in configuration file" << endl;
-    return NULL;
+  switch (nvds_event_ext_kind (meta)) {
+    case NVDS_EVENT_EXT_TRACK:
+      return generate_track_message (ctx, meta, message);
+    case NVDS_EVENT_EXT_FRAME:
+      if (scratch->heatmap.config.enable)
+        return generate_heatmap_message (ctx, scratch, meta, message);
+      break;
+    default:
+      return false;
   }
 
-  /* sensor object
-   * "sensor": {
-       "id": "string",
-       "type": "Camera/Puck",
-       "description": "Entrance of Endeavor Garage Right Lane"
-     }
-   */
-
-  // sensor object
-  sensorObj = json_object_new ();
-  json_object_set_string_member (sensorObj, "id", dsSensorObj->id.c_str());
-  json_object_set_string_member (sensorObj, "type", dsSensorObj->type.c_str());
-  json_object_set_string_member (sensorObj, "description", dsSensorObj->desc.c_str());
+  {
+    NvDsFrameObjDescEvent* frame_object_desc = (NvDsFrameObjDescEvent*)meta->extMsg;
 
-  return sensorObj;
-}
+    stage = shed ? nvds_load_shed_update (shedder, &privObj->backlog,
+        frame_object_desc->queueFillPercent) : NVDS_SHED_NONE;
+    if (stage == NVDS_SHED_DROP ||
+        (stage == NVDS_SHED_SAMPLE &&
+         !nvds_load_shed_sample (shedder, meta->sensorId))) {
+      shedder->shed[stage]++;
+      return false;
+    }
+    if (stage == NVDS_SHED_MINIMAL || stage == NVDS_SHED_TRUNCATE)
+      shedder->shed[stage]++;
 
-static JsonArray*
-generate_object_array(NvDsMsg2pCtx *ctx, NvDsFrameObjDescEvent* frame_obj_desc){
-  JsonArray *bbox;
-  JsonArray *objectArray;
-  
-  objectArray = json_array_new();
-  for(guint idx=0; idx < frame_obj_desc->objCounts; idx++){
-    JsonObject* obj = json_object_new();
-    bbox = json_array_new();
+    if(frame_object_desc->objCounts == 0){
+      return false;
+    }
+    if (!nvds_sensor_catalog_find (*privObj->catalog, meta->sensorId,
+            sensor)) {
+      NVDS_MSG2P_LOG (meta->sensorId,
+          "No entry for " CONFIG_GROUP_SENSOR "%d in configuration file",
+          meta->sensorId);
+      return false;
+    }
+    objCount = select_objects (scratch, frame_object_desc,
+        stage >= NVDS_SHED_TRUNCATE ? shedder->config.maxObjects : MAX_OBJ_NUM,
+        objIndices);
+    if (stage >= NVDS_SHED_MINIMAL) {
+      generate_minimal_frame_message (meta, sensor, frame_object_desc,
+          objIndices, objCount, message);
+      return true;
+    }
 
-    json_array_add_double_element(bbox, frame_obj_desc->objMetaList[idx].bbox.top);
-    json_array_add_double_element(bbox, frame_obj_desc->objMetaList[idx].bbox.left);
-    json_array_add_double_element(bbox, frame_obj_desc->objMetaList[idx].bbox.width);
-    json_array_add_double_element(bbox, frame_obj_desc->objMetaList[idx].bbox.height);
+    /* Sized from the descriptors so the objects are appended without
+     * reallocating. */
+    size = 256 + nvds_schema_estimate (*frame_object_desc);
+    for (guint i = 0; i < objCount; i++)
+      size += nvds_schema_estimate (
+          frame_object_desc->objMetaList[objIndices[i]]) + 1;
+    nvds_json_reserve (message, size);
+
+    #ifdef NDEBUG
+    gsize start = message->len;
+    #endif
+    append_message_header (message, meta, sensor);
+    g_string_append (message, ",\"objects\":[");
+    for (guint i = 0; i < objCount; i++) {
+      if (i)
+        g_string_append_c (message, ',');
+      nvds_schema_append_object (message,
+          frame_object_desc->objMetaList[objIndices[i]]);
+    }
+    g_string_append (message, "],\"frame\":");
+    nvds_schema_append_object (message, *frame_object_desc);
+    if (objCount < frame_object_desc->objCounts) {
+      g_string_append (message, ",\"objectCount\":");
+      nvds_json_append_int (message, frame_object_desc->objCounts);
+    }
+    g_string_append_c (message, '}');
+    #ifdef NDEBUG
+    NVGSTDS_INFO_MSG_V("%s: %s", __func__, message->str + start);
+    #endif
+    return true;
+  }
 
-    json_object_set_int_member(obj, "trackingId", frame_obj_desc->objMetaList[idx].trackingId);
-    json_object_set_array_member(obj, "bbox", bbox);
-    json_object_set_string_member(obj, "type", frame_obj_desc->objMetaList[idx].label);
+  return false;
+}
 
-    json_array_add_object_element(objectArray, obj);
+static const gchar *
+schema_trace_name (NvDsMsg2pScratch *scratch, NvDsEventMsgMeta *meta)
+{
+  switch (nvds_event_ext_kind (meta)) {
+    case NVDS_EVENT_EXT_TRACK:
+      return "encode-track";
+    case NVDS_EVENT_EXT_FRAME:
+      if (scratch->heatmap.config.enable)
+        return "encode-heatmap";
+      return "encode-frame";
+    default:
+      return "encode-frame";
   }
-  
-  return objectArray;
 }
 
-static JsonObject*
-generate_frame_meta(NvDsMsg2pCtx *ctx, NvDsFrameObjDescEvent* frame_obj_desc){
-  JsonObject* frameObj = NULL;
-  frameObj = json_object_new();
-  json_object_set_int_member(frameObj, "width", frame_obj_desc->frameWidth);
-  json_object_set_int_member(frameObj, "height", frame_obj_desc->frameHeight);
-  json_object_set_int_member(frameObj, "frameId", frame_obj_desc->frameId);
+/* Appends the message of @meta to @message, returns false if there is none. */
+static bool
+generate_schema_message (NvDsMsg2pCtx *ctx, NvDsMsg2pScratch *scratch,
+    NvDsEventMsgMeta *meta, bool shed, GString *message)
+{
+  gint64 traceBegin = nvds_trace_begin ();
+  gsize start = message->len;
+  bool generated = encode_schema_message (ctx, scratch, meta, shed, message);
 
-  return frameObj;
+  if (traceBegin) {
+    nvds_trace_end ("msgconv", schema_trace_name (scratch, meta), traceBegin,
+        "bytes", message->len - start);
+  }
+  return generated;
 }
 
+/* Returns the message of @meta as a string of its own, or NULL. */
 static gchar*
-generate_schema_message (NvDsMsg2pCtx *ctx, NvDsEventMsgMeta *meta){
-  JsonNode *rootNode;
-  JsonObject *rootObj;
-  JsonObject *sensorObj;
-
-  uuid_t msgId;
-  gchar msgIdStr[37];
-  JsonArray *objectArray;
-  // JsonArray *cloudModules;
-  // JsonArray *supportModules;
-  // gchar** cloudModulesList;
-  // gchar** supportModulesList;
-  JsonObject* frameObj;
-  gchar* message = NULL;
- 
-
-  // TODO: hash sensorObj.id
-  // json_object_set_string_member(rootObj, "id", sensorObj.id.c_str());
-  // partition-key, follow this guide https://docs.nvidia.com/metropolis/deepstream/dev-guide/text/DS_plugin_gst-nvmsgbroker.html
-
-  if(meta->extMsgSize > 0){
-    NvDsFrameObjDescEvent* frame_object_desc = (NvDsFrameObjDescEvent*)meta->extMsg;
+generate_schema_string (NvDsMsg2pCtx *ctx, NvDsMsg2pScratch *scratch,
+    NvDsEventMsgMeta *meta, bool shed)
+{
+  GString *message = g_string_sized_new (0);
 
-    if(frame_object_desc->objCounts > 0){
-      sensorObj = generate_sensor_object (ctx, meta);
-      if(sensorObj == NULL){
-        return NULL;
-      }
-      objectArray = generate_object_array (ctx, frame_object_desc);
-      frameObj = generate_frame_meta(ctx, frame_object_desc);
-
-      uuid_generate_random (msgId);
-      uuid_unparse_lower(msgId, msgIdStr);
-      rootObj = json_object_new(); 
-      
-      json_object_set_string_member (rootObj, "messageid", msgIdStr);
-      json_object_set_string_member (rootObj, "mdsversion", "1.0");
-      json_object_set_string_member (rootObj, "@timestamp", meta->ts);
-      json_object_set_object_member (rootObj, "sensor", sensorObj);
-      json_object_set_array_member (rootObj, "objects", objectArray);
-      json_object_set_object_member (rootObj, "frame", frameObj);
-
-      // supportModulesList = g_strsplit(frame_object_desc->filterCloudModules, ";", 128);
-      // cloudModulesList = g_strsplit(frame_object_desc->sourceCloudModules, ";", 128);
-
-      // cloudModules = json_array_new();
-      // supportModules = json_array_new();
-      // for(guint idx=0; idx < g_strv_length(supportModulesList); idx++){
-      //   json_array_add_string_element(supportModules, supportModulesList[idx]);
-      // }
-      // for(guint idx=0; idx < g_strv_length(cloudModulesList); idx++){
-      //   json_array_add_string_element(cloudModules, cloudModulesList[idx]);
-      // }
-
-      // json_object_set_array_member (rootObj, "support-modules", supportModules);
-      // json_object_set_array_member (rootObj, "source-modules", cloudModules);
-
-      // g_strfreev(supportModulesList);
-      // g_strfreev(cloudModulesList);
-
-      rootNode = json_node_new (JSON_NODE_OBJECT);
-      json_node_set_object (rootNode, rootObj);
-      message = json_to_string (rootNode, TRUE);
-      #ifdef NDEBUG
-      NVGSTDS_INFO_MSG_V("%s: %s", __func__, message);
-      #endif
-    }
-    if(rootNode != NULL){
-      json_node_free(rootNode);
-    }
-    json_object_unref(rootObj);
+  if (!generate_schema_message (ctx, scratch, meta, shed, message)) {
+    g_string_free (message, TRUE);
+    return NULL;
   }
-  
-  return message;
+  return g_string_free (message, FALSE);
 }
 
 static const gchar*
@@ -303,26 +475,93 @@ static const gchar *
 sensor_id_to_str (NvDsMsg2pCtx *ctx, gint sensorId)
 {
   NvDsPayloadPriv *privObj = NULL;
-  NvDsSensorObject *dsObj = NULL;
+  NvDsSensorView dsObj;
 
   g_return_val_if_fail (ctx, NULL);
   g_return_val_if_fail (ctx->privData, NULL);
 
   privObj = (NvDsPayloadPriv *) ctx->privData;
 
-  auto idMap = privObj->sensorObj.find (sensorId);
-  if (idMap != privObj->sensorObj.end()) {
-    dsObj = &idMap->second;
-    return dsObj->id.c_str();
+  if (nvds_sensor_catalog_find (*privObj->catalog, sensorId, dsObj)) {
+    return dsObj.id;
   } else {
-    cout << "No entry for " CONFIG_GROUP_SENSOR << sensorId
-        << " in configuration file" << endl;
+    NVDS_MSG2P_LOG (sensorId,
+        "No entry for " CONFIG_GROUP_SENSOR "%d in configuration file",
+        sensorId);
     return NULL;
   }
 }
 
-static gchar*
-generate_deepstream_message_minimal (NvDsMsg2pCtx *ctx, NvDsEvent *events, guint size)
+/*
+ * Appends the attributes of an object extension of type @T in the minimal
+ * schema, see nvmsgconv_schema.h for their order.
+ */
+template <typename T>
+static void
+append_minimal_attributes (GString *out, NvDsEventMsgMeta *meta)
+{
+  if (meta->extMsgSize < sizeof (T)) {
+    NVDS_MSG2P_LOG (meta->objType,
+        "Extension of object type (%d) too small: %u", meta->objType,
+        meta->extMsgSize);
+    return;
+  }
+  g_string_append (out, "|#");
+  nvds_schema_append_delimited (out, *(const T *) meta->extMsg);
+  g_string_append_c (out, '|');
+  nvds_json_append_double (out, meta->confidence);
+}
+
+/* Appends one pipe-delimited object record, escaped for a JSON string. */
+static void
+append_minimal_object (GString *out, NvDsEventMsgMeta *meta)
+{
+  const gchar *objStr;
+
+  nvds_json_append_int (out, meta->trackingId);
+  g_string_append_c (out, '|');
+  nvds_json_append_double (out, meta->bbox.left);
+  g_string_append_c (out, '|');
+  nvds_json_append_double (out, meta->bbox.top);
+  g_string_append_c (out, '|');
+  nvds_json_append_double (out, meta->bbox.left + meta->bbox.width);
+  g_string_append_c (out, '|');
+  nvds_json_append_double (out, meta->bbox.top + meta->bbox.height);
+  g_string_append_c (out, '|');
+  objStr = object_enum_to_str (meta->objType, meta->objectId);
+  nvds_json_append_escaped (out, objStr, strlen (objStr));
+
+  if (!meta->extMsg || !meta->extMsgSize)
+    return;
+
+  // Attach secondary inference attributes.
+  switch (meta->objType) {
+    case NVDS_OBJECT_TYPE_VEHICLE:
+      append_minimal_attributes<NvDsVehicleObject> (out, meta);
+      break;
+    case NVDS_OBJECT_TYPE_PERSON:
+      append_minimal_attributes<NvDsPersonObject> (out, meta);
+      break;
+    case NVDS_OBJECT_TYPE_FACE:
+      append_minimal_attributes<NvDsFaceObject> (out, meta);
+      break;
+    case NVDS_OBJECT_TYPE_BAG:
+    case NVDS_OBJECT_TYPE_BICYCLE:
+    case NVDS_OBJECT_TYPE_ROADSIGN:
+      /* No extension struct in the schema, hence no attributes. */
+      g_string_append (out, "|#|");
+      nvds_json_append_double (out, meta->confidence);
+      break;
+    default:
+      NVDS_MSG2P_LOG (meta->objType, "Object type (%d) not implemented",
+          meta->objType);
+      break;
+  }
+}
+
+static void
+generate_deepstream_message_minimal (NvDsMsg2pCtx *ctx, NvDsEvent *events,
+    guint size, GString *message)
 {
   /*
   The JSON structure of the frame
@@ -353,90 +592,45 @@ generate_deepstream_message_minimal (NvDsMsg2pCtx *ctx, NvDsEvent *events, guint
   }
    */
 
-  JsonNode *rootNode;
-  JsonObject *jobject;
-  JsonArray *jArray;
+  NvDsEventMsgMeta *first = events[0].metadata;
+  const gchar *sensorStr;
   guint i;
-  stringstream ss;
-  gchar *message = NULL;
-
-  jArray = json_array_new ();
-
-  for (i = 0; i < size; i++) {
 
-    ss.str("");
-    ss.clear();
-
-    NvDsEventMsgMeta *meta = events[i].metadata;
-    ss << meta->trackingId << "|" << meta->bbox.left << "|" << meta->bbox.top
-        << "|" << meta->bbox.left + meta->bbox.width << "|" << meta->bbox.top + meta->bbox.height
-        << "|" << object_enum_to_str (meta->objType, meta->objectId);
-
-    if (meta->extMsg && meta->extMsgSize) {
-      // Attach secondary inference attributes.
-      switch (meta->objType) {
-        case NVDS_OBJECT_TYPE_VEHICLE: {
-          NvDsVehicleObject *dsObj = (NvDsVehicleObject *) meta->extMsg;
-          if (dsObj) {
-            ss << "|#|" << to_str(dsObj->type) << "|" << to_str(dsObj->make) << "|"
-               << to_str(dsObj->model) << "|" << to_str(dsObj->color) << "|" << to_str(dsObj->license)
-               << "|" << to_str(dsObj->region) << "|" << meta->confidence;
-          }
-        }
-          break;
-        case NVDS_OBJECT_TYPE_PERSON: {
-          NvDsPersonObject *dsObj = (NvDsPersonObject *) meta->extMsg;
-          if (dsObj) {
-            ss << "|#|" << to_str(dsObj->gender) << "|" << dsObj->age << "|"
-                << to_str(dsObj->hair) << "|" << to_str(dsObj->cap) << "|" << to_str(dsObj->apparel)
-                << "|" << meta->confidence;
-          }
-        }
-          break;
-        default:
-          cout << "Object type (" << meta->objType << ") not implemented" << endl;
-          break;
-      }
-    }
-
-    json_array_add_string_element (jArray, ss.str().c_str());
-  }
+  /* Sized for typical records so objects are appended without
+   * reallocating. */
+  nvds_json_reserve (message, 256 + size * 128);
 
   // It is assumed that all events / objects are associated with same frame.
   // Therefore ts / sensorId / frameId of first object can be used.
-
-  jobject = json_object_new ();
-  json_object_set_string_member (jobject, "version", "4.0");
-  json_object_set_int_member (jobject, "id", events[0].metadata->frameId);
-  json_object_set_string_member (jobject, "@timestamp", events[0].metadata->ts);
-  if (events[0].metadata->sensorStr) {
-    json_object_set_string_member (jobject, "sensorId", events[0].metadata->sensorStr);
+  if (first->sensorStr) {
+    sensorStr = first->sensorStr;
   } else if (ctx->privData) {
-    json_object_set_string_member (jobject, "sensorId",
-        to_str((gchar *) sensor_id_to_str (ctx, events[0].metadata->sensorId)));
+    sensorStr = to_str ((gchar *) sensor_id_to_str (ctx, first->sensorId));
   } else {
-    json_object_set_string_member (jobject, "sensorId", "0");
+    sensorStr = "0";
   }
 
-  json_object_set_array_member (jobject, "objects", jArray);
-  rootNode = json_node_new (JSON_NODE_OBJECT);
-  json_node_set_object (rootNode, jobject);
-  message = json_to_string (rootNode, TRUE);
-  json_node_free (rootNode);
-  json_object_unref (jobject);
+  append_minimal_header (message, first->frameId, first->ts, sensorStr);
 
-  return message;
+  for (i = 0; i < size; i++) {
+    if (i)
+      g_string_append_c (message, ',');
+    g_string_append_c (message, '"');
+    append_minimal_object (message, events[i].metadata);
+    g_string_append_c (message, '"');
+  }
+  g_string_append (message, "]}");
 }
 
 static bool
-nvds_msg2p_parse_sensor (NvDsMsg2pCtx *ctx, GKeyFile *key_file, gchar *group)
+nvds_msg2p_parse_sensor (NvDsSensorCatalog &catalog, GKeyFile *key_file,
+    gchar *group)
 {
   bool ret = false;
   bool isEnabled = false;
   gchar **keys = NULL;
   gchar **key = NULL;
   GError *error = NULL;
-  NvDsPayloadPriv *privObj = NULL;
   NvDsSensorObject sensorObj;
   gint sensorId;
   gchar *keyVal;
@@ -446,10 +640,8 @@ nvds_msg2p_parse_sensor (NvDsMsg2pCtx *ctx, GKeyFile *key_file, gchar *group)
     return ret;
   }
 
-  privObj = (NvDsPayloadPriv *) ctx->privData;
-
-  auto idMap = privObj->sensorObj.find (sensorId);
-  if (idMap != privObj->sensorObj.end()) {
+  auto idMap = catalog.sensors.find (sensorId);
+  if (idMap != catalog.sensors.end()) {
     cout << "Duplicate entries for " << group << endl;
     return ret;
   }
@@ -494,7 +686,8 @@ nvds_msg2p_parse_sensor (NvDsMsg2pCtx *ctx, GKeyFile *key_file, gchar *group)
       g_free (keyVal);
   }
 
-  privObj->sensorObj.insert (make_pair (sensorId, sensorObj));
+  nvds_sensor_object_build_json (sensorObj);
+  catalog.sensors.insert (make_pair (sensorId, sensorObj));
 
   ret = true;
 
@@ -510,58 +703,35 @@ done:
 }
 
 static bool
-nvds_msg2p_parse_csv (NvDsMsg2pCtx *ctx, const gchar *file)
+nvds_msg2p_parse_catalog (NvDsSensorCatalog &catalog, GKeyFile *key_file,
+    gchar *group)
 {
-  NvDsPayloadPriv *privObj = NULL;
-  NvDsSensorObject sensorObj;
-  bool retVal = true;
-  bool firstRow = true;
-  string line;
-  gint i, index = 0;
+  GError *error = NULL;
+  gchar *snapshot;
+  bool ret;
 
-  ifstream inputFile (file);
-  if (!inputFile.is_open()) {
-    cout << "Couldn't open CSV file " << file << endl;
+  snapshot = g_key_file_get_string (key_file, group, CONFIG_KEY_SNAPSHOT,
+      &error);
+  if (error) {
+    cout << "Error: " << error->message << endl;
+    g_error_free (error);
     return false;
   }
 
-  privObj = (NvDsPayloadPriv *) ctx->privData;
-
-  try {
-
-    while (getline (inputFile, line)) {
-
-      if (firstRow) {
-        // Discard first row as it will have header fields.
-        firstRow = false;
-        continue;
-      }
-
-      vector<string> tokens;
-      get_csv_tokens (line, tokens);
-      // Ignore first cameraId field.
-      i = 1;
-
-      // sensor object fields
-      sensorObj.id = tokens.at(i++);
-      sensorObj.type = "Camera";
-      sensorObj.desc = tokens.at(i++);
-
-      privObj->sensorObj.insert (make_pair (index, sensorObj));
-      index++;
-    }
-  } catch (const std::out_of_range& oor) {
-    std::cerr << "Out of Range error: " << oor.what() << '\n';
-    retVal = false;
-  }
-
-  inputFile.close ();
-  return retVal;
+  ret = nvds_sensor_snapshot_map (snapshot, catalog);
+  g_free (snapshot);
+  return ret;
 }
 
+/*
+ * Parses key-value configuration @file. Sensors go into @catalog, unless
+ * it is NULL because the context shares a catalog loaded before.
+ */
 static bool
-nvds_msg2p_parse_key_value (NvDsMsg2pCtx *ctx, const gchar *file)
+nvds_msg2p_parse_key_value (NvDsMsg2pCtx *ctx, const gchar *file,
+    NvDsSensorCatalog *catalog)
 {
+  NvDsPayloadPriv *privObj = (NvDsPayloadPriv *) ctx->privData;
   bool retVal = true;
   GKeyFile *cfgFile = NULL;
   GError *error = NULL;
@@ -578,8 +748,34 @@ nvds_msg2p_parse_key_value (NvDsMsg2pCtx *ctx, const gchar *file)
   groups = g_key_file_get_groups (cfgFile, NULL);
 
   for (group = groups; *group; group++) {
-    if (!strncmp (*group, CONFIG_GROUP_SENSOR, strlen (CONFIG_GROUP_SENSOR))) {
-      retVal = nvds_msg2p_parse_sensor (ctx, cfgFile, *group);
+    if (!g_strcmp0 (*group, CONFIG_GROUP_CATALOG)) {
+      if (catalog)
+        retVal = nvds_msg2p_parse_catalog (*catalog, cfgFile, *group);
+    } else if (!strncmp (*group, CONFIG_GROUP_SENSOR,
+            strlen (CONFIG_GROUP_SENSOR))) {
+      if (catalog)
+        retVal = nvds_msg2p_parse_sensor (*catalog, cfgFile, *group);
+    } else if (!g_strcmp0 (*group, CONFIG_GROUP_PRIORITY_LANES)) {
+      retVal = nvds_lanes_parse (&privObj->scratch.lanes.config, cfgFile,
+          *group);
+    } else if (!g_strcmp0 (*group, CONFIG_GROUP_HEATMAP)) {
+      retVal = nvds_heatmap_parse (&privObj->scratch.heatmap.config, cfgFile,
+          *group);
+    } else if (!g_strcmp0 (*group, CONFIG_GROUP_ARROW)) {
+      retVal = nvds_arrow_parse (&privObj->scratch.arrow.config, cfgFile,
+          *group);
+    } else if (!g_strcmp0 (*group, CONFIG_GROUP_LINGER)) {
+      retVal = nvds_linger_parse (&privObj->scratch.linger.config, cfgFile,
+          *group);
+    } else if (!g_strcmp0 (*group, CONFIG_GROUP_MODULES)) {
+      retVal = nvds_modules_parse (&privObj->modules, cfgFile, *group);
+    } else if (!g_strcmp0 (*group, CONFIG_GROUP_PAYLOADS)) {
+      retVal = nvds_results_parse (&privObj->results.config, cfgFile, *group);
+    } else if (!g_strcmp0 (*group, CONFIG_GROUP_LOAD_SHEDDING)) {
+      retVal = nvds_load_shed_parse (&privObj->scratch.shedder.config, cfgFile,
+          *group);
+    } else if (!g_strcmp0 (*group, CONFIG_GROUP_CONTEXT)) {
+      retVal = nvds_context_parse (&privObj->context, cfgFile, *group);
     } else {
       cout << "Unknown group " << *group << endl;
     }
@@ -600,6 +796,36 @@ done:
   return retVal;
 }
 
+/*
+ * Loads configuration @file into the new context @ctx, sharing the catalog
+ * with other contexts created from the same file. CSV catalogs are only
+ * accepted for the full DeepStream schema.
+ */
+static bool
+nvds_msg2p_load (NvDsMsg2pCtx *ctx, const gchar *file, bool csv)
+{
+  NvDsPayloadPriv *privObj = (NvDsPayloadPriv *) ctx->privData;
+  bool snapshot = g_str_has_suffix (file, NVDS_SNAPSHOT_SUFFIX);
+  bool loaded = false;
+
+  privObj->catalog = nvds_sensor_catalog_acquire (file,
+      [&] (NvDsSensorCatalog &catalog) {
+        loaded = true;
+        if (csv)
+          return nvds_msg2p_load_sensor_csv (file, catalog.sensors);
+        if (snapshot)
+          return nvds_sensor_snapshot_map (file, catalog);
+        return nvds_msg2p_parse_key_value (ctx, file, &catalog);
+      });
+  if (!privObj->catalog)
+    return false;
+
+  // The other groups of a key-value file belong to each context.
+  if (!loaded && !csv && !snapshot)
+    return nvds_msg2p_parse_key_value (ctx, file, NULL);
+  return true;
+}
+
 NvDsMsg2pCtx* nvds_msg2p_ctx_create (const gchar *file, NvDsPayloadType type)
 {
   NvDsMsg2pCtx *ctx = NULL;
@@ -615,20 +841,15 @@ NvDsMsg2pCtx* nvds_msg2p_ctx_create (const gchar *file, NvDsPayloadType type)
 
     ctx = new NvDsMsg2pCtx;
     ctx->privData = (void *) new NvDsPayloadPriv;
-
-    if (g_str_has_suffix (file, ".csv")) {
-      retVal = nvds_msg2p_parse_csv (ctx, file);
-    } else {
-      retVal = nvds_msg2p_parse_key_value (ctx, file);
-    }
+    retVal = nvds_msg2p_load (ctx, file, g_str_has_suffix (file, ".csv"));
   } else {
     ctx = new NvDsMsg2pCtx;
-    /* If configuration file is provided for minimal schema,
+    /* If configuration file is provided for minimal or custom schema,
      * parse it for static values.
      */
     if (file) {
       ctx->privData = (void *) new NvDsPayloadPriv;
-      retVal = nvds_msg2p_parse_key_value (ctx, file);
+      retVal = nvds_msg2p_load (ctx, file, false);
     } else {
       ctx->privData = nullptr;
       retVal = true;
@@ -637,6 +858,22 @@ NvDsMsg2pCtx* nvds_msg2p_ctx_create (const gchar *file, NvDsPayloadType type)
 
   ctx->payloadType = type;
 
+  if (retVal && ctx->privData) {
+    const NvDsMsg2pScratch &scratch =
+        ((NvDsPayloadPriv *) ctx->privData)->scratch;
+
+    // Lanes and JSON envelopes both need text messages.
+    if (scratch.linger.config.enable && !scratch.linger.config.frames &&
+        type == NVDS_PAYLOAD_CUSTOM) {
+      cout << "JSON envelopes need a JSON payload type" << endl;
+      retVal = false;
+    } else if (scratch.linger.config.enable && scratch.linger.config.frames &&
+        scratch.lanes.config.enable) {
+      cout << "Priority lanes need JSON envelopes" << endl;
+      retVal = false;
+    }
+  }
+
   if (!retVal) {
     cout << "Error in creating instance" << endl;
 
@@ -647,6 +884,8 @@ NvDsMsg2pCtx* nvds_msg2p_ctx_create (const gchar *file, NvDsPayloadType type)
       delete ctx;
       ctx = NULL;
     }
+  } else {
+    nvds_msg2p_log_acquire ();
   }
   return ctx;
 }
@@ -656,89 +895,615 @@ void nvds_msg2p_ctx_destroy (NvDsMsg2pCtx *ctx)
   delete (NvDsPayloadPriv *) ctx->privData;
   ctx->privData = nullptr;
   delete ctx;
+  nvds_msg2p_log_release ();
 }
 
-NvDsPayload**
-nvds_msg2p_generate_multiple (NvDsMsg2pCtx *ctx, NvDsEvent *events, guint eventSize,
-                     guint *payloadCount)
+bool
+nvds_msg2p_write_snapshot (NvDsMsg2pCtx *ctx, const gchar *file)
 {
+  g_return_val_if_fail (ctx && ctx->privData, false);
+
+  return nvds_sensor_snapshot_write (
+      ((NvDsPayloadPriv *) ctx->privData)->catalog->sensors, file);
+}
+
+/* Tracks payloads handed out until they are released, as a measure of the
+ * backlog towards the broker. */
+static void
+account_payload (NvDsMsg2pCtx *ctx, NvDsPayload *payload, bool generated)
+{
+  if (ctx->privData && payload->payload) {
+    nvds_load_shed_account (&((NvDsPayloadPriv *) ctx->privData)->backlog,
+        payload->payloadSize, generated);
+  }
+}
+
+/*
+ * Calls @deliver (componentId, last) for every module @meta routes to, see
+ * nvmsgconv_modules.h, or once with componentId 0 if routing is off, and
+ * returns the number of calls. With @allClasses only the sensor counts.
+ */
+template <typename Deliver>
+static guint
+route_modules (NvDsMsg2pCtx *ctx, const NvDsEventMsgMeta *meta,
+    bool allClasses, Deliver deliver)
+{
+  const NvDsModuleTable *table =
+      &((NvDsPayloadPriv *) ctx->privData)->modules;
+  NvDsModuleMask mask;
+  guint count = 0;
+
+  if (!table->enable) {
+    deliver (0u, true);
+    return 1;
+  }
+
+  mask = nvds_modules_route (table, meta, allClasses);
+  for (; mask; count++) {
+    guint id = __builtin_ctzll (mask);
+
+    mask &= mask - 1;
+    deliver (table->modules[id].componentId, !mask);
+  }
+  return count;
+}
+
+/* Routes the message of @meta, see route_modules. */
+template <typename Deliver>
+static guint
+route_message (NvDsMsg2pCtx *ctx, NvDsMsg2pScratch *scratch,
+    NvDsEventMsgMeta *meta, Deliver deliver)
+{
+  // A heatmap covers every class of the frames it was built from.
+  return route_modules (ctx, meta, scratch->heatmap.config.enable &&
+      nvds_event_ext_kind (meta) == NVDS_EVENT_EXT_FRAME, deliver);
+}
+
+/*
+ * Calls @deliver (message, componentId) with a copy of @message for every
+ * module @meta routes to. @message is freed if no module wants it.
+ */
+template <typename Deliver>
+static void
+route_copies (NvDsMsg2pCtx *ctx, NvDsMsg2pScratch *scratch,
+    NvDsEventMsgMeta *meta, gchar *message, Deliver deliver)
+{
+  guint count = route_message (ctx, scratch, meta,
+      [&] (guint componentId, bool last) {
+        // The last module gets the original.
+        deliver (last ? message : g_strdup (message), componentId);
+      });
+
+  if (!count)
+    g_free (message);
+}
+
+/*
+ * Converts each event into its own message, queues it on its priority lane
+ * and hands out the next messages by lane priority, plus every critical
+ * message beyond the budget. Telemetry messages linger first and are
+ * queued as envelopes.
+ */
+static void
+generate_multiple_by_priority (NvDsMsg2pCtx *ctx, NvDsEvent *events,
+    guint eventSize, vector<NvDsResultMessage> &messages)
+{
+  NvDsMsg2pScratch *scratch = get_scratch (ctx);
+  NvDsPriorityLanes *lanes = &scratch->lanes;
+  NvDsLinger *linger = &scratch->linger;
+  NvDsResultMessage envelope;
   gchar *message = NULL;
-  gint len = 0;
-  NvDsPayload **payloads = NULL;
-  *payloadCount = 0;
-  //Set how many payloads are being sent back to the plugin
-  payloads = (NvDsPayload **) g_malloc0 (sizeof (NvDsPayload*) * 1);
+  guint componentId;
+
+  for (guint i = 0; i < eventSize; i++) {
+    NvDsLaneId lane = nvds_lanes_classify (lanes, events[i].metadata);
+    gint sensorId = events[i].metadata->sensorId;
+
+    message = generate_schema_string (ctx, scratch, events[i].metadata,
+        lane != NVDS_LANE_CRITICAL);
+    if (!message)
+      continue;
+    route_copies (ctx, scratch, events[i].metadata, message,
+        [&] (gchar *copy, guint id) {
+          if (lane == NVDS_LANE_TELEMETRY && linger->config.enable) {
+            nvds_linger_add (linger, { copy, (guint) strlen (copy), id },
+                sensorId);
+            g_free (copy);
+          } else {
+            nvds_lanes_push (lanes, lane, copy, id);
+          }
+        });
+  }
 
-  if (ctx->payloadType == NVDS_PAYLOAD_DEEPSTREAM) {
-    message = generate_schema_message (ctx, events->metadata);
-    if (message) {
-      payloads[*payloadCount]= (NvDsPayload *) g_malloc0 (sizeof (NvDsPayload));
-      len = strlen (message);
-      // Remove '\0' character at the end of string and just copy the content.
-      payloads[*payloadCount]->payload = g_memdup (message, len);
-      payloads[*payloadCount]->payloadSize = len;
-      ++(*payloadCount);
-      g_free (message);
+  if (linger->config.enable) {
+    nvds_linger_expire (linger, false);
+    while (nvds_linger_pop (linger, &envelope)) {
+      nvds_lanes_push (lanes, NVDS_LANE_TELEMETRY, (gchar *) envelope.data,
+          envelope.componentId);
     }
-  } else if (ctx->payloadType == NVDS_PAYLOAD_DEEPSTREAM_MINIMAL) {
-    message = generate_deepstream_message_minimal (ctx, events, eventSize);
-    if (message) {
-      len = strlen (message);
-      payloads[*payloadCount] = (NvDsPayload *) g_malloc0 (sizeof (NvDsPayload));
-      // Remove '\0' character at the end of string and just copy the content.
-      payloads[*payloadCount]->payload = g_memdup (message, len);
-      payloads[*payloadCount]->payloadSize = len;
-      ++(*payloadCount);
-      g_free (message);
+    nvds_linger_report (linger);
+  }
+
+  while (messages.size () < lanes->config.maxPayloadsPerCall &&
+      (message = nvds_lanes_pop (lanes, &componentId))) {
+    // The message is handed over as is, without its '\0'.
+    messages.push_back ({ message, (guint) strlen (message), componentId });
+  }
+  // Only telemetry may wait for a later call, which may never come.
+  while ((message = nvds_lanes_pop_lane (lanes, NVDS_LANE_CRITICAL,
+              &componentId)))
+    messages.push_back ({ message, (guint) strlen (message), componentId });
+  nvds_lanes_report (lanes);
+}
+
+/*
+ * Adds the objects of @events to the Arrow batch and appends the batch to
+ * @message once it is complete.
+ */
+static bool
+generate_arrow_batch (NvDsMsg2pCtx *ctx, NvDsEvent *events, guint size,
+    GString *message)
+{
+  NvDsPayloadPriv *privObj = (NvDsPayloadPriv *) ctx->privData;
+  NvDsArrowBatch *batch = &get_scratch (ctx)->arrow;
+
+  for (guint i = 0; i < size; i++) {
+    NvDsEventMsgMeta *meta = events[i].metadata;
+    gchar sensorIdStr[16];
+    NvDsSensorView sensor;
+    NvDsArrowRow row;
+
+    // Sensors missing from the catalog are identified by their number.
+    if (meta->sensorStr) {
+      row.sensorId = meta->sensorStr;
+    } else if (nvds_sensor_catalog_find (*privObj->catalog, meta->sensorId,
+            sensor)) {
+      row.sensorId = sensor.id;
+    } else {
+      g_snprintf (sensorIdStr, sizeof (sensorIdStr), "%d", meta->sensorId);
+      row.sensorId = sensorIdStr;
     }
+    row.frameId = meta->frameId;
+    row.timestamp = nvds_arrow_parse_timestamp (meta->ts);
+
+    // Track events have no boxes, they only exist in the JSON schema.
+    NvDsEventExtKind kind = nvds_event_ext_kind (meta);
+    if (kind == NVDS_EVENT_EXT_TRACK)
+      continue;
+
+    if (kind == NVDS_EVENT_EXT_FRAME) {
+      NvDsFrameObjDescEvent *frame_obj_desc =
+          (NvDsFrameObjDescEvent *) meta->extMsg;
+      guint count = MIN (frame_obj_desc->objCounts, MAX_OBJ_NUM);
+
+      for (guint idx = 0; idx < count; idx++) {
+        NvDsSimpleObjectMeta *obj = &frame_obj_desc->objMetaList[idx];
+
+        row.trackingId = obj->trackingId;
+        row.left = obj->bbox.left;
+        row.top = obj->bbox.top;
+        row.width = obj->bbox.width;
+        row.height = obj->bbox.height;
+        row.classId = obj->classId;
+        row.label = obj->label;
+        row.confidence = obj->confidence;
+        nvds_arrow_append (batch, &row);
+      }
+    } else {
+      row.trackingId = meta->trackingId;
+      row.left = meta->bbox.left;
+      row.top = meta->bbox.top;
+      row.width = meta->bbox.width;
+      row.height = meta->bbox.height;
+      row.classId = meta->objClassId;
+      row.label = object_enum_to_str (meta->objType, meta->objectId);
+      row.confidence = meta->confidence;
+      nvds_arrow_append (batch, &row);
+    }
+  }
+
+  if (!nvds_arrow_ready (batch))
+    return false;
+  nvds_arrow_finish (batch, message);
+  return true;
+}
+
+/*
+ * Appends the payload of @events to @message, without the '\0' ending
+ * JSON messages. Returns false if there is none.
+ */
+static bool
+generate_message (NvDsMsg2pCtx *ctx, NvDsEvent *events, guint size,
+    GString *message)
+{
+  static const gchar custom[] = "CUSTOM Schema";
+  gsize start = message->len;
+  bool generated = false;
+  gint64 traceBegin;
+
+  if (ctx->payloadType == NVDS_PAYLOAD_DEEPSTREAM) {
+    generated = generate_schema_message (ctx, get_scratch (ctx),
+        events->metadata, true, message);
+  } else if (ctx->payloadType == NVDS_PAYLOAD_DEEPSTREAM_MINIMAL) {
+    traceBegin = nvds_trace_begin ();
+    generate_deepstream_message_minimal (ctx, events, size, message);
+    generated = true;
+    nvds_trace_end ("msgconv", "encode-minimal", traceBegin, "bytes",
+        message->len - start);
+  } else if (ctx->payloadType == NVDS_PAYLOAD_CUSTOM && ctx->privData &&
+      ((NvDsPayloadPriv *) ctx->privData)->scratch.arrow.config.enable) {
+    traceBegin = nvds_trace_begin ();
+    generated = generate_arrow_batch (ctx, events, size, message);
+    nvds_trace_end ("msgconv", "encode-arrow", traceBegin, "bytes",
+        message->len - start);
   } else if (ctx->payloadType == NVDS_PAYLOAD_CUSTOM) {
-    payloads[*payloadCount] = (NvDsPayload *) g_malloc0 (sizeof (NvDsPayload));
-    payloads[*payloadCount]->payload = (gpointer) g_strdup ("CUSTOM Schema");
-    payloads[*payloadCount]->payloadSize = strlen ((char *)payloads[*payloadCount]->payload) + 1;
-    ++(*payloadCount);
-  } else
-    payloads = NULL;
+    g_string_append_len (message, custom, sizeof (custom));
+    generated = true;
+  }
+  return generated;
+}
+
+/* Returns the payload of @events as a buffer of its own, or NULL. */
+static gchar*
+generate_string (NvDsMsg2pCtx *ctx, NvDsEvent *events, guint size,
+    guint *len)
+{
+  GString *message = g_string_sized_new (0);
+
+  if (!generate_message (ctx, events, size, message)) {
+    g_string_free (message, TRUE);
+    return NULL;
+  }
+  *len = message->len;
+  return g_string_free (message, FALSE);
+}
+
+static bool
+contiguous_results (NvDsMsg2pCtx *ctx)
+{
+  return ctx->privData &&
+      ((NvDsPayloadPriv *) ctx->privData)->results.config.contiguous;
+}
+
+static NvDsLinger*
+get_linger (NvDsMsg2pCtx *ctx)
+{
+  if (!ctx->privData ||
+      !((NvDsPayloadPriv *) ctx->privData)->scratch.linger.config.enable)
+    return NULL;
+  return &get_scratch (ctx)->linger;
+}
+
+/*
+ * Moves @messages into the envelopes of @linger and replaces them with the
+ * envelopes that closed, all of them if @all.
+ */
+static void
+linger_messages (NvDsLinger *linger, gint sensorId,
+    vector<NvDsResultMessage> &messages, bool all)
+{
+  NvDsResultMessage envelope;
+
+  for (NvDsResultMessage &message : messages) {
+    nvds_linger_add (linger, message, sensorId);
+    g_free ((gchar *) message.data);
+  }
+  messages.clear ();
+
+  nvds_linger_expire (linger, all);
+  while (nvds_linger_pop (linger, &envelope))
+    messages.push_back (envelope);
+  nvds_linger_report (linger);
+}
+
+/* Hands @messages over as an array of at least @capacity payloads. */
+static NvDsPayload**
+build_payloads (NvDsMsg2pCtx *ctx, vector<NvDsResultMessage> &messages,
+    guint capacity, guint *payloadCount)
+{
+  //Set how many payloads are being sent back to the plugin
+  NvDsPayload **payloads = (NvDsPayload **) g_malloc0 (sizeof (NvDsPayload*) *
+      MAX (capacity, (guint) messages.size ()));
+
+  if (contiguous_results (ctx)) {
+    nvds_results_build (&((NvDsPayloadPriv *) ctx->privData)->results,
+        &get_scratch (ctx)->results, messages.data (), messages.size (),
+        payloads);
+    for (NvDsResultMessage &message : messages)
+      g_free ((gchar *) message.data);
+  } else {
+    for (guint i = 0; i < messages.size (); i++) {
+      payloads[i] = (NvDsPayload *) g_malloc0 (sizeof (NvDsPayload));
+      // The message buffer is handed over, payloadSize says how much of it
+      // is payload.
+      payloads[i]->payload = (gpointer) messages[i].data;
+      payloads[i]->payloadSize = messages[i].size;
+      payloads[i]->componentId = messages[i].componentId;
+    }
+  }
+  *payloadCount = messages.size ();
+
+  for (guint i = 0; i < *payloadCount; i++)
+    account_payload (ctx, payloads[i], true);
 
   return payloads;
 }
 
-NvDsPayload*
-nvds_msg2p_generate (NvDsMsg2pCtx *ctx, NvDsEvent *events, guint size)
+/*
+ * Encodes the payloads of @events straight into the next result block, see
+ * nvmsgconv_results.h. The modules a message routes to share its body.
+ */
+static NvDsPayload**
+generate_in_block (NvDsMsg2pCtx *ctx, NvDsEvent *events, guint eventSize,
+    guint *payloadCount)
 {
-  gchar *message = NULL;
-  gint len = 0;
-  NvDsPayload *payload = (NvDsPayload *) g_malloc0 (sizeof (NvDsPayload));
+  NvDsPayloadPriv *privObj = (NvDsPayloadPriv *) ctx->privData;
+  NvDsMsg2pScratch *scratch = get_scratch (ctx);
+  NvDsResultSpan spans[NVDS_MAX_MODULES];
+  guint maxCount = privObj->modules.enable ?
+      MAX ((guint) privObj->modules.modules.size (), 1u) : 1;
+  GString *data = nvds_results_begin (&privObj->results, &scratch->results,
+      maxCount);
+  gsize offset = data->len;
+  NvDsPayload **payloads;
+  guint count = 0;
+
+  if (ctx->payloadType == NVDS_PAYLOAD_DEEPSTREAM && privObj->modules.enable) {
+    if (generate_schema_message (ctx, scratch, events->metadata, true, data)) {
+      route_message (ctx, scratch, events->metadata,
+          [&] (guint componentId, bool) {
+            spans[count++] = { offset, (guint) (data->len - offset),
+                componentId };
+          });
+    }
+  } else if (generate_message (ctx, events, eventSize, data)) {
+    spans[count++] = { offset, (guint) (data->len - offset), 0 };
+  }
+
+  //Set how many payloads are being sent back to the plugin
+  payloads = (NvDsPayload **) g_malloc0 (sizeof (NvDsPayload*) *
+      MAX (count, 1u));
+  nvds_results_finish (&privObj->results, &scratch->results, spans, count,
+      payloads);
+  *payloadCount = count;
+
+  for (guint i = 0; i < count; i++)
+    account_payload (ctx, payloads[i], true);
+
+  return payloads;
+}
+
+/* Converts @events into messages of their own, one per module. */
+static void
+generate_messages (NvDsMsg2pCtx *ctx, NvDsEvent *events, guint eventSize,
+    vector<NvDsResultMessage> &messages)
+{
+  if (ctx->payloadType == NVDS_PAYLOAD_DEEPSTREAM &&
+      ((NvDsPayloadPriv *) ctx->privData)->modules.enable) {
+    NvDsMsg2pScratch *scratch = get_scratch (ctx);
+    gchar *message = generate_schema_string (ctx, scratch, events->metadata,
+        true);
 
-  if (ctx->payloadType == NVDS_PAYLOAD_DEEPSTREAM) {
-    message = generate_schema_message (ctx, events->metadata);
     if (message) {
-      len = strlen (message);
-      // Remove '\0' character at the end of string and just copy the content.
-      payload->payload = g_memdup (message, len);
-      payload->payloadSize = len;
-      g_free (message);
+      route_copies (ctx, scratch, events->metadata, message,
+          [&] (gchar *copy, guint id) {
+            messages.push_back ({ copy, (guint) strlen (copy), id });
+          });
     }
-  } else if (ctx->payloadType == NVDS_PAYLOAD_DEEPSTREAM_MINIMAL) {
-    message = generate_deepstream_message_minimal (ctx, events, size);
-    if (message) {
-      len = strlen (message);
-      // Remove '\0' character at the end of string and just copy the content.
-      payload->payload = g_memdup (message, len);
-      payload->payloadSize = len;
+  } else {
+    NvDsResultMessage message = { NULL, 0, 0 };
+
+    message.data = generate_string (ctx, events, eventSize, &message.size);
+    if (message.data)
+      messages.push_back (message);
+  }
+}
+
+NvDsPayload**
+nvds_msg2p_generate_multiple (NvDsMsg2pCtx *ctx, NvDsEvent *events, guint eventSize,
+                     guint *payloadCount)
+{
+  vector<NvDsResultMessage> messages;
+  NvDsLinger *linger = NULL;
+  guint capacity = 1;
+  *payloadCount = 0;
+
+  if (ctx->payloadType == NVDS_PAYLOAD_DEEPSTREAM &&
+      ((NvDsPayloadPriv *) ctx->privData)->scratch.lanes.config.enable) {
+    capacity = ((NvDsPayloadPriv *) ctx->privData)->
+        scratch.lanes.config.maxPayloadsPerCall;
+    messages.reserve (capacity);
+    generate_multiple_by_priority (ctx, events, eventSize, messages);
+  } else if (ctx->payloadType == NVDS_PAYLOAD_DEEPSTREAM ||
+      ctx->payloadType == NVDS_PAYLOAD_DEEPSTREAM_MINIMAL ||
+      ctx->payloadType == NVDS_PAYLOAD_CUSTOM) {
+    linger = get_linger (ctx);
+    // Lingering messages outlive the call, they are copied into the block.
+    if (!linger && contiguous_results (ctx))
+      return generate_in_block (ctx, events, eventSize, payloadCount);
+    generate_messages (ctx, events, eventSize, messages);
+  } else {
+    return NULL;
+  }
+
+  if (linger)
+    linger_messages (linger, events->metadata->sensorId, messages, false);
+
+  return build_payloads (ctx, messages, capacity, payloadCount);
+}
+
+/*
+ * Writes the heatmaps of the sensors with frames in their current period,
+ * routed like the heatmaps sent when a period ends, into @linger if there
+ * is one or else into @messages.
+ */
+static void
+flush_heatmaps (NvDsMsg2pCtx *ctx, NvDsMsg2pScratch *scratch,
+    NvDsLinger *linger, vector<NvDsResultMessage> &messages)
+{
+  NvDsPayloadPriv *privObj = (NvDsPayloadPriv *) ctx->privData;
+  NvDsHeatmap *heatmap = &scratch->heatmap;
+  NvDsEventMsgMeta meta;
+  NvDsSensorView sensor;
+  GString *data;
+  gchar *message;
+  guint size;
+
+  for (auto &entry : heatmap->sensors) {
+    if (!entry.second.frames ||
+        !nvds_sensor_catalog_find (*privObj->catalog, entry.first, sensor))
+      continue;
+
+    // The message is timed like the frame that would have ended the period.
+    memset (&meta, 0, sizeof (meta));
+    meta.sensorId = entry.first;
+    meta.ts = (gchar *) entry.second.lastTs.c_str ();
+    data = g_string_sized_new (0);
+    write_heatmap_message (heatmap, &meta, sensor, data);
+    size = data->len;
+    message = g_string_free (data, FALSE);
+
+    guint count = route_modules (ctx, &meta, true,
+        [&] (guint componentId, bool last) {
+          gchar *copy = last ? message : g_strdup (message);
+
+          if (linger) {
+            nvds_linger_add (linger, { copy, size, componentId },
+                meta.sensorId);
+            g_free (copy);
+          } else {
+            messages.push_back ({ copy, size, componentId });
+          }
+        });
+    if (!count)
       g_free (message);
+  }
+}
+
+NvDsPayload**
+nvds_msg2p_flush (NvDsMsg2pCtx *ctx, guint *payloadCount)
+{
+  vector<NvDsResultMessage> messages;
+  NvDsLinger *linger = get_linger (ctx);
+  NvDsMsg2pScratch *scratch;
+  NvDsPriorityLanes *lanes;
+  gchar *message;
+  guint componentId;
+
+  *payloadCount = 0;
+  if (!ctx->privData)
+    return NULL;
+
+  // Batches only complete when events arrive, hand out the partial one.
+  scratch = get_scratch (ctx);
+  if (ctx->payloadType == NVDS_PAYLOAD_CUSTOM && scratch->arrow.config.enable &&
+      scratch->arrow.rows) {
+    GString *batch = g_string_sized_new (0);
+    guint size;
+
+    nvds_arrow_finish (&scratch->arrow, batch);
+    size = batch->len;
+    messages.push_back ({ g_string_free (batch, FALSE), size, 0 });
+  }
+  // Heatmap periods too, send the grids of the open ones.
+  if (ctx->payloadType == NVDS_PAYLOAD_DEEPSTREAM &&
+      scratch->heatmap.config.enable)
+    flush_heatmaps (ctx, scratch, linger, messages);
+
+  if (linger)
+    linger_messages (linger, 0, messages, true);
+
+  lanes = &scratch->lanes;
+  if (ctx->payloadType == NVDS_PAYLOAD_DEEPSTREAM && lanes->config.enable) {
+    for (NvDsResultMessage &envelope : messages) {
+      nvds_lanes_push (lanes, NVDS_LANE_TELEMETRY, (gchar *) envelope.data,
+          envelope.componentId);
     }
-  } else if (ctx->payloadType == NVDS_PAYLOAD_CUSTOM) {
-    payload->payload = (gpointer) g_strdup ("CUSTOM Schema");
-    payload->payloadSize = strlen ((char *)payload->payload) + 1;
-  } else
-    payload->payload = NULL;
+    messages.clear ();
+    while ((message = nvds_lanes_pop (lanes, &componentId)))
+      messages.push_back ({ message, (guint) strlen (message), componentId });
+  }
+
+  if (messages.empty ())
+    return NULL;
+  return build_payloads (ctx, messages, 1, payloadCount);
+}
+
+NvDsPayload*
+nvds_msg2p_generate (NvDsMsg2pCtx *ctx, NvDsEvent *events, guint size)
+{
+  NvDsResultMessage message = { NULL, 0, 0 };
+  NvDsPayload *payload = NULL;
+  NvDsLinger *linger = get_linger (ctx);
+
+  if (!linger && contiguous_results (ctx)) {
+    NvDsPayloadPriv *privObj = (NvDsPayloadPriv *) ctx->privData;
+    NvDsMsg2pScratch *scratch = get_scratch (ctx);
+    GString *data = nvds_results_begin (&privObj->results, &scratch->results,
+        1);
+    NvDsResultSpan span = { data->len, 0, 0 };
+    guint count = generate_message (ctx, events, size, data) ? 1 : 0;
+
+    span.size = data->len - span.offset;
+    nvds_results_finish (&privObj->results, &scratch->results, &span, count,
+        &payload);
+    if (!count)
+      payload = nvds_results_build_empty ();
+    account_payload (ctx, payload, true);
+    return payload;
+  }
+
+  message.data = generate_string (ctx, events, size, &message.size);
+
+  // One payload per call: closed envelopes wait for the next calls.
+  if (linger) {
+    if (message.data) {
+      nvds_linger_add (linger, message, events->metadata->sensorId);
+      g_free ((gchar *) message.data);
+    }
+    nvds_linger_expire (linger, false);
+    if (!nvds_linger_pop (linger, &message))
+      message = { NULL, 0, 0 };
+    nvds_linger_report (linger);
+  }
+
+  if (contiguous_results (ctx) && message.data) {
+    nvds_results_build (&((NvDsPayloadPriv *) ctx->privData)->results,
+        &get_scratch (ctx)->results, &message, 1, &payload);
+    g_free ((gchar *) message.data);
+  } else if (contiguous_results (ctx)) {
+    payload = nvds_results_build_empty ();
+  } else {
+    payload = (NvDsPayload *) g_malloc0 (sizeof (NvDsPayload));
+    payload->payload = (gpointer) message.data;
+    payload->payloadSize = message.size;
+  }
 
+  account_payload (ctx, payload, true);
   return payload;
 }
 
 void
 nvds_msg2p_release (NvDsMsg2pCtx *ctx, NvDsPayload *payload)
 {
+  account_payload (ctx, payload, false);
+  if (contiguous_results (ctx)) {
+    nvds_results_release (&((NvDsPayloadPriv *) ctx->privData)->results,
+        payload);
+    return;
+  }
   g_free (payload->payload);
   g_free (payload);
 }
+
+void
+nvds_msg2p_release_multiple (NvDsMsg2pCtx *ctx, NvDsPayload **payloads,
+    guint payloadCount)
+{
+  if (!payloads)
+    return;
+
+  for (guint i = 0; i < payloadCount; i++)
+    nvds_msg2p_release (ctx, payloads[i]);
+  g_free (payloads);
+}
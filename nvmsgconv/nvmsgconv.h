@@ -93,12 +93,32 @@ nvds_msg2p_generate (NvDsMsg2pCtx *ctx, NvDsEvent *events, guint size);
  *
  * @return pointer to @ref array of NvDsPayload pointers generated or NULL in
  * case of error. The number of payloads in the array is returned through
- * payloadCount. This pointer should be freed by calling g_free() and the
- * individual payloads should be freed with @ref nvds_msg2p_release
+ * payloadCount. The array and the payloads should be freed with
+ * @ref nvds_msg2p_release_multiple, or else the individual payloads should
+ * be freed with @ref nvds_msg2p_release and then the array by calling
+ * g_free().
  */
 NvDsPayload**
 nvds_msg2p_generate_multiple (NvDsMsg2pCtx *ctx, NvDsEvent *events, guint size, guint *payloadCount);
 
+/**
+ * Hands out the messages the calling thread has left in the context: the
+ * open lingering envelopes, the partial Arrow batch, the heatmaps of the
+ * periods still open and, with priority lanes, everything still queued on
+ * the lanes. Should be called before the context is destroyed and whenever
+ * a stream goes idle, as envelopes, batches and periods only complete
+ * during calls. The stock gst-nvmsgconv plugin never calls it, so
+ * lingering is only safe in applications that do.
+ *
+ * @param[in] ctx pointer to library context.
+ * @param[out] payloadCount number of payloads being returned by the function.
+ *
+ * @return array of NvDsPayload pointers like
+ * @ref nvds_msg2p_generate_multiple, or NULL if there was nothing left.
+ */
+NvDsPayload**
+nvds_msg2p_flush (NvDsMsg2pCtx *ctx, guint *payloadCount);
+
 /**
  * This function should be called to release memory allocated for payload.
  *
@@ -107,6 +127,20 @@ nvds_msg2p_generate_multiple (NvDsMsg2pCtx *ctx, NvDsEvent *events, guint size,
  */
 void nvds_msg2p_release (NvDsMsg2pCtx *ctx, NvDsPayload *payload);
 
+/**
+ * This function releases the array returned by
+ * @ref nvds_msg2p_generate_multiple together with all its payloads. The
+ * array may also be freed with g_free once each payload is released with
+ * @ref nvds_msg2p_release. When the context returns contiguous results the
+ * memory of the payloads is kept for a later call instead of being freed.
+ *
+ * @param[in] ctx pointer to library context.
+ * @param[in] payloads array returned by @ref nvds_msg2p_generate_multiple.
+ * @param[in] payloadCount number of payloads in the array.
+ */
+void nvds_msg2p_release_multiple (NvDsMsg2pCtx *ctx, NvDsPayload **payloads,
+    guint payloadCount);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,610 @@
+/*
+ * Copyright (c) 2018-2020, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA Corporation and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA Corporation is strictly prohibited.
+ *
+ */
+
+#include "nvmsgconv_arrow.h"
+#include "nvmsgconv_json.h"
+#include "nvmsgconv_log.h"
+#include <string.h>
+
+using namespace std;
+
+#define CONFIG_KEY_ENABLE "enable"
+#define CONFIG_KEY_MAX_ROWS "max-rows"
+#define CONFIG_KEY_MAX_LATENCY_MS "max-latency-ms"
+
+#define ALIGN_UP(size, align) (((size) + (align) - 1) / (align) * (align))
+
+/* Values from the Arrow format's Schema.fbs and Message.fbs. */
+#define ARROW_METADATA_V5 4
+#define ARROW_HEADER_SCHEMA 1
+#define ARROW_HEADER_RECORD_BATCH 3
+#define ARROW_TYPE_INT 2
+#define ARROW_TYPE_FLOATING_POINT 3
+#define ARROW_TYPE_UTF8 5
+#define ARROW_TYPE_TIMESTAMP 10
+#define ARROW_PRECISION_SINGLE 1
+#define ARROW_PRECISION_DOUBLE 2
+#define ARROW_TIME_UNIT_MILLISECOND 1
+#define ARROW_CONTINUATION 0xFFFFFFFFu
+
+/* Field ids of the tables written, in schema order. */
+enum { MESSAGE_VERSION, MESSAGE_HEADER_TYPE, MESSAGE_HEADER,
+  MESSAGE_BODY_LENGTH };
+enum { SCHEMA_ENDIANNESS, SCHEMA_FIELDS };
+enum { FIELD_NAME, FIELD_NULLABLE, FIELD_TYPE_TYPE, FIELD_TYPE,
+  FIELD_DICTIONARY, FIELD_CHILDREN };
+enum { INT_BIT_WIDTH, INT_IS_SIGNED };
+enum { FLOATING_POINT_PRECISION };
+enum { TIMESTAMP_UNIT, TIMESTAMP_TIMEZONE };
+enum { RECORD_BATCH_LENGTH, RECORD_BATCH_NODES, RECORD_BATCH_BUFFERS };
+
+enum ArrowColumnType {
+  COLUMN_UTF8,
+  COLUMN_INT32,
+  COLUMN_INT64,
+  COLUMN_FLOAT32,
+  COLUMN_FLOAT64,
+  COLUMN_TIMESTAMP,
+};
+
+struct ArrowColumn {
+  const gchar *name;
+  ArrowColumnType type;
+  bool nullable;
+};
+
+/* Must match the order of collect_buffers. */
+static const ArrowColumn arrowColumns[] = {
+  { "sensorId", COLUMN_UTF8, false },
+  { "frameId", COLUMN_INT64, false },
+  { "timestamp", COLUMN_TIMESTAMP, true },
+  { "trackingId", COLUMN_INT32, false },
+  { "left", COLUMN_FLOAT32, false },
+  { "top", COLUMN_FLOAT32, false },
+  { "width", COLUMN_FLOAT32, false },
+  { "height", COLUMN_FLOAT32, false },
+  { "classId", COLUMN_INT32, false },
+  { "label", COLUMN_UTF8, false },
+  { "confidence", COLUMN_FLOAT64, false },
+};
+
+#define NUM_COLUMNS G_N_ELEMENTS (arrowColumns)
+
+/* Structs of RecordBatch, laid out as in the format. */
+struct ArrowFieldNode {
+  gint64 length;
+  gint64 nullCount;
+};
+
+struct ArrowBuffer {
+  gint64 offset;
+  gint64 length;
+};
+
+struct FbField {
+  guint16 id;
+  /* Size of the scalar, 0 for an offset to another object. */
+  guint8 size;
+  guint64 value;
+};
+
+#define FB_MAX_FIELDS 8
+
+/*
+ * Minimal FlatBuffers writer. FlatBuffers offsets are unsigned and point
+ * forward, so objects are written front to back, each one before the
+ * objects it refers to, and an offset is linked when its target is placed.
+ * Integers are written in host order, which Arrow requires to be little
+ * endian.
+ */
+class FbWriter {
+public:
+  string buf;
+
+  void pad (size_t align)
+  {
+    buf.append (ALIGN_UP (buf.size (), align) - buf.size (), '\0');
+  }
+
+  template <typename T> void put (T value)
+  {
+    buf.append ((const char *) &value, sizeof (value));
+  }
+
+  /* Starts the buffer with the offset of the root table. */
+  size_t root ()
+  {
+    put<guint32> (0);
+    return 0;
+  }
+
+  /* Points the offset stored at @slot to the current position. */
+  void link (size_t slot)
+  {
+    guint32 offset = buf.size () - slot;
+    memcpy (&buf[slot], &offset, sizeof (offset));
+  }
+
+  /*
+   * Writes a table referred to by @parent and returns the position of its
+   * offset fields in @slots, in the order of @fields.
+   */
+  void table (size_t parent, const FbField *fields, guint count,
+      size_t *slots)
+  {
+    guint16 offsets[FB_MAX_FIELDS] = { 0 };
+    guint16 position[FB_MAX_FIELDS];
+    guint16 numIds = 0, tableSize = sizeof (gint32), vtableSize;
+    size_t start;
+
+    /* Largest fields first, each aligned to its size. */
+    for (guint size : { 8, 4, 2, 1 }) {
+      for (guint i = 0; i < count; i++) {
+        guint fieldSize = fields[i].size ? fields[i].size : sizeof (guint32);
+        if (fieldSize != size)
+          continue;
+        tableSize = ALIGN_UP (tableSize, size);
+        position[i] = tableSize;
+        offsets[fields[i].id] = tableSize;
+        tableSize += size;
+        numIds = MAX (numIds, fields[i].id + 1);
+      }
+    }
+
+    /* The vtable goes right before the table, which is 8-byte aligned. */
+    vtableSize = sizeof (guint16) * (2 + numIds);
+    start = ALIGN_UP (buf.size () + vtableSize, 8);
+    buf.append (start - vtableSize - buf.size (), '\0');
+    put<guint16> (vtableSize);
+    put<guint16> (tableSize);
+    for (guint16 id = 0; id < numIds; id++)
+      put<guint16> (offsets[id]);
+
+    link (parent);
+    put<gint32> (vtableSize);
+    buf.resize (start + tableSize, '\0');
+    for (guint i = 0; i < count; i++) {
+      if (fields[i].size)
+        memcpy (&buf[start + position[i]], &fields[i].value, fields[i].size);
+      else
+        *slots++ = start + position[i];
+    }
+  }
+
+  void string_ (size_t parent, const gchar *str)
+  {
+    guint32 len = strlen (str);
+
+    pad (4);
+    link (parent);
+    put<guint32> (len);
+    buf.append (str, len + 1);
+  }
+
+  void vector (size_t parent, const void *data, guint count, size_t elemSize)
+  {
+    /* Elements are 8-byte aligned, the length comes right before them. */
+    pad (4);
+    if ((buf.size () + sizeof (guint32)) % 8)
+      put<guint32> (0);
+    link (parent);
+    put<guint32> (count);
+    buf.append ((const char *) data, count * elemSize);
+  }
+
+  void offset_vector (size_t parent, guint count, size_t *slots)
+  {
+    pad (4);
+    link (parent);
+    put<guint32> (count);
+    for (guint i = 0; i < count; i++) {
+      slots[i] = buf.size ();
+      put<guint32> (0);
+    }
+  }
+};
+
+/* Frames a metadata flatbuffer as an IPC message. */
+static void
+append_message (string &out, FbWriter &fb)
+{
+  guint32 continuation = ARROW_CONTINUATION;
+  gint32 size;
+
+  fb.pad (8);
+  size = fb.buf.size ();
+  out.append ((const char *) &continuation, sizeof (continuation));
+  out.append ((const char *) &size, sizeof (size));
+  out += fb.buf;
+}
+
+static void
+write_type (FbWriter &fb, size_t parent, ArrowColumnType type)
+{
+  size_t slot;
+
+  switch (type) {
+    case COLUMN_UTF8:
+      fb.table (parent, NULL, 0, NULL);
+      break;
+    case COLUMN_INT32:
+    case COLUMN_INT64: {
+      FbField fields[] = {
+        { INT_BIT_WIDTH, 4, (guint64) (type == COLUMN_INT32 ? 32 : 64) },
+        { INT_IS_SIGNED, 1, 1 },
+      };
+      fb.table (parent, fields, G_N_ELEMENTS (fields), NULL);
+      break;
+    }
+    case COLUMN_FLOAT32:
+    case COLUMN_FLOAT64: {
+      FbField fields[] = {
+        { FLOATING_POINT_PRECISION, 2, (guint64) (type == COLUMN_FLOAT32 ?
+              ARROW_PRECISION_SINGLE : ARROW_PRECISION_DOUBLE) },
+      };
+      fb.table (parent, fields, G_N_ELEMENTS (fields), NULL);
+      break;
+    }
+    case COLUMN_TIMESTAMP: {
+      FbField fields[] = {
+        { TIMESTAMP_UNIT, 2, ARROW_TIME_UNIT_MILLISECOND },
+        { TIMESTAMP_TIMEZONE, 0, 0 },
+      };
+      fb.table (parent, fields, G_N_ELEMENTS (fields), &slot);
+      fb.string_ (slot, "UTC");
+      break;
+    }
+  }
+}
+
+static guint8
+type_id (ArrowColumnType type)
+{
+  switch (type) {
+    case COLUMN_UTF8:
+      return ARROW_TYPE_UTF8;
+    case COLUMN_INT32:
+    case COLUMN_INT64:
+      return ARROW_TYPE_INT;
+    case COLUMN_FLOAT32:
+    case COLUMN_FLOAT64:
+      return ARROW_TYPE_FLOATING_POINT;
+    case COLUMN_TIMESTAMP:
+      return ARROW_TYPE_TIMESTAMP;
+  }
+  return 0;
+}
+
+static string
+build_schema_message ()
+{
+  FbWriter fb;
+  FbField message[] = {
+    { MESSAGE_VERSION, 2, ARROW_METADATA_V5 },
+    { MESSAGE_HEADER_TYPE, 1, ARROW_HEADER_SCHEMA },
+    { MESSAGE_HEADER, 0, 0 },
+    { MESSAGE_BODY_LENGTH, 8, 0 },
+  };
+  FbField schema[] = {
+    { SCHEMA_FIELDS, 0, 0 },
+  };
+  size_t headerSlot, fieldsSlot, columnSlots[NUM_COLUMNS];
+  string out;
+
+  fb.table (fb.root (), message, G_N_ELEMENTS (message), &headerSlot);
+  fb.table (headerSlot, schema, G_N_ELEMENTS (schema), &fieldsSlot);
+  fb.offset_vector (fieldsSlot, NUM_COLUMNS, columnSlots);
+
+  for (guint i = 0; i < NUM_COLUMNS; i++) {
+    FbField field[] = {
+      { FIELD_NAME, 0, 0 },
+      { FIELD_NULLABLE, 1, arrowColumns[i].nullable },
+      { FIELD_TYPE_TYPE, 1, type_id (arrowColumns[i].type) },
+      { FIELD_TYPE, 0, 0 },
+      { FIELD_CHILDREN, 0, 0 },
+    };
+    size_t slots[3];
+
+    fb.table (columnSlots[i], field, G_N_ELEMENTS (field), slots);
+    fb.string_ (slots[0], arrowColumns[i].name);
+    write_type (fb, slots[1], arrowColumns[i].type);
+    fb.offset_vector (slots[2], 0, NULL);
+  }
+
+  append_message (out, fb);
+  return out;
+}
+
+static void
+reset_batch (NvDsArrowBatch *batch)
+{
+  batch->rows = 0;
+  batch->timestampNulls = 0;
+  batch->sensorIdOffsets.assign (1, 0);
+  batch->sensorIdData.clear ();
+  batch->frameId.clear ();
+  batch->timestamp.clear ();
+  batch->timestampValid.clear ();
+  batch->trackingId.clear ();
+  batch->left.clear ();
+  batch->top.clear ();
+  batch->width.clear ();
+  batch->height.clear ();
+  batch->classId.clear ();
+  batch->labelOffsets.assign (1, 0);
+  batch->labelData.clear ();
+  batch->confidence.clear ();
+}
+
+NvDsArrowBatch::~NvDsArrowBatch ()
+{
+  if (rows) {
+    NVDS_MSG2P_LOG (0, "Arrow: %u rows lost, the context was destroyed "
+        "without nvds_msg2p_flush", rows);
+  }
+}
+
+bool
+nvds_arrow_parse (NvDsArrowConfig *config, GKeyFile *key_file,
+    const gchar *group)
+{
+  GError *error = NULL;
+  gint64 ival;
+
+  config->enable = g_key_file_get_boolean (key_file, group, CONFIG_KEY_ENABLE,
+      NULL);
+
+  ival = g_key_file_get_int64 (key_file, group, CONFIG_KEY_MAX_ROWS, &error);
+  if (!error)
+    config->maxRows = CLAMP (ival, 1, G_MAXINT32);
+  g_clear_error (&error);
+
+  ival = g_key_file_get_int64 (key_file, group, CONFIG_KEY_MAX_LATENCY_MS,
+      &error);
+  if (!error)
+    config->maxLatencyUs = MAX (ival, 0) * 1000;
+  g_clear_error (&error);
+
+  return true;
+}
+
+static bool
+parse_digits (const gchar *str, guint count, gint *value)
+{
+  *value = 0;
+  for (guint i = 0; i < count; i++) {
+    if (!g_ascii_isdigit (str[i]))
+      return false;
+    *value = *value * 10 + (str[i] - '0');
+  }
+  return true;
+}
+
+/* Days since 1970-01-01 of a proleptic Gregorian date. */
+static gint64
+days_from_civil (gint64 year, guint month, guint day)
+{
+  gint64 era;
+  guint yearOfEra, dayOfYear, dayOfEra;
+
+  year -= month <= 2;
+  era = (year >= 0 ? year : year - 399) / 400;
+  yearOfEra = year - era * 400;
+  dayOfYear = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+  dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+  return era * 146097 + dayOfEra - 719468;
+}
+
+gint64
+nvds_arrow_parse_timestamp (const gchar *ts)
+{
+  gint year, month, day, hour, minute, second, millis = 0;
+  const gchar *p;
+
+  /* YYYY-MM-DDTHH:MM:SS[.fff...]Z as generated by the applications. */
+  if (!ts || strlen (ts) < 20 ||
+      !parse_digits (ts, 4, &year) || ts[4] != '-' ||
+      !parse_digits (ts + 5, 2, &month) || ts[7] != '-' ||
+      !parse_digits (ts + 8, 2, &day) || ts[10] != 'T' ||
+      !parse_digits (ts + 11, 2, &hour) || ts[13] != ':' ||
+      !parse_digits (ts + 14, 2, &minute) || ts[16] != ':' ||
+      !parse_digits (ts + 17, 2, &second))
+    return G_MININT64;
+  if (month < 1 || month > 12 || day < 1 || day > 31 || hour > 23 ||
+      minute > 59 || second > 60)
+    return G_MININT64;
+
+  p = ts + 19;
+  if (*p == '.') {
+    guint digits = 0;
+    for (p++; g_ascii_isdigit (*p); p++, digits++) {
+      if (digits < 3)
+        millis = millis * 10 + (*p - '0');
+    }
+    if (!digits)
+      return G_MININT64;
+    for (; digits < 3; digits++)
+      millis *= 10;
+  }
+  if (p[0] != 'Z' || p[1])
+    return G_MININT64;
+
+  return ((days_from_civil (year, month, day) * 24 + hour) * 60 + minute) *
+      60000 + second * 1000 + millis;
+}
+
+/* Arrow requires valid UTF-8, invalid bytes are replaced like in JSON. */
+static void
+append_utf8 (vector<gint32> &offsets, string &data, const gchar *value)
+{
+  gsize len = value ? strlen (value) : 0;
+  gsize valid;
+
+  while ((valid = nvds_utf8_validate (value, len)) < len) {
+    data.append (value, valid);
+    data += NVDS_UTF8_REPLACEMENT;
+    value += valid + 1;
+    len -= valid + 1;
+  }
+  data.append (value ? value : "", len);
+  offsets.push_back (data.size ());
+}
+
+void
+nvds_arrow_append (NvDsArrowBatch *batch, const NvDsArrowRow *row)
+{
+  if (batch->sensorIdOffsets.empty ())
+    reset_batch (batch);
+  if (!batch->rows)
+    batch->firstRowUs = g_get_monotonic_time ();
+
+  append_utf8 (batch->sensorIdOffsets, batch->sensorIdData, row->sensorId);
+  batch->frameId.push_back (row->frameId);
+  if (batch->rows % 8 == 0)
+    batch->timestampValid.push_back (0);
+  if (row->timestamp == G_MININT64) {
+    batch->timestamp.push_back (0);
+    batch->timestampNulls++;
+  } else {
+    batch->timestamp.push_back (row->timestamp);
+    batch->timestampValid.back () |= 1 << (batch->rows % 8);
+  }
+  batch->trackingId.push_back (row->trackingId);
+  batch->left.push_back (row->left);
+  batch->top.push_back (row->top);
+  batch->width.push_back (row->width);
+  batch->height.push_back (row->height);
+  batch->classId.push_back (row->classId);
+  append_utf8 (batch->labelOffsets, batch->labelData, row->label);
+  batch->confidence.push_back (row->confidence);
+  batch->rows++;
+}
+
+bool
+nvds_arrow_ready (NvDsArrowBatch *batch)
+{
+  if (!batch->rows)
+    return false;
+  /* Offsets are 32 bits, emit well before the string data gets there. */
+  if (batch->sensorIdData.size () > G_MAXINT32 / 2 ||
+      batch->labelData.size () > G_MAXINT32 / 2)
+    return true;
+  return batch->rows >= batch->config.maxRows ||
+      g_get_monotonic_time () - batch->firstRowUs >=
+      batch->config.maxLatencyUs;
+}
+
+struct BodyPart {
+  const void *data;
+  size_t size;
+};
+
+struct BodyLayout {
+  vector<ArrowFieldNode> nodes;
+  vector<ArrowBuffer> buffers;
+  vector<BodyPart> parts;
+  gint64 length = 0;
+
+  void add (const void *data, size_t size)
+  {
+    buffers.push_back ({ length, (gint64) size });
+    if (size)
+      parts.push_back ({ data, size });
+    length += ALIGN_UP (size, 8);
+  }
+
+  template <typename T> void primitive (const vector<T> &values)
+  {
+    nodes.push_back ({ (gint64) values.size (), 0 });
+    add (NULL, 0);
+    add (values.data (), values.size () * sizeof (T));
+  }
+
+  void utf8 (const vector<gint32> &offsets, const string &data)
+  {
+    nodes.push_back ({ (gint64) offsets.size () - 1, 0 });
+    add (NULL, 0);
+    add (offsets.data (), offsets.size () * sizeof (gint32));
+    add (data.data (), data.size ());
+  }
+};
+
+static void
+collect_buffers (NvDsArrowBatch *batch, BodyLayout &body)
+{
+  body.utf8 (batch->sensorIdOffsets, batch->sensorIdData);
+  body.primitive (batch->frameId);
+  body.nodes.push_back ({ batch->rows, batch->timestampNulls });
+  if (batch->timestampNulls)
+    body.add (batch->timestampValid.data (), batch->timestampValid.size ());
+  else
+    body.add (NULL, 0);
+  body.add (batch->timestamp.data (), batch->timestamp.size () * sizeof (gint64));
+  body.primitive (batch->trackingId);
+  body.primitive (batch->left);
+  body.primitive (batch->top);
+  body.primitive (batch->width);
+  body.primitive (batch->height);
+  body.primitive (batch->classId);
+  body.utf8 (batch->labelOffsets, batch->labelData);
+  body.primitive (batch->confidence);
+}
+
+void
+nvds_arrow_finish (NvDsArrowBatch *batch, GString *out)
+{
+  static const guint8 padding[8] = { 0 };
+  static const guint32 endOfStream[2] = { ARROW_CONTINUATION, 0 };
+  BodyLayout body;
+  FbWriter fb;
+  size_t headerSlot, slots[2];
+  string metadata;
+
+  if (batch->schemaMessage.empty ())
+    batch->schemaMessage = build_schema_message ();
+  if (batch->sensorIdOffsets.empty ())
+    reset_batch (batch);
+
+  collect_buffers (batch, body);
+
+  FbField message[] = {
+    { MESSAGE_VERSION, 2, ARROW_METADATA_V5 },
+    { MESSAGE_HEADER_TYPE, 1, ARROW_HEADER_RECORD_BATCH },
+    { MESSAGE_HEADER, 0, 0 },
+    { MESSAGE_BODY_LENGTH, 8, (guint64) body.length },
+  };
+  FbField recordBatch[] = {
+    { RECORD_BATCH_LENGTH, 8, batch->rows },
+    { RECORD_BATCH_NODES, 0, 0 },
+    { RECORD_BATCH_BUFFERS, 0, 0 },
+  };
+  fb.table (fb.root (), message, G_N_ELEMENTS (message), &headerSlot);
+  fb.table (headerSlot, recordBatch, G_N_ELEMENTS (recordBatch), slots);
+  fb.vector (slots[0], body.nodes.data (), body.nodes.size (),
+      sizeof (ArrowFieldNode));
+  fb.vector (slots[1], body.buffers.data (), body.buffers.size (),
+      sizeof (ArrowBuffer));
+  append_message (metadata, fb);
+
+  nvds_json_reserve (out, batch->schemaMessage.size () + metadata.size () +
+      body.length + sizeof (endOfStream));
+  g_string_append_len (out, batch->schemaMessage.data (),
+      batch->schemaMessage.size ());
+  g_string_append_len (out, metadata.data (), metadata.size ());
+  for (BodyPart &part : body.parts) {
+    g_string_append_len (out, (const gchar *) part.data, part.size);
+    g_string_append_len (out, (const gchar *) padding,
+        ALIGN_UP (part.size, 8) - part.size);
+  }
+  g_string_append_len (out, (const gchar *) endOfStream, sizeof (endOfStream));
+
+  reset_batch (batch);
+}
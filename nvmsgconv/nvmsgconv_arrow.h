@@ -0,0 +1,118 @@
+/*
+ * Copyright (c) 2018-2020, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA Corporation and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA Corporation is strictly prohibited.
+ *
+ */
+
+/**
+ * @file
+ * <b>Columnar Arrow batches</b>
+ *
+ * @b Description: Accumulates the objects of many events into columns and
+ * emits them as an Apache Arrow IPC stream (schema, one record batch, end
+ * of stream), so every payload can be read on its own with any Arrow
+ * stream reader. The format is written in-tree, the Arrow library is not
+ * needed.
+ *
+ * Columns, one row per object:
+ *
+ *   sensorId    utf8
+ *   frameId     int64
+ *   timestamp   timestamp[ms, UTC], null if the event's time can't be parsed
+ *   trackingId  int32
+ *   left, top, width, height  float32
+ *   classId     int32
+ *   label       utf8
+ *   confidence  float64
+ *
+ * Used for NVDS_PAYLOAD_CUSTOM when the [arrow] group of the converter's
+ * key-value configuration file enables it:
+ *
+ *   enable=1
+ *   max-rows=N        emit once a call brings the batch to N rows
+ *   max-latency-ms=N  emit once the oldest row is N ms old
+ *
+ * Limits are checked when events arrive, calls that don't complete a batch
+ * return no payload; nvds_msg2p_flush emits a partial batch. Use it with the
+ * multiple payload API.
+ */
+
+#ifndef NVMSGCONV_ARROW_H_
+#define NVMSGCONV_ARROW_H_
+
+#include <glib.h>
+#include <string>
+#include <vector>
+
+#define CONFIG_GROUP_ARROW "arrow"
+
+struct NvDsArrowConfig {
+  bool enable = false;
+  guint maxRows = 4096;
+  gint64 maxLatencyUs = G_USEC_PER_SEC;
+};
+
+struct NvDsArrowRow {
+  const gchar *sensorId;
+  gint64 frameId;
+  /** Milliseconds since the epoch, or G_MININT64 if unknown. */
+  gint64 timestamp;
+  gint trackingId;
+  gfloat left;
+  gfloat top;
+  gfloat width;
+  gfloat height;
+  gint classId;
+  const gchar *label;
+  gdouble confidence;
+};
+
+struct NvDsArrowBatch {
+  NvDsArrowConfig config;
+
+  guint rows = 0;
+  gint64 firstRowUs = 0;
+
+  /* Column data, kept allocated between batches. */
+  std::vector<gint32> sensorIdOffsets;
+  std::string sensorIdData;
+  std::vector<gint64> frameId;
+  std::vector<gint64> timestamp;
+  std::vector<guint8> timestampValid;
+  guint timestampNulls = 0;
+  std::vector<gint32> trackingId;
+  std::vector<gfloat> left;
+  std::vector<gfloat> top;
+  std::vector<gfloat> width;
+  std::vector<gfloat> height;
+  std::vector<gint32> classId;
+  std::vector<gint32> labelOffsets;
+  std::string labelData;
+  std::vector<gdouble> confidence;
+
+  /* The schema message, the same for every batch. */
+  std::string schemaMessage;
+
+  ~NvDsArrowBatch ();
+};
+
+bool nvds_arrow_parse (NvDsArrowConfig *config, GKeyFile *key_file,
+    const gchar *group);
+
+/** Parses an RFC 3339 UTC time, returns G_MININT64 if @ts isn't one. */
+gint64 nvds_arrow_parse_timestamp (const gchar *ts);
+
+void nvds_arrow_append (NvDsArrowBatch *batch, const NvDsArrowRow *row);
+
+/** Returns TRUE if the batch reached one of its limits. */
+bool nvds_arrow_ready (NvDsArrowBatch *batch);
+
+/** Appends the batch to @out as an Arrow IPC stream and starts a new batch. */
+void nvds_arrow_finish (NvDsArrowBatch *batch, GString *out);
+
+#endif /* NVMSGCONV_ARROW_H_ */
@@ -0,0 +1,76 @@
+/*
+ * Copyright (c) 2018-2020, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA Corporation and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA Corporation is strictly prohibited.
+ *
+ */
+
+#include "nvmsgconv_context.h"
+#include <atomic>
+
+using namespace std;
+
+#define CONFIG_KEY_CONCURRENT "concurrent"
+
+/* Contexts a thread calls into at the same time, more just take the lock. */
+#define SCRATCH_CACHE_SIZE 4
+
+struct ScratchCacheEntry {
+  guint64 setId;
+  NvDsMsg2pScratch *scratch;
+};
+
+static atomic<guint64> nextSetId { 1 };
+
+static thread_local ScratchCacheEntry scratchCache[SCRATCH_CACHE_SIZE];
+static thread_local guint scratchCacheNext;
+
+NvDsScratchSet::NvDsScratchSet ()
+    : id (nextSetId.fetch_add (1, memory_order_relaxed))
+{
+}
+
+bool
+nvds_context_parse (NvDsContextConfig *config, GKeyFile *key_file,
+    const gchar *group)
+{
+  config->concurrent = g_key_file_get_boolean (key_file, group,
+      CONFIG_KEY_CONCURRENT, NULL);
+  return true;
+}
+
+NvDsMsg2pScratch *
+nvds_scratch_get (NvDsScratchSet *set, const NvDsMsg2pScratch *proto)
+{
+  NvDsMsg2pScratch *scratch;
+
+  for (guint i = 0; i < SCRATCH_CACHE_SIZE; i++) {
+    if (scratchCache[i].setId == set->id)
+      return scratchCache[i].scratch;
+  }
+
+  {
+    lock_guard<mutex> guard (set->lock);
+    unique_ptr<NvDsMsg2pScratch> &slot =
+        set->threads[this_thread::get_id ()];
+
+    if (!slot) {
+      slot.reset (new NvDsMsg2pScratch);
+      slot->shedder.config = proto->shedder.config;
+      slot->lanes.config = proto->lanes.config;
+      slot->arrow.config = proto->arrow.config;
+      slot->heatmap.config = proto->heatmap.config;
+      slot->linger.config = proto->linger.config;
+    }
+    scratch = slot.get ();
+  }
+
+  scratchCache[scratchCacheNext].setId = set->id;
+  scratchCache[scratchCacheNext].scratch = scratch;
+  scratchCacheNext = (scratchCacheNext + 1) % SCRATCH_CACHE_SIZE;
+  return scratch;
+}
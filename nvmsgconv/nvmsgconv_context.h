@@ -0,0 +1,99 @@
+/*
+ * Copyright (c) 2018-2020, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA Corporation and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA Corporation is strictly prohibited.
+ *
+ */
+
+/**
+ * @file
+ * <b>Concurrent converter contexts</b>
+ *
+ * @b Description: Lets many streaming threads share one converter context.
+ * Everything a payload generation call changes, i.e. the load shedding
+ * stage, the priority lanes, the Arrow batch, the lingering envelopes and
+ * reused buffers, lives in a scratch. A context normally has a single
+ * scratch and, like before, must not be used by two threads at once. A
+ * concurrent context gives each calling thread its own scratch on first use
+ * and finds it again through a small thread local cache, so generating
+ * takes no locks. The sensor
+ * catalog, the configuration and the count of outstanding payloads are
+ * shared. Payloads may be released from any thread.
+ *
+ * Each thread therefore sheds load, fills priority lanes, builds Arrow
+ * batches, aggregates heatmaps and lingers on its own. Scratches are freed
+ * with the context; payloads still queued on the lanes, in the Arrow batch
+ * or in the envelopes of a thread that stops calling are lost.
+ *
+ * Settings are read from the [context] group of the converter's key-value
+ * configuration file:
+ *
+ *   concurrent=1
+ */
+
+#ifndef NVMSGCONV_CONTEXT_H_
+#define NVMSGCONV_CONTEXT_H_
+
+#include "nvmsgconv_arrow.h"
+#include "nvmsgconv_heatmap.h"
+#include "nvmsgconv_lanes.h"
+#include "nvmsgconv_linger.h"
+#include "nvmsgconv_results.h"
+#include "nvmsgconv_shed.h"
+#include <glib.h>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#define CONFIG_GROUP_CONTEXT "context"
+
+struct NvDsContextConfig {
+  bool concurrent = false;
+};
+
+struct NvDsMsg2pScratch {
+  NvDsLoadShedder shedder;
+  NvDsPriorityLanes lanes;
+  NvDsArrowBatch arrow;
+  NvDsHeatmap heatmap;
+  NvDsLinger linger;
+
+  /* The block the next contiguous result is encoded into. */
+  NvDsResultArena results;
+
+  /* Candidates of the object selection, kept allocated between calls. */
+  std::vector<guint> objOrder;
+};
+
+/* The scratches of a concurrent context, one per calling thread. */
+struct NvDsScratchSet {
+  /* Never reused, so thread caches can't mistake a later set for this. */
+  const guint64 id;
+
+  std::mutex lock;
+  std::unordered_map<std::thread::id, std::unique_ptr<NvDsMsg2pScratch>>
+      threads;
+
+  NvDsScratchSet ();
+  NvDsScratchSet (const NvDsScratchSet &) = delete;
+  NvDsScratchSet &operator= (const NvDsScratchSet &) = delete;
+};
+
+/** Parses @group into @config. Returns false on invalid values. */
+bool nvds_context_parse (NvDsContextConfig *config, GKeyFile *key_file,
+    const gchar *group);
+
+/**
+ * Returns the calling thread's scratch of @set, configured like @proto
+ * when the thread first asks for it.
+ */
+NvDsMsg2pScratch *nvds_scratch_get (NvDsScratchSet *set,
+    const NvDsMsg2pScratch *proto);
+
+#endif /* NVMSGCONV_CONTEXT_H_ */
@@ -0,0 +1,28 @@
+/*
+ * Copyright (c) 2018-2020, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA Corporation and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA Corporation is strictly prohibited.
+ *
+ */
+
+/**
+ * @file
+ * <b>Frame event extension</b>
+ *
+ * @b Description: The extensions the application attaches to events of
+ * the DeepStream schema: all objects of one frame, or the lifecycle of one
+ * track. Their fields are listed in nvmsgconv_event_fields.h, which the
+ * application includes as well.
+ */
+
+#ifndef NVMSGCONV_EVENT_H_
+#define NVMSGCONV_EVENT_H_
+
+#include "nvmsgconv.h"
+#include "nvmsgconv_event_fields.h"
+
+#endif /* NVMSGCONV_EVENT_H_ */
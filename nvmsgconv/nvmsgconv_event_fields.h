@@ -0,0 +1,201 @@
+/*
+ * Copyright (c) 2018-2020, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA Corporation and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA Corporation is strictly prohibited.
+ *
+ */
+
+
+/**
+ * @file
+ * <b>Event extension fields</b>
+ *
+ * @b Description: The one definition of the event extensions the
+ * application attaches and the converter reads. Each struct is described
+ * by a list of fields, X (kind, type, name, dim, wire), and everything
+ * that depends on its members is generated from that list: the struct
+ * itself, the deep copy and free used by the application (below) and the
+ * converter's encoders (nvmsgconv_schema.h). Adding a field means adding
+ * one line here.
+ *
+ *   kind  VALUE   a plain @type member
+ *         STRING  a gchar * owned by the struct, duplicated on copy
+ *         CHARS   a gchar[@dim] string
+ *         ARRAY   a @type[@dim] array of structs that own no memory,
+ *                 written by the encoder of the enclosing message
+ *   wire  member name in the JSON schema, NULL if it isn't written
+ *
+ * Plain C, included by the application as well as by the converter.
+ */
+
+#ifndef NVMSGCONV_EVENT_FIELDS_H_
+#define NVMSGCONV_EVENT_FIELDS_H_
+
+#include <glib.h>
+#include "nvdsmeta_schema.h"
+
+#ifndef MAX_LABEL_SIZE
+#define MAX_LABEL_SIZE 128
+#endif
+#define MAX_OBJ_NUM 256
+#define MAX_TRACK_POINTS 128
+
+/* Tag in the first member of every event extension, so that the converter
+ * and the application tell them apart without relying on their sizes. The
+ * values are arbitrary but non-zero, so a zeroed extension matches none. */
+typedef enum
+{
+  NVDS_EVENT_EXT_NONE = 0,
+  NVDS_EVENT_EXT_FRAME = 0x4e564601,
+  NVDS_EVENT_EXT_TRACK = 0x4e565401
+} NvDsEventExtKind;
+
+/* One object of a frame event; bbox is written as [top, left, width,
+ * height]. */
+#define NVDS_SIMPLE_OBJECT_FIELDS(X) \
+  X (VALUE, NvDsObjectType, objType, 1, NULL) \
+  X (VALUE, NvDsRect, bbox, 1, "bbox") \
+  X (VALUE, gdouble, confidence, 1, NULL) \
+  X (VALUE, gint, trackingId, 1, "trackingId") \
+  X (VALUE, gint, classId, 1, NULL) \
+  X (CHARS, gchar, label, MAX_LABEL_SIZE, "type")
+
+/* All objects of a frame. kind is NVDS_EVENT_EXT_FRAME; queueFillPercent is
+ * the fill level of the queue in front of the converter, see
+ * nvmsgconv_shed.h. */
+#define NVDS_FRAME_EVENT_FIELDS(X) \
+  X (VALUE, NvDsEventExtKind, kind, 1, NULL) \
+  X (STRING, gchar, sourceUri, 1, NULL) \
+  X (VALUE, gint, sourceId, 1, NULL) \
+  X (VALUE, gint, sourceType, 1, NULL) \
+  X (VALUE, guint, frameId, 1, "frameId") \
+  X (VALUE, guint, frameWidth, 1, "width") \
+  X (VALUE, guint, frameHeight, 1, "height") \
+  X (VALUE, guint, objCounts, 1, NULL) \
+  X (ARRAY, NvDsSimpleObjectMeta, objMetaList, MAX_OBJ_NUM, NULL) \
+  X (STRING, gchar, filterCloudModules, 1, NULL) \
+  X (STRING, gchar, sourceCloudModules, 1, NULL) \
+  X (VALUE, guint, queueFillPercent, 1, NULL)
+
+/* Center of an object's bounding box, written as [frame, x, y]. */
+#define NVDS_TRACK_POINT_FIELDS(X) \
+  X (VALUE, gint, frameId, 1, "frame") \
+  X (VALUE, gfloat, x, 1, "x") \
+  X (VALUE, gfloat, y, 1, "y")
+
+/* The lifecycle of one track, kind is NVDS_EVENT_EXT_TRACK; points holds the
+ * simplified trajectory since the previous event. */
+#define NVDS_TRACK_EVENT_FIELDS(X) \
+  X (VALUE, NvDsEventExtKind, kind, 1, NULL) \
+  X (VALUE, gint, trackingId, 1, "trackingId") \
+  X (VALUE, gint, classId, 1, "classId") \
+  X (CHARS, gchar, label, MAX_LABEL_SIZE, "type") \
+  X (VALUE, gint, firstFrameId, 1, "firstFrame") \
+  X (VALUE, gint, lastFrameId, 1, "lastFrame") \
+  X (VALUE, guint, numPoints, 1, NULL) \
+  X (ARRAY, NvDsTrackPoint, points, MAX_TRACK_POINTS, NULL) \
+  X (VALUE, guint, queueFillPercent, 1, NULL)
+
+#define NVDS_EVENT_DECLARE_VALUE(type, name, dim) type name;
+#define NVDS_EVENT_DECLARE_STRING(type, name, dim) type *name;
+#define NVDS_EVENT_DECLARE_CHARS(type, name, dim) type name[dim];
+#define NVDS_EVENT_DECLARE_ARRAY(type, name, dim) type name[dim];
+#define NVDS_EVENT_DECLARE_FIELD(kind, type, name, dim, wire) \
+    NVDS_EVENT_DECLARE_##kind (type, name, dim)
+
+#define NVDS_EVENT_COPY_VALUE(name)
+#define NVDS_EVENT_COPY_STRING(name) \
+    nvds_event_dst_->name = g_strdup (nvds_event_src_->name);
+#define NVDS_EVENT_COPY_CHARS(name)
+#define NVDS_EVENT_COPY_ARRAY(name)
+#define NVDS_EVENT_COPY_FIELD(kind, type, name, dim, wire) \
+    NVDS_EVENT_COPY_##kind (name)
+
+#define NVDS_EVENT_FREE_VALUE(name)
+#define NVDS_EVENT_FREE_STRING(name) g_free (nvds_event_->name);
+#define NVDS_EVENT_FREE_CHARS(name)
+#define NVDS_EVENT_FREE_ARRAY(name)
+#define NVDS_EVENT_FREE_FIELD(kind, type, name, dim, wire) \
+    NVDS_EVENT_FREE_##kind (name)
+
+/**
+ * Duplicates the memory @dst, a byte copy of @src, shares with it. @FIELDS
+ * is the field list of @type.
+ */
+#define NVDS_EVENT_DEEP_COPY(FIELDS, type, dst, src) \
+  G_STMT_START { \
+    type *nvds_event_dst_ = (dst); \
+    const type *nvds_event_src_ = (src); \
+    FIELDS (NVDS_EVENT_COPY_FIELD) \
+    (void) nvds_event_dst_; \
+    (void) nvds_event_src_; \
+  } G_STMT_END
+
+/** Frees the memory @event owns, but not @event itself. */
+#define NVDS_EVENT_FREE_MEMBERS(FIELDS, type, event) \
+  G_STMT_START { \
+    type *nvds_event_ = (event); \
+    FIELDS (NVDS_EVENT_FREE_FIELD) \
+    (void) nvds_event_; \
+  } G_STMT_END
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+typedef struct
+{
+  NVDS_SIMPLE_OBJECT_FIELDS (NVDS_EVENT_DECLARE_FIELD)
+} NvDsSimpleObjectMeta;
+
+typedef struct
+{
+  NVDS_FRAME_EVENT_FIELDS (NVDS_EVENT_DECLARE_FIELD)
+} NvDsFrameObjDescEvent;
+
+typedef struct
+{
+  NVDS_TRACK_POINT_FIELDS (NVDS_EVENT_DECLARE_FIELD)
+} NvDsTrackPoint;
+
+/**
+ * Extension of a track lifecycle event. The event type is NVDS_EVENT_ENTRY for the start of a track,
+ * NVDS_EVENT_MOVING for an update and NVDS_EVENT_EXIT for its end.
+ */
+typedef struct
+{
+  NVDS_TRACK_EVENT_FIELDS (NVDS_EVENT_DECLARE_FIELD)
+} NvDsTrackEvent;
+
+/**
+ * Returns which of the extensions above @meta carries, NVDS_EVENT_EXT_NONE
+ * for none or any other, e.g. an object extension of the SDK. The size has
+ * to match the tag as well, so nothing is read past the end of @meta's
+ * extension.
+ */
+static inline NvDsEventExtKind
+nvds_event_ext_kind (const NvDsEventMsgMeta *meta)
+{
+  NvDsEventExtKind kind;
+
+  if (!meta->extMsg || meta->extMsgSize < sizeof (NvDsEventExtKind))
+    return NVDS_EVENT_EXT_NONE;
+  kind = *(const NvDsEventExtKind *) meta->extMsg;
+  if (kind == NVDS_EVENT_EXT_FRAME &&
+      meta->extMsgSize == sizeof (NvDsFrameObjDescEvent))
+    return kind;
+  if (kind == NVDS_EVENT_EXT_TRACK &&
+      meta->extMsgSize == sizeof (NvDsTrackEvent))
+    return kind;
+  return NVDS_EVENT_EXT_NONE;
+}
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* NVMSGCONV_EVENT_FIELDS_H_ */
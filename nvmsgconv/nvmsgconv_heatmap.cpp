@@ -0,0 +1,250 @@
+/*
+ * Copyright (c) 2018-2020, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA Corporation and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA Corporation is strictly prohibited.
+ *
+ */
+
+#include "nvmsgconv_heatmap.h"
+#include "nvmsgconv_json.h"
+#include "nvmsgconv_log.h"
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <iostream>
+
+using namespace std;
+
+#define CONFIG_KEY_ENABLE "enable"
+#define CONFIG_KEY_GRID_WIDTH "grid-width"
+#define CONFIG_KEY_GRID_HEIGHT "grid-height"
+#define CONFIG_KEY_PERIOD_MS "period-ms"
+#define CONFIG_KEY_ENCODING "encoding"
+
+/* Keeps a message of dense grids within a few hundred kilobytes. */
+#define MAX_GRID_CELLS 65536
+
+NvDsHeatmap::~NvDsHeatmap ()
+{
+  guint lostSensors = 0;
+  guint lostFrames = 0;
+
+  for (auto &entry : sensors) {
+    if (!entry.second.frames)
+      continue;
+    lostSensors++;
+    lostFrames += entry.second.frames;
+  }
+  if (lostSensors) {
+    NVDS_MSG2P_LOG (0, "Heatmap: %u frames of %u sensors lost, the context "
+        "was destroyed without nvds_msg2p_flush", lostFrames, lostSensors);
+  }
+}
+
+bool
+nvds_heatmap_parse (NvDsHeatmapConfig *config, GKeyFile *key_file,
+    const gchar *group)
+{
+  GError *error = NULL;
+  gchar *encoding = NULL;
+  gint64 ival;
+  bool ret = true;
+
+  config->enable = g_key_file_get_boolean (key_file, group, CONFIG_KEY_ENABLE,
+      NULL);
+
+  ival = g_key_file_get_int64 (key_file, group, CONFIG_KEY_GRID_WIDTH,
+      &error);
+  if (!error)
+    config->gridWidth = CLAMP (ival, 1, MAX_GRID_CELLS);
+  g_clear_error (&error);
+
+  ival = g_key_file_get_int64 (key_file, group, CONFIG_KEY_GRID_HEIGHT,
+      &error);
+  if (!error)
+    config->gridHeight = CLAMP (ival, 1, MAX_GRID_CELLS);
+  g_clear_error (&error);
+
+  if ((guint64) config->gridWidth * config->gridHeight > MAX_GRID_CELLS) {
+    cout << "Heatmap grid " << config->gridWidth << "x" << config->gridHeight
+        << " has more than " << MAX_GRID_CELLS << " cells" << endl;
+    ret = false;
+  }
+
+  ival = g_key_file_get_int64 (key_file, group, CONFIG_KEY_PERIOD_MS, &error);
+  if (!error)
+    config->periodUs = MAX (ival, 0) * 1000;
+  g_clear_error (&error);
+
+  encoding = g_key_file_get_string (key_file, group, CONFIG_KEY_ENCODING,
+      NULL);
+  if (encoding) {
+    if (!g_strcmp0 (encoding, "dense")) {
+      config->encoding = NVDS_HEATMAP_DENSE;
+    } else if (!g_strcmp0 (encoding, "rle")) {
+      config->encoding = NVDS_HEATMAP_RLE;
+    } else {
+      cout << "Unknown " CONFIG_KEY_ENCODING " " << encoding << endl;
+      ret = false;
+    }
+    g_free (encoding);
+  }
+
+  return ret;
+}
+
+static NvDsHeatmapGrid &
+find_grid (const NvDsHeatmapConfig &config, NvDsHeatmapSensor &sensor,
+    const NvDsSimpleObjectMeta *obj)
+{
+  for (NvDsHeatmapGrid &grid : sensor.grids) {
+    if (grid.classId == obj->classId)
+      return grid;
+  }
+
+  sensor.grids.emplace_back ();
+  NvDsHeatmapGrid &grid = sensor.grids.back ();
+  grid.classId = obj->classId;
+  grid.label.assign (obj->label, strnlen (obj->label, MAX_LABEL_SIZE));
+  grid.counts.assign ((gsize) config.gridWidth * config.gridHeight, 0);
+  return grid;
+}
+
+void
+nvds_heatmap_add (NvDsHeatmap *heatmap, gint sensorId,
+    const NvDsFrameObjDescEvent *frame, const gchar *ts)
+{
+  const NvDsHeatmapConfig &config = heatmap->config;
+  NvDsHeatmapSensor &sensor = heatmap->sensors[sensorId];
+  guint count = MIN (frame->objCounts, MAX_OBJ_NUM);
+  guint32 *cells;
+
+  if (!sensor.frames) {
+    sensor.startUs = g_get_monotonic_time ();
+    sensor.startTs = ts ? ts : "";
+  }
+  sensor.lastTs = ts ? ts : "";
+  sensor.frames++;
+
+  if (!count || !frame->frameWidth || !frame->frameHeight)
+    return;
+
+  const gfloat scaleX = (gfloat) config.gridWidth / frame->frameWidth;
+  const gfloat scaleY = (gfloat) config.gridHeight / frame->frameHeight;
+  const gfloat maxX = config.gridWidth - 1;
+  const gfloat maxY = config.gridHeight - 1;
+  const guint32 width = config.gridWidth;
+
+  heatmap->cells.resize (MAX_OBJ_NUM);
+  cells = heatmap->cells.data ();
+
+  /* Foot points to cells without branches, so the loop vectorizes. fmaxf
+   * also maps NaN to the first cell, and the clamps keep boxes that reach
+   * out of the frame on its border. */
+  for (guint i = 0; i < count; i++) {
+    const NvDsRect &bbox = frame->objMetaList[i].bbox;
+    gfloat x = (bbox.left + bbox.width * 0.5f) * scaleX;
+    gfloat y = (bbox.top + bbox.height) * scaleY;
+
+    x = fminf (fmaxf (x, 0.0f), maxX);
+    y = fminf (fmaxf (y, 0.0f), maxY);
+    cells[i] = (guint32) y * width + (guint32) x;
+  }
+
+  NvDsHeatmapGrid *grid = NULL;
+  for (guint i = 0; i < count; i++) {
+    const NvDsSimpleObjectMeta *obj = &frame->objMetaList[i];
+
+    if (!grid || grid->classId != obj->classId)
+      grid = &find_grid (config, sensor, obj);
+    grid->counts[cells[i]]++;
+    grid->total++;
+  }
+}
+
+bool
+nvds_heatmap_ready (NvDsHeatmap *heatmap, gint sensorId)
+{
+  auto it = heatmap->sensors.find (sensorId);
+
+  return it != heatmap->sensors.end () && it->second.frames &&
+      g_get_monotonic_time () - it->second.startUs >=
+      heatmap->config.periodUs;
+}
+
+static void
+append_cells (GString *out, const vector<guint32> &counts,
+    NvDsHeatmapEncoding encoding)
+{
+  gsize size = counts.size ();
+
+  if (encoding == NVDS_HEATMAP_DENSE) {
+    for (gsize i = 0; i < size; i++) {
+      if (i)
+        g_string_append_c (out, ',');
+      nvds_json_append_int (out, counts[i]);
+    }
+    return;
+  }
+
+  for (gsize i = 0; i < size;) {
+    gsize run = 1;
+
+    while (i + run < size && counts[i + run] == counts[i])
+      run++;
+    if (i)
+      g_string_append_c (out, ',');
+    nvds_json_append_int (out, run);
+    g_string_append_c (out, ',');
+    nvds_json_append_int (out, counts[i]);
+    i += run;
+  }
+}
+
+void
+nvds_heatmap_write (NvDsHeatmap *heatmap, gint sensorId, GString *out)
+{
+  const NvDsHeatmapConfig &config = heatmap->config;
+  NvDsHeatmapSensor &sensor = heatmap->sensors[sensorId];
+  bool first = true;
+
+  g_string_append (out, "\"heatmap\":{\"start\":");
+  nvds_json_append_string (out, sensor.startTs.c_str ());
+  g_string_append (out, ",\"frames\":");
+  nvds_json_append_int (out, sensor.frames);
+  g_string_append (out, ",\"width\":");
+  nvds_json_append_int (out, config.gridWidth);
+  g_string_append (out, ",\"height\":");
+  nvds_json_append_int (out, config.gridHeight);
+  g_string_append (out, config.encoding == NVDS_HEATMAP_RLE ?
+      ",\"encoding\":\"rle\"" : ",\"encoding\":\"dense\"");
+  g_string_append (out, ",\"classes\":[");
+
+  for (NvDsHeatmapGrid &grid : sensor.grids) {
+    if (!grid.total)
+      continue;
+    if (!first)
+      g_string_append_c (out, ',');
+    first = false;
+
+    g_string_append (out, "{\"classId\":");
+    nvds_json_append_int (out, grid.classId);
+    g_string_append (out, ",\"label\":");
+    nvds_json_append_string (out, grid.label.c_str ());
+    g_string_append (out, ",\"total\":");
+    nvds_json_append_int (out, grid.total);
+    g_string_append (out, ",\"cells\":[");
+    append_cells (out, grid.counts, config.encoding);
+    g_string_append (out, "]}");
+
+    fill (grid.counts.begin (), grid.counts.end (), 0);
+    grid.total = 0;
+  }
+  g_string_append (out, "]}");
+
+  sensor.frames = 0;
+}
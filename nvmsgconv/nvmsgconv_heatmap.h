@@ -0,0 +1,115 @@
+/*
+ * Copyright (c) 2018-2020, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA Corporation and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA Corporation is strictly prohibited.
+ *
+ */
+
+/**
+ * @file
+ * <b>Occupancy heatmaps</b>
+ *
+ * @b Description: Bins the foot point (bottom center of the box) of every
+ * object of the frame events of a sensor into a grid per class, and sends
+ * the grids once per period instead of the objects. Cells count object
+ * frames, so a cell's count divided by the number of frames in the period is
+ * its average occupancy.
+ *
+ * Used for the DeepStream schema when the [heatmap] group of the converter's
+ * key-value configuration file enables it:
+ *
+ *   enable=1
+ *   grid-width=N      cells across the frame
+ *   grid-height=N     cells down the frame
+ *   period-ms=N       send the grids of a sensor once its first frame in
+ *                     the period is N ms old
+ *   encoding=E        dense, or rle for runs of equal counts
+ *
+ * The heatmap of a sensor is written as
+ *
+ *   "heatmap": {
+ *     "start": "<timestamp of the first frame>", "frames": 300,
+ *     "width": 32, "height": 18, "encoding": "rle",
+ *     "classes": [ { "classId": 0, "label": "car", "total": 1200,
+ *                    "cells": [...] } ]
+ *   }
+ *
+ * where cells are the counts in row-major order, or with rle pairs of run
+ * length and count covering the whole grid. Classes without objects in the
+ * period are left out. Periods are checked when events arrive, calls that
+ * don't end one return no payload; nvds_msg2p_flush sends the grids of the
+ * periods still open.
+ */
+
+#ifndef NVMSGCONV_HEATMAP_H_
+#define NVMSGCONV_HEATMAP_H_
+
+#include "nvmsgconv_event.h"
+#include <glib.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#define CONFIG_GROUP_HEATMAP "heatmap"
+
+enum NvDsHeatmapEncoding {
+  NVDS_HEATMAP_DENSE,
+  NVDS_HEATMAP_RLE,
+};
+
+struct NvDsHeatmapConfig {
+  bool enable = false;
+  guint gridWidth = 32;
+  guint gridHeight = 18;
+  gint64 periodUs = 10 * G_USEC_PER_SEC;
+  NvDsHeatmapEncoding encoding = NVDS_HEATMAP_RLE;
+};
+
+struct NvDsHeatmapGrid {
+  gint classId;
+  std::string label;
+  guint64 total = 0;
+  std::vector<guint32> counts;
+};
+
+struct NvDsHeatmapSensor {
+  gint64 startUs = 0;
+  std::string startTs;
+  /* Time of the newest frame, the message time when flushed. */
+  std::string lastTs;
+  guint frames = 0;
+  /* Few classes, searched linearly. Kept allocated between periods. */
+  std::vector<NvDsHeatmapGrid> grids;
+};
+
+struct NvDsHeatmap {
+  NvDsHeatmapConfig config;
+  std::unordered_map<gint, NvDsHeatmapSensor> sensors;
+
+  /* Cells of the objects of the frame being binned. */
+  std::vector<guint32> cells;
+
+  ~NvDsHeatmap ();
+};
+
+bool nvds_heatmap_parse (NvDsHeatmapConfig *config, GKeyFile *key_file,
+    const gchar *group);
+
+/** Bins the objects of @frame, seen at @ts, into the grids of @sensorId. */
+void nvds_heatmap_add (NvDsHeatmap *heatmap, gint sensorId,
+    const NvDsFrameObjDescEvent *frame, const gchar *ts);
+
+/** Returns true if the period of @sensorId is over. */
+bool nvds_heatmap_ready (NvDsHeatmap *heatmap, gint sensorId);
+
+/**
+ * Appends the "heatmap" member of @sensorId's message to @out and starts a
+ * new period.
+ */
+void nvds_heatmap_write (NvDsHeatmap *heatmap, gint sensorId, GString *out);
+
+#endif /* NVMSGCONV_HEATMAP_H_ */
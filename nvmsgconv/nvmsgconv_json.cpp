@@ -0,0 +1,256 @@
+/*
+ * Copyright (c) 2018-2020, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA Corporation and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA Corporation is strictly prohibited.
+ *
+ */
+
+#include "nvmsgconv_json.h"
+#include <math.h>
+#include <string.h>
+#if defined (__SSE2__)
+#include <immintrin.h>
+#elif defined (__aarch64__)
+#include <arm_neon.h>
+#endif
+
+/*
+ * Returns the first byte from @p on that is not ASCII or, if @Escape, has
+ * to be escaped in a JSON string, or @end if there is none.
+ */
+template <bool Escape>
+static inline const guchar *
+scan (const guchar *p, const guchar *end)
+{
+#if defined (__AVX2__)
+  for (; end - p >= 32; p += 32) {
+    __m256i v = _mm256_loadu_si256 ((const __m256i *) p);
+    guint mask;
+
+    if (Escape) {
+      // A signed compare, so bytes from 0x80 on are below ' ' as well.
+      __m256i hit = _mm256_or_si256 (
+          _mm256_cmpgt_epi8 (_mm256_set1_epi8 (0x20), v),
+          _mm256_or_si256 (_mm256_cmpeq_epi8 (v, _mm256_set1_epi8 ('"')),
+              _mm256_cmpeq_epi8 (v, _mm256_set1_epi8 ('\\'))));
+      mask = _mm256_movemask_epi8 (hit);
+    } else {
+      mask = _mm256_movemask_epi8 (v);
+    }
+    if (mask)
+      return p + __builtin_ctz (mask);
+  }
+#endif
+#if defined (__SSE2__)
+  for (; end - p >= 16; p += 16) {
+    __m128i v = _mm_loadu_si128 ((const __m128i *) p);
+    guint mask;
+
+    if (Escape) {
+      // A signed compare, so bytes from 0x80 on are below ' ' as well.
+      __m128i hit = _mm_or_si128 (_mm_cmpgt_epi8 (_mm_set1_epi8 (0x20), v),
+          _mm_or_si128 (_mm_cmpeq_epi8 (v, _mm_set1_epi8 ('"')),
+              _mm_cmpeq_epi8 (v, _mm_set1_epi8 ('\\'))));
+      mask = _mm_movemask_epi8 (hit);
+    } else {
+      mask = _mm_movemask_epi8 (v);
+    }
+    if (mask)
+      return p + __builtin_ctz (mask);
+  }
+#elif defined (__aarch64__)
+  for (; end - p >= 16; p += 16) {
+    uint8x16_t v = vld1q_u8 (p);
+    uint8x16_t hit = vcgeq_u8 (v, vdupq_n_u8 (0x80));
+    guint64 mask;
+
+    if (Escape) {
+      hit = vorrq_u8 (vorrq_u8 (hit, vcltq_u8 (v, vdupq_n_u8 (0x20))),
+          vorrq_u8 (vceqq_u8 (v, vdupq_n_u8 ('"')),
+              vceqq_u8 (v, vdupq_n_u8 ('\\'))));
+    }
+    // NEON has no movemask, narrowing leaves four bits per byte.
+    mask = vget_lane_u64 (vreinterpret_u64_u8 (
+            vshrn_n_u16 (vreinterpretq_u16_u8 (hit), 4)), 0);
+    if (mask)
+      return p + (__builtin_ctzll (mask) >> 2);
+  }
+#endif
+  for (; p < end; p++) {
+    if (*p >= 0x80 || (Escape && (*p < 0x20 || *p == '"' || *p == '\\')))
+      break;
+  }
+  return p;
+}
+
+/*
+ * Returns the length of the UTF-8 sequence starting with the non-ASCII
+ * byte at @p, or 0 if it is invalid: a stray continuation byte, an
+ * overlong form, a surrogate, a code point above U+10FFFF or a sequence
+ * cut short.
+ */
+static inline gsize
+sequence_length (const guchar *p, const guchar *end)
+{
+  guchar lo = 0x80;
+  guchar hi = 0xbf;
+  gsize n;
+
+  if (p[0] >= 0xc2 && p[0] <= 0xdf) {
+    n = 2;
+  } else if (p[0] >= 0xe0 && p[0] <= 0xef) {
+    n = 3;
+    if (p[0] == 0xe0)
+      lo = 0xa0;
+    else if (p[0] == 0xed)
+      hi = 0x9f;
+  } else if (p[0] >= 0xf0 && p[0] <= 0xf4) {
+    n = 4;
+    if (p[0] == 0xf0)
+      lo = 0x90;
+    else if (p[0] == 0xf4)
+      hi = 0x8f;
+  } else {
+    return 0;
+  }
+
+  if ((gsize) (end - p) < n || p[1] < lo || p[1] > hi)
+    return 0;
+  for (gsize i = 2; i < n; i++) {
+    if ((p[i] & 0xc0) != 0x80)
+      return 0;
+  }
+  return n;
+}
+
+gsize
+nvds_utf8_validate (const gchar *str, gsize len)
+{
+  const guchar *start = (const guchar *) str;
+  const guchar *end = start + len;
+  const guchar *p = start;
+  gsize n;
+
+  while ((p = scan<false> (p, end)) < end &&
+      (n = sequence_length (p, end)))
+    p += n;
+  return p - start;
+}
+
+void
+nvds_json_append_escaped (GString *out, const gchar *str, gsize len)
+{
+  static const char hex[] = "0123456789abcdef";
+  const guchar *end = (const guchar *) str + len;
+  const guchar *run = (const guchar *) str;
+  const guchar *p = run;
+
+  /* Copy runs that need no escaping in one go. */
+  while ((p = scan<true> (p, end)) < end) {
+    guchar c = *p;
+    const gchar *escape;
+    gsize n;
+
+    if (c >= 0x80) {
+      n = sequence_length (p, end);
+      if (n) {
+        p += n;
+        continue;
+      }
+    }
+
+    g_string_append_len (out, (const gchar *) run, p - run);
+    run = ++p;
+    switch (c) {
+      case '"':
+        escape = "\\\"";
+        break;
+      case '\\':
+        escape = "\\\\";
+        break;
+      case '\n':
+        escape = "\\n";
+        break;
+      case '\r':
+        escape = "\\r";
+        break;
+      case '\t':
+        escape = "\\t";
+        break;
+      default:
+        if (c >= 0x80) {
+          escape = NVDS_UTF8_REPLACEMENT;
+          break;
+        }
+        g_string_append (out, "\\u00");
+        g_string_append_c (out, hex[c >> 4]);
+        g_string_append_c (out, hex[c & 0xf]);
+        continue;
+    }
+    g_string_append (out, escape);
+  }
+  g_string_append_len (out, (const gchar *) run, end - run);
+}
+
+void
+nvds_json_append_string (GString *out, const gchar *str)
+{
+  if (!str) {
+    g_string_append (out, "null");
+    return;
+  }
+  g_string_append_c (out, '"');
+  nvds_json_append_escaped (out, str, strlen (str));
+  g_string_append_c (out, '"');
+}
+
+void
+nvds_json_append_double (GString *out, gdouble value)
+{
+  gchar buf[G_ASCII_DTOSTR_BUF_SIZE];
+
+  g_string_append (out, g_ascii_formatd (buf, sizeof (buf), "%g", value));
+}
+
+void
+nvds_json_append_number (GString *out, gdouble value)
+{
+  gchar buf[G_ASCII_DTOSTR_BUF_SIZE];
+
+  if (!isfinite (value)) {
+    g_string_append (out, "null");
+    return;
+  }
+  g_string_append (out, g_ascii_dtostr (buf, sizeof (buf), value));
+}
+
+void
+nvds_json_append_int (GString *out, gint64 value)
+{
+  gchar buf[24];
+  gchar *p = buf + sizeof (buf);
+  guint64 magnitude = value < 0 ? -(guint64) value : (guint64) value;
+
+  do {
+    *--p = '0' + magnitude % 10;
+    magnitude /= 10;
+  } while (magnitude);
+  if (value < 0)
+    *--p = '-';
+  g_string_append_len (out, p, buf + sizeof (buf) - p);
+}
+
+void
+nvds_json_reserve (GString *out, gsize size)
+{
+  gsize len = out->len;
+
+  if (out->allocated_len > len + size)
+    return;
+  g_string_set_size (out, len + size);
+  g_string_truncate (out, len);
+}
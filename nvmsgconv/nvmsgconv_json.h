@@ -0,0 +1,64 @@
+/*
+ * Copyright (c) 2018-2020, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA Corporation and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA Corporation is strictly prohibited.
+ *
+ */
+
+/**
+ * @file
+ * <b>JSON text helpers</b>
+ *
+ * @b Description: Helpers for encoders that write JSON text directly
+ * instead of building a json-glib tree.
+ *
+ * Strings are scanned 16 bytes at a time (32 with AVX2) with SSE2 or NEON
+ * for bytes that need escaping or are not ASCII, and clean runs are copied
+ * in one go. Multibyte sequences are checked one by one; bytes that are
+ * not valid UTF-8, e.g. a label cut in the middle of a character, are
+ * replaced by U+FFFD so the output always parses.
+ */
+
+#ifndef NVMSGCONV_JSON_H_
+#define NVMSGCONV_JSON_H_
+
+#include <glib.h>
+
+/* U+REPLACEMENT CHARACTER, written for each byte of invalid UTF-8. */
+#define NVDS_UTF8_REPLACEMENT "\xef\xbf\xbd"
+
+/**
+ * Returns the length of the longest prefix of the @len bytes at @str that
+ * is valid UTF-8.
+ */
+gsize nvds_utf8_validate (const gchar *str, gsize len);
+
+/** Appends @len bytes of @str to @out escaped for use inside a JSON string. */
+void nvds_json_append_escaped (GString *out, const gchar *str, gsize len);
+
+/** Appends @str as a quoted JSON string, or null if @str is NULL. */
+void nvds_json_append_string (GString *out, const gchar *str);
+
+/**
+ * Appends @value the way printf's %g would in the C locale, as the records
+ * of the minimal schema have it.
+ */
+void nvds_json_append_double (GString *out, gdouble value);
+
+/**
+ * Appends @value as a JSON number with 17 significant digits, like
+ * json-glib, so it reads back exactly. NaN and infinities have no JSON
+ * number and are written as null.
+ */
+void nvds_json_append_number (GString *out, gdouble value);
+
+void nvds_json_append_int (GString *out, gint64 value);
+
+/** Grows @out so @size more bytes are appended without reallocating. */
+void nvds_json_reserve (GString *out, gsize size);
+
+#endif /* NVMSGCONV_JSON_H_ */
@@ -0,0 +1,248 @@
+/*
+ * Copyright (c) 2018-2020, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA Corporation and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA Corporation is strictly prohibited.
+ *
+ */
+
+#include "nvmsgconv_lanes.h"
+#include "nvmsgconv_log.h"
+#include <iostream>
+
+using namespace std;
+
+#define CONFIG_KEY_ENABLE "enable"
+#define CONFIG_KEY_CRITICAL_TYPES "critical-types"
+#define CONFIG_KEY_SCHEDULING "scheduling"
+#define CONFIG_KEY_WEIGHTS "weights"
+#define CONFIG_KEY_QUEUE_SIZE "queue-size"
+#define CONFIG_KEY_MAX_PAYLOADS_PER_CALL "max-payloads-per-call"
+
+#define REPORT_INTERVAL_US (10 * G_USEC_PER_SEC)
+
+static const gchar *laneNames[NVDS_LANE_COUNT] = { "critical", "telemetry" };
+
+static const struct {
+  const gchar *name;
+  NvDsEventType type;
+} eventTypes[] = {
+  { "entry", NVDS_EVENT_ENTRY },
+  { "exit", NVDS_EVENT_EXIT },
+  { "moving", NVDS_EVENT_MOVING },
+  { "stopped", NVDS_EVENT_STOPPED },
+  { "empty", NVDS_EVENT_EMPTY },
+  { "parked", NVDS_EVENT_PARKED },
+  { "reset", NVDS_EVENT_RESET },
+  { "custom", NVDS_EVENT_CUSTOM },
+};
+
+NvDsPriorityLanes::~NvDsPriorityLanes ()
+{
+  for (guint l = 0; l < NVDS_LANE_COUNT; l++) {
+    NvDsLane &lane = lanes[l];
+
+    if (lane.queue.empty ())
+      continue;
+    NVDS_MSG2P_LOG (l, "Lane %s: %u payloads lost, the context was destroyed "
+        "before they were handed out", laneNames[l],
+        (guint) lane.queue.size ());
+    for (NvDsLaneItem &item : lane.queue)
+      g_free (item.message);
+  }
+}
+
+/* Reads a list of one value per lane into @values. */
+static bool
+parse_lane_values (GKeyFile *key_file, const gchar *group, const gchar *key,
+    guint *values)
+{
+  GError *error = NULL;
+  gsize length = 0;
+  gint *list = g_key_file_get_integer_list (key_file, group, key, &length,
+      &error);
+
+  if (error) {
+    g_error_free (error);
+    return true;
+  }
+  if (length != NVDS_LANE_COUNT) {
+    cout << "Expected " << NVDS_LANE_COUNT << " " << key << " in [" << group
+        << "]" << endl;
+    g_free (list);
+    return false;
+  }
+  for (gsize i = 0; i < length; i++)
+    values[i] = MAX (list[i], 1);
+  g_free (list);
+  return true;
+}
+
+bool
+nvds_lanes_parse (NvDsLaneConfig *config, GKeyFile *key_file,
+    const gchar *group)
+{
+  GError *error = NULL;
+  gchar **types = NULL;
+  gchar *scheduling = NULL;
+  gint ival;
+  bool ret = true;
+
+  config->enable = g_key_file_get_boolean (key_file, group, CONFIG_KEY_ENABLE,
+      NULL);
+
+  scheduling = g_key_file_get_string (key_file, group, CONFIG_KEY_SCHEDULING,
+      NULL);
+  if (scheduling) {
+    if (!g_strcmp0 (scheduling, "weighted")) {
+      config->weighted = true;
+    } else if (!g_strcmp0 (scheduling, "strict")) {
+      config->weighted = false;
+    } else {
+      cout << "Unknown " CONFIG_KEY_SCHEDULING " " << scheduling << endl;
+      ret = false;
+    }
+    g_free (scheduling);
+  }
+
+  ival = g_key_file_get_integer (key_file, group,
+      CONFIG_KEY_MAX_PAYLOADS_PER_CALL, &error);
+  if (!error)
+    config->maxPayloadsPerCall = MAX (ival, 1);
+  g_clear_error (&error);
+
+  if (!parse_lane_values (key_file, group, CONFIG_KEY_WEIGHTS,
+          config->weights) ||
+      !parse_lane_values (key_file, group, CONFIG_KEY_QUEUE_SIZE,
+          config->queueSize))
+    ret = false;
+
+  types = g_key_file_get_string_list (key_file, group,
+      CONFIG_KEY_CRITICAL_TYPES, NULL, NULL);
+  if (types) {
+    config->criticalTypes.clear ();
+    for (gchar **type = types; *type; type++) {
+      bool found = false;
+
+      for (const auto &entry : eventTypes) {
+        if (!g_ascii_strcasecmp (g_strstrip (*type), entry.name)) {
+          config->criticalTypes.push_back (entry.type);
+          found = true;
+        }
+      }
+      if (!found) {
+        cout << "Unknown event type " << *type << " in [" << group << "]"
+            << endl;
+        ret = false;
+      }
+    }
+    g_strfreev (types);
+  }
+
+  return ret;
+}
+
+NvDsLaneId
+nvds_lanes_classify (NvDsPriorityLanes *lanes, const NvDsEventMsgMeta *meta)
+{
+  for (NvDsEventType type : lanes->config.criticalTypes) {
+    if (meta->type == type)
+      return NVDS_LANE_CRITICAL;
+  }
+  return NVDS_LANE_TELEMETRY;
+}
+
+void
+nvds_lanes_push (NvDsPriorityLanes *lanes, NvDsLaneId id, gchar *message,
+    guint componentId)
+{
+  NvDsLane &lane = lanes->lanes[id];
+
+  if (lane.queue.size () >= lanes->config.queueSize[id]) {
+    g_free (lane.queue.front ().message);
+    lane.queue.pop_front ();
+    lane.dropped++;
+  }
+  lane.queue.push_back ({ message, componentId, g_get_monotonic_time () });
+  lane.enqueued++;
+}
+
+static gchar *
+take (NvDsLane &lane, guint *componentId)
+{
+  NvDsLaneItem item = lane.queue.front ();
+  gint64 latency = g_get_monotonic_time () - item.enqueuedUs;
+
+  lane.queue.pop_front ();
+  lane.emitted++;
+  lane.latencySumUs += latency;
+  lane.latencyMaxUs = MAX (lane.latencyMaxUs, latency);
+  *componentId = item.componentId;
+  return item.message;
+}
+
+gchar *
+nvds_lanes_pop (NvDsPriorityLanes *lanes, guint *componentId)
+{
+  guint i;
+
+  if (!lanes->config.weighted) {
+    for (NvDsLane &lane : lanes->lanes) {
+      if (!lane.queue.empty ())
+        return take (lane, componentId);
+    }
+    return NULL;
+  }
+
+  /* Weighted round robin: each lane may send up to its weight per round,
+   * lanes without pending payloads forfeit their share. */
+  for (i = 0; i <= 2 * NVDS_LANE_COUNT; i++) {
+    NvDsLane &lane = lanes->lanes[lanes->current];
+
+    if (!lane.queue.empty () && lane.credit > 0) {
+      lane.credit--;
+      return take (lane, componentId);
+    }
+    lanes->current = (lanes->current + 1) % NVDS_LANE_COUNT;
+    if (lanes->current == 0) {
+      for (guint l = 0; l < NVDS_LANE_COUNT; l++)
+        lanes->lanes[l].credit = lanes->config.weights[l];
+    }
+  }
+  return NULL;
+}
+
+gchar *
+nvds_lanes_pop_lane (NvDsPriorityLanes *lanes, NvDsLaneId id,
+    guint *componentId)
+{
+  NvDsLane &lane = lanes->lanes[id];
+
+  if (lane.queue.empty ())
+    return NULL;
+  return take (lane, componentId);
+}
+
+void
+nvds_lanes_report (NvDsPriorityLanes *lanes)
+{
+  gint64 now = g_get_monotonic_time ();
+
+  if (now - lanes->lastReportUs < REPORT_INTERVAL_US)
+    return;
+  lanes->lastReportUs = now;
+
+  for (guint l = 0; l < NVDS_LANE_COUNT; l++) {
+    const NvDsLane &lane = lanes->lanes[l];
+
+    NVDS_MSG2P_LOG (l, "Lane %s: queued %" G_GUINT64_FORMAT ", sent %"
+        G_GUINT64_FORMAT ", dropped %" G_GUINT64_FORMAT ", pending %u, "
+        "latency avg %.1f ms max %.1f ms", laneNames[l], lane.enqueued,
+        lane.emitted, lane.dropped, (guint) lane.queue.size (),
+        lane.emitted ? lane.latencySumUs / 1000.0 / lane.emitted : 0.0,
+        lane.latencyMaxUs / 1000.0);
+  }
+}
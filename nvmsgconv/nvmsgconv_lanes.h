@@ -0,0 +1,129 @@
+/*
+ * Copyright (c) 2018-2020, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA Corporation and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA Corporation is strictly prohibited.
+ *
+ */
+
+/**
+ * @file
+ * <b>Message converter priority lanes</b>
+ *
+ * @b Description: Keeps critical events from queueing behind periodic
+ * telemetry. In multiple-payload mode each event is converted into its own
+ * payload and queued on the lane of its type: event types listed as
+ * critical go to the critical lane, everything else (e.g. the periodic
+ * NVDS_EVENT_CUSTOM object dumps) to the telemetry lane. Every call then
+ * hands out at most max-payloads-per-call payloads, taken from the lanes in
+ * strict priority order or by weighted round robin, and then whatever is
+ * left on the critical lane: critical payloads are never held back for a
+ * later call, only telemetry is. Lanes are bounded and drop their oldest
+ * payload when full. Critical events are exempt from load shedding.
+ *
+ * Telemetry left on the lanes waits for the next generate call. The stock
+ * gst-nvmsgconv element makes no call after the last buffer, so at EOS the
+ * backlog is only handed out by nvds_msg2p_flush(); otherwise it is lost
+ * when the context is destroyed, which is logged with the number of
+ * payloads lost per lane.
+ *
+ * Settings are read from the [priority-lanes] group of the converter's
+ * key-value configuration file:
+ *
+ *   enable=1
+ *   critical-types=entry;exit;...   NvDsEventType names without prefix
+ *   scheduling=strict|weighted
+ *   weights=N;N                     critical;telemetry, for weighted
+ *   queue-size=N;N                  critical;telemetry
+ *   max-payloads-per-call=N
+ */
+
+#ifndef NVMSGCONV_LANES_H_
+#define NVMSGCONV_LANES_H_
+
+#include "nvdsmeta_schema.h"
+#include <glib.h>
+#include <deque>
+#include <vector>
+
+#define CONFIG_GROUP_PRIORITY_LANES "priority-lanes"
+
+enum NvDsLaneId {
+  NVDS_LANE_CRITICAL,
+  NVDS_LANE_TELEMETRY,
+  NVDS_LANE_COUNT
+};
+
+struct NvDsLaneConfig {
+  bool enable = false;
+  bool weighted = false;
+  guint weights[NVDS_LANE_COUNT] = { 4, 1 };
+  guint queueSize[NVDS_LANE_COUNT] = { 256, 1024 };
+  guint maxPayloadsPerCall = 8;
+  std::vector<NvDsEventType> criticalTypes = {
+    NVDS_EVENT_ENTRY, NVDS_EVENT_EXIT, NVDS_EVENT_MOVING, NVDS_EVENT_STOPPED,
+    NVDS_EVENT_EMPTY, NVDS_EVENT_PARKED, NVDS_EVENT_RESET
+  };
+};
+
+struct NvDsLaneItem {
+  gchar *message;
+  guint componentId;
+  gint64 enqueuedUs;
+};
+
+struct NvDsLane {
+  std::deque<NvDsLaneItem> queue;
+  /* Payloads the lane may still take in the current weighted round. */
+  guint credit = 0;
+
+  guint64 enqueued = 0;
+  guint64 emitted = 0;
+  guint64 dropped = 0;
+  gint64 latencySumUs = 0;
+  gint64 latencyMaxUs = 0;
+};
+
+struct NvDsPriorityLanes {
+  NvDsLaneConfig config;
+  NvDsLane lanes[NVDS_LANE_COUNT];
+  guint current = 0;
+  gint64 lastReportUs = 0;
+
+  ~NvDsPriorityLanes ();
+};
+
+/** Parses @group into @config. Returns false on invalid values. */
+bool nvds_lanes_parse (NvDsLaneConfig *config, GKeyFile *key_file,
+    const gchar *group);
+
+NvDsLaneId nvds_lanes_classify (NvDsPriorityLanes *lanes,
+    const NvDsEventMsgMeta *meta);
+
+/**
+ * Queues @message, which is freed by the lanes, on @lane. @componentId is
+ * handed out with it.
+ */
+void nvds_lanes_push (NvDsPriorityLanes *lanes, NvDsLaneId lane,
+    gchar *message, guint componentId);
+
+/**
+ * Returns the next message to send and its componentId, or NULL if all
+ * lanes are empty.
+ */
+gchar *nvds_lanes_pop (NvDsPriorityLanes *lanes, guint *componentId);
+
+/**
+ * Returns the oldest message of @lane regardless of the scheduling, or
+ * NULL if it is empty.
+ */
+gchar *nvds_lanes_pop_lane (NvDsPriorityLanes *lanes, NvDsLaneId lane,
+    guint *componentId);
+
+/** Logs per-lane counters and latencies every few seconds. */
+void nvds_lanes_report (NvDsPriorityLanes *lanes);
+
+#endif /* NVMSGCONV_LANES_H_ */
@@ -0,0 +1,211 @@
+/*
+ * Copyright (c) 2018-2020, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA Corporation and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA Corporation is strictly prohibited.
+ *
+ */
+
+#include "nvmsgconv_linger.h"
+#include "nvmsgconv_log.h"
+#include <iostream>
+
+using namespace std;
+
+#define CONFIG_KEY_ENABLE "enable"
+#define CONFIG_KEY_LINGER_MS "linger-ms"
+#define CONFIG_KEY_MAX_BYTES "max-bytes"
+#define CONFIG_KEY_MAX_MESSAGES "max-messages"
+#define CONFIG_KEY_PARTITION "partition"
+#define CONFIG_KEY_ENVELOPE "envelope"
+
+#define REPORT_INTERVAL_US (10 * G_USEC_PER_SEC)
+
+/* Bytes a frame adds per message. */
+#define FRAME_HEADER_SIZE 4
+/* Envelopes grow beyond this as needed. */
+#define INITIAL_ENVELOPE_SIZE (64 * 1024)
+
+NvDsLinger::~NvDsLinger ()
+{
+  guint openMessages = 0;
+
+  for (auto &entry : open) {
+    if (!entry.second.data)
+      continue;
+    openMessages += entry.second.count;
+    g_string_free (entry.second.data, TRUE);
+  }
+  for (NvDsResultMessage &message : closed)
+    g_free ((gchar *) message.data);
+
+  if (openMessages || !closed.empty ()) {
+    NVDS_MSG2P_LOG (0, "Linger: %u messages of open envelopes and %u closed "
+        "envelopes lost, the context was destroyed without "
+        "nvds_msg2p_flush", openMessages, (guint) closed.size ());
+  }
+}
+
+bool
+nvds_linger_parse (NvDsLingerConfig *config, GKeyFile *key_file,
+    const gchar *group)
+{
+  GError *error = NULL;
+  gchar *str = NULL;
+  gint ival;
+  bool ret = true;
+
+  config->enable = g_key_file_get_boolean (key_file, group, CONFIG_KEY_ENABLE,
+      NULL);
+
+  ival = g_key_file_get_integer (key_file, group, CONFIG_KEY_LINGER_MS,
+      &error);
+  if (!error)
+    config->lingerUs = MAX (ival, 0) * G_TIME_SPAN_MILLISECOND;
+  g_clear_error (&error);
+
+  ival = g_key_file_get_integer (key_file, group, CONFIG_KEY_MAX_BYTES,
+      &error);
+  if (!error)
+    config->maxBytes = MAX (ival, 1);
+  g_clear_error (&error);
+
+  ival = g_key_file_get_integer (key_file, group, CONFIG_KEY_MAX_MESSAGES,
+      &error);
+  if (!error)
+    config->maxMessages = MAX (ival, 1);
+  g_clear_error (&error);
+
+  str = g_key_file_get_string (key_file, group, CONFIG_KEY_PARTITION, NULL);
+  if (str) {
+    if (!g_strcmp0 (str, "sensor")) {
+      config->perSensor = true;
+    } else if (!g_strcmp0 (str, "component")) {
+      config->perSensor = false;
+    } else {
+      cout << "Unknown " CONFIG_KEY_PARTITION " " << str << endl;
+      ret = false;
+    }
+    g_free (str);
+  }
+
+  str = g_key_file_get_string (key_file, group, CONFIG_KEY_ENVELOPE, NULL);
+  if (str) {
+    if (!g_strcmp0 (str, "frames")) {
+      config->frames = true;
+    } else if (!g_strcmp0 (str, "json")) {
+      config->frames = false;
+    } else {
+      cout << "Unknown " CONFIG_KEY_ENVELOPE " " << str << endl;
+      ret = false;
+    }
+    g_free (str);
+  }
+
+  return ret;
+}
+
+static void
+close_envelope (NvDsLinger *linger, NvDsLingerEnvelope &envelope,
+    guint componentId)
+{
+  GString *data = envelope.data;
+  guint size;
+
+  if (!linger->config.frames)
+    g_string_append_c (data, ']');
+  size = data->len;
+  linger->closed.push_back ({ g_string_free (data, FALSE), size,
+      componentId });
+  linger->envelopes++;
+  envelope.data = nullptr;
+  envelope.count = 0;
+}
+
+void
+nvds_linger_add (NvDsLinger *linger, const NvDsResultMessage &message,
+    gint sensorId)
+{
+  const NvDsLingerConfig &config = linger->config;
+  guint64 key = (guint64) message.componentId << 32 |
+      (config.perSensor ? (guint32) sensorId : 0);
+  NvDsLingerEnvelope &envelope = linger->open[key];
+  /* With the separator and, for JSON, the closing bracket. */
+  gsize added = message.size + (config.frames ? FRAME_HEADER_SIZE : 2);
+
+  /* A message larger than max-bytes gets an envelope of its own. */
+  if (envelope.data && envelope.data->len + added > config.maxBytes)
+    close_envelope (linger, envelope, message.componentId);
+
+  if (!envelope.data) {
+    envelope.data = g_string_sized_new (MIN (config.maxBytes,
+            INITIAL_ENVELOPE_SIZE) + 1);
+    envelope.firstUs = g_get_monotonic_time ();
+    if (!config.frames)
+      g_string_append_c (envelope.data, '[');
+  }
+
+  if (config.frames) {
+    guint32 length = GUINT32_TO_LE (message.size);
+
+    g_string_append_len (envelope.data, (const gchar *) &length,
+        sizeof (length));
+  } else if (envelope.count) {
+    g_string_append_c (envelope.data, ',');
+  }
+  g_string_append_len (envelope.data, message.data, message.size);
+  envelope.count++;
+  linger->messages++;
+
+  if (envelope.count >= config.maxMessages ||
+      envelope.data->len + (config.frames ? 0 : 1) >= config.maxBytes)
+    close_envelope (linger, envelope, message.componentId);
+}
+
+void
+nvds_linger_expire (NvDsLinger *linger, bool all)
+{
+  gint64 now = g_get_monotonic_time ();
+
+  for (auto it = linger->open.begin (); it != linger->open.end ();) {
+    NvDsLingerEnvelope &envelope = it->second;
+
+    if (envelope.data &&
+        (all || now - envelope.firstUs >= linger->config.lingerUs))
+      close_envelope (linger, envelope, (guint) (it->first >> 32));
+    /* Sensors come and go, partitions without a message are dropped. */
+    if (!envelope.data)
+      it = linger->open.erase (it);
+    else
+      ++it;
+  }
+}
+
+bool
+nvds_linger_pop (NvDsLinger *linger, NvDsResultMessage *message)
+{
+  if (linger->closed.empty ())
+    return false;
+  *message = linger->closed.front ();
+  linger->closed.pop_front ();
+  return true;
+}
+
+void
+nvds_linger_report (NvDsLinger *linger)
+{
+  gint64 now = g_get_monotonic_time ();
+
+  if (now - linger->lastReportUs < REPORT_INTERVAL_US)
+    return;
+  linger->lastReportUs = now;
+
+  NVDS_MSG2P_LOG (0, "Linger: %" G_GUINT64_FORMAT " messages in %"
+      G_GUINT64_FORMAT " envelopes (%.1f per envelope), %u partitions open",
+      linger->messages, linger->envelopes,
+      linger->envelopes ? (gdouble) linger->messages / linger->envelopes : 0.0,
+      (guint) linger->open.size ());
+}
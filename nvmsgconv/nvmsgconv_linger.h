@@ -0,0 +1,113 @@
+/*
+ * Copyright (c) 2018-2020, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA Corporation and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA Corporation is strictly prohibited.
+ *
+ */
+
+/**
+ * @file
+ * <b>Payload lingering</b>
+ *
+ * @b Description: Trades a bounded delay for fewer broker messages. Instead
+ * of handing out every message as its own payload, the converter holds
+ * messages per partition, i.e. per componentId or per componentId and
+ * sensor, and merges them into one envelope payload:
+ *
+ *   json    [message,message,...], for the JSON schemas
+ *   frames  each message prefixed by its length, 4 bytes little endian,
+ *           for any payload type
+ *
+ * An envelope is closed once it holds max-messages messages, once another
+ * message would take it past max-bytes, or once its first message has
+ * waited linger-ms. Calls that close no envelope return no payload. With
+ * priority lanes only the telemetry lane lingers, its envelopes are queued
+ * on the lane.
+ *
+ * The converter has no thread of its own: linger-ms is checked, for every
+ * partition, only when the context is called, so it bounds the delay only
+ * as long as events keep coming. The envelopes of a stream that goes quiet
+ * wait for the next call, and the ones still open when the context is
+ * destroyed are lost, which is logged. nvds_msg2p_flush() hands them out,
+ * but the stock gst-nvmsgconv plugin never calls it. Lingering is
+ * therefore off unless enabled, and meant for applications that call
+ * nvds_msg2p_flush() on idle streams and at EOS.
+ *
+ * Settings are read from the [linger] group of the converter's key-value
+ * configuration file:
+ *
+ *   enable=1
+ *   linger-ms=N         (default 100)
+ *   max-bytes=N         (default 65536)
+ *   max-messages=N      (default 64)
+ *   partition=component|sensor
+ *   envelope=json|frames
+ */
+
+#ifndef NVMSGCONV_LINGER_H_
+#define NVMSGCONV_LINGER_H_
+
+#include "nvmsgconv_results.h"
+#include <glib.h>
+#include <deque>
+#include <unordered_map>
+
+#define CONFIG_GROUP_LINGER "linger"
+
+struct NvDsLingerConfig {
+  bool enable = false;
+  gint64 lingerUs = 100 * G_TIME_SPAN_MILLISECOND;
+  gsize maxBytes = 64 * 1024;
+  guint maxMessages = 64;
+  bool perSensor = false;
+  bool frames = false;
+};
+
+struct NvDsLingerEnvelope {
+  GString *data = nullptr;
+  guint count = 0;
+  gint64 firstUs = 0;
+};
+
+struct NvDsLinger {
+  NvDsLingerConfig config;
+  /* Open envelopes by componentId and, per sensor, sensor id. */
+  std::unordered_map<guint64, NvDsLingerEnvelope> open;
+  /* Closed envelopes not handed out yet. */
+  std::deque<NvDsResultMessage> closed;
+
+  guint64 messages = 0;
+  guint64 envelopes = 0;
+  gint64 lastReportUs = 0;
+
+  ~NvDsLinger ();
+};
+
+/** Parses @group into @config. Returns false on invalid values. */
+bool nvds_linger_parse (NvDsLingerConfig *config, GKeyFile *key_file,
+    const gchar *group);
+
+/** Adds a copy of @message to the envelope of its partition. */
+void nvds_linger_add (NvDsLinger *linger, const NvDsResultMessage &message,
+    gint sensorId);
+
+/**
+ * Closes the envelopes that have lingered long enough, or all of them if
+ * @all.
+ */
+void nvds_linger_expire (NvDsLinger *linger, bool all);
+
+/**
+ * Takes the oldest closed envelope, which the caller frees with g_free().
+ * Returns false if there is none.
+ */
+bool nvds_linger_pop (NvDsLinger *linger, NvDsResultMessage *message);
+
+/** Logs the coalescing ratio every few seconds. */
+void nvds_linger_report (NvDsLinger *linger);
+
+#endif /* NVMSGCONV_LINGER_H_ */
@@ -0,0 +1,274 @@
+/*
+ * Copyright (c) 2018-2020, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA Corporation and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA Corporation is strictly prohibited.
+ *
+ */
+
+#include "nvmsgconv_log.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <mutex>
+#include <thread>
+
+using namespace std;
+
+#define LOG_QUEUE_SIZE 256
+#define LOG_MESSAGE_SIZE 256
+#define LOG_KEY_SLOTS 256
+#define LOG_KEY_PROBES 4
+#define LOG_RATE_INTERVAL_US G_USEC_PER_SEC
+#define LOG_DRAIN_PERIOD_MS 20
+
+/* Rate limiting state of one message key. */
+typedef struct
+{
+  atomic<guint64> ident;
+  atomic<gint64> last_us;
+  atomic<guint64> suppressed;
+} LogKeySlot;
+
+typedef struct
+{
+  atomic<guint64> sequence;
+  guint key_slot;
+  guint64 suppressed;
+  gchar text[LOG_MESSAGE_SIZE];
+} LogEntry;
+
+/* Bounded multi-producer queue: a slot is free for the producer whose
+ * position equals its sequence and ready for the consumer once the
+ * sequence is one past it. */
+struct NvDsMsg2pLog
+{
+  NvDsMsg2pLog ()
+  {
+    for (guint i = 0; i < LOG_QUEUE_SIZE; i++)
+      entries[i].sequence.store (i, memory_order_relaxed);
+  }
+
+  /* Contexts are often never destroyed, e.g. by applications that exit
+   * without tearing down the pipeline: stop the writer here, or the
+   * joinable thread would terminate the process. */
+  ~NvDsMsg2pLog ()
+  {
+    if (writer.joinable ()) {
+      stop.store (true, memory_order_release);
+      writer.join ();
+    }
+  }
+
+  LogEntry entries[LOG_QUEUE_SIZE];
+  alignas (64) atomic<guint64> tail;
+  alignas (64) guint64 head;
+  alignas (64) atomic<guint64> dropped;
+
+  LogKeySlot keys[LOG_KEY_SLOTS];
+  /* Last message written for each key, only touched by the writer. */
+  gchar last_text[LOG_KEY_SLOTS][LOG_MESSAGE_SIZE];
+
+  mutex lock;
+  guint users;
+  atomic<bool> stop;
+  thread writer;
+};
+
+static NvDsMsg2pLog logger;
+
+static guint64
+key_ident (const gchar *key, gint64 id)
+{
+  guint64 h = (guint64) (guintptr) key * 0x9E3779B97F4A7C15ULL;
+
+  h ^= (guint64) id + 0x7F4A7C159E3779B9ULL + (h << 6) + (h >> 2);
+  return h ? h : 1;
+}
+
+static LogKeySlot *
+find_key_slot (guint64 ident, guint *index)
+{
+  guint i;
+
+  for (i = 0; i < LOG_KEY_PROBES; i++) {
+    guint slot_index = (ident + i) % LOG_KEY_SLOTS;
+    LogKeySlot *slot = &logger.keys[slot_index];
+    guint64 expected = 0;
+
+    if (slot->ident.load (memory_order_relaxed) == ident ||
+        slot->ident.compare_exchange_strong (expected, ident,
+            memory_order_relaxed) || expected == ident) {
+      *index = slot_index;
+      return slot;
+    }
+  }
+  /* Table crowded: share the last probed slot. */
+  *index = (ident + LOG_KEY_PROBES - 1) % LOG_KEY_SLOTS;
+  return &logger.keys[*index];
+}
+
+static LogEntry *
+reserve_entry (guint64 *position)
+{
+  guint64 pos = logger.tail.load (memory_order_relaxed);
+
+  for (;;) {
+    LogEntry *entry = &logger.entries[pos % LOG_QUEUE_SIZE];
+    guint64 seq = entry->sequence.load (memory_order_acquire);
+    gint64 diff = (gint64) seq - (gint64) pos;
+
+    if (diff == 0) {
+      if (logger.tail.compare_exchange_weak (pos, pos + 1,
+              memory_order_relaxed)) {
+        *position = pos;
+        return entry;
+      }
+    } else if (diff < 0) {
+      return NULL;
+    } else {
+      pos = logger.tail.load (memory_order_relaxed);
+    }
+  }
+}
+
+void
+nvds_msg2p_log (const gchar *key, gint64 id, const gchar *format, ...)
+{
+  guint64 ident = key_ident (key, id);
+  guint key_index = 0;
+  LogKeySlot *slot = find_key_slot (ident, &key_index);
+  gint64 now = g_get_monotonic_time ();
+  gint64 last = slot->last_us.load (memory_order_relaxed);
+  LogEntry *entry = NULL;
+  guint64 position = 0;
+  va_list args;
+
+  if ((last && now - last < LOG_RATE_INTERVAL_US) ||
+      !slot->last_us.compare_exchange_strong (last, now,
+          memory_order_relaxed)) {
+    slot->suppressed.fetch_add (1, memory_order_relaxed);
+    return;
+  }
+
+  entry = reserve_entry (&position);
+  if (!entry) {
+    logger.dropped.fetch_add (1, memory_order_relaxed);
+    return;
+  }
+
+  va_start (args, format);
+  g_vsnprintf (entry->text, sizeof (entry->text), format, args);
+  va_end (args);
+  entry->key_slot = key_index;
+  entry->suppressed = slot->suppressed.exchange (0, memory_order_relaxed);
+  entry->sequence.store (position + 1, memory_order_release);
+}
+
+static void
+write_message (const gchar *text, guint64 suppressed)
+{
+  cout << text;
+  if (suppressed)
+    cout << " (suppressed " << suppressed << " similar)";
+  cout << '\n';
+}
+
+static bool
+drain_queue ()
+{
+  bool wrote = false;
+
+  for (;;) {
+    LogEntry *entry = &logger.entries[logger.head % LOG_QUEUE_SIZE];
+
+    if (entry->sequence.load (memory_order_acquire) != logger.head + 1)
+      break;
+    write_message (entry->text, entry->suppressed);
+    g_strlcpy (logger.last_text[entry->key_slot], entry->text,
+        LOG_MESSAGE_SIZE);
+    entry->sequence.store (logger.head + LOG_QUEUE_SIZE,
+        memory_order_release);
+    logger.head++;
+    wrote = true;
+  }
+  return wrote;
+}
+
+/* Reports messages suppressed for keys that have gone quiet since, which
+ * would otherwise only be reported with their next occurrence. */
+static bool
+flush_suppressed (gint64 now)
+{
+  bool wrote = false;
+  guint i;
+
+  for (i = 0; i < LOG_KEY_SLOTS; i++) {
+    LogKeySlot *slot = &logger.keys[i];
+    guint64 suppressed;
+
+    if (!slot->suppressed.load (memory_order_relaxed) ||
+        now - slot->last_us.load (memory_order_relaxed) < LOG_RATE_INTERVAL_US)
+      continue;
+    suppressed = slot->suppressed.exchange (0, memory_order_relaxed);
+    /* The key's message was never written, e.g. the queue was full. */
+    if (suppressed && logger.last_text[i][0]) {
+      write_message (logger.last_text[i], suppressed);
+      wrote = true;
+    }
+  }
+  return wrote;
+}
+
+static void
+writer_thread ()
+{
+  bool stopping = false;
+
+  while (!stopping) {
+    bool wrote;
+    guint64 dropped;
+
+    stopping = logger.stop.load (memory_order_acquire);
+    wrote = drain_queue ();
+    wrote |= flush_suppressed (stopping ? G_MAXINT64 :
+        g_get_monotonic_time ());
+
+    dropped = logger.dropped.exchange (0, memory_order_relaxed);
+    if (dropped) {
+      cout << "Log queue full, dropped " << dropped << " messages\n";
+      wrote = true;
+    }
+    if (wrote)
+      cout.flush ();
+    else if (!stopping)
+      this_thread::sleep_for (chrono::milliseconds (LOG_DRAIN_PERIOD_MS));
+  }
+}
+
+void
+nvds_msg2p_log_acquire ()
+{
+  lock_guard<mutex> guard (logger.lock);
+
+  if (logger.users++)
+    return;
+  logger.stop.store (false);
+  logger.writer = thread (writer_thread);
+}
+
+void
+nvds_msg2p_log_release ()
+{
+  lock_guard<mutex> guard (logger.lock);
+
+  if (logger.users == 0 || --logger.users || !logger.writer.joinable ())
+    return;
+  logger.stop.store (true, memory_order_release);
+  logger.writer.join ();
+}
@@ -0,0 +1,54 @@
+/*
+ * Copyright (c) 2018-2020, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA Corporation and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA Corporation is strictly prohibited.
+ *
+ */
+
+/**
+ * @file
+ * <b>Message converter logging</b>
+ *
+ * @b Description: Logging for the payload generation path. Messages are
+ * formatted into a slot of a bounded lock-free queue and written by a
+ * background thread, so callers never wait on stdout. Each call site is
+ * rate limited per key (the format string plus an id such as the sensor
+ * id): within the rate interval further messages are only counted, and the
+ * count is reported as "suppressed N similar" with the next message or
+ * once the key went quiet. When the queue is full messages are dropped and
+ * the number dropped is reported later.
+ */
+
+#ifndef NVMSGCONV_LOG_H_
+#define NVMSGCONV_LOG_H_
+
+#include <glib.h>
+
+/**
+ * Starts the writer thread on the first call. Every call must be paired
+ * with nvds_msg2p_log_release().
+ */
+void nvds_msg2p_log_acquire ();
+
+/**
+ * Stops the writer thread after the last user released it, writing out
+ * pending messages first.
+ */
+void nvds_msg2p_log_release ();
+
+/**
+ * Queues a message without blocking. @key must be a string with static
+ * storage; together with @id it identifies the message for rate limiting.
+ */
+void nvds_msg2p_log (const gchar *key, gint64 id, const gchar *format, ...)
+    G_GNUC_PRINTF (3, 4);
+
+/** Logs @format, rate limited per call site and @id. */
+#define NVDS_MSG2P_LOG(id, format, ...) \
+    nvds_msg2p_log (format, id, format, ##__VA_ARGS__)
+
+#endif /* NVMSGCONV_LOG_H_ */
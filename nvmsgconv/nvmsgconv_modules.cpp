@@ -0,0 +1,193 @@
+/*
+ * Copyright (c) 2018-2020, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA Corporation and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA Corporation is strictly prohibited.
+ *
+ */
+
+#include "nvmsgconv_modules.h"
+#include "nvmsgconv_event.h"
+#include <string.h>
+#include <iostream>
+
+using namespace std;
+
+#define CONFIG_KEY_ENABLE "enable"
+#define CONFIG_KEY_NAMES "names"
+#define CONFIG_KEY_COMPONENT_IDS "component-ids"
+#define CONFIG_KEY_CLASSES_SUFFIX "-classes"
+#define CONFIG_KEY_SENSOR_PREFIX "sensor"
+
+/* Resolves the ;-separated module names of @key into a mask. */
+static bool
+parse_module_list (const NvDsModuleTable *table, GKeyFile *key_file,
+    const gchar *group, const gchar *key, NvDsModuleMask *mask)
+{
+  gchar **names = NULL;
+  bool ret = true;
+
+  names = g_key_file_get_string_list (key_file, group, key, NULL, NULL);
+  *mask = 0;
+  for (gchar **name = names; name && *name; name++) {
+    guint id;
+
+    g_strstrip (*name);
+    if (!**name)
+      continue;
+    for (id = 0; id < table->modules.size (); id++) {
+      if (table->modules[id].name == *name)
+        break;
+    }
+    if (id == table->modules.size ()) {
+      cout << "Unknown module " << *name << " in " << key << endl;
+      ret = false;
+      break;
+    }
+    *mask |= (NvDsModuleMask) 1 << id;
+  }
+  g_strfreev (names);
+  return ret;
+}
+
+bool
+nvds_modules_parse (NvDsModuleTable *table, GKeyFile *key_file,
+    const gchar *group)
+{
+  gchar **names = NULL;
+  gchar **keys = NULL;
+  gint *componentIds = NULL;
+  gsize numComponentIds = 0;
+  bool ret = true;
+
+  *table = NvDsModuleTable ();
+  table->enable = g_key_file_get_boolean (key_file, group, CONFIG_KEY_ENABLE,
+      NULL);
+
+  names = g_key_file_get_string_list (key_file, group, CONFIG_KEY_NAMES, NULL,
+      NULL);
+  for (gchar **name = names; name && *name; name++) {
+    g_strstrip (*name);
+    if (!**name)
+      continue;
+    if (table->modules.size () == NVDS_MAX_MODULES) {
+      cout << "More than " << NVDS_MAX_MODULES << " modules" << endl;
+      ret = false;
+      goto done;
+    }
+    table->modules.push_back ({ *name, (guint) table->modules.size () + 1 });
+  }
+  if (table->modules.empty ())
+    goto done;
+  table->all = table->modules.size () == NVDS_MAX_MODULES ? ~0ull :
+      ((NvDsModuleMask) 1 << table->modules.size ()) - 1;
+
+  componentIds = g_key_file_get_integer_list (key_file, group,
+      CONFIG_KEY_COMPONENT_IDS, &numComponentIds, NULL);
+  if (componentIds) {
+    if (numComponentIds != table->modules.size ()) {
+      cout << CONFIG_KEY_COMPONENT_IDS " needs one id per module" << endl;
+      ret = false;
+      goto done;
+    }
+    for (guint id = 0; id < numComponentIds; id++)
+      table->modules[id].componentId = componentIds[id];
+  }
+
+  for (guint id = 0; id < table->modules.size (); id++) {
+    gchar *key = g_strconcat (table->modules[id].name.c_str (),
+        CONFIG_KEY_CLASSES_SUFFIX, NULL);
+    gsize numClasses = 0;
+    gint *classes = g_key_file_get_integer_list (key_file, group, key,
+        &numClasses, NULL);
+
+    if (!numClasses)
+      table->anyClass |= (NvDsModuleMask) 1 << id;
+    for (gsize i = 0; i < numClasses; i++) {
+      if (classes[i] < 0 || classes[i] >= NVDS_MAX_ROUTED_CLASSES) {
+        cout << "Class " << classes[i] << " of " << key << " out of range"
+            << endl;
+        ret = false;
+        break;
+      }
+      table->byClass[classes[i]] |= (NvDsModuleMask) 1 << id;
+    }
+    g_free (classes);
+    g_free (key);
+    if (!ret)
+      goto done;
+  }
+
+  keys = g_key_file_get_keys (key_file, group, NULL, NULL);
+  for (gchar **key = keys; key && *key; key++) {
+    const gchar *idStr = *key + strlen (CONFIG_KEY_SENSOR_PREFIX);
+    gchar *end = NULL;
+    guint64 sourceId;
+    NvDsModuleMask mask;
+
+    if (strncmp (*key, CONFIG_KEY_SENSOR_PREFIX,
+            strlen (CONFIG_KEY_SENSOR_PREFIX)))
+      continue;
+    sourceId = g_ascii_strtoull (idStr, &end, 10);
+    if (end == idStr || *end || sourceId > G_MAXINT16) {
+      cout << "Invalid source in " << *key << endl;
+      ret = false;
+      goto done;
+    }
+    if (!parse_module_list (table, key_file, group, *key, &mask)) {
+      ret = false;
+      goto done;
+    }
+    if (sourceId >= table->bySource.size ())
+      table->bySource.resize (sourceId + 1, table->all);
+    table->bySource[sourceId] = mask;
+  }
+
+done:
+  g_strfreev (names);
+  g_strfreev (keys);
+  g_free (componentIds);
+  return ret;
+}
+
+NvDsModuleMask
+nvds_modules_route (const NvDsModuleTable *table,
+    const NvDsEventMsgMeta *meta, bool allClasses)
+{
+  NvDsModuleMask source = table->all;
+  NvDsModuleMask classes = table->anyClass;
+  guint classId;
+
+  if (meta->sensorId >= 0 && (guint) meta->sensorId < table->bySource.size ())
+    source = table->bySource[meta->sensorId];
+  if (!source || allClasses)
+    return source;
+
+  switch (nvds_event_ext_kind (meta)) {
+    case NVDS_EVENT_EXT_FRAME: {
+      const NvDsFrameObjDescEvent *frame =
+          (const NvDsFrameObjDescEvent *) meta->extMsg;
+      guint count = MIN (frame->objCounts, MAX_OBJ_NUM);
+
+      for (guint i = 0; i < count && (source & ~classes); i++) {
+        classId = frame->objMetaList[i].classId;
+
+        if (classId < NVDS_MAX_ROUTED_CLASSES)
+          classes |= table->byClass[classId];
+      }
+      return source & classes;
+    }
+    case NVDS_EVENT_EXT_TRACK:
+      classId = ((const NvDsTrackEvent *) meta->extMsg)->classId;
+      break;
+    default:
+      classId = meta->objClassId;
+      break;
+  }
+  if (classId < NVDS_MAX_ROUTED_CLASSES)
+    classes |= table->byClass[classId];
+  return source & classes;
+}
@@ -0,0 +1,90 @@
+/*
+ * Copyright (c) 2018-2020, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA Corporation and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA Corporation is strictly prohibited.
+ *
+ */
+
+/**
+ * @file
+ * <b>Module routing</b>
+ *
+ * @b Description: Sends each event of the DeepStream schema only to the
+ * cloud analytics modules that need it. Module names are resolved once, at
+ * configuration time, into ids; which modules a source feeds and which
+ * modules need a class are kept as bitsets of those ids. Routing an event
+ * is then the intersection of its source's subscriptions with the modules
+ * of the classes it carries, without looking at any string.
+ *
+ * In multiple-payload mode the message of an event is handed out once per
+ * module it routes to, with the module's componentId, so a nvmsgbroker per
+ * module with that comp-id sends it to the module's topic. Events routed
+ * to no module produce no payload. nvds_msg2p_generate is not routed.
+ *
+ * Settings are read from the [modules] group of the converter's key-value
+ * configuration file:
+ *
+ *   enable=1
+ *   names=pet;fight             at most NVDS_MAX_MODULES modules
+ *   component-ids=11;12         componentId of each module's payloads,
+ *                               1, 2, ... by default
+ *   <name>-classes=N;N          classes the module needs, a module without
+ *                               classes takes every event of its sources
+ *   sensorN=pet;fight           modules source N feeds, sources without a
+ *                               key feed every module
+ *
+ * Frame events route by the classes of their objects, track events by the
+ * track's class and other events by objClassId. Heatmaps go to every module
+ * of their source.
+ */
+
+#ifndef NVMSGCONV_MODULES_H_
+#define NVMSGCONV_MODULES_H_
+
+#include "nvdsmeta_schema.h"
+#include <glib.h>
+#include <string>
+#include <vector>
+
+#define CONFIG_GROUP_MODULES "modules"
+
+#define NVDS_MAX_MODULES 64
+/* Classes at or above this only reach modules without classes. */
+#define NVDS_MAX_ROUTED_CLASSES 256
+
+typedef guint64 NvDsModuleMask;
+
+struct NvDsModule {
+  std::string name;
+  guint componentId;
+};
+
+struct NvDsModuleTable {
+  bool enable = false;
+  std::vector<NvDsModule> modules;
+  NvDsModuleMask all = 0;
+
+  /* Modules that take every event of their sources. */
+  NvDsModuleMask anyClass = 0;
+  /* Modules that need each class. */
+  NvDsModuleMask byClass[NVDS_MAX_ROUTED_CLASSES] = {};
+  /* Subscriptions by source id, sources past the end feed every module. */
+  std::vector<NvDsModuleMask> bySource;
+};
+
+/** Parses @group into @table. Returns false on invalid values. */
+bool nvds_modules_parse (NvDsModuleTable *table, GKeyFile *key_file,
+    const gchar *group);
+
+/**
+ * Returns the modules @meta should be sent to. With @allClasses the classes
+ * of the event are not looked at.
+ */
+NvDsModuleMask nvds_modules_route (const NvDsModuleTable *table,
+    const NvDsEventMsgMeta *meta, bool allClasses);
+
+#endif /* NVMSGCONV_MODULES_H_ */
@@ -0,0 +1,156 @@
+/*
+ * Copyright (c) 2018-2020, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA Corporation and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA Corporation is strictly prohibited.
+ *
+ */
+
+#include "nvmsgconv_results.h"
+#include <string.h>
+#include <new>
+#include <vector>
+
+#define CONFIG_KEY_CONTIGUOUS "contiguous"
+
+/* Blocks grow beyond this as needed. */
+#define INITIAL_BLOCK_SIZE (16 * 1024)
+
+#define ALIGN_UP(size) (((size) + 7) & ~(gsize) 7)
+
+struct NvDsResultBlock {
+  gsize allocSize;
+  std::atomic<guint> refs;
+};
+
+/* The header comes first, so the NvDsPayload handed out points here. */
+struct NvDsResultPayload {
+  NvDsPayload payload;
+  /* NULL if the payload owns its header. */
+  NvDsResultBlock *block;
+};
+
+static inline NvDsResultPayload *
+block_headers (gchar *block)
+{
+  return (NvDsResultPayload *) (block + ALIGN_UP (sizeof (NvDsResultBlock)));
+}
+
+NvDsResultPool::~NvDsResultPool ()
+{
+  g_free (spare.load ());
+}
+
+NvDsResultArena::~NvDsResultArena ()
+{
+  if (data)
+    g_string_free (data, TRUE);
+}
+
+bool
+nvds_results_parse (NvDsResultConfig *config, GKeyFile *key_file,
+    const gchar *group)
+{
+  config->contiguous = g_key_file_get_boolean (key_file, group,
+      CONFIG_KEY_CONTIGUOUS, NULL);
+  return true;
+}
+
+GString *
+nvds_results_begin (NvDsResultPool *pool, NvDsResultArena *arena,
+    guint maxCount)
+{
+  GString *data = arena->data;
+
+  if (!data)
+    data = arena->data = g_string_sized_new (INITIAL_BLOCK_SIZE);
+
+  /* The last buffer was handed over: reuse a released block or start a new
+   * one. The fields of a GString are public, its buffer a g_malloc one. */
+  if (!data->str) {
+    NvDsResultBlock *spare = (NvDsResultBlock *) pool->spare.exchange (nullptr);
+
+    if (spare) {
+      data->allocated_len = spare->allocSize;
+      data->str = (gchar *) spare;
+    } else {
+      data->allocated_len = INITIAL_BLOCK_SIZE;
+      data->str = (gchar *) g_malloc (INITIAL_BLOCK_SIZE);
+    }
+  }
+
+  g_string_set_size (data, ALIGN_UP (sizeof (NvDsResultBlock)) +
+      sizeof (NvDsResultPayload) * maxCount);
+  return data;
+}
+
+void
+nvds_results_finish (NvDsResultPool *pool, NvDsResultArena *arena,
+    const NvDsResultSpan *spans, guint count, NvDsPayload **payloads)
+{
+  GString *data = arena->data;
+  NvDsResultPayload *headers;
+  NvDsResultBlock *block;
+
+  if (!count) {
+    g_string_truncate (data, 0);
+    return;
+  }
+
+  block = new (data->str) NvDsResultBlock;
+  block->allocSize = data->allocated_len;
+  block->refs.store (count, std::memory_order_relaxed);
+  headers = block_headers (data->str);
+
+  for (guint i = 0; i < count; i++) {
+    NvDsResultPayload *header = &headers[i];
+
+    memset (header, 0, sizeof (*header));
+    header->block = block;
+    if (spans[i].size)
+      header->payload.payload = data->str + spans[i].offset;
+    header->payload.payloadSize = spans[i].size;
+    header->payload.componentId = spans[i].componentId;
+    payloads[i] = &header->payload;
+  }
+
+  data->str = NULL;
+  data->len = 0;
+  data->allocated_len = 0;
+}
+
+void
+nvds_results_build (NvDsResultPool *pool, NvDsResultArena *arena,
+    const NvDsResultMessage *messages, guint count, NvDsPayload **payloads)
+{
+  std::vector<NvDsResultSpan> spans (count);
+  GString *data = nvds_results_begin (pool, arena, count);
+
+  for (guint i = 0; i < count; i++) {
+    spans[i] = { data->len, messages[i].size, messages[i].componentId };
+    g_string_append_len (data, messages[i].data, messages[i].size);
+  }
+  nvds_results_finish (pool, arena, spans.data (), count, payloads);
+}
+
+NvDsPayload *
+nvds_results_build_empty ()
+{
+  return &g_new0 (NvDsResultPayload, 1)->payload;
+}
+
+void
+nvds_results_release (NvDsResultPool *pool, NvDsPayload *payload)
+{
+  NvDsResultBlock *block = ((NvDsResultPayload *) payload)->block;
+
+  if (!block) {
+    g_free (payload);
+    return;
+  }
+  if (block->refs.fetch_sub (1, std::memory_order_acq_rel) == 1)
+    g_free (pool->spare.exchange (block));
+}
@@ -0,0 +1,123 @@
+/*
+ * Copyright (c) 2018-2020, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA Corporation and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA Corporation is strictly prohibited.
+ *
+ */
+
+/**
+ * @file
+ * <b>Contiguous payload results</b>
+ *
+ * @b Description: By default every payload returned by the converter is a
+ * separately allocated header and body, and nvds_msg2p_generate_multiple
+ * adds a separately allocated pointer array. In contiguous mode the
+ * headers and the bodies of one call share a single block, so a call
+ * makes two allocations, the pointer array and the block, however many
+ * payloads it returns:
+ *
+ *   NvDsResultBlock      allocation size, payloads not yet released
+ *   NvDsResultPayload    headers[count]
+ *   bodies
+ *
+ * Messages are encoded straight into the block, which is a per-thread
+ * arena handed over once the call is done; payloads of modules sharing a
+ * message share its body. Only messages that outlive a call, i.e. those
+ * queued on priority lanes or lingering, are copied into the block.
+ *
+ * The pointer array is allocated on its own, so it may be freed with
+ * g_free() as soon as the payloads were taken out, as gst-nvmsgconv does.
+ * Each payload holds a reference to its block: the block is freed, or
+ * kept for the next result, when the last one is released with
+ * nvds_msg2p_release or nvds_msg2p_release_multiple, in any order and from
+ * any thread.
+ *
+ * Settings are read from the [payloads] group of the converter's key-value
+ * configuration file:
+ *
+ *   contiguous=1
+ */
+
+#ifndef NVMSGCONV_RESULTS_H_
+#define NVMSGCONV_RESULTS_H_
+
+#include "nvdsmeta_schema.h"
+#include <atomic>
+
+#define CONFIG_GROUP_PAYLOADS "payloads"
+
+struct NvDsResultConfig {
+  bool contiguous = false;
+};
+
+/* A message to hand out, the body is copied. */
+struct NvDsResultMessage {
+  const gchar *data;
+  guint size;
+  guint componentId;
+};
+
+/* A payload encoded into the arena, at @offset from its start. */
+struct NvDsResultSpan {
+  gsize offset;
+  guint size;
+  guint componentId;
+};
+
+struct NvDsResultPool {
+  NvDsResultConfig config;
+
+  /* One released block kept for reuse. */
+  std::atomic<gpointer> spare { nullptr };
+
+  NvDsResultPool () = default;
+  NvDsResultPool (const NvDsResultPool &) = delete;
+  NvDsResultPool &operator= (const NvDsResultPool &) = delete;
+  ~NvDsResultPool ();
+};
+
+/* The block being filled by a thread, its buffer becomes the next block. */
+struct NvDsResultArena {
+  GString *data = nullptr;
+
+  NvDsResultArena () = default;
+  NvDsResultArena (const NvDsResultArena &) = delete;
+  NvDsResultArena &operator= (const NvDsResultArena &) = delete;
+  ~NvDsResultArena ();
+};
+
+bool nvds_results_parse (NvDsResultConfig *config, GKeyFile *key_file,
+    const gchar *group);
+
+/**
+ * Starts a block with room for @maxCount payloads and returns the string
+ * to append their bodies to.
+ */
+GString *nvds_results_begin (NvDsResultPool *pool, NvDsResultArena *arena,
+    guint maxCount);
+
+/**
+ * Hands the block over as the @count payloads described by @spans, written
+ * to @payloads. With no payloads the arena is kept for the next call.
+ */
+void nvds_results_finish (NvDsResultPool *pool, NvDsResultArena *arena,
+    const NvDsResultSpan *spans, guint count, NvDsPayload **payloads);
+
+/** Builds a block holding copies of @count @messages into @payloads. */
+void nvds_results_build (NvDsResultPool *pool, NvDsResultArena *arena,
+    const NvDsResultMessage *messages, guint count, NvDsPayload **payloads);
+
+/** Returns a payload without a body, it owns its header. */
+NvDsPayload *nvds_results_build_empty ();
+
+/**
+ * Releases @payload's reference to its block, freeing or recycling the
+ * block with the last one.
+ */
+void nvds_results_release (NvDsResultPool *pool, NvDsPayload *payload);
+
+#endif /* NVMSGCONV_RESULTS_H_ */
@@ -0,0 +1,401 @@
+/*
+ * Copyright (c) 2018-2020, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA Corporation and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA Corporation is strictly prohibited.
+ *
+ */
+
+/**
+ * @file
+ * <b>Schema descriptors</b>
+ *
+ * @b Description: Compile-time descriptors of the schema structs, generated
+ * from the field lists of nvmsgconv_event_fields.h, and the encoders built
+ * on them. NvDsSchema<T>::visit() calls a visitor once per field with the
+ * field's kind as a tag type, its wire name and a reference to the member,
+ * so every encoder below is a set of overloads the compiler resolves and
+ * inlines per field; nothing is looked up at run time.
+ *
+ * The object extensions of the SDK (vehicle, person, face) are described
+ * too, by lists that only name their members in the order the minimal
+ * schema writes them.
+ */
+
+#ifndef NVMSGCONV_SCHEMA_H_
+#define NVMSGCONV_SCHEMA_H_
+
+#include <cstring>
+#include "nvmsgconv_event_fields.h"
+#include "nvmsgconv_json.h"
+
+#define NVDS_VEHICLE_OBJECT_FIELDS(X) \
+  X (STRING, gchar, type, 1, "type") \
+  X (STRING, gchar, make, 1, "make") \
+  X (STRING, gchar, model, 1, "model") \
+  X (STRING, gchar, color, 1, "color") \
+  X (STRING, gchar, license, 1, "license") \
+  X (STRING, gchar, region, 1, "licenseState")
+
+#define NVDS_PERSON_OBJECT_FIELDS(X) \
+  X (STRING, gchar, gender, 1, "gender") \
+  X (VALUE, guint, age, 1, "age") \
+  X (STRING, gchar, hair, 1, "hair") \
+  X (STRING, gchar, cap, 1, "cap") \
+  X (STRING, gchar, apparel, 1, "apparel")
+
+#define NVDS_FACE_OBJECT_FIELDS(X) \
+  X (STRING, gchar, gender, 1, "gender") \
+  X (VALUE, guint, age, 1, "age") \
+  X (STRING, gchar, hair, 1, "hair") \
+  X (STRING, gchar, cap, 1, "cap") \
+  X (STRING, gchar, glasses, 1, "glasses") \
+  X (STRING, gchar, facialhair, 1, "facialhair") \
+  X (STRING, gchar, name, 1, "name") \
+  X (STRING, gchar, eyecolor, 1, "eyecolor")
+
+enum NvDsFieldKind {
+  NVDS_FIELD_VALUE,
+  NVDS_FIELD_STRING,
+  NVDS_FIELD_CHARS,
+  NVDS_FIELD_ARRAY,
+};
+
+template <NvDsFieldKind K>
+struct NvDsFieldTag {};
+
+template <typename T>
+struct NvDsSchema;
+
+#define NVDS_SCHEMA_VISIT_FIELD(kind, type, name, dim, wire) \
+    visitor (NvDsFieldTag<NVDS_FIELD_##kind> (), wire, value.name);
+
+#define NVDS_SCHEMA_DESCRIBE(T, FIELDS) \
+  template <> \
+  struct NvDsSchema<T> { \
+    template <typename V> \
+    static inline void visit (const T &value, V &visitor) \
+    { \
+      FIELDS (NVDS_SCHEMA_VISIT_FIELD) \
+    } \
+  };
+
+NVDS_SCHEMA_DESCRIBE (NvDsSimpleObjectMeta, NVDS_SIMPLE_OBJECT_FIELDS)
+NVDS_SCHEMA_DESCRIBE (NvDsFrameObjDescEvent, NVDS_FRAME_EVENT_FIELDS)
+NVDS_SCHEMA_DESCRIBE (NvDsTrackPoint, NVDS_TRACK_POINT_FIELDS)
+NVDS_SCHEMA_DESCRIBE (NvDsTrackEvent, NVDS_TRACK_EVENT_FIELDS)
+NVDS_SCHEMA_DESCRIBE (NvDsVehicleObject, NVDS_VEHICLE_OBJECT_FIELDS)
+NVDS_SCHEMA_DESCRIBE (NvDsPersonObject, NVDS_PERSON_OBJECT_FIELDS)
+NVDS_SCHEMA_DESCRIBE (NvDsFaceObject, NVDS_FACE_OBJECT_FIELDS)
+
+/* JSON text of the values a VALUE field may hold. */
+static inline void
+nvds_schema_append_value (GString *out, gint value)
+{
+  nvds_json_append_int (out, value);
+}
+
+static inline void
+nvds_schema_append_value (GString *out, guint value)
+{
+  nvds_json_append_int (out, value);
+}
+
+static inline void
+nvds_schema_append_value (GString *out, gdouble value)
+{
+  nvds_json_append_number (out, value);
+}
+
+static inline void
+nvds_schema_append_value (GString *out, gfloat value)
+{
+  nvds_json_append_number (out, value);
+}
+
+static inline void
+nvds_schema_append_value (GString *out, NvDsObjectType value)
+{
+  nvds_json_append_int (out, value);
+}
+
+static inline void
+nvds_schema_append_value (GString *out, const NvDsRect &value)
+{
+  g_string_append_c (out, '[');
+  nvds_json_append_number (out, value.top);
+  g_string_append_c (out, ',');
+  nvds_json_append_number (out, value.left);
+  g_string_append_c (out, ',');
+  nvds_json_append_number (out, value.width);
+  g_string_append_c (out, ',');
+  nvds_json_append_number (out, value.height);
+  g_string_append_c (out, ']');
+}
+
+/* Upper bounds of the JSON text of the same values. */
+static inline gsize nvds_schema_value_size (gint) { return 11; }
+static inline gsize nvds_schema_value_size (guint) { return 10; }
+static inline gsize nvds_schema_value_size (gdouble) { return 24; }
+static inline gsize nvds_schema_value_size (gfloat) { return 24; }
+static inline gsize nvds_schema_value_size (NvDsObjectType) { return 11; }
+static inline gsize nvds_schema_value_size (const NvDsRect &)
+{
+  return 4 * 24 + 5;
+}
+
+/*
+ * Writes the fields with a wire name as members of the JSON object being
+ * written, after a comma unless @first. ARRAY fields are left to the
+ * caller, their layout is message specific.
+ */
+struct NvDsJsonMembers {
+  GString *out;
+  bool first;
+
+  void key (const gchar *wire)
+  {
+    if (!first)
+      g_string_append_c (out, ',');
+    first = false;
+    g_string_append_c (out, '"');
+    g_string_append (out, wire);
+    g_string_append (out, "\":");
+  }
+
+  template <typename F>
+  void operator() (NvDsFieldTag<NVDS_FIELD_VALUE>, const gchar *wire,
+      const F &value)
+  {
+    if (!wire)
+      return;
+    key (wire);
+    nvds_schema_append_value (out, value);
+  }
+
+  void operator() (NvDsFieldTag<NVDS_FIELD_STRING>, const gchar *wire,
+      const gchar *value)
+  {
+    if (!wire)
+      return;
+    key (wire);
+    nvds_json_append_string (out, value);
+  }
+
+  template <gsize N>
+  void operator() (NvDsFieldTag<NVDS_FIELD_CHARS>, const gchar *wire,
+      const gchar (&value)[N])
+  {
+    if (!wire)
+      return;
+    key (wire);
+    g_string_append_c (out, '"');
+    nvds_json_append_escaped (out, value, strnlen (value, N));
+    g_string_append_c (out, '"');
+  }
+
+  template <typename F>
+  void operator() (NvDsFieldTag<NVDS_FIELD_ARRAY>, const gchar *, const F &)
+  {
+  }
+};
+
+/* Writes the values of the fields with a wire name as a JSON array. */
+struct NvDsJsonTuple {
+  NvDsJsonMembers members;
+
+  void separate ()
+  {
+    if (!members.first)
+      g_string_append_c (members.out, ',');
+    members.first = false;
+  }
+
+  template <typename F>
+  void operator() (NvDsFieldTag<NVDS_FIELD_VALUE>, const gchar *wire,
+      const F &value)
+  {
+    if (!wire)
+      return;
+    separate ();
+    nvds_schema_append_value (members.out, value);
+  }
+
+  void operator() (NvDsFieldTag<NVDS_FIELD_STRING>, const gchar *wire,
+      const gchar *value)
+  {
+    if (!wire)
+      return;
+    separate ();
+    nvds_json_append_string (members.out, value);
+  }
+
+  template <gsize N>
+  void operator() (NvDsFieldTag<NVDS_FIELD_CHARS>, const gchar *wire,
+      const gchar (&value)[N])
+  {
+    if (!wire)
+      return;
+    separate ();
+    g_string_append_c (members.out, '"');
+    nvds_json_append_escaped (members.out, value, strnlen (value, N));
+    g_string_append_c (members.out, '"');
+  }
+
+  template <typename F>
+  void operator() (NvDsFieldTag<NVDS_FIELD_ARRAY>, const gchar *, const F &)
+  {
+  }
+};
+
+/*
+ * Adds up an upper bound of what NvDsJsonMembers writes, strings counted
+ * as if every byte needed a \u escape.
+ */
+struct NvDsJsonSize {
+  gsize size;
+
+  template <typename F>
+  void operator() (NvDsFieldTag<NVDS_FIELD_VALUE>, const gchar *wire,
+      const F &value)
+  {
+    if (wire)
+      size += strlen (wire) + 4 + nvds_schema_value_size (value);
+  }
+
+  void operator() (NvDsFieldTag<NVDS_FIELD_STRING>, const gchar *wire,
+      const gchar *value)
+  {
+    if (wire)
+      size += strlen (wire) + 4 + (value ? strlen (value) * 6 + 2 : 4);
+  }
+
+  template <gsize N>
+  void operator() (NvDsFieldTag<NVDS_FIELD_CHARS>, const gchar *wire,
+      const gchar (&value)[N])
+  {
+    if (wire)
+      size += strlen (wire) + 4 + strnlen (value, N) * 6 + 2;
+  }
+
+  template <typename F>
+  void operator() (NvDsFieldTag<NVDS_FIELD_ARRAY>, const gchar *, const F &)
+  {
+  }
+};
+
+/*
+ * Writes every field, wire name or not, as '|' and its value escaped for
+ * a JSON string: the attribute layout of the minimal schema. NULL strings
+ * are left empty.
+ */
+struct NvDsDelimited {
+  GString *out;
+
+  template <typename F>
+  void operator() (NvDsFieldTag<NVDS_FIELD_VALUE>, const gchar *,
+      const F &value)
+  {
+    g_string_append_c (out, '|');
+    nvds_schema_append_value (out, value);
+  }
+
+  /* Records keep the %g text of the original stringstream encoder. */
+  void operator() (NvDsFieldTag<NVDS_FIELD_VALUE>, const gchar *,
+      gdouble value)
+  {
+    g_string_append_c (out, '|');
+    nvds_json_append_double (out, value);
+  }
+
+  void operator() (NvDsFieldTag<NVDS_FIELD_VALUE>, const gchar *,
+      gfloat value)
+  {
+    g_string_append_c (out, '|');
+    nvds_json_append_double (out, value);
+  }
+
+  void operator() (NvDsFieldTag<NVDS_FIELD_STRING>, const gchar *,
+      const gchar *value)
+  {
+    g_string_append_c (out, '|');
+    if (value)
+      nvds_json_append_escaped (out, value, strlen (value));
+  }
+
+  template <gsize N>
+  void operator() (NvDsFieldTag<NVDS_FIELD_CHARS>, const gchar *,
+      const gchar (&value)[N])
+  {
+    g_string_append_c (out, '|');
+    nvds_json_append_escaped (out, value, strnlen (value, N));
+  }
+
+  template <typename F>
+  void operator() (NvDsFieldTag<NVDS_FIELD_ARRAY>, const gchar *, const F &)
+  {
+  }
+};
+
+/* Appends the members of @value with a wire name as a JSON object. */
+template <typename T>
+static inline void
+nvds_schema_append_object (GString *out, const T &value)
+{
+  NvDsJsonMembers members = { out, true };
+
+  g_string_append_c (out, '{');
+  NvDsSchema<T>::visit (value, members);
+  g_string_append_c (out, '}');
+}
+
+/*
+ * Appends the members of @value with a wire name to an object the caller
+ * has opened, after a comma unless @first.
+ */
+template <typename T>
+static inline void
+nvds_schema_append_members (GString *out, const T &value, bool first)
+{
+  NvDsJsonMembers members = { out, first };
+
+  NvDsSchema<T>::visit (value, members);
+}
+
+/* Appends the values of @value with a wire name as a JSON array. */
+template <typename T>
+static inline void
+nvds_schema_append_tuple (GString *out, const T &value)
+{
+  NvDsJsonTuple tuple = { { out, true } };
+
+  g_string_append_c (out, '[');
+  NvDsSchema<T>::visit (value, tuple);
+  g_string_append_c (out, ']');
+}
+
+/* Upper bound of the members nvds_schema_append_object() writes. */
+template <typename T>
+static inline gsize
+nvds_schema_estimate (const T &value)
+{
+  NvDsJsonSize size = { 2 };
+
+  NvDsSchema<T>::visit (value, size);
+  return size.size;
+}
+
+/* Appends every field of @value in the minimal schema's layout. */
+template <typename T>
+static inline void
+nvds_schema_append_delimited (GString *out, const T &value)
+{
+  NvDsDelimited delimited = { out };
+
+  NvDsSchema<T>::visit (value, delimited);
+}
+
+#endif /* NVMSGCONV_SCHEMA_H_ */
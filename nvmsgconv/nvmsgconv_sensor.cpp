@@ -0,0 +1,346 @@
+/*
+ * Copyright (c) 2018-2020, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA Corporation and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA Corporation is strictly prohibited.
+ *
+ */
+
+#include "nvmsgconv_sensor.h"
+#include "nvmsgconv_json.h"
+#include "nvmsgconv_snapshot.h"
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+#define CSV_FIELD_ID 1
+#define CSV_FIELD_DESCRIPTION 2
+#define CSV_SENSOR_TYPE "Camera"
+/* Files smaller than this per thread are not worth splitting. */
+#define CSV_MIN_CHUNK_SIZE (1024 * 1024)
+
+/* Catalogs in use, by the identity of the file they were loaded from. */
+static mutex catalogsLock;
+static map<string, weak_ptr<const NvDsSensorCatalog>> catalogs;
+
+struct CsvChunk {
+  const char *begin;
+  const char *end;
+  vector<NvDsSensorObject> rows;
+  /* First malformed row, with the reason. */
+  const char *errorAt = nullptr;
+  const char *error = nullptr;
+};
+
+static inline bool
+is_blank (char c)
+{
+  return c == ' ' || c == '\t' || c == '\r';
+}
+
+/*
+ * Parses the field starting at @p, stopping at the next separator or
+ * @end, and leaves @p on the separator. Stores the field in @out if set.
+ * Returns the reason if the field is malformed.
+ */
+static const char *
+parse_field (const char *&p, const char *end, string *out)
+{
+  while (p < end && is_blank (*p))
+    p++;
+
+  if (p < end && *p == '"') {
+    const char *start = ++p;
+    bool escaped = false;
+
+    for (;;) {
+      const char *quote = (const char *) memchr (p, '"', end - p);
+      if (!quote)
+        return "unterminated quoted field";
+      p = quote + 1;
+      if (p < end && *p == '"') {
+        escaped = true;
+        p++;
+        continue;
+      }
+      if (out) {
+        out->assign (start, quote - start);
+        if (escaped) {
+          /* Collapse the doubled quotes. */
+          size_t j = 0;
+          for (size_t i = 0; i < out->size (); i++, j++) {
+            (*out)[j] = (*out)[i];
+            if ((*out)[i] == '"')
+              i++;
+          }
+          out->resize (j);
+        }
+      }
+      break;
+    }
+    while (p < end && is_blank (*p))
+      p++;
+    if (p < end && *p != ',')
+      return "unexpected character after quoted field";
+    return nullptr;
+  }
+
+  const char *start = p;
+  const char *comma = (const char *) memchr (p, ',', end - p);
+  const char *last = comma ? comma : end;
+
+  p = last;
+  while (last > start && is_blank (last[-1]))
+    last--;
+  if (out)
+    out->assign (start, last - start);
+  return nullptr;
+}
+
+static void
+parse_chunk (CsvChunk *chunk)
+{
+  const char *p = chunk->begin;
+
+  while (p < chunk->end) {
+    const char *newline = (const char *) memchr (p, '\n', chunk->end - p);
+    const char *lineEnd = newline ? newline : chunk->end;
+    const char *lineStart = p;
+    NvDsSensorObject sensor;
+    guint field = 0;
+
+    while (p < lineEnd && is_blank (*p))
+      p++;
+    if (p == lineEnd) {
+      p = lineEnd + 1;
+      continue;
+    }
+
+    p = lineStart;
+    for (;;) {
+      string *out = NULL;
+      const char *error;
+
+      if (field == CSV_FIELD_ID)
+        out = &sensor.id;
+      else if (field == CSV_FIELD_DESCRIPTION)
+        out = &sensor.desc;
+      error = parse_field (p, lineEnd, out);
+      if (error) {
+        chunk->errorAt = lineStart;
+        chunk->error = error;
+        return;
+      }
+      field++;
+      if (p == lineEnd)
+        break;
+      p++;
+    }
+
+    if (field <= CSV_FIELD_DESCRIPTION) {
+      chunk->errorAt = lineStart;
+      chunk->error = "too few fields";
+      return;
+    }
+    sensor.type = CSV_SENSOR_TYPE;
+    nvds_sensor_object_build_json (sensor);
+    chunk->rows.push_back (std::move (sensor));
+    p = lineEnd + 1;
+  }
+}
+
+void
+nvds_sensor_object_build_json (NvDsSensorObject &sensor)
+{
+  GString *json = g_string_sized_new (sensor.id.size () + sensor.type.size ()
+      + sensor.desc.size () + 48);
+
+  g_string_append (json, "{\"id\":\"");
+  nvds_json_append_escaped (json, sensor.id.data (), sensor.id.size ());
+  g_string_append (json, "\",\"type\":\"");
+  nvds_json_append_escaped (json, sensor.type.data (), sensor.type.size ());
+  g_string_append (json, "\",\"description\":\"");
+  nvds_json_append_escaped (json, sensor.desc.data (), sensor.desc.size ());
+  g_string_append (json, "\"}");
+  sensor.json.assign (json->str, json->len);
+  g_string_free (json, TRUE);
+}
+
+NvDsSensorCatalog::~NvDsSensorCatalog ()
+{
+  if (snapshot)
+    munmap ((void *) snapshot, snapshotSize);
+}
+
+bool
+nvds_sensor_catalog_find (const NvDsSensorCatalog &catalog, gint sensorId,
+    NvDsSensorView &view)
+{
+  if (catalog.snapshot &&
+      nvds_sensor_snapshot_find (catalog.snapshot, sensorId, view))
+    return true;
+
+  auto it = catalog.sensors.find (sensorId);
+  if (it == catalog.sensors.end ())
+    return false;
+
+  view.id = it->second.id.c_str ();
+  view.type = it->second.type.c_str ();
+  view.desc = it->second.desc.c_str ();
+  view.json = it->second.json.c_str ();
+  view.jsonLen = it->second.json.size ();
+  return true;
+}
+
+/* Identifies @file by inode and modification, so a rewritten file is
+ * loaded again. */
+static bool
+catalog_key (const gchar *file, string &key)
+{
+  struct stat st;
+  gchar *str;
+
+  if (stat (file, &st) < 0)
+    return false;
+
+  str = g_strdup_printf ("%" G_GUINT64_FORMAT ":%" G_GUINT64_FORMAT ":%"
+      G_GINT64_FORMAT ":%" G_GINT64_FORMAT ".%09ld", (guint64) st.st_dev,
+      (guint64) st.st_ino, (gint64) st.st_size, (gint64) st.st_mtim.tv_sec,
+      st.st_mtim.tv_nsec);
+  key = str;
+  g_free (str);
+  return true;
+}
+
+NvDsSharedCatalog
+nvds_sensor_catalog_acquire (const gchar *file,
+    const function<bool (NvDsSensorCatalog &)> &load)
+{
+  shared_ptr<NvDsSensorCatalog> catalog;
+  string key;
+
+  // Without a key the load fails or reports why, there is nothing to share.
+  if (!catalog_key (file, key)) {
+    catalog = make_shared<NvDsSensorCatalog> ();
+    return load (*catalog) ? catalog : nullptr;
+  }
+
+  lock_guard<mutex> guard (catalogsLock);
+
+  for (auto it = catalogs.begin (); it != catalogs.end ();) {
+    if (it->second.expired ())
+      it = catalogs.erase (it);
+    else
+      ++it;
+  }
+
+  auto it = catalogs.find (key);
+  if (it != catalogs.end ()) {
+    NvDsSharedCatalog shared = it->second.lock ();
+    if (shared)
+      return shared;
+  }
+
+  catalog = make_shared<NvDsSensorCatalog> ();
+  if (!load (*catalog))
+    return nullptr;
+  catalogs[key] = catalog;
+  return catalog;
+}
+
+/* Returns the start of the line following the one containing @p. */
+static const char *
+next_line (const char *p, const char *end)
+{
+  const char *newline = (const char *) memchr (p, '\n', end - p);
+  return newline ? newline + 1 : end;
+}
+
+bool
+nvds_msg2p_load_sensor_csv (const gchar *file, NvDsSensorMap &sensors)
+{
+  struct stat st;
+  const char *data = NULL;
+  const char *end = NULL;
+  vector<CsvChunk> chunks;
+  vector<thread> workers;
+  size_t numChunks, total = 0;
+  bool ret = true;
+  gint index = 0;
+  int fd;
+
+  fd = open (file, O_RDONLY | O_CLOEXEC);
+  if (fd < 0 || fstat (fd, &st) < 0) {
+    cout << "Couldn't open CSV file " << file << endl;
+    if (fd >= 0)
+      close (fd);
+    return false;
+  }
+  if (st.st_size == 0) {
+    close (fd);
+    return true;
+  }
+
+  data = (const char *) mmap (NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close (fd);
+  if (data == MAP_FAILED) {
+    cout << "Couldn't map CSV file " << file << endl;
+    return false;
+  }
+  madvise ((void *) data, st.st_size, MADV_SEQUENTIAL);
+  end = data + st.st_size;
+
+  /* Split after the header row, on line boundaries. */
+  numChunks = MAX (1u, MIN ((size_t) thread::hardware_concurrency (),
+          (size_t) st.st_size / CSV_MIN_CHUNK_SIZE));
+  chunks.resize (numChunks);
+  chunks[0].begin = next_line (data, end);
+  for (size_t i = 1; i < numChunks; i++) {
+    const char *split = data + st.st_size / numChunks * i;
+    chunks[i].begin = MAX (next_line (split, end), chunks[i - 1].begin);
+    chunks[i - 1].end = chunks[i].begin;
+  }
+  chunks[numChunks - 1].end = end;
+
+  for (size_t i = 1; i < numChunks; i++)
+    workers.emplace_back (parse_chunk, &chunks[i]);
+  parse_chunk (&chunks[0]);
+  for (thread &worker : workers)
+    worker.join ();
+
+  for (CsvChunk &chunk : chunks) {
+    if (chunk.error) {
+      /* Only count lines for the report, the happy path doesn't need
+       * them. */
+      size_t line = 1 + count (data, chunk.errorAt, '\n');
+      cout << file << ":" << line << ": " << chunk.error << endl;
+      ret = false;
+      break;
+    }
+    total += chunk.rows.size ();
+  }
+
+  if (ret) {
+    sensors.reserve (sensors.size () + total);
+    for (CsvChunk &chunk : chunks) {
+      for (NvDsSensorObject &sensor : chunk.rows)
+        sensors.emplace (index++, std::move (sensor));
+    }
+  }
+
+  munmap ((void *) data, st.st_size);
+  return ret;
+}
@@ -0,0 +1,100 @@
+/*
+ * Copyright (c) 2018-2020, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA Corporation and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA Corporation is strictly prohibited.
+ *
+ */
+
+/**
+ * @file
+ * <b>Sensor catalog</b>
+ *
+ * @b Description: Static sensor properties the converter adds to every
+ * payload, keyed by sensor id, and the loader for CSV catalogs.
+ *
+ * A catalog doesn't change once loaded. Contexts created from the same
+ * unchanged configuration file share one catalog, whatever their payload
+ * type, so pipelines in one process don't each keep a copy.
+ */
+
+#ifndef NVMSGCONV_SENSOR_H_
+#define NVMSGCONV_SENSOR_H_
+
+#include <glib.h>
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+struct NvDsSensorObject {
+  std::string id;
+  std::string type;
+  std::string desc;
+  /** The sensor as an escaped JSON object, see nvds_sensor_object_build_json. */
+  std::string json;
+};
+
+typedef std::unordered_map<int, NvDsSensorObject> NvDsSensorMap;
+
+/**
+ * Borrowed view of a catalog entry, valid as long as the catalog. The
+ * strings are NUL terminated.
+ */
+struct NvDsSensorView {
+  const char *id;
+  const char *type;
+  const char *desc;
+  /** {"id":..,"type":..,"description":..} with the values escaped, for
+   * encoders that write JSON text directly. */
+  const char *json;
+  size_t jsonLen;
+};
+
+/**
+ * Sensors known to a converter context. Entries come from a mapped
+ * snapshot (see nvmsgconv_snapshot.h), from parsed configuration, or both;
+ * the snapshot wins when a sensor is in both.
+ */
+struct NvDsSensorCatalog {
+  NvDsSensorMap sensors;
+  const guint8 *snapshot = nullptr;
+  size_t snapshotSize = 0;
+
+  NvDsSensorCatalog () = default;
+  NvDsSensorCatalog (const NvDsSensorCatalog &) = delete;
+  NvDsSensorCatalog &operator= (const NvDsSensorCatalog &) = delete;
+  ~NvDsSensorCatalog ();
+};
+
+/** Fills in @sensor's json from its other fields. */
+void nvds_sensor_object_build_json (NvDsSensorObject &sensor);
+
+bool nvds_sensor_catalog_find (const NvDsSensorCatalog &catalog,
+    gint sensorId, NvDsSensorView &view);
+
+typedef std::shared_ptr<const NvDsSensorCatalog> NvDsSharedCatalog;
+
+/**
+ * Returns the catalog of configuration @file, shared with every context
+ * still holding it if the file is unchanged since, or else a new one
+ * filled in by @load. Returns null if @load fails. Catalogs are created
+ * one at a time, so a file is loaded once even by concurrent callers.
+ */
+NvDsSharedCatalog nvds_sensor_catalog_acquire (const gchar *file,
+    const std::function<bool (NvDsSensorCatalog &)> &load);
+
+/**
+ * Loads the CSV catalog @file into @sensors. The first row is a header,
+ * every other non-blank row describes the sensor whose id is the row's
+ * index: the second field is the sensor's id string and the third its
+ * description. Fields may be quoted, with "" standing for a quote, but may
+ * not span lines. Large files are parsed in parallel. Errors are reported
+ * with their line number and fail the whole load.
+ */
+bool nvds_msg2p_load_sensor_csv (const gchar *file, NvDsSensorMap &sensors);
+
+#endif /* NVMSGCONV_SENSOR_H_ */
@@ -0,0 +1,176 @@
+/*
+ * Copyright (c) 2018-2020, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA Corporation and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA Corporation is strictly prohibited.
+ *
+ */
+
+#include "nvmsgconv_shed.h"
+#include "nvmsgconv_log.h"
+#include <iostream>
+
+using namespace std;
+
+#define CONFIG_KEY_ENABLE "enable"
+#define CONFIG_KEY_MAX_OUTSTANDING_BYTES "max-outstanding-bytes"
+#define CONFIG_KEY_MAX_OUTSTANDING_PAYLOADS "max-outstanding-payloads"
+#define CONFIG_KEY_THRESHOLDS "thresholds"
+#define CONFIG_KEY_HYSTERESIS "hysteresis"
+#define CONFIG_KEY_RECOVER_MS "recover-ms"
+#define CONFIG_KEY_MAX_OBJECTS "max-objects"
+#define CONFIG_KEY_SAMPLE_INTERVAL "sample-interval"
+
+static const gchar *stageNames[NVDS_SHED_STAGE_COUNT] = {
+  "none", "minimal", "truncate", "sample", "drop"
+};
+
+bool
+nvds_load_shed_parse (NvDsLoadShedConfig *config, GKeyFile *key_file,
+    const gchar *group)
+{
+  GError *error = NULL;
+  gdouble *thresholds = NULL;
+  gsize length = 0;
+  gint64 ival;
+  gsize i;
+
+  config->enable = g_key_file_get_boolean (key_file, group, CONFIG_KEY_ENABLE,
+      NULL);
+
+  ival = g_key_file_get_int64 (key_file, group,
+      CONFIG_KEY_MAX_OUTSTANDING_BYTES, &error);
+  if (!error)
+    config->maxOutstandingBytes = MAX (ival, 0);
+  g_clear_error (&error);
+
+  ival = g_key_file_get_int64 (key_file, group,
+      CONFIG_KEY_MAX_OUTSTANDING_PAYLOADS, &error);
+  if (!error)
+    config->maxOutstandingPayloads = MAX (ival, 0);
+  g_clear_error (&error);
+
+  ival = g_key_file_get_int64 (key_file, group, CONFIG_KEY_RECOVER_MS, &error);
+  if (!error)
+    config->recoverUs = MAX (ival, 0) * 1000;
+  g_clear_error (&error);
+
+  ival = g_key_file_get_int64 (key_file, group, CONFIG_KEY_MAX_OBJECTS, &error);
+  if (!error)
+    config->maxObjects = MAX (ival, 1);
+  g_clear_error (&error);
+
+  ival = g_key_file_get_int64 (key_file, group, CONFIG_KEY_SAMPLE_INTERVAL,
+      &error);
+  if (!error)
+    config->sampleInterval = MAX (ival, 1);
+  g_clear_error (&error);
+
+  config->hysteresis = g_key_file_get_double (key_file, group,
+      CONFIG_KEY_HYSTERESIS, &error);
+  if (error)
+    config->hysteresis = NvDsLoadShedConfig ().hysteresis;
+  g_clear_error (&error);
+
+  thresholds = g_key_file_get_double_list (key_file, group,
+      CONFIG_KEY_THRESHOLDS, &length, &error);
+  if (!error) {
+    if (length != NVDS_SHED_STAGE_COUNT - 1) {
+      cout << "Expected " << NVDS_SHED_STAGE_COUNT - 1 << " "
+          CONFIG_KEY_THRESHOLDS " in [" << group << "]" << endl;
+      g_free (thresholds);
+      return false;
+    }
+    for (i = 0; i < length; i++) {
+      if (i > 0 && thresholds[i] < thresholds[i - 1]) {
+        cout << CONFIG_KEY_THRESHOLDS " in [" << group
+            << "] must be increasing" << endl;
+        g_free (thresholds);
+        return false;
+      }
+      config->thresholds[i] = thresholds[i];
+    }
+    g_free (thresholds);
+  }
+  g_clear_error (&error);
+
+  return true;
+}
+
+static gdouble
+current_pressure (NvDsLoadShedder *shedder, const NvDsShedBacklog *backlog,
+    guint queueFillPercent)
+{
+  const NvDsLoadShedConfig &config = shedder->config;
+  gdouble pressure = queueFillPercent / 100.0;
+
+  if (config.maxOutstandingBytes) {
+    pressure = MAX (pressure, (gdouble) backlog->outstandingBytes.load (
+            memory_order_relaxed) / config.maxOutstandingBytes);
+  }
+  if (config.maxOutstandingPayloads) {
+    pressure = MAX (pressure, (gdouble) backlog->outstandingPayloads.load (
+            memory_order_relaxed) / config.maxOutstandingPayloads);
+  }
+  return pressure;
+}
+
+NvDsShedStage
+nvds_load_shed_update (NvDsLoadShedder *shedder,
+    const NvDsShedBacklog *backlog, guint queueFillPercent)
+{
+  const NvDsLoadShedConfig &config = shedder->config;
+  gdouble pressure;
+  gint64 now;
+  guint target = NVDS_SHED_NONE;
+  NvDsShedStage previous = shedder->stage;
+
+  if (!config.enable)
+    return NVDS_SHED_NONE;
+
+  pressure = current_pressure (shedder, backlog, queueFillPercent);
+  while (target < NVDS_SHED_STAGE_COUNT - 1 &&
+      pressure >= config.thresholds[target])
+    target++;
+
+  now = g_get_monotonic_time ();
+  if (target > shedder->stage) {
+    shedder->stage = (NvDsShedStage) target;
+  } else if (shedder->stage > NVDS_SHED_NONE &&
+      pressure < config.thresholds[shedder->stage - 1] - config.hysteresis &&
+      now - shedder->stageSinceUs >= config.recoverUs) {
+    shedder->stage = (NvDsShedStage) (shedder->stage - 1);
+  }
+
+  if (shedder->stage != previous) {
+    shedder->stageSinceUs = now;
+    NVDS_MSG2P_LOG (shedder->stage, "Load shedding %s -> %s (pressure %.2f), "
+        "so far minimal %" G_GUINT64_FORMAT ", truncated %" G_GUINT64_FORMAT
+        ", sampled out %" G_GUINT64_FORMAT ", dropped %" G_GUINT64_FORMAT,
+        stageNames[previous], stageNames[shedder->stage],
+        pressure, shedder->shed[NVDS_SHED_MINIMAL],
+        shedder->shed[NVDS_SHED_TRUNCATE], shedder->shed[NVDS_SHED_SAMPLE],
+        shedder->shed[NVDS_SHED_DROP]);
+  }
+  return shedder->stage;
+}
+
+bool
+nvds_load_shed_sample (NvDsLoadShedder *shedder, gint sensorId)
+{
+  return shedder->sampleCounters[sensorId]++ %
+      shedder->config.sampleInterval == 0;
+}
+
+void
+nvds_load_shed_account (NvDsShedBacklog *backlog, gsize size, bool generated)
+{
+  gint64 sign = generated ? 1 : -1;
+
+  backlog->outstandingBytes.fetch_add (sign * (gint64) size,
+      memory_order_relaxed);
+  backlog->outstandingPayloads.fetch_add (sign, memory_order_relaxed);
+}
@@ -0,0 +1,119 @@
+/*
+ * Copyright (c) 2018-2020, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA Corporation and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA Corporation is strictly prohibited.
+ *
+ */
+
+/**
+ * @file
+ * <b>Message converter load shedding</b>
+ *
+ * @b Description: Degrades the generated payloads when the path to the
+ * broker falls behind, instead of letting the backlog grow without bound.
+ * Pressure is the larger of the payload bytes or payloads generated but
+ * not yet released, relative to their configured limits, and the fill
+ * level of the queue in front of the converter reported by the
+ * application in each event. Stages, entered as pressure crosses their
+ * threshold:
+ *
+ *   minimal   frame events in the minimal schema: a pipe-delimited record
+ *             per object, the sensor id without type and description
+ *   truncate  only the max-objects most confident objects per message
+ *   sample    only one message in sample-interval per sensor
+ *   drop      no messages, losses are counted
+ *
+ * Later stages keep the minimal schema. Track and heatmap messages are
+ * never degraded.
+ *
+ * Stages are entered immediately and left one at a time, once pressure is
+ * below the threshold of the current stage by the hysteresis margin and
+ * the stage has lasted at least recover-ms.
+ *
+ * Settings are read from the [load-shedding] group of the converter's
+ * key-value configuration file:
+ *
+ *   enable=1
+ *   max-outstanding-bytes=N     (0 ignores bytes)
+ *   max-outstanding-payloads=N  (0 ignores payloads)
+ *   thresholds=F;F;F;F          pressure entering each stage
+ *   hysteresis=F
+ *   recover-ms=N
+ *   max-objects=N
+ *   sample-interval=N
+ */
+
+#ifndef NVMSGCONV_SHED_H_
+#define NVMSGCONV_SHED_H_
+
+#include <glib.h>
+#include <atomic>
+#include <unordered_map>
+
+#define CONFIG_GROUP_LOAD_SHEDDING "load-shedding"
+
+enum NvDsShedStage {
+  NVDS_SHED_NONE,
+  NVDS_SHED_MINIMAL,
+  NVDS_SHED_TRUNCATE,
+  NVDS_SHED_SAMPLE,
+  NVDS_SHED_DROP,
+  NVDS_SHED_STAGE_COUNT
+};
+
+struct NvDsLoadShedConfig {
+  bool enable = false;
+  guint64 maxOutstandingBytes = 16 * 1024 * 1024;
+  guint64 maxOutstandingPayloads = 1024;
+  gdouble thresholds[NVDS_SHED_STAGE_COUNT - 1] = { 0.5, 0.7, 0.85, 1.0 };
+  gdouble hysteresis = 0.1;
+  gint64 recoverUs = 2 * G_USEC_PER_SEC;
+  guint maxObjects = 16;
+  guint sampleInterval = 4;
+};
+
+/*
+ * Payloads generated but not yet released. Updated on generate and release,
+ * which may run on different threads.
+ */
+struct NvDsShedBacklog {
+  std::atomic<gint64> outstandingBytes { 0 };
+  std::atomic<gint64> outstandingPayloads { 0 };
+};
+
+struct NvDsLoadShedder {
+  NvDsLoadShedConfig config;
+
+  NvDsShedStage stage = NVDS_SHED_NONE;
+  gint64 stageSinceUs = 0;
+  std::unordered_map<gint, guint64> sampleCounters;
+  /* Messages degraded or lost in each stage. */
+  guint64 shed[NVDS_SHED_STAGE_COUNT] = { 0 };
+};
+
+/** Parses @group into @config. Returns false on invalid values. */
+bool nvds_load_shed_parse (NvDsLoadShedConfig *config, GKeyFile *key_file,
+    const gchar *group);
+
+/**
+ * Recomputes the stage from the outstanding payloads of @backlog and
+ * @queueFillPercent and returns it.
+ */
+NvDsShedStage nvds_load_shed_update (NvDsLoadShedder *shedder,
+    const NvDsShedBacklog *backlog, guint queueFillPercent);
+
+/**
+ * In the sample stage, returns whether the message of @sensorId is one of
+ * those kept.
+ */
+bool nvds_load_shed_sample (NvDsLoadShedder *shedder, gint sensorId);
+
+/** Accounts for a payload of @size bytes being generated or released. */
+void nvds_load_shed_account (NvDsShedBacklog *backlog, gsize size,
+    bool generated);
+
+#endif /* NVMSGCONV_SHED_H_ */
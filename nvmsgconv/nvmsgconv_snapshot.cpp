@@ -0,0 +1,274 @@
+/*
+ * Copyright (c) 2018-2020, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA Corporation and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA Corporation is strictly prohibited.
+ *
+ */
+
+#include "nvmsgconv_snapshot.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+using namespace std;
+
+/* Sparse ids are stored densely, refuse catalogs that would mostly be
+ * holes. */
+#define MAX_INDEX_OVERHEAD 16
+#define MIN_INDEX_SIZE 65536
+
+static guint64
+snapshot_checksum (const guint8 *data, size_t size)
+{
+  guint64 lanes[4] = { 0xcbf29ce484222325ULL, 0x84222325cbf29ce4ULL,
+    0x9ce484222325cbf2ULL, 0x2325cbf29ce48422ULL };
+  guint64 hash = 0;
+  size_t i = 0;
+
+  /* FNV-1a over 64-bit words, only meant to catch torn or damaged files.
+   * Four independent lanes keep the multiplies from serializing, this runs
+   * on every startup. */
+  for (; i + sizeof (lanes) <= size; i += sizeof (lanes)) {
+    for (guint lane = 0; lane < 4; lane++) {
+      guint64 word;
+      memcpy (&word, data + i + lane * sizeof (word), sizeof (word));
+      lanes[lane] = (lanes[lane] ^ word) * 0x100000001b3ULL;
+    }
+  }
+  for (; i < size; i++)
+    lanes[0] = (lanes[0] ^ data[i]) * 0x100000001b3ULL;
+  for (guint lane = 0; lane < 4; lane++)
+    hash = (hash ^ lanes[lane]) * 0x100000001b3ULL;
+  return hash;
+}
+
+static NvDsSnapshotString
+add_string (string &strings, const string &value)
+{
+  NvDsSnapshotString ref = { (guint32) strings.size (),
+    (guint32) value.size () };
+
+  strings += value;
+  strings += '\0';
+  return ref;
+}
+
+static bool
+write_all (int fd, const void *data, size_t size)
+{
+  const guint8 *p = (const guint8 *) data;
+
+  while (size) {
+    ssize_t written = write (fd, p, size);
+    if (written < 0)
+      return false;
+    p += written;
+    size -= written;
+  }
+  return true;
+}
+
+bool
+nvds_sensor_snapshot_write (const NvDsSensorMap &sensors, const gchar *file)
+{
+  NvDsSnapshotHeader header;
+  vector<gint> ids;
+  vector<guint32> index;
+  vector<NvDsSnapshotRecord> records;
+  string strings, body;
+  gchar *tmpFile = NULL;
+  bool ret = false;
+  int fd;
+
+  for (const auto &it : sensors)
+    ids.push_back (it.first);
+  sort (ids.begin (), ids.end ());
+
+  memset (&header, 0, sizeof (header));
+  memcpy (header.magic, NVDS_SNAPSHOT_MAGIC, sizeof (header.magic));
+  header.version = NVDS_SNAPSHOT_VERSION;
+  header.headerSize = sizeof (header);
+  header.numSensors = ids.size ();
+
+  if (!ids.empty ()) {
+    gint64 span = (gint64) ids.back () - ids.front () + 1;
+
+    if (span > (gint64) MAX (ids.size () * MAX_INDEX_OVERHEAD,
+            MIN_INDEX_SIZE)) {
+      cout << "Sensor ids " << ids.front () << ".." << ids.back ()
+          << " are too sparse for a snapshot" << endl;
+      return false;
+    }
+    header.minSensorId = ids.front ();
+    header.indexSize = span;
+  }
+
+  index.assign (header.indexSize, NVDS_SNAPSHOT_NO_SENSOR);
+  for (gint id : ids) {
+    const NvDsSensorObject &sensor = sensors.at (id);
+    NvDsSnapshotRecord record;
+
+    index[id - header.minSensorId] = records.size ();
+    record.id = add_string (strings, sensor.id);
+    record.type = add_string (strings, sensor.type);
+    record.desc = add_string (strings, sensor.desc);
+    record.json = add_string (strings, sensor.json);
+    records.push_back (record);
+  }
+  if (strings.size () > G_MAXUINT32) {
+    cout << "Sensor catalog is too large for a snapshot" << endl;
+    return false;
+  }
+
+  header.indexOffset = sizeof (header);
+  header.recordsOffset = header.indexOffset + index.size () * sizeof (guint32);
+  header.stringsOffset = header.recordsOffset +
+      records.size () * sizeof (NvDsSnapshotRecord);
+  header.stringsSize = strings.size ();
+  header.fileSize = header.stringsOffset + header.stringsSize;
+
+  body.reserve (header.fileSize - sizeof (header));
+  body.append ((const char *) index.data (), index.size () * sizeof (guint32));
+  body.append ((const char *) records.data (),
+      records.size () * sizeof (NvDsSnapshotRecord));
+  body += strings;
+  header.checksum = snapshot_checksum ((const guint8 *) body.data (),
+      body.size ());
+
+  tmpFile = g_strdup_printf ("%s.XXXXXX", file);
+  fd = mkstemp (tmpFile);
+  if (fd < 0) {
+    cout << "Couldn't create " << tmpFile << ": " << strerror (errno) << endl;
+    g_free (tmpFile);
+    return false;
+  }
+
+  if (!write_all (fd, &header, sizeof (header)) ||
+      !write_all (fd, body.data (), body.size ()) || fsync (fd) < 0) {
+    cout << "Couldn't write " << tmpFile << ": " << strerror (errno) << endl;
+  } else if (fchmod (fd, 0644) < 0 || rename (tmpFile, file) < 0) {
+    cout << "Couldn't replace " << file << ": " << strerror (errno) << endl;
+  } else {
+    ret = true;
+  }
+
+  close (fd);
+  if (!ret)
+    unlink (tmpFile);
+  g_free (tmpFile);
+  return ret;
+}
+
+static bool
+snapshot_valid (const guint8 *data, size_t size)
+{
+  const NvDsSnapshotHeader *header = (const NvDsSnapshotHeader *) data;
+  const NvDsSnapshotRecord *records;
+  const guint32 *index;
+
+  if (size < sizeof (*header) ||
+      memcmp (header->magic, NVDS_SNAPSHOT_MAGIC, sizeof (header->magic)))
+    return false;
+  if (header->version != NVDS_SNAPSHOT_VERSION ||
+      header->headerSize != sizeof (*header) || header->fileSize != size)
+    return false;
+  if (header->indexOffset != sizeof (*header) ||
+      header->recordsOffset != header->indexOffset +
+      (guint64) header->indexSize * sizeof (guint32) ||
+      header->stringsOffset != header->recordsOffset +
+      (guint64) header->numSensors * sizeof (NvDsSnapshotRecord) ||
+      header->stringsOffset + header->stringsSize != size)
+    return false;
+  if (snapshot_checksum (data + sizeof (*header), size - sizeof (*header)) !=
+      header->checksum)
+    return false;
+
+  /* The checksum only catches damage, still make sure lookups stay inside
+   * the file whatever wrote it. */
+  records = (const NvDsSnapshotRecord *) (data + header->recordsOffset);
+  for (guint32 i = 0; i < header->numSensors; i++) {
+    for (const NvDsSnapshotString *str : { &records[i].id, &records[i].type,
+            &records[i].desc, &records[i].json }) {
+      if ((guint64) str->offset + str->length >= header->stringsSize ||
+          data[header->stringsOffset + str->offset + str->length] != '\0')
+        return false;
+    }
+  }
+  index = (const guint32 *) (data + header->indexOffset);
+  for (guint32 i = 0; i < header->indexSize; i++) {
+    if (index[i] != NVDS_SNAPSHOT_NO_SENSOR && index[i] >= header->numSensors)
+      return false;
+  }
+  return true;
+}
+
+bool
+nvds_sensor_snapshot_map (const gchar *file, NvDsSensorCatalog &catalog)
+{
+  struct stat st;
+  void *data;
+  int fd;
+
+  fd = open (file, O_RDONLY | O_CLOEXEC);
+  if (fd < 0 || fstat (fd, &st) < 0) {
+    cout << "Couldn't open snapshot " << file << endl;
+    if (fd >= 0)
+      close (fd);
+    return false;
+  }
+
+  data = mmap (NULL, st.st_size, PROT_READ, MAP_SHARED | MAP_POPULATE, fd,
+      0);
+  close (fd);
+  if (data == MAP_FAILED) {
+    cout << "Couldn't map snapshot " << file << endl;
+    return false;
+  }
+
+  if (!snapshot_valid ((const guint8 *) data, st.st_size)) {
+    cout << "Invalid or corrupted snapshot " << file << endl;
+    munmap (data, st.st_size);
+    return false;
+  }
+
+  if (catalog.snapshot)
+    munmap ((void *) catalog.snapshot, catalog.snapshotSize);
+  catalog.snapshot = (const guint8 *) data;
+  catalog.snapshotSize = st.st_size;
+  return true;
+}
+
+bool
+nvds_sensor_snapshot_find (const guint8 *snapshot, gint sensorId,
+    NvDsSensorView &view)
+{
+  const NvDsSnapshotHeader *header = (const NvDsSnapshotHeader *) snapshot;
+  const guint32 *index = (const guint32 *) (snapshot + header->indexOffset);
+  const NvDsSnapshotRecord *record;
+  const char *strings;
+  gint64 slot = (gint64) sensorId - header->minSensorId;
+
+  if (slot < 0 || slot >= header->indexSize ||
+      index[slot] == NVDS_SNAPSHOT_NO_SENSOR)
+    return false;
+
+  record = (const NvDsSnapshotRecord *) (snapshot + header->recordsOffset) +
+      index[slot];
+  strings = (const char *) snapshot + header->stringsOffset;
+  view.id = strings + record->id.offset;
+  view.type = strings + record->type.offset;
+  view.desc = strings + record->desc.offset;
+  view.json = strings + record->json.offset;
+  view.jsonLen = record->json.length;
+  return true;
+}
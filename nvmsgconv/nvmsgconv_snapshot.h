@@ -0,0 +1,100 @@
+/*
+ * Copyright (c) 2018-2020, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA Corporation and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA Corporation is strictly prohibited.
+ *
+ */
+
+/**
+ * @file
+ * <b>Binary sensor catalog snapshots</b>
+ *
+ * @b Description: A snapshot is a sensor catalog compiled ahead of time by
+ * nvds_msgconv_snapshot. The converter maps it read-only instead of parsing
+ * the configuration, so startup doesn't depend on the catalog size and all
+ * pipelines on a host share one copy of it in the page cache.
+ *
+ * Layout, in host byte order (a snapshot from a host of the other byte
+ * order fails the version check):
+ *
+ *   NvDsSnapshotHeader
+ *   guint32 index[indexSize]          record of sensor minSensorId + i, or
+ *                                     NVDS_SNAPSHOT_NO_SENSOR
+ *   NvDsSnapshotRecord records[numSensors]
+ *   char strings[stringsSize]         NUL terminated, referenced by records
+ *
+ * The checksum covers everything after the header and is verified when the
+ * snapshot is mapped.
+ *
+ * The converter uses a snapshot given as the configuration file if its
+ * name ends in ".snap", or the one named by the "snapshot" key of the
+ * [catalog] group of a key-value configuration.
+ */
+
+#ifndef NVMSGCONV_SNAPSHOT_H_
+#define NVMSGCONV_SNAPSHOT_H_
+
+#include "nvmsgconv.h"
+#include "nvmsgconv_sensor.h"
+
+#define NVDS_SNAPSHOT_MAGIC "NVDSCAT"
+#define NVDS_SNAPSHOT_VERSION 1
+#define NVDS_SNAPSHOT_SUFFIX ".snap"
+#define NVDS_SNAPSHOT_NO_SENSOR G_MAXUINT32
+
+#define CONFIG_GROUP_CATALOG "catalog"
+#define CONFIG_KEY_SNAPSHOT "snapshot"
+
+struct NvDsSnapshotHeader {
+  char magic[8];
+  guint32 version;
+  guint32 headerSize;
+  guint64 fileSize;
+  guint64 checksum;
+  gint32 minSensorId;
+  guint32 indexSize;
+  guint32 numSensors;
+  guint32 reserved;
+  guint64 indexOffset;
+  guint64 recordsOffset;
+  guint64 stringsOffset;
+  guint64 stringsSize;
+};
+
+struct NvDsSnapshotString {
+  guint32 offset;
+  guint32 length;
+};
+
+struct NvDsSnapshotRecord {
+  NvDsSnapshotString id;
+  NvDsSnapshotString type;
+  NvDsSnapshotString desc;
+  NvDsSnapshotString json;
+};
+
+/**
+ * Writes @sensors to @file. The file is replaced atomically, processes
+ * that still map the previous snapshot keep their copy.
+ */
+bool nvds_sensor_snapshot_write (const NvDsSensorMap &sensors,
+    const gchar *file);
+
+/** Maps and verifies @file and makes it the snapshot of @catalog. */
+bool nvds_sensor_snapshot_map (const gchar *file, NvDsSensorCatalog &catalog);
+
+/** Looks @sensorId up in a snapshot mapped by nvds_sensor_snapshot_map. */
+bool nvds_sensor_snapshot_find (const guint8 *snapshot, gint sensorId,
+    NvDsSensorView &view);
+
+/**
+ * Writes the sensors parsed by @ctx to the snapshot @file. Used by the
+ * snapshot compiler so it reads configuration exactly like the converter.
+ */
+bool nvds_msg2p_write_snapshot (NvDsMsg2pCtx *ctx, const gchar *file);
+
+#endif /* NVMSGCONV_SNAPSHOT_H_ */